@@ -11,8 +11,37 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "../third_party/cJSON/cJSON.h"
 #include "heartyhty_functions.h" // Include heartyhty_functions.h
+#include "heartyhty_index.h" // Include heartyhty_index.h
+#include "heartyhty_topk.h" // Include heartyhty_topk.h
+#include "heartyhty_join.h" // Include heartyhty_join.h
+#include "heartyhty_pool.h" // Include heartyhty_pool.h
+#include "heartyhty_results.h" // Include heartyhty_results.h
+#include "heartyhty_batch.h" // Include heartyhty_batch.h
+#include "heartyhty_sql.h" // Include heartyhty_sql.h
+#include "heartyhty_output.h" // Include heartyhty_output.h
+#include "heartyhty_arena.h" // Include heartyhty_arena.h
+#include "heartyhty_stats.h" // Include heartyhty_stats.h
+#include "heartyhty_delete.h" // Include heartyhty_delete.h
+#include "heartyhty_snapshot.h" // Include heartyhty_snapshot.h
+#include "heartyhty_distinct.h" // Include heartyhty_distinct.h
+
+static int show_stats = 0; // --stats: print the instrumentation of every query
+
+/**
+ * @brief Print the stage breakdown and counters of the last query to stderr and start over
+ */
+void report_stats(void) {
+    if (show_stats) {
+        fflush(stdout); // Results first
+        HtyQueryStats stats;
+        get_query_stats(&stats);
+        print_query_stats(stderr, &stats);
+    }
+    reset_query_stats();
+}
 
 /**
  * @brief Print the menu
@@ -26,10 +55,29 @@ void print_menu() {
     printf("4. Project Multiple Columns\n");
     printf("5. Project and Filter Columns\n");
     printf("6. Add Row\n");
+    printf("7. Build Column Index\n");
+    printf("8. Top Rows (ORDER BY ... LIMIT)\n");
+    printf("9. Join With Another File\n");
+    printf("10. Delete Rows\n");
+    printf("11. Update Rows\n");
+    printf("12. Compact File\n");
+    printf("13. Distinct Values\n");
+    printf("14. Filter Single Column by a List (IN)\n");
     printf("0. Exit\n");
-    printf("Enter your choice (0-5): ");
+    printf("Enter your choice (0-14): ");
 }
 
+/**
+ * @brief Ask for an optional filter on a column
+ * 
+ * @param metadata - metadata object of the file
+ * @param label - what to ask for, e.g. "filter column"
+ * @param column_name - buffer for the filter column (256 bytes)
+ * @param predicate - predicate to fill
+ * @return int - 1 if a filter was entered, 0 otherwise
+ */
+int read_filter(cJSON* metadata, const char* label, char* column_name, HtyPredicate* predicate);
+
 /**
  * @brief Print the operation menu
  * 
@@ -45,11 +93,275 @@ void print_operation() {
     printf("Enter operation (1-6): ");
 }
 
-int main() {
+int read_filter(cJSON* metadata, const char* label, char* column_name, HtyPredicate* predicate) {
+    char inputline[256];
+    int column_index, is_float;
+    
+    printf("Enter %s (blank for none): ", label);
+    if (fgets(inputline, sizeof(inputline), stdin) == NULL || sscanf(inputline, "%255s", column_name) != 1) {
+        return 0;
+    }
+    if (resolve_columns(metadata, &column_name, 1, &column_index, &is_float) != 0) {
+        return 0;
+    }
+    
+    print_operation();
+    fgets(inputline, sizeof(inputline), stdin);
+    sscanf(inputline, "%d", &predicate->op);
+    
+    printf("Enter filter value: ");
+    fgets(inputline, sizeof(inputline), stdin);
+    if (is_float) {
+        float temp;
+        sscanf(inputline, "%f", &temp);
+        predicate->value = *(int*)&temp;  // Store float bits as int for comparison
+    } else {
+        sscanf(inputline, "%d", &predicate->value);
+    }
+    predicate->column = column_name;
+    return 1;
+}
+
+/**
+ * @brief Ask for a value of a column, read as the type of the column
+ * 
+ * @param metadata - metadata object
+ * @param column_name - column the value is for
+ * @param value - pointer to store the value (float bits for float columns)
+ * @return int - 0 on success, -1 if the column does not exist
+ */
+int read_column_value(cJSON* metadata, const char* column_name, int* value) {
+    char inputline[256];
+    int column_index, is_float;
+    char* name = (char*)column_name;
+    if (resolve_columns(metadata, &name, 1, &column_index, &is_float) != 0) {
+        return -1;
+    }
+    
+    printf("Enter %s value for %s: ", is_float ? "float" : "integer", column_name);
+    fgets(inputline, sizeof(inputline), stdin);
+    if (is_float) {
+        float temp;
+        sscanf(inputline, "%f", &temp);
+        *value = *(int*)&temp;  // Store float bits as int
+    } else {
+        sscanf(inputline, "%d", value);
+    }
+    return 0;
+}
+
+/**
+ * @brief Run every query of a query file with one scan and print the results
+ * 
+ * Blank lines and lines starting with # are skipped.
+ * 
+ * @param hty_file_path - path to hty file
+ * @param query_file_path - path to the query file (one query per line, see parse_batch_query)
+ * @return int - 0 on success, 1 on failure
+ */
+int run_query_file(const char* hty_file_path, const char* query_file_path) {
+    // Every query of the batch reads the same version of the file
+    if (pin_snapshot(hty_file_path, NULL) != 0) {
+        return 1;
+    }
+    cJSON* metadata = extract_metadata(hty_file_path);
+    if (metadata == NULL) {
+        fprintf(stderr, "Error extracting metadata.\n");
+        unpin_snapshot(hty_file_path);
+        return 1;
+    }
+    FILE* query_file = fopen(query_file_path, "r");
+    if (query_file == NULL) {
+        fprintf(stderr, "Error opening file: %s\n", query_file_path);
+        cJSON_Delete(metadata);
+        unpin_snapshot(hty_file_path);
+        return 1;
+    }
+
+    // Parse the whole file first so that a typo does not waste a scan
+    char line[HTY_BATCH_MAX_LINE];
+    int num_queries = 0, capacity = 16, line_number = 0, status = 0;
+    HtyBatchQuery* queries = (HtyBatchQuery*)malloc(capacity * sizeof(HtyBatchQuery));
+    char** query_text = (char**)malloc(capacity * sizeof(char*));
+    while (fgets(line, sizeof(line), query_file) != NULL) {
+        line_number++;
+        line[strcspn(line, "\r\n")] = '\0';
+        char* start = line + strspn(line, " \t");
+        if (*start == '\0' || *start == '#') {
+            continue;
+        }
+        if (num_queries == capacity) {
+            capacity *= 2;
+            queries = (HtyBatchQuery*)realloc(queries, capacity * sizeof(HtyBatchQuery));
+            query_text = (char**)realloc(query_text, capacity * sizeof(char*));
+        }
+        if (parse_batch_query(metadata, start, &queries[num_queries]) != 0) {
+            fprintf(stderr, "Error in query on line %d\n", line_number);
+            status = 1;
+            continue;
+        }
+        query_text[num_queries++] = strdup(start);
+    }
+    fclose(query_file);
+
+    if (status == 0 && run_batch(metadata, hty_file_path, queries, num_queries) != 0) {
+        status = 1;
+    }
+    for (int q = 0; q < num_queries; q++) {
+        if (status == 0) {
+            int* column_indices = (int*)malloc(queries[q].num_columns * sizeof(int));
+            int* column_types = (int*)malloc(queries[q].num_columns * sizeof(int));
+            resolve_columns(metadata, queries[q].columns, queries[q].num_columns, column_indices, column_types);
+            printf("\n=== Query %d: %s ===\n", q + 1, query_text[q]);
+            display_typed_result_set(queries[q].columns, column_types, queries[q].num_columns,
+                                     queries[q].result, queries[q].row_count);
+            printf("(%d rows)\n", queries[q].row_count);
+            free(column_indices);
+            free(column_types);
+        }
+        free_batch_query(&queries[q]);
+        free(query_text[q]);
+    }
+    free(queries);
+    free(query_text);
+    cJSON_Delete(metadata);
+    unpin_snapshot(hty_file_path);
+    clear_buffer_pool();
+    report_stats();
+    return status;
+}
+
+/**
+ * @brief Write a result to a file: CSV for .csv, TSV for .tsv, columnar export otherwise
+ * 
+ * @param result - result to write
+ * @param output_path - path of the file to write
+ * @return int - 0 on success, -1 on failure
+ */
+int export_result(HtySqlResult* result, const char* output_path) {
+    const char* extension = strrchr(output_path, '.');
+    int is_csv = extension != NULL && strcmp(extension, ".csv") == 0;
+    int is_tsv = extension != NULL && strcmp(extension, ".tsv") == 0;
+    if (!is_csv && !is_tsv) {
+        HtyColumnarWriter* writer = open_columnar_writer(output_path, result->column_names, result->column_types,
+                                                         result->num_columns);
+        if (writer == NULL) {
+            return -1;
+        }
+        int status = write_columnar_batch(writer, result->columns, result->row_count);
+        return close_columnar_writer(writer) == 0 ? status : -1;
+    }
+    FILE* file = fopen(output_path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Error opening file: %s\n", output_path);
+        return -1;
+    }
+    int status = write_delimited(file, result->column_names, result->column_types, result->num_columns,
+                                 result->columns, result->row_count, is_csv ? "," : "\t", HTY_FLOAT_EXACT);
+    return fclose(file) == 0 ? status : -1;
+}
+
+/**
+ * @brief Parse and run one SQL statement, then print its result and timing
+ * 
+ * @param statement - statement, see parse_sql
+ * @param output_path - file to write the result to instead of printing it, NULL to print
+ * @return int - 0 on success, 1 on failure
+ */
+int run_statement(const char* statement, const char* output_path) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    HtySqlQuery query;
+    HtySqlResult result;
+    if (parse_sql(statement, &query) != 0) {
+        return 1;
+    }
+    int status = run_sql(&query, &result);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (status == 0) {
+        double elapsed_ms = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+        if (output_path == NULL) {
+            display_typed_result_set(result.column_names, result.column_types, result.num_columns,
+                                     result.columns, result.row_count);
+        } else if (export_result(&result, output_path) != 0) {
+            status = -1;
+        }
+        printf("(%d rows, %.3f ms, %s)\n", result.row_count, elapsed_ms, result.plan);
+        free_sql_result(&result);
+    }
+    free_sql_query(&query);
+    report_stats();
+    return status == 0 ? 0 : 1;
+}
+
+/**
+ * @brief Run every ;-separated SQL statement read from a stream
+ * 
+ * Statements may span lines; a failing statement is reported and the rest still run.
+ * 
+ * @param stream - stream to read statements from
+ * @return int - 0 if every statement succeeded, 1 otherwise
+ */
+int run_sql_stream(FILE* stream) {
+    char* statement = NULL;
+    size_t capacity = 0;
+    int status = 0;
+    while (getdelim(&statement, &capacity, ';', stream) != -1) {
+        if (statement[strspn(statement, " \t\r\n;")] == '\0') {
+            continue; // Blank statement
+        }
+        status |= run_statement(statement, NULL);
+    }
+    free(statement);
+    return status;
+}
+
+int main(int argc, char* argv[]) {
+    // Instrumentation: analyze [--stats] [--profile] [--trace trace.json] ...
+    while (argc > 1 && (strcmp(argv[1], "--stats") == 0 || strcmp(argv[1], "--profile") == 0 ||
+                        (strcmp(argv[1], "--trace") == 0 && argc > 2))) {
+        int consumed = 1;
+        if (strcmp(argv[1], "--stats") == 0) {
+            show_stats = 1;
+            enable_query_stats(1);
+        } else if (strcmp(argv[1], "--profile") == 0) {
+            // Hardware counters per stage, printed with the stats
+            show_stats = 1;
+            enable_query_profile(1);
+        } else if (start_query_trace(argv[2]) == 0) {
+            atexit(stop_query_trace);
+            consumed = 2;
+        } else {
+            return 1;
+        }
+        argc -= consumed;
+        memmove(argv + 1, argv + 1 + consumed, (argc) * sizeof(char*)); // Keeps the terminating NULL
+    }
+    // Scripted workloads: analyze --batch file.hty queries.txt
+    if (argc == 4 && strcmp(argv[1], "--batch") == 0) {
+        return run_query_file(argv[2], argv[3]);
+    }
+    // SQL: analyze -e "SELECT ..." [-o result.csv|.tsv|.col] or analyze --sql < statements.sql
+    int export = argc == 5 && strcmp(argv[3], "-o") == 0;
+    if (((argc == 3 || export) && strcmp(argv[1], "-e") == 0) || (argc == 2 && strcmp(argv[1], "--sql") == 0)) {
+        int status = argc == 2 ? run_sql_stream(stdin) : run_statement(argv[2], export ? argv[4] : NULL);
+        close_sql_table();
+        clear_buffer_pool();
+        clear_result_cache();
+        return status;
+    }
+    if (argc != 1) {
+        fprintf(stderr, "Usage: %s [--stats] [--profile] [--trace trace.json] [--batch file.hty queries.txt | -e \"SELECT ...\" [-o file] | --sql]\n",
+                argv[0]);
+        return 1;
+    }
+
     char inputline[256]; // User input buffer
     char hty_file_path[256]; // HTY file path
     int choice; // User choice
     cJSON* metadata = NULL; // Metadata object
+    HtyFileVersion metadata_version; // Version of the file the metadata was read from
+    HtyArena* query_arena = create_arena(0); // Memory of the current menu query, released every loop
 
     // Get HTY file path at start
     printf("Please enter the .hty file path: ");
@@ -60,6 +372,23 @@ int main() {
         print_menu();
         fgets(inputline, sizeof(inputline), stdin);
         sscanf(inputline, "%d", &choice); // get user choice
+        reset_arena(query_arena);
+
+        // Reading choices pin the current version of the file, so another process replacing it does not disturb them
+        int pinned = (choice >= 1 && choice <= 9 && choice != 6) || choice == 13 || choice == 14;
+        HtyFileVersion version;
+        if (pinned && pin_snapshot(hty_file_path, &version) != 0) {
+            pinned = 0;
+        }
+        int known = pinned || (choice >= 2 && get_file_version(hty_file_path, &version) == 0);
+        if (known && metadata != NULL && !same_file_version(&version, &metadata_version)) {
+            cJSON* current_metadata = extract_metadata(hty_file_path);
+            if (current_metadata != NULL) {
+                cJSON_Delete(metadata);
+                metadata = current_metadata;
+                metadata_version = version;
+            }
+        }
 
         switch(choice) {
             case 1: { // Task 2: Extract and Display Metadata
@@ -71,6 +400,7 @@ int main() {
                     fprintf(stderr, "Error extracting metadata. Exiting.\n");
                     return 1;
                 }
+                get_file_version(hty_file_path, &metadata_version);
                 printf("Successfully extracted metadata!\n");
                 char* printed_metadata = cJSON_Print(metadata);
                 printf("%s\n", printed_metadata);
@@ -155,23 +485,18 @@ int main() {
                 fgets(inputline, sizeof(inputline), stdin);
                 sscanf(inputline, "%d", &num_columns);
                 
-                projected_columns = (char**)malloc(num_columns * sizeof(char*));
+                projected_columns = (char**)arena_alloc(query_arena, num_columns * sizeof(char*));
                 for (int i = 0; i < num_columns; i++) {
-                    projected_columns[i] = (char*)malloc(256);
+                    projected_columns[i] = (char*)arena_alloc(query_arena, 256);
                     printf("Enter column name %d: ", i + 1);
                     fgets(inputline, sizeof(inputline), stdin);
                     sscanf(inputline, "%s", projected_columns[i]);
                 }
                 
-                int** result_set = project(metadata, hty_file_path, projected_columns, num_columns, &size);
+                // The result lives in the query arena and is released at the next menu choice
+                int** result_set = project_into_arena(query_arena, metadata, hty_file_path, projected_columns, num_columns, &size);
                 if (result_set != NULL) {
                     display_result_set(metadata, projected_columns, num_columns, result_set, size); // Task 5.2 Display multiple columns
-                    for (int i = 0; i < num_columns; i++) {
-                        free(result_set[i]);
-                        free(projected_columns[i]);
-                    }
-                    free(result_set);
-                    free(projected_columns);
                 }
                 break;
             }
@@ -229,27 +554,21 @@ int main() {
                 fgets(inputline, sizeof(inputline), stdin);
                 sscanf(inputline, "%d", &num_columns);
                 
-                projected_columns = (char**)malloc(num_columns * sizeof(char*));
+                projected_columns = (char**)arena_alloc(query_arena, num_columns * sizeof(char*));
                 for (int i = 0; i < num_columns; i++) {
-                    projected_columns[i] = (char*)malloc(256);
+                    projected_columns[i] = (char*)arena_alloc(query_arena, 256);
                     printf("Enter column name %d: ", i + 1);
                     fgets(inputline, sizeof(inputline), stdin);
                     sscanf(inputline, "%s", projected_columns[i]);
                 }
                 
-                int** filtered_result = project_and_filter(metadata, hty_file_path, projected_columns, 
-                                                         num_columns, filtered_column, operation, 
-                                                         value_to_compare, &filtered_row_count);
+                int** filtered_result = project_and_filter_into_arena(query_arena, metadata, hty_file_path, projected_columns, 
+                                                                    num_columns, filtered_column, operation, 
+                                                                    value_to_compare, &filtered_row_count);
                 
                 if (filtered_result != NULL) {
                     display_result_set(metadata, projected_columns, num_columns, 
                                      filtered_result, filtered_row_count);
-                    for (int i = 0; i < num_columns; i++) {
-                        free(filtered_result[i]);
-                        free(projected_columns[i]);
-                    }
-                    free(filtered_result);
-                    free(projected_columns);
                 }
                 break;
             }
@@ -350,12 +669,263 @@ int main() {
                 }
                 free(rows);
                 
-                // If rows added successfully, delete original file and rename temp file
-                remove(hty_file_path);                // Delete original file
-                rename(temp_path, hty_file_path);     // Rename temp file to original name
+                // If rows added successfully, publish the temp file in place of the original
+                invalidate_buffer_pool(hty_file_path); // Drop cached blocks of the original file
+                invalidate_result_cache(hty_file_path); // Drop cached results of the original file
+                rename(temp_path, hty_file_path);     // Replace the original atomically; readers keep the version they pinned
+                rename_indexes(metadata, temp_path, hty_file_path); // Move the updated column indexes along
                 printf("\nRows added successfully. Modified file saved as: %s\n", hty_file_path);
                 break;
             }
+            case 7: { // Build a sorted index for point and range lookups
+                printf("\n=== Build Column Index ===\n");
+                char column_name[256];
+                
+                printf("Enter column name: ");
+                fgets(inputline, sizeof(inputline), stdin);
+                sscanf(inputline, "%s", column_name);
+                
+                if (build_index(metadata, hty_file_path, column_name) == 0) {
+                    char* index_path = index_file_path(hty_file_path, column_name);
+                    printf("Index saved as: %s\n", index_path);
+                    free(index_path);
+                }
+                break;
+            }
+            case 8: { // ORDER BY ... LIMIT
+                printf("\n=== Top Rows ===\n");
+                char order_column[256];
+                char direction[16] = "desc";
+                int k, num_columns, size;
+                char** projected_columns;
+                
+                printf("Enter column to order by: ");
+                fgets(inputline, sizeof(inputline), stdin);
+                sscanf(inputline, "%s", order_column);
+                
+                printf("Enter order (asc/desc): ");
+                fgets(inputline, sizeof(inputline), stdin);
+                sscanf(inputline, "%15s", direction);
+                
+                printf("Enter number of rows (LIMIT): ");
+                fgets(inputline, sizeof(inputline), stdin);
+                sscanf(inputline, "%d", &k);
+                
+                printf("Enter number of columns to project: ");
+                fgets(inputline, sizeof(inputline), stdin);
+                sscanf(inputline, "%d", &num_columns);
+                
+                projected_columns = (char**)arena_alloc(query_arena, num_columns * sizeof(char*));
+                for (int i = 0; i < num_columns; i++) {
+                    projected_columns[i] = (char*)arena_alloc(query_arena, 256);
+                    printf("Enter column name %d: ", i + 1);
+                    fgets(inputline, sizeof(inputline), stdin);
+                    sscanf(inputline, "%s", projected_columns[i]);
+                }
+                
+                int** top_rows = top_k(metadata, hty_file_path, order_column, strcmp(direction, "asc") != 0,
+                                       k, projected_columns, num_columns, &size);
+                if (top_rows != NULL) {
+                    display_result_set(metadata, projected_columns, num_columns, top_rows, size);
+                    for (int i = 0; i < num_columns; i++) {
+                        free(top_rows[i]);
+                    }
+                    free(top_rows);
+                }
+                break;
+            }
+            case 9: { // Hash join with a second file
+                printf("\n=== Join With Another File ===\n");
+                char other_file_path[256], left_key[256], right_key[256];
+                char left_filter_column[256], right_filter_column[256];
+                HtyPredicate left_filter, right_filter;
+                int num_left_columns, num_right_columns, size;
+                
+                printf("Enter the other .hty file path: ");
+                fgets(inputline, sizeof(inputline), stdin);
+                sscanf(inputline, "%s", other_file_path);
+                if (pin_snapshot(other_file_path, NULL) != 0) {
+                    break;
+                }
+                cJSON* other_metadata = extract_metadata(other_file_path);
+                if (other_metadata == NULL) {
+                    unpin_snapshot(other_file_path);
+                    break;
+                }
+                
+                printf("Enter join key column of this file: ");
+                fgets(inputline, sizeof(inputline), stdin);
+                sscanf(inputline, "%s", left_key);
+                printf("Enter join key column of the other file: ");
+                fgets(inputline, sizeof(inputline), stdin);
+                sscanf(inputline, "%s", right_key);
+                
+                int has_left_filter = read_filter(metadata, "this file's filter column", left_filter_column, &left_filter);
+                int has_right_filter = read_filter(other_metadata, "the other file's filter column", right_filter_column, &right_filter);
+                
+                printf("Enter number of columns to project from this file: ");
+                fgets(inputline, sizeof(inputline), stdin);
+                sscanf(inputline, "%d", &num_left_columns);
+                printf("Enter number of columns to project from the other file: ");
+                fgets(inputline, sizeof(inputline), stdin);
+                sscanf(inputline, "%d", &num_right_columns);
+                
+                int total_columns = num_left_columns + num_right_columns;
+                char** column_names = (char**)arena_alloc(query_arena, (total_columns + 1) * sizeof(char*));
+                int* column_types = (int*)arena_alloc(query_arena, (total_columns + 1) * sizeof(int));
+                int* column_indices = (int*)arena_alloc(query_arena, (total_columns + 1) * sizeof(int));
+                for (int i = 0; i < total_columns; i++) {
+                    column_names[i] = (char*)arena_alloc(query_arena, 256);
+                    printf("Enter %s column name %d: ", i < num_left_columns ? "this file's" : "the other file's",
+                           (i < num_left_columns ? i : i - num_left_columns) + 1);
+                    fgets(inputline, sizeof(inputline), stdin);
+                    sscanf(inputline, "%s", column_names[i]);
+                }
+                
+                int** joined = NULL;
+                if (resolve_columns(metadata, column_names, num_left_columns, column_indices, column_types) == 0 &&
+                    resolve_columns(other_metadata, column_names + num_left_columns, num_right_columns,
+                                    column_indices + num_left_columns, column_types + num_left_columns) == 0) {
+                    joined = hash_join(metadata, hty_file_path, left_key, column_names, num_left_columns,
+                                       has_left_filter ? &left_filter : NULL,
+                                       other_metadata, other_file_path, right_key, column_names + num_left_columns,
+                                       num_right_columns, has_right_filter ? &right_filter : NULL, &size);
+                }
+                if (joined != NULL) {
+                    if (size == 0) {
+                        printf("No matching records found.\n");
+                    } else {
+                        display_typed_result_set(column_names, column_types, total_columns, joined, size);
+                    }
+                    for (int i = 0; i < total_columns; i++) {
+                        free(joined[i]);
+                    }
+                    free(joined);
+                }
+                cJSON_Delete(other_metadata);
+                unpin_snapshot(other_file_path);
+                break;
+            }
+            case 10: { // Delete rows; they stay in the file, marked in its deletion bitmap until compaction
+                printf("\n=== Delete Rows ===\n");
+                char column_name[256];
+                int operation, value;
+                
+                printf("Enter filter column: ");
+                fgets(inputline, sizeof(inputline), stdin);
+                sscanf(inputline, "%s", column_name);
+                
+                print_operation();
+                fgets(inputline, sizeof(inputline), stdin);
+                sscanf(inputline, "%d", &operation);
+                if (read_column_value(metadata, column_name, &value) != 0) {
+                    break;
+                }
+                
+                int deleted = delete_where(metadata, hty_file_path, column_name, operation, value);
+                if (deleted >= 0) {
+                    printf("%d rows deleted, %d rows left.\n", deleted, count_live_rows(metadata));
+                }
+                break;
+            }
+            case 11: { // Update rows in place
+                printf("\n=== Update Rows ===\n");
+                char column_name[256], set_column[256];
+                int operation, value, new_value;
+                
+                printf("Enter filter column: ");
+                fgets(inputline, sizeof(inputline), stdin);
+                sscanf(inputline, "%s", column_name);
+                
+                print_operation();
+                fgets(inputline, sizeof(inputline), stdin);
+                sscanf(inputline, "%d", &operation);
+                if (read_column_value(metadata, column_name, &value) != 0) {
+                    break;
+                }
+                
+                printf("Enter column to set: ");
+                fgets(inputline, sizeof(inputline), stdin);
+                sscanf(inputline, "%s", set_column);
+                if (read_column_value(metadata, set_column, &new_value) != 0) {
+                    break;
+                }
+                
+                int updated = update_where(metadata, hty_file_path, column_name, operation, value, set_column, new_value);
+                if (updated >= 0) {
+                    printf("%d rows updated.\n", updated);
+                }
+                break;
+            }
+            case 12: { // Rewrite the file without its deleted rows
+                printf("\n=== Compact File ===\n");
+                int num_rows = cJSON_GetObjectItemCaseSensitive(metadata, "num_rows")->valueint;
+                if (compact_file(metadata, hty_file_path) == 0) {
+                    printf("Removed %d deleted rows, %d rows left.\n",
+                           num_rows - count_live_rows(metadata), count_live_rows(metadata));
+                }
+                break;
+            }
+            case 13: { // SELECT DISTINCT column [WHERE ...]
+                printf("\n=== Distinct Values ===\n");
+                char column_name[256], filter_column[256];
+                HtyPredicate filter;
+                int column_index, column_type, size;
+                
+                printf("Enter column name: ");
+                fgets(inputline, sizeof(inputline), stdin);
+                sscanf(inputline, "%s", column_name);
+                char* column_names[1] = {column_name};
+                if (resolve_columns(metadata, column_names, 1, &column_index, &column_type) != 0) {
+                    break;
+                }
+                int has_filter = read_filter(metadata, "filter column", filter_column, &filter);
+                
+                int* values = distinct_values(metadata, hty_file_path, column_name, has_filter ? &filter : NULL,
+                                              has_filter, &size);
+                if (values != NULL) {
+                    display_typed_result_set(column_names, &column_type, 1, &values, size);
+                    printf("%d distinct values\n", size);
+                    free(values);
+                }
+                break;
+            }
+            case 14: { // WHERE column IN (value, ...)
+                printf("\n=== Filter Single Column by a List (IN) ===\n");
+                char column_name[256];
+                int num_values, size;
+                
+                printf("Enter column name: ");
+                fgets(inputline, sizeof(inputline), stdin);
+                sscanf(inputline, "%s", column_name);
+                printf("Enter number of values: ");
+                fgets(inputline, sizeof(inputline), stdin);
+                if (sscanf(inputline, "%d", &num_values) != 1 || num_values <= 0) {
+                    printf("Invalid input. Please enter a positive number.\n");
+                    break;
+                }
+                
+                int* values = (int*)arena_alloc(query_arena, num_values * sizeof(int));
+                int status = values != NULL ? 0 : -1;
+                for (int i = 0; i < num_values && status == 0; i++) {
+                    status = read_column_value(metadata, column_name, &values[i]);
+                }
+                if (status != 0) {
+                    break;
+                }
+                
+                int* filtered_data = filter_in(metadata, hty_file_path, column_name, values, num_values, &size);
+                if (filtered_data != NULL) {
+                    if (size == 0) {
+                        printf("No matching records found.\n");
+                    } else {
+                        printf("\nFiltered results:\n");
+                        display_column(metadata, column_name, filtered_data, size);
+                    }
+                    free(filtered_data);
+                }
+                break;
+            }
             case 0:
                 printf("Exiting program.\n");
                 break;
@@ -363,8 +933,16 @@ int main() {
             default:
                 printf("Invalid choice. Please try again.\n");
         }
+        if (pinned) {
+            unpin_snapshot(hty_file_path);
+        }
+        report_stats();
     } while (choice != 0);
 
     cJSON_Delete(metadata);
+    free_arena(query_arena);
+    close_sql_table();
+    clear_buffer_pool();
+    clear_result_cache();
     return 0;
 }
\ No newline at end of file
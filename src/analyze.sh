@@ -1,3 +1,3 @@
-gcc -o analyze analyze.c heartyhty_functions.c ../third_party/cJSON/cJSON.c
+gcc -o analyze analyze.c heartyhty_functions.c heartyhty_writer.c heartyhty_dataset.c heartyhty_index.c heartyhty_bloom.c heartyhty_sort.c heartyhty_topk.c heartyhty_join.c heartyhty_io.c heartyhty_pool.c heartyhty_results.c heartyhty_batch.c heartyhty_sql.c heartyhty_output.c heartyhty_arena.c heartyhty_stats.c heartyhty_table.c heartyhty_estimate.c heartyhty_delete.c heartyhty_snapshot.c heartyhty_pipeline.c heartyhty_expr.c heartyhty_distinct.c ../third_party/cJSON/cJSON.c -lpthread -lm
 ./analyze
 # valgrind --leak-check=yes ./analyze
@@ -0,0 +1,6 @@
+gcc -O2 -o hty_bench hty_bench.c heartyhty_functions.c heartyhty_writer.c heartyhty_index.c heartyhty_bloom.c heartyhty_sort.c heartyhty_topk.c heartyhty_io.c heartyhty_pool.c heartyhty_results.c heartyhty_output.c heartyhty_arena.c heartyhty_stats.c heartyhty_estimate.c heartyhty_delete.c heartyhty_snapshot.c heartyhty_pipeline.c heartyhty_expr.c heartyhty_distinct.c ../third_party/cJSON/cJSON.c -lpthread -lm
+gcc -O2 -o csv_to_hty csv_to_hty.c heartyhty_functions.c heartyhty_writer.c heartyhty_index.c heartyhty_bloom.c heartyhty_sort.c heartyhty_topk.c heartyhty_io.c heartyhty_pool.c heartyhty_results.c heartyhty_output.c heartyhty_arena.c heartyhty_stats.c heartyhty_estimate.c heartyhty_delete.c heartyhty_snapshot.c heartyhty_pipeline.c heartyhty_expr.c heartyhty_distinct.c ../third_party/cJSON/cJSON.c -lpthread -lm
+./hty_bench generate bench.hty -r 1M -t int,int,float -k 100000 -f c1
+./hty_bench run bench.hty -o bench_results.json
+# Save a baseline with: cp bench_results.json bench_baseline.json
+if [ -f bench_baseline.json ]; then ./hty_bench compare bench_baseline.json bench_results.json; fi
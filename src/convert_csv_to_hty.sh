@@ -1,3 +1,3 @@
-gcc -o csv_to_hty csv_to_hty.c ../third_party/cJSON/cJSON.c
+gcc -o csv_to_hty csv_to_hty.c heartyhty_functions.c heartyhty_writer.c heartyhty_index.c heartyhty_bloom.c heartyhty_sort.c heartyhty_topk.c heartyhty_io.c heartyhty_pool.c heartyhty_results.c heartyhty_output.c heartyhty_arena.c heartyhty_stats.c heartyhty_estimate.c heartyhty_delete.c heartyhty_snapshot.c heartyhty_pipeline.c heartyhty_expr.c heartyhty_distinct.c ../third_party/cJSON/cJSON.c -lpthread -lm
 ./csv_to_hty
-# valgrind --leak-check=yes ./csv_to_hty
\ No newline at end of file
+# valgrind --leak-check=yes ./csv_to_hty
@@ -0,0 +1,3 @@
+gcc -o hty_to_csv hty_to_csv.c heartyhty_functions.c heartyhty_writer.c heartyhty_index.c heartyhty_bloom.c heartyhty_sort.c heartyhty_topk.c heartyhty_io.c heartyhty_pool.c heartyhty_results.c heartyhty_batch.c heartyhty_output.c heartyhty_arena.c heartyhty_stats.c heartyhty_estimate.c heartyhty_delete.c heartyhty_snapshot.c heartyhty_pipeline.c heartyhty_expr.c heartyhty_distinct.c ../third_party/cJSON/cJSON.c -lpthread -lm
+./hty_to_csv data.hty data_export.csv
+# valgrind --leak-check=yes ./hty_to_csv data.hty data_export.csv
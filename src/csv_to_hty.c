@@ -12,33 +12,226 @@
 #include <stdlib.h>
 #include <string.h>
 #include "../third_party/cJSON/cJSON.h" // Include cJSON library
+#include "heartyhty_writer.h" // Include shared row writer
+#include "heartyhty_sort.h" // Include sort-on-write
+#include "heartyhty_pipeline.h" // Include the conversion pipeline
+
+/**
+ * @brief What a parser found in one chunk of the CSV file during the first pass
+ */
+typedef struct {
+    int num_rows; // number of rows
+    int column_types[256]; // type of the last value of each column: 0 for int, 1 for float, -1 if none
+    int sort_seen[64]; // check if a sort key column has a value
+    int sort_int_min[64], sort_int_max[64]; // sort key column range read as int
+    float sort_float_min[64], sort_float_max[64]; // sort key column range read as float
+} CsvScan;
+
+/**
+ * @brief Rows of one chunk of the CSV file, converted during the second pass
+ */
+typedef struct {
+    int num_rows; // number of rows
+    int capacity; // number of rows allocated
+    int* rows; // values, num_columns per row
+} CsvRows;
+
+/**
+ * @brief Columns shared by the parser threads
+ */
+typedef struct {
+    int num_columns; // number of columns
+    int* column_types; // 0 for int, 1 for float (second pass only)
+    int* sort_indices; // sort key columns
+    int num_sort_columns; // number of sort key columns
+} CsvColumns;
+
+/**
+ * @brief Function to cut the next line out of a chunk
+ *
+ * @param cursor - start of the next line, moved past the line
+ * @param end - end of the chunk
+ * @return char* - the line, null terminated without its line end; NULL after the last line
+ */
+static char* next_line(char** cursor, char* end) {
+    char* line = *cursor;
+    if (line >= end) {
+        return NULL;
+    }
+    char* newline = (char*)memchr(line, '\n', end - line);
+    if (newline != NULL) {
+        *newline = '\0';
+        *cursor = newline + 1;
+    } else {
+        *cursor = end;
+    }
+    return line;
+}
+
+/**
+ * @brief Function to find the column types and sort key ranges of a chunk (first pass parser)
+ *
+ * @param chunk - chunk of whole lines
+ * @param context - CsvColumns of the file
+ * @return int - 0 on success, -1 on failure
+ */
+static int scan_chunk(HtyLineChunk* chunk, void* context) {
+    CsvColumns* columns = (CsvColumns*)context;
+    CsvScan* scan = (CsvScan*)chunk->result;
+    if (scan == NULL) {
+        scan = (CsvScan*)malloc(sizeof(CsvScan));
+        if (scan == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            return -1;
+        }
+        chunk->result = scan;
+    }
+    scan->num_rows = 0;
+    memset(scan->column_types, -1, sizeof(scan->column_types));
+    memset(scan->sort_seen, 0, sizeof(scan->sort_seen));
+
+    char* cursor = chunk->text;
+    char* end = chunk->text + chunk->length;
+    char* line;
+    char* saveptr;
+    while ((line = next_line(&cursor, end)) != NULL) {
+        scan->num_rows++;
+        int col_index = 0;
+        for (char* token = strtok_r(line, ",\n", &saveptr); token != NULL && col_index < columns->num_columns;
+             token = strtok_r(NULL, ",\n", &saveptr), col_index++) {
+            scan->column_types[col_index] = strchr(token, '.') != NULL; // 1 for float, 0 for int
+            // Track the range of sort key columns, the type is only known once all rows are read
+            for (int k = 0; k < columns->num_sort_columns; k++) {
+                if (columns->sort_indices[k] != col_index) {
+                    continue;
+                }
+                int int_value = atoi(token);
+                float float_value = strtof(token, NULL);
+                if (!scan->sort_seen[k]) {
+                    scan->sort_int_min[k] = scan->sort_int_max[k] = int_value;
+                    scan->sort_float_min[k] = scan->sort_float_max[k] = float_value;
+                    scan->sort_seen[k] = 1;
+                } else {
+                    if (int_value < scan->sort_int_min[k]) scan->sort_int_min[k] = int_value;
+                    if (int_value > scan->sort_int_max[k]) scan->sort_int_max[k] = int_value;
+                    if (float_value < scan->sort_float_min[k]) scan->sort_float_min[k] = float_value;
+                    if (float_value > scan->sort_float_max[k]) scan->sort_float_max[k] = float_value;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Function to convert the rows of a chunk to column values (second pass parser)
+ *
+ * @param chunk - chunk of whole lines
+ * @param context - CsvColumns of the file
+ * @return int - 0 on success, -1 on failure
+ */
+static int convert_chunk(HtyLineChunk* chunk, void* context) {
+    CsvColumns* columns = (CsvColumns*)context;
+    CsvRows* batch = (CsvRows*)chunk->result;
+    if (batch == NULL) {
+        batch = (CsvRows*)calloc(1, sizeof(CsvRows));
+        if (batch == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            return -1;
+        }
+        chunk->result = batch;
+    }
+    batch->num_rows = 0;
+
+    char* cursor = chunk->text;
+    char* end = chunk->text + chunk->length;
+    char* line;
+    char* saveptr;
+    while ((line = next_line(&cursor, end)) != NULL) {
+        if (batch->num_rows == batch->capacity) {
+            int capacity = batch->capacity == 0 ? 4096 : batch->capacity * 2;
+            int* rows = (int*)realloc(batch->rows, ((size_t)capacity * columns->num_columns + 1) * sizeof(int));
+            if (rows == NULL) {
+                fprintf(stderr, "Memory allocation failed\n");
+                return -1;
+            }
+            batch->rows = rows;
+            batch->capacity = capacity;
+        }
+        int* row = &batch->rows[(size_t)batch->num_rows * columns->num_columns];
+        memset(row, 0, columns->num_columns * sizeof(int));
+        char* token = strtok_r(line, ",", &saveptr);
+        for (int i = 0; i < columns->num_columns && token != NULL; i++) {
+            if (columns->column_types[i] == 1) { // float
+                float value = strtof(token, NULL);
+                memcpy(&row[i], &value, sizeof(float));
+            } else { // int
+                row[i] = atoi(token);
+            }
+            token = strtok_r(NULL, ",\n", &saveptr);
+        }
+        batch->num_rows++;
+    }
+    return 0;
+}
+
+/**
+ * @brief Function to free the rows of a chunk
+ *
+ * @param result - CsvRows object
+ */
+static void free_rows(void* result) {
+    CsvRows* batch = (CsvRows*)result;
+    free(batch->rows);
+    free(batch);
+}
 
 /**
  * @brief Convert CSV file to HTY file
+ *
+ * Both passes over the CSV file run as a pipeline: a reader thread reads
+ * large chunks of lines, parser threads convert them, and this thread merges
+ * the chunks in file order and encodes the rows, while a writer thread
+ * writes the finished blocks of the HTY file.
  * 
  * @param pIn - input file pointer
  * @param pOut - output file pointer
  * @param csv_file_path - path to data.csv
  * @param hty_file_path - path to data.hty
+ * @param bloom_columns - comma-separated columns to build Bloom filters for (empty for none)
+ * @param sort_columns - column to sort by, or comma-separated columns to Z-order by (empty for none)
  */
-void convert_from_csv_to_hty(FILE* pIn, FILE* pOut, char* csv_file_path, char* hty_file_path) {
-    char inputline[256]; // user buffer
+void convert_from_csv_to_hty(FILE* pIn, FILE* pOut, char* csv_file_path, char* hty_file_path, char* bloom_columns,
+                             char* sort_columns) {
+    char* header = NULL; // header line
+    size_t header_size = 0; // bytes allocated for the header line
+    long data_offset; // offset of the first data line
     int num_rows = 0; // number of rows
     int num_columns = 0; // number of columns
-    int column_types[256]; // 0 for int, 1 for float
+    int column_types[256] = {0}; // 0 for int, 1 for float
     char* column_names[256]; // column names
     int column_count = 0; // column count
-    int is_first_line = 1; // check if it is the first line
     char* token; // token
-    int col_index; // column index for data lines
     cJSON* metadata; // JSON metadata object
     cJSON* groups; // JSON groups array
     cJSON* group; // JSON group object
     cJSON* columns; // JSON columns array
     cJSON* column; // JSON column object
     char* printed_metadata; // printed metadata string
-    char* metadata_str; // metadata string
-    int metadata_size; // metadata size
+    FILE* output; // data.hty written by the writer thread
+    HtyWriter* writer; // row writer
+    HtyLinePipeline* pipeline; // reader and parser threads
+    HtyLineChunk* chunk; // parsed chunk of lines
+    int status; // pipeline status
+    CsvColumns parse_columns; // columns shared by the parser threads
+    int bloom_indices[256]; // columns to build Bloom filters for
+    int num_bloom_columns = 0; // number of Bloom filter columns
+    int sort_indices[64]; // sort key columns
+    int num_sort_columns = 0; // number of sort key columns
+    int sort_seen[64] = {0}; // check if a sort key column has a value yet
+    int sort_int_min[64], sort_int_max[64]; // sort key column range read as int
+    float sort_float_min[64], sort_float_max[64]; // sort key column range read as float
+    HtySorter* sorter = NULL; // external sorter (NULL when not sorting)
     
     // Open data.csv file
     pIn = fopen(csv_file_path, "r");
@@ -54,37 +247,89 @@ void convert_from_csv_to_hty(FILE* pIn, FILE* pOut, char* csv_file_path, char* h
         return;
     }
 
-    //reading each line of the file
-    while (fgets(inputline, sizeof(inputline), pIn) != NULL) {
-        if (is_first_line) {
-            // Parse header line
-            token = strtok(inputline, ",\n");
-            while (token != NULL) {
-                column_names[column_count] = strdup(token); //keep column names
-                printf("Header - Column %d: %s\n", column_count, column_names[column_count]);
-                column_count++;
-                token = strtok(NULL, ",\n");
+    // Parse header line, the data lines are read by the pipeline from the end of it
+    if (getline(&header, &header_size, pIn) != -1) {
+        token = strtok(header, ",\n");
+        while (token != NULL && column_count < 256) {
+            column_names[column_count] = strdup(token); //keep column names
+            printf("Header - Column %d: %s\n", column_count, column_names[column_count]);
+            column_count++;
+            token = strtok(NULL, ",\n");
+        }
+    }
+    free(header);
+    num_columns = column_count;
+    data_offset = ftell(pIn);
+    fclose(pIn);
+
+    // Find the sort key columns
+    token = strtok(sort_columns, ", \n");
+    while (token != NULL && num_sort_columns < 64) {
+        int found = 0;
+        for (int i = 0; i < num_columns; i++) {
+            if (strcmp(column_names[i], token) == 0) {
+                sort_indices[num_sort_columns++] = i;
+                found = 1;
+                break;
             }
-            num_columns = column_count;
-            is_first_line = 0;
-        } else {
-            // Parse data lines
-            num_rows++;
-            token = strtok(inputline, ",\n");
-            col_index = 0;
-            while (token != NULL) {
-                if (strchr(token, '.') != NULL) {
-                    column_types[col_index] = 1; // float
-                    printf("Row %d, Column %d: %s (float)\n", num_rows, col_index, token);
+        }
+        if (!found) {
+            fprintf(stderr, "Sort key column not found: %s\n", token);
+        }
+        token = strtok(NULL, ", \n");
+    }
+    parse_columns.num_columns = num_columns;
+    parse_columns.column_types = column_types;
+    parse_columns.sort_indices = sort_indices;
+    parse_columns.num_sort_columns = num_sort_columns;
+
+    // First pass: count the rows, find the column types and the sort key ranges
+    status = -1;
+    pipeline = open_line_pipeline(csv_file_path, data_offset, scan_chunk, &parse_columns, free);
+    if (pipeline != NULL) {
+        while ((status = next_line_chunk(pipeline, &chunk)) == 1) {
+            CsvScan* scan = (CsvScan*)chunk->result;
+            num_rows += scan->num_rows;
+            for (int i = 0; i < num_columns; i++) {
+                if (scan->column_types[i] >= 0) {
+                    column_types[i] = scan->column_types[i]; // the last value decides the type
+                }
+            }
+            for (int k = 0; k < num_sort_columns; k++) {
+                if (!scan->sort_seen[k]) {
+                    continue;
+                }
+                if (!sort_seen[k]) {
+                    sort_int_min[k] = scan->sort_int_min[k];
+                    sort_int_max[k] = scan->sort_int_max[k];
+                    sort_float_min[k] = scan->sort_float_min[k];
+                    sort_float_max[k] = scan->sort_float_max[k];
+                    sort_seen[k] = 1;
                 } else {
-                    column_types[col_index] = 0; // int
-                    printf("Row %d, Column %d: %s (int)\n", num_rows, col_index, token);
+                    if (scan->sort_int_min[k] < sort_int_min[k]) sort_int_min[k] = scan->sort_int_min[k];
+                    if (scan->sort_int_max[k] > sort_int_max[k]) sort_int_max[k] = scan->sort_int_max[k];
+                    if (scan->sort_float_min[k] < sort_float_min[k]) sort_float_min[k] = scan->sort_float_min[k];
+                    if (scan->sort_float_max[k] > sort_float_max[k]) sort_float_max[k] = scan->sort_float_max[k];
                 }
-                col_index++;
-                token = strtok(NULL, ",\n");
             }
+            release_line_chunk(pipeline, chunk);
+        }
+        if (close_line_pipeline(pipeline) != 0) {
+            status = -1;
+        }
+    }
+    if (status != 0) {
+        fprintf(stderr, "Error reading input file: %s\n", csv_file_path);
+        for (int i = 0; i < num_columns; i++) {
+            free(column_names[i]);
         }
+        fclose(pOut);
+        return;
+    }
+    for (int i = 0; i < num_columns; i++) {
+        printf("Column %d: %s (%s)\n", i, column_names[i], column_types[i] == 0 ? "int" : "float");
     }
+    printf("Rows: %d\n", num_rows);
 
     // Create metadata using cJSON
     metadata = cJSON_CreateObject();
@@ -103,45 +348,113 @@ void convert_from_csv_to_hty(FILE* pIn, FILE* pOut, char* csv_file_path, char* h
     }
     cJSON_AddItemToArray(groups, group); // Add group to groups array
 
+    // Find the Bloom filter columns
+    token = strtok(bloom_columns, ", \n");
+    while (token != NULL) {
+        int found = 0;
+        for (int i = 0; i < num_columns; i++) {
+            if (strcmp(column_names[i], token) == 0) {
+                bloom_indices[num_bloom_columns++] = i;
+                found = 1;
+                break;
+            }
+        }
+        if (!found) {
+            fprintf(stderr, "Bloom filter column not found: %s\n", token);
+        }
+        token = strtok(NULL, ", \n");
+    }
+
     // Write raw data 
-    rewind(pIn);
-    is_first_line = 1;
-    while (fgets(inputline, sizeof(inputline), pIn) != NULL) {
-        if (is_first_line) {
-            is_first_line = 0;
-            continue;
-        }
-        token = strtok(inputline, ",");
-        for (int i = 0; i < num_columns && token != NULL; i++) {
-            if (column_types[i] == 1) { // float
-                float value = strtof(token, NULL);
-                fwrite(&value, sizeof(float), 1, pOut);
-            } else { // int
-                int value = atoi(token);
-                fwrite(&value, sizeof(int), 1, pOut);
+    output = open_async_output(pOut);
+    writer = output != NULL ? create_writer(output, num_columns, column_types) : NULL;
+    if (writer != NULL && enable_bloom_filters(writer, bloom_indices, num_bloom_columns) != 0) {
+        free_writer(writer);
+        writer = NULL;
+    }
+    if (writer != NULL && num_sort_columns > 0) {
+        sorter = create_sorter(num_columns, column_types, sort_indices, num_sort_columns, HTY_SORT_MEMORY_BYTES);
+        if (sorter == NULL) {
+            free_writer(writer);
+            writer = NULL;
+        } else {
+            for (int k = 0; k < num_sort_columns && sort_seen[k]; k++) {
+                if (column_types[sort_indices[k]] == 1) { // float
+                    int min_bits, max_bits;
+                    memcpy(&min_bits, &sort_float_min[k], sizeof(float));
+                    memcpy(&max_bits, &sort_float_max[k], sizeof(float));
+                    set_sorter_key_range(sorter, k, min_bits, max_bits);
+                } else { // int
+                    set_sorter_key_range(sorter, k, sort_int_min[k], sort_int_max[k]);
+                }
             }
-            token = strtok(NULL, ",\n");
         }
     }
+    if (writer == NULL) {
+        cJSON_Delete(metadata);
+        for (int i = 0; i < num_columns; i++) {
+            free(column_names[i]);
+        }
+        if (output != NULL) {
+            fclose(output);
+        }
+        fclose(pOut);
+        return;
+    }
+
+    // Second pass: convert the rows and encode them in file order
+    status = -1;
+    pipeline = open_line_pipeline(csv_file_path, data_offset, convert_chunk, &parse_columns, free_rows);
+    if (pipeline != NULL) {
+        while ((status = next_line_chunk(pipeline, &chunk)) == 1) {
+            CsvRows* batch = (CsvRows*)chunk->result;
+            for (int r = 0; r < batch->num_rows; r++) {
+                int* row = &batch->rows[(size_t)r * num_columns];
+                if (sorter != NULL) {
+                    sorter_add_row(sorter, row);
+                } else {
+                    write_row(writer, row);
+                }
+            }
+            release_line_chunk(pipeline, chunk);
+        }
+        if (close_line_pipeline(pipeline) != 0) {
+            status = -1;
+        }
+    }
+    if (status != 0) {
+        fprintf(stderr, "Error reading input file: %s\n", csv_file_path);
+    }
+
+    // Write rows in sort key order and record the key
+    if (sorter != NULL) {
+        sorter_write_sorted(sorter, writer);
+        free_sorter(sorter);
+        cJSON* sort_key = cJSON_AddObjectToObject(metadata, "sort_key");
+        cJSON* sort_key_columns = cJSON_AddArrayToObject(sort_key, "columns");
+        for (int k = 0; k < num_sort_columns; k++) {
+            cJSON_AddItemToArray(sort_key_columns, cJSON_CreateString(column_names[sort_indices[k]]));
+        }
+        cJSON_AddStringToObject(sort_key, "order", num_sort_columns == 1 ? "linear" : "z-order");
+    }
+
+    // Write metadata (with footer statistics) to data.hty and wait for the writer thread
+    finish_writer(writer, metadata);
+    free_writer(writer);
+    if (fclose(output) != 0) {
+        fprintf(stderr, "Error writing output file: %s\n", hty_file_path);
+    }
 
     // Print the metadata
     printed_metadata = cJSON_Print(metadata);
     printf("Metadata:\n%s\n", printed_metadata);
     free(printed_metadata);
 
-    // Write metadata to data.hty
-    metadata_str = cJSON_PrintUnformatted(metadata);
-    metadata_size = strlen(metadata_str);
-    fwrite(metadata_str, sizeof(char), metadata_size, pOut);
-    fwrite(&metadata_size, sizeof(int), 1, pOut);
-
     // Cleanup
     cJSON_Delete(metadata);
-    free(metadata_str);
     for (int i = 0; i < num_columns; i++) {
         free(column_names[i]);
     }
-    fclose(pIn);
     fclose(pOut);
 }
 
@@ -151,6 +464,8 @@ int main() {
     char csv_file_path[256]; // csv file path
     char hty_file_path[256]; // hty file path
     char inputline[256]; // user buffer
+    char bloom_columns[256] = ""; // Bloom filter columns
+    char sort_columns[256] = ""; // sort key columns
 
     printf("Please enter the .csv file path: ");
     fgets(inputline, sizeof(inputline), stdin);
@@ -160,6 +475,16 @@ int main() {
     fgets(inputline, sizeof(inputline), stdin);
     sscanf(inputline, "%s", hty_file_path);
 
-    convert_from_csv_to_hty(pIn, pOut, csv_file_path, hty_file_path); //Task 1 - Convert from CSV to HTY
+    printf("Enter columns to build Bloom filters for (comma-separated, blank for none): ");
+    if (fgets(inputline, sizeof(inputline), stdin) != NULL) {
+        strcpy(bloom_columns, inputline);
+    }
+
+    printf("Enter sort key (column, or comma-separated columns for Z-order, blank for none): ");
+    if (fgets(inputline, sizeof(inputline), stdin) != NULL) {
+        strcpy(sort_columns, inputline);
+    }
+
+    convert_from_csv_to_hty(pIn, pOut, csv_file_path, hty_file_path, bloom_columns, sort_columns); //Task 1 - Convert from CSV to HTY
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,172 @@
+/**
+ * @file heartyhty_arena.c
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Arenas: per-query memory that is released in one shot
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "heartyhty_arena.h"
+#include "heartyhty_stats.h"
+
+#define CHUNK_ALIGNMENT 4096 // Alignment of chunk memory, enough for direct I/O buffers
+
+/**
+ * @brief One chunk of an arena
+ */
+typedef struct ArenaChunk {
+    struct ArenaChunk* next;  // Next chunk
+    char* memory;             // Chunk memory, CHUNK_ALIGNMENT aligned
+    size_t size;              // Bytes of memory
+    size_t used;              // Bytes handed out since the last reset
+} ArenaChunk;
+
+struct HtyArena {
+    ArenaChunk* chunks;   // Chunks, in allocation order
+    ArenaChunk* current;  // Chunk allocations are made from; the chunks before it are full
+    size_t chunk_bytes;   // Size of ordinary chunks
+    size_t total_bytes;   // Bytes of all chunks
+};
+
+HtyArena* create_arena(size_t chunk_bytes) {
+    HtyArena* arena = (HtyArena*)calloc(1, sizeof(HtyArena));
+    if (arena == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return NULL;
+    }
+    arena->chunk_bytes = chunk_bytes > 0 ? chunk_bytes : HTY_ARENA_CHUNK_BYTES;
+    return arena;
+}
+
+/**
+ * @brief Function to add a chunk at the end of an arena
+ *
+ * @param arena - arena
+ * @param min_bytes - bytes the chunk must hold at least
+ * @return ArenaChunk* - new chunk, NULL on failure
+ */
+static ArenaChunk* add_chunk(HtyArena* arena, size_t min_bytes) {
+    size_t size = min_bytes > arena->chunk_bytes ? min_bytes : arena->chunk_bytes;
+    ArenaChunk* chunk = (ArenaChunk*)calloc(1, sizeof(ArenaChunk));
+    if (chunk == NULL || posix_memalign((void**)&chunk->memory, CHUNK_ALIGNMENT, size) != 0) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(chunk);
+        return NULL;
+    }
+    chunk->size = size;
+    ArenaChunk** last = &arena->chunks;
+    while (*last != NULL) {
+        last = &(*last)->next;
+    }
+    *last = chunk;
+    arena->total_bytes += size;
+    return chunk;
+}
+
+void* arena_alloc_aligned(HtyArena* arena, size_t bytes, size_t alignment) {
+    HTY_STATS_ADD(allocations, 1);
+    HTY_STATS_ADD(allocated_bytes, bytes);
+    if (arena == NULL) {
+        void* memory = NULL;
+        if (alignment < sizeof(void*)) {
+            alignment = sizeof(void*);
+        }
+        if (posix_memalign(&memory, alignment, bytes > 0 ? bytes : 1) != 0) {
+            return NULL;
+        }
+        return memory;
+    }
+
+    // Use the first chunk from the current one on with room; chunks skipped over stay for the next reset
+    for (ArenaChunk* chunk = arena->current != NULL ? arena->current : arena->chunks; chunk != NULL; chunk = chunk->next) {
+        size_t start = (chunk->used + alignment - 1) & ~(alignment - 1);
+        if (start + bytes <= chunk->size) {
+            chunk->used = start + bytes;
+            if (chunk->used + HTY_ARENA_ALIGNMENT > chunk->size) {
+                arena->current = chunk->next;  // Full: start from the next chunk next time
+            } else {
+                arena->current = chunk;
+            }
+            return chunk->memory + start;
+        }
+    }
+    ArenaChunk* chunk = add_chunk(arena, bytes + alignment);
+    if (chunk == NULL) {
+        return NULL;
+    }
+    chunk->used = bytes;  // Chunk memory is aligned to CHUNK_ALIGNMENT already
+    if (alignment > CHUNK_ALIGNMENT) {
+        chunk->used = chunk->size;  // Rare: give the caller the whole chunk, aligned by hand
+        return (void*)(((uintptr_t)chunk->memory + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    }
+    arena->current = chunk;
+    return chunk->memory;
+}
+
+void* arena_alloc(HtyArena* arena, size_t bytes) {
+    if (arena == NULL) {
+        HTY_STATS_ADD(allocations, 1);
+        HTY_STATS_ADD(allocated_bytes, bytes);
+        return malloc(bytes > 0 ? bytes : 1);
+    }
+    return arena_alloc_aligned(arena, bytes, HTY_ARENA_ALIGNMENT);
+}
+
+char* arena_strdup(HtyArena* arena, const char* text) {
+    size_t length = strlen(text) + 1;
+    char* copy = (char*)arena_alloc(arena, length);
+    if (copy != NULL) {
+        memcpy(copy, text, length);
+    }
+    return copy;
+}
+
+void arena_release(HtyArena* arena, void* memory) {
+    if (arena == NULL) {
+        free(memory);
+    }
+}
+
+void reset_arena(HtyArena* arena) {
+    // Keep chunks in order until the budget is used up, free the rest
+    size_t kept = 0;
+    ArenaChunk** link = &arena->chunks;
+    while (*link != NULL) {
+        ArenaChunk* chunk = *link;
+        if (kept + chunk->size <= HTY_ARENA_KEEP_BYTES || kept == 0) {
+            kept += chunk->size;
+            chunk->used = 0;
+            link = &chunk->next;
+        } else {
+            *link = chunk->next;
+            arena->total_bytes -= chunk->size;
+            free(chunk->memory);
+            free(chunk);
+        }
+    }
+    arena->current = arena->chunks;
+}
+
+size_t arena_bytes(HtyArena* arena) {
+    return arena->total_bytes;
+}
+
+void free_arena(HtyArena* arena) {
+    if (arena == NULL) {
+        return;
+    }
+    ArenaChunk* chunk = arena->chunks;
+    while (chunk != NULL) {
+        ArenaChunk* next = chunk->next;
+        free(chunk->memory);
+        free(chunk);
+        chunk = next;
+    }
+    free(arena);
+}
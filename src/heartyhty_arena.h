@@ -0,0 +1,107 @@
+/**
+ * @file heartyhty_arena.h
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Header file for arenas: per-query memory that is released in one shot
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef HEARTYHTY_ARENA_H
+#define HEARTYHTY_ARENA_H
+
+#include <stddef.h>
+
+#define HTY_ARENA_CHUNK_BYTES (1L * 1024 * 1024) // Default size of the chunks an arena allocates from
+#define HTY_ARENA_ALIGNMENT 16                   // Alignment of arena_alloc() memory
+
+// Memory reset_arena() keeps for the next query; larger chunks are returned to the system
+#ifndef HTY_ARENA_KEEP_BYTES
+#define HTY_ARENA_KEEP_BYTES (256L * 1024 * 1024)
+#endif
+
+/**
+ * @brief Monotonic allocator: memory comes from large chunks and is only released all at once
+ *
+ * An arena is not thread-safe; allocate from one thread.
+ */
+typedef struct HtyArena HtyArena;
+
+/**
+ * @brief Function to create an arena
+ *
+ * @param chunk_bytes - size of the chunks to allocate from, 0 for HTY_ARENA_CHUNK_BYTES
+ * @return HtyArena* - arena, NULL on failure
+ */
+HtyArena* create_arena(size_t chunk_bytes);
+
+/**
+ * @brief Function to allocate memory from an arena
+ *
+ * With a NULL arena the memory comes from malloc() and is freed with arena_release().
+ *
+ * @param arena - arena, or NULL
+ * @param bytes - bytes to allocate
+ * @return void* - memory aligned to HTY_ARENA_ALIGNMENT, NULL on failure
+ */
+void* arena_alloc(HtyArena* arena, size_t bytes);
+
+/**
+ * @brief Function to allocate aligned memory from an arena
+ *
+ * With a NULL arena the memory comes from posix_memalign() and is freed with arena_release().
+ *
+ * @param arena - arena, or NULL
+ * @param bytes - bytes to allocate
+ * @param alignment - alignment, a power of two
+ * @return void* - memory, NULL on failure
+ */
+void* arena_alloc_aligned(HtyArena* arena, size_t bytes, size_t alignment);
+
+/**
+ * @brief Function to copy a string into an arena
+ *
+ * @param arena - arena, or NULL
+ * @param text - string to copy
+ * @return char* - copy, NULL on failure
+ */
+char* arena_strdup(HtyArena* arena, const char* text);
+
+/**
+ * @brief Function to give back memory from arena_alloc()
+ *
+ * Arena memory is only released by reset_arena() and free_arena(), so this
+ * frees the memory only when it came from a NULL arena.
+ *
+ * @param arena - arena the memory came from, or NULL
+ * @param memory - memory to give back
+ */
+void arena_release(HtyArena* arena, void* memory);
+
+/**
+ * @brief Function to release everything allocated from an arena
+ *
+ * Up to HTY_ARENA_KEEP_BYTES of chunks are kept, so the next query with
+ * the same shape allocates nothing from the system.
+ *
+ * @param arena - arena
+ */
+void reset_arena(HtyArena* arena);
+
+/**
+ * @brief Function to get the memory an arena holds
+ *
+ * @param arena - arena
+ * @return size_t - bytes of chunks held
+ */
+size_t arena_bytes(HtyArena* arena);
+
+/**
+ * @brief Function to free an arena and all its memory
+ *
+ * @param arena - arena, or NULL
+ */
+void free_arena(HtyArena* arena);
+
+#endif // HEARTYHTY_ARENA_H
@@ -0,0 +1,396 @@
+/**
+ * @file heartyhty_batch.c
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Shared-scan batches: many queries answered in one pass over a file
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include "../third_party/cJSON/cJSON.h"
+#include "heartyhty_functions.h"
+#include "heartyhty_pool.h"
+#include "heartyhty_batch.h"
+#include "heartyhty_stats.h"
+
+/**
+ * @brief Per query state of a batch scan
+ */
+typedef struct {
+    int* positions;       // Position of each projected column among the columns read
+    int filter_position;  // Position of the filter column among the columns read
+    int filter_type;      // Filter column type (0 for int, 1 for float)
+    int capacity;         // Rows the result columns can hold
+} BatchState;
+
+/**
+ * @brief Function to free the result columns of a query
+ *
+ * @param query - query whose result to free
+ */
+static void free_result_columns(HtyBatchQuery* query) {
+    if (query->result != NULL) {
+        for (int i = 0; i < query->num_columns; i++) {
+            free(query->result[i]);
+        }
+        free(query->result);
+    }
+    query->result = NULL;
+    query->row_count = 0;
+}
+
+/**
+ * @brief Function to make room for more rows in the result of a query
+ *
+ * @param query - query
+ * @param state - scan state of the query
+ * @param rows - rows the result must be able to hold
+ * @return int - 0 on success, -1 on failure
+ */
+static int grow_result(HtyBatchQuery* query, BatchState* state, int rows) {
+    if (rows <= state->capacity) {
+        return 0;
+    }
+    int capacity = state->capacity > 0 ? state->capacity : 1024;
+    while (capacity < rows) {
+        capacity *= 2;
+    }
+    for (int i = 0; i < query->num_columns; i++) {
+        int* column = (int*)realloc(query->result[i], capacity * sizeof(int));
+        if (column == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            return -1;
+        }
+        query->result[i] = column;
+    }
+    state->capacity = capacity;
+    return 0;
+}
+
+/**
+ * @brief Function to find the row groups that may hold rows for any query of a batch
+ *
+ * @param metadata - metadata object
+ * @param hty_file_path - path to hty file
+ * @param queries - queries to run
+ * @param states - state of each query, with filter_position still the column index
+ * @param num_queries - number of queries
+ * @return int* - one flag per row group, 1 if it must be read; NULL to read them all
+ */
+static int* batch_row_groups(cJSON* metadata, const char* hty_file_path, const HtyBatchQuery* queries,
+                             const BatchState* states, int num_queries) {
+    int num_rows = cJSON_GetObjectItemCaseSensitive(metadata, "num_rows")->valueint;
+    int block_rows = get_block_rows(metadata);
+    int num_row_groups = (num_rows + block_rows - 1) / block_rows;
+    int* row_groups = NULL;
+    for (int q = 0; q < num_queries; q++) {
+        int* query_groups = !queries[q].has_filter ? NULL :
+            row_groups_to_read(metadata, hty_file_path, queries[q].filter.column, states[q].filter_position,
+                               states[q].filter_type, queries[q].filter.op, &queries[q].filter.value, 1);
+        if (query_groups == NULL) {
+            free(row_groups);
+            return NULL; // This query reads every row group
+        }
+        if (row_groups == NULL) {
+            row_groups = query_groups;
+            continue;
+        }
+        for (int group = 0; group < num_row_groups; group++) {
+            row_groups[group] |= query_groups[group];
+        }
+        free(query_groups);
+    }
+    return row_groups;
+}
+
+/**
+ * @brief Function to run many queries with a single scan of a file (see run_batch())
+ *
+ * @param metadata - metadata object
+ * @param hty_file_path - path to hty file
+ * @param queries - queries to run
+ * @param num_queries - number of queries
+ * @return int - 0 on success, -1 on failure
+ */
+static int scan_batch(cJSON* metadata, const char* hty_file_path, HtyBatchQuery* queries, int num_queries) {
+    cJSON* group = cJSON_GetArrayItem(cJSON_GetObjectItemCaseSensitive(metadata, "groups"), 0);  // Assuming single group
+    int total_columns = cJSON_GetArraySize(cJSON_GetObjectItemCaseSensitive(group, "columns"));
+    int block_rows = get_block_rows(metadata);
+
+    // Find the columns of every query; each column is read once for all of them
+    int* column_position = (int*)malloc((total_columns + 1) * sizeof(int));
+    int* read_columns = (int*)malloc((total_columns + 1) * sizeof(int));
+    int* selection = (int*)malloc((block_rows + 1) * sizeof(int));
+    BatchState* states = (BatchState*)calloc(num_queries + 1, sizeof(BatchState));
+    if (!column_position || !read_columns || !selection || !states) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(column_position);
+        free(read_columns);
+        free(selection);
+        free(states);
+        return -1;
+    }
+    for (int i = 0; i < total_columns; i++) {
+        column_position[i] = -1;
+    }
+    for (int q = 0; q < num_queries; q++) {
+        queries[q].result = NULL;
+        queries[q].row_count = 0;
+    }
+    int status = 0;
+    for (int q = 0; q < num_queries && status == 0; q++) {
+        HtyBatchQuery* query = &queries[q];
+        BatchState* state = &states[q];
+        state->positions = (int*)malloc((query->num_columns + 1) * sizeof(int));
+        int* types = (int*)malloc((query->num_columns + 1) * sizeof(int));
+        if (state->positions == NULL || types == NULL ||
+            resolve_columns(metadata, query->columns, query->num_columns, state->positions, types) != 0) {
+            status = -1;
+        }
+        free(types);
+        if (status == 0 && query->has_filter) {
+            char* filter_name = (char*)query->filter.column;
+            status = resolve_columns(metadata, &filter_name, 1, &state->filter_position, &state->filter_type);
+        }
+        if (status != 0) {
+            break;
+        }
+
+        // Mark the columns to read; they are numbered below, in column order
+        for (int i = 0; i < query->num_columns; i++) {
+            column_position[state->positions[i]] = 0;
+        }
+        if (query->has_filter) {
+            column_position[state->filter_position] = 0;
+        }
+        query->result = (int**)calloc(query->num_columns + 1, sizeof(int*));
+        if (query->result == NULL) {
+            status = -1;
+        }
+    }
+    int num_read = 0;
+    for (int i = 0; i < total_columns; i++) {
+        if (column_position[i] != -1) {
+            column_position[i] = num_read;
+            read_columns[num_read++] = i;
+        }
+    }
+
+    // A row group is skipped only when the filter of every query rules it out
+    int* row_groups = status == 0 ? batch_row_groups(metadata, hty_file_path, queries, states, num_queries) : NULL;
+
+    // Turn column indices into positions among the columns read
+    for (int q = 0; q < num_queries && status == 0; q++) {
+        for (int i = 0; i < queries[q].num_columns; i++) {
+            states[q].positions[i] = column_position[states[q].positions[i]];
+        }
+        if (queries[q].has_filter) {
+            states[q].filter_position = column_position[states[q].filter_position];
+        }
+    }
+
+    // One pass over the file, every query evaluated against each row group
+    HtyColumnReader* reader = status == 0 ? open_column_reader(metadata, hty_file_path, read_columns, num_read, row_groups) : NULL;
+    free(row_groups);
+    if (status == 0 && reader == NULL) {
+        status = -1;
+    }
+    int** block;
+    int first_row, rows_in_block, got;
+    while (status == 0 && (got = next_column_block(reader, &block, &first_row, &rows_in_block)) != 0) {
+        if (got < 0) {
+            status = -1;
+            break;
+        }
+        for (int q = 0; q < num_queries && status == 0; q++) {
+            HtyBatchQuery* query = &queries[q];
+            BatchState* state = &states[q];
+
+            // Select the matching rows, then copy each projected column
+            int selected = 0;
+            if (query->has_filter) {
+                const int* values = block[state->filter_position];
+                for (int i = 0; i < rows_in_block; i++) {
+                    selection[selected] = i;
+                    selected += compare_values(values[i], query->filter.value, query->filter.op, state->filter_type);
+                }
+            } else {
+                for (int i = 0; i < rows_in_block; i++) {
+                    selection[selected++] = i;
+                }
+            }
+            if (selected == 0) {
+                continue;
+            }
+            if (grow_result(query, state, query->row_count + selected) != 0) {
+                status = -1;
+                break;
+            }
+            for (int c = 0; c < query->num_columns; c++) {
+                const int* values = block[state->positions[c]];
+                int* output = query->result[c] + query->row_count;
+                for (int i = 0; i < selected; i++) {
+                    output[i] = values[selection[i]];
+                }
+            }
+            query->row_count += selected;
+        }
+    }
+    close_column_reader(reader);
+
+    // Shape the results like project() and project_and_filter() do
+    for (int q = 0; q < num_queries; q++) {
+        if (status != 0 || (queries[q].has_filter && queries[q].row_count == 0)) {
+            free_result_columns(&queries[q]);
+        } else if (queries[q].row_count == 0) {
+            for (int c = 0; c < queries[q].num_columns; c++) {
+                queries[q].result[c] = (int*)malloc(sizeof(int)); // Empty file: empty columns
+            }
+        }
+        free(states[q].positions);
+    }
+    free(states);
+    free(selection);
+    free(read_columns);
+    free(column_position);
+    return status;
+}
+
+int run_batch(cJSON* metadata, const char* hty_file_path, HtyBatchQuery* queries, int num_queries) {
+    HtyStageTimer query_timer;
+    HTY_STAGE_BEGIN(query_timer);
+    int status = scan_batch(metadata, hty_file_path, queries, num_queries);
+    for (int q = 0; q < num_queries && status == 0; q++) {
+        HTY_STATS_ADD(rows_matched, queries[q].row_count);
+    }
+    HTY_QUERY_END("run_batch", query_timer);
+    return status;
+}
+
+/**
+ * @brief Function to find a keyword as a whole word, ignoring case
+ *
+ * @param text - text to search
+ * @param keyword - keyword to find
+ * @return char* - start of the keyword, NULL if not found
+ */
+static char* find_keyword(char* text, const char* keyword) {
+    size_t length = strlen(keyword);
+    for (char* at = text; *at != '\0'; at++) {
+        if (strncasecmp(at, keyword, length) == 0 && (at == text || isspace((unsigned char)at[-1])) &&
+            (at[length] == '\0' || isspace((unsigned char)at[length]))) {
+            return at;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Function to turn an operator into one of the OP_* operations
+ *
+ * @param text - operator text
+ * @return int - operation, -1 if unknown
+ */
+static int parse_operation(const char* text) {
+    if (strcmp(text, ">") == 0) return OP_GREATER;
+    if (strcmp(text, ">=") == 0) return OP_GREATER_EQUAL;
+    if (strcmp(text, "<") == 0) return OP_LESS;
+    if (strcmp(text, "<=") == 0) return OP_LESS_EQUAL;
+    if (strcmp(text, "=") == 0) return OP_EQUAL;
+    if (strcmp(text, "!=") == 0) return OP_NOT_EQUAL;
+    return -1;
+}
+
+int parse_batch_query(cJSON* metadata, const char* line, HtyBatchQuery* query) {
+    memset(query, 0, sizeof(HtyBatchQuery));
+    char* text = strdup(line);
+    if (text == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+
+    // Split off the filter
+    char* where = find_keyword(text, "WHERE");
+    if (where != NULL) {
+        char column_name[256], op_text[3], value_text[64];
+        *where = '\0';
+        if (sscanf(where + 5, " %255[^<>=! \t] %2[<>=!] %63s", column_name, op_text, value_text) != 3 ||
+            (query->filter.op = parse_operation(op_text)) == -1) {
+            fprintf(stderr, "Invalid filter: %s\n", where + 5);
+            free(text);
+            return -1;
+        }
+        int column_index, is_float;
+        char* name = column_name;
+        if (resolve_columns(metadata, &name, 1, &column_index, &is_float) != 0) {
+            free(text);
+            return -1;
+        }
+        char* end;
+        if (is_float) {
+            float value = strtof(value_text, &end);
+            query->filter.value = *(int*)&value;  // Store float bits as int for comparison
+        } else {
+            query->filter.value = (int)strtol(value_text, &end, 10);
+        }
+        if (*end != '\0') {
+            fprintf(stderr, "Invalid filter value: %s\n", value_text);
+            free(text);
+            return -1;
+        }
+        query->filter.column = strdup(column_name);
+        query->has_filter = 1;
+    }
+
+    // Comma separated projected columns; spaces around names are ignored
+    int capacity = 1;
+    for (char* c = text; *c != '\0'; c++) {
+        capacity += *c == ',';
+    }
+    query->columns = (char**)calloc(capacity, sizeof(char*));
+    char* saveptr;
+    for (char* token = strtok_r(text, ",", &saveptr); token != NULL; token = strtok_r(NULL, ",", &saveptr)) {
+        while (isspace((unsigned char)*token)) {
+            token++;
+        }
+        char* end = token + strlen(token);
+        while (end > token && isspace((unsigned char)end[-1])) {
+            *--end = '\0';
+        }
+        if (*token == '\0' || strpbrk(token, " \t") != NULL) {
+            break; // Caught below
+        }
+        query->columns[query->num_columns++] = strdup(token);
+    }
+    free(text);
+    if (query->num_columns == 0 || query->num_columns != capacity) {
+        fprintf(stderr, "Invalid column list: %s\n", line);
+        free_batch_query(query);
+        return -1;
+    }
+    int* indices = (int*)malloc(query->num_columns * sizeof(int));
+    int* types = (int*)malloc(query->num_columns * sizeof(int));
+    int status = resolve_columns(metadata, query->columns, query->num_columns, indices, types);
+    free(indices);
+    free(types);
+    if (status != 0) {
+        free_batch_query(query);
+    }
+    return status;
+}
+
+void free_batch_query(HtyBatchQuery* query) {
+    free_result_columns(query);
+    for (int i = 0; i < query->num_columns; i++) {
+        free(query->columns[i]);
+    }
+    free(query->columns);
+    free((char*)query->filter.column);
+    memset(query, 0, sizeof(HtyBatchQuery));
+}
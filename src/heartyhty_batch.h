@@ -0,0 +1,64 @@
+/**
+ * @file heartyhty_batch.h
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Header file for shared-scan batches: many queries answered in one pass over a file
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef HEARTYHTY_BATCH_H
+#define HEARTYHTY_BATCH_H
+
+#define HTY_BATCH_MAX_LINE 4096 // Longest line of a query file
+
+/**
+ * @brief One query of a batch: project columns, optionally filtered on one column
+ */
+typedef struct {
+    char** columns;         // Names of the projected columns
+    int num_columns;        // Number of projected columns
+    int has_filter;         // 1 if the query has a filter
+    HtyPredicate filter;    // Filter (valid if has_filter)
+    int** result;           // Result columns, set by run_batch (NULL if no rows match)
+    int row_count;          // Number of resulting rows, set by run_batch
+} HtyBatchQuery;
+
+/**
+ * @brief Function to run many queries with a single scan of a file
+ *
+ * Each row group is read once (through the buffer pool) and every query's
+ * filter and projection is evaluated against it. Every query gets the same
+ * result as project() or project_and_filter() would give it.
+ *
+ * @param metadata - metadata object
+ * @param hty_file_path - path to hty file
+ * @param queries - queries to run; result and row_count are filled in
+ * @param num_queries - number of queries
+ * @return int - 0 on success, -1 on failure (no results are set)
+ */
+int run_batch(cJSON* metadata, const char* hty_file_path, HtyBatchQuery* queries, int num_queries);
+
+/**
+ * @brief Function to parse one line of a query file
+ *
+ * The format is "col1,col2,... [WHERE column op value]" with op one of
+ * >, >=, <, <=, =, !=, e.g. "id,salary WHERE salary >= 40000". The value is
+ * read as a float for float columns.
+ *
+ * @param metadata - metadata object
+ * @param line - line to parse
+ * @param query - query to fill in (free it with free_batch_query)
+ * @return int - 0 on success, -1 on a syntax error or unknown column
+ */
+int parse_batch_query(cJSON* metadata, const char* line, HtyBatchQuery* query);
+
+/**
+ * @brief Function to free the columns and the result of a query
+ *
+ * @param query - query to free (the struct itself is not freed)
+ */
+void free_batch_query(HtyBatchQuery* query);
+
+#endif // HEARTYHTY_BATCH_H
@@ -0,0 +1,188 @@
+/**
+ * @file heartyhty_bloom.c
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Per-row-group split-block Bloom filters
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#include "../third_party/cJSON/cJSON.h"
+#include "heartyhty_functions.h"
+#include "heartyhty_bloom.h"
+#include "heartyhty_pool.h"
+#include "heartyhty_snapshot.h"
+
+// Odd constants that pick one bit in each of the 8 words of a block (same as Parquet)
+static const uint32_t BLOOM_SALT[HTY_BLOOM_BLOCK_WORDS] = {
+    0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+    0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+};
+
+/**
+ * @brief Function to hash a value to 64 bits
+ *
+ * @param value - value (float bits for float columns)
+ * @param is_float - flag to indicate if value is float
+ * @return uint64_t - hash of the value
+ */
+static uint64_t hash_value(int value, int is_float) {
+    if (is_float && value == (int)0x80000000) {
+        value = 0; // -0.0 == 0.0, so both must hash the same
+    }
+    // splitmix64 finalizer
+    uint64_t hash = (uint64_t)(uint32_t)value + 0x9e3779b97f4a7c15ULL;
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+    return hash ^ (hash >> 31);
+}
+
+/**
+ * @brief Function to pick the filter block a hash belongs to
+ *
+ * @param hash - hash of the value
+ * @param num_blocks - number of 256-bit blocks in the filter
+ * @return int - block index
+ */
+static int block_index(uint64_t hash, int num_blocks) {
+    return (int)(((hash >> 32) * (uint64_t)num_blocks) >> 32);
+}
+
+/**
+ * @brief Function to build the bit mask of a hash inside one block
+ *
+ * @param key - low 32 bits of the hash
+ * @param mask - array of 8 words to fill
+ */
+static void block_mask(uint32_t key, uint32_t* mask) {
+    for (int i = 0; i < HTY_BLOOM_BLOCK_WORDS; i++) { // Vectorizes to one multiply and shift per 8 lanes
+        mask[i] = 1U << ((key * BLOOM_SALT[i]) >> 27);
+    }
+}
+
+/**
+ * @brief Function to check one 256-bit block against a hash
+ *
+ * @param block - 8 words of the block
+ * @param key - low 32 bits of the hash
+ * @return int - 1 if every bit of the mask is set
+ */
+static int block_check(const uint32_t* block, uint32_t key) {
+#ifdef __AVX2__
+    __m256i salt = _mm256_loadu_si256((const __m256i*)BLOOM_SALT);
+    __m256i shifts = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_set1_epi32((int)key), salt), 27);
+    __m256i mask = _mm256_sllv_epi32(_mm256_set1_epi32(1), shifts);
+    __m256i bits = _mm256_loadu_si256((const __m256i*)block);
+    return _mm256_testc_si256(bits, mask); // All mask bits present in the block
+#else
+    uint32_t mask[HTY_BLOOM_BLOCK_WORDS];
+    block_mask(key, mask);
+    uint32_t missing = 0;
+    for (int i = 0; i < HTY_BLOOM_BLOCK_WORDS; i++) {
+        missing |= mask[i] & ~block[i];
+    }
+    return missing == 0;
+#endif
+}
+
+int bloom_filter_bytes(int block_rows) {
+    long bits = (long)block_rows * HTY_BLOOM_BITS_PER_VALUE;
+    long num_blocks = (bits + 255) / 256;
+    if (num_blocks < 1) {
+        num_blocks = 1;
+    }
+    return (int)(num_blocks * HTY_BLOOM_BLOCK_WORDS * sizeof(uint32_t));
+}
+
+void bloom_insert(unsigned int* filter, int num_blocks, int value, int is_float) {
+    uint64_t hash = hash_value(value, is_float);
+    uint32_t* block = (uint32_t*)filter + (long)block_index(hash, num_blocks) * HTY_BLOOM_BLOCK_WORDS;
+    uint32_t mask[HTY_BLOOM_BLOCK_WORDS];
+    block_mask((uint32_t)hash, mask);
+    for (int i = 0; i < HTY_BLOOM_BLOCK_WORDS; i++) {
+        block[i] |= mask[i];
+    }
+}
+
+int bloom_check(const unsigned int* filter, int num_blocks, int value, int is_float) {
+    uint64_t hash = hash_value(value, is_float);
+    const uint32_t* block = (const uint32_t*)filter + (long)block_index(hash, num_blocks) * HTY_BLOOM_BLOCK_WORDS;
+    return block_check(block, (uint32_t)hash);
+}
+
+int* bloom_row_groups_to_read(cJSON* metadata, const char* hty_file_path, const char* column_name,
+                              const int* values, int num_values) {
+    cJSON* bloom = cJSON_GetObjectItemCaseSensitive(metadata, "bloom_filters");
+    if (bloom == NULL) {
+        return NULL; // File was written without Bloom filters
+    }
+
+    // Find the position of the column among the filtered columns
+    cJSON* bloom_columns = cJSON_GetObjectItemCaseSensitive(bloom, "columns");
+    int num_bloom_columns = cJSON_GetArraySize(bloom_columns);
+    int bloom_index = -1;
+    int col_idx = 0;
+    cJSON* name;
+    cJSON_ArrayForEach(name, bloom_columns) {
+        if (strcmp(name->valuestring, column_name) == 0) {
+            bloom_index = col_idx;
+            break;
+        }
+        col_idx++;
+    }
+    if (bloom_index == -1) {
+        return NULL;
+    }
+
+    // Column type decides how -0.0 is hashed
+    int is_float = 0;
+    cJSON* columns = cJSON_GetObjectItemCaseSensitive(
+        cJSON_GetArrayItem(cJSON_GetObjectItemCaseSensitive(metadata, "groups"), 0), "columns");
+    cJSON* column;
+    cJSON_ArrayForEach(column, columns) {
+        if (strcmp(cJSON_GetObjectItemCaseSensitive(column, "column_name")->valuestring, column_name) == 0) {
+            is_float = strcmp(cJSON_GetObjectItemCaseSensitive(column, "column_type")->valuestring, "float") == 0;
+            break;
+        }
+    }
+
+    long bloom_offset = (long)cJSON_GetObjectItemCaseSensitive(bloom, "offset")->valuedouble;
+    int filter_bytes = cJSON_GetObjectItemCaseSensitive(bloom, "filter_bytes")->valueint;
+    int num_blocks = filter_bytes / (HTY_BLOOM_BLOCK_WORDS * sizeof(uint32_t));
+    int num_rows = cJSON_GetObjectItemCaseSensitive(metadata, "num_rows")->valueint;
+    int block_rows = get_block_rows(metadata);
+    int num_row_groups = (num_rows + block_rows - 1) / block_rows;
+
+    FILE* file = open_snapshot(hty_file_path);
+    if (file == NULL) {
+        fprintf(stderr, "Error opening file: %s\n", hty_file_path);
+        return NULL;
+    }
+
+    int* to_read = (int*)malloc((num_row_groups + 1) * sizeof(int));
+    for (int group = 0; group < num_row_groups; group++) {
+        // Filters are stored group by group: [group 0: column 0, column 1, ...] [group 1: ...]
+        long filter_offset = bloom_offset + ((long)group * num_bloom_columns + bloom_index) * filter_bytes;
+        to_read[group] = 0;
+        for (int i = 0; i < num_values && !to_read[group]; i++) {
+            uint64_t hash = hash_value(values[i], is_float);
+            uint32_t block[HTY_BLOOM_BLOCK_WORDS];
+            fseek(file, filter_offset + (long)block_index(hash, num_blocks) * sizeof(block), SEEK_SET);
+            if (fread(block, sizeof(block), 1, file) != 1) {
+                to_read[group] = 1; // Unreadable filter, do not skip
+            } else {
+                to_read[group] = block_check(block, (uint32_t)hash);
+            }
+        }
+    }
+    fclose(file);
+    return to_read;
+}
@@ -0,0 +1,61 @@
+/**
+ * @file heartyhty_bloom.h
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Header file for per-row-group split-block Bloom filters
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef HEARTYHTY_BLOOM_H
+#define HEARTYHTY_BLOOM_H
+
+#define HTY_BLOOM_BITS_PER_VALUE 10 // About 1% false positives
+#define HTY_BLOOM_BLOCK_WORDS 8     // 256-bit filter blocks, one cache-line half each
+
+/**
+ * @brief Function to get the size of the Bloom filter of one row group
+ *
+ * @param block_rows - number of rows in a row group
+ * @return int - size of the filter in bytes (a multiple of 32)
+ */
+int bloom_filter_bytes(int block_rows);
+
+/**
+ * @brief Function to add a value to a Bloom filter
+ *
+ * @param filter - filter words
+ * @param num_blocks - number of 256-bit blocks in the filter
+ * @param value - value to add (float bits for float columns)
+ * @param is_float - flag to indicate if value is float
+ */
+void bloom_insert(unsigned int* filter, int num_blocks, int value, int is_float);
+
+/**
+ * @brief Function to check whether a Bloom filter may contain a value
+ *
+ * @param filter - filter words
+ * @param num_blocks - number of 256-bit blocks in the filter
+ * @param value - value to check (float bits for float columns)
+ * @param is_float - flag to indicate if value is float
+ * @return int - 0 if the value is definitely absent, 1 if it may be present
+ */
+int bloom_check(const unsigned int* filter, int num_blocks, int value, int is_float);
+
+/**
+ * @brief Function to find the row groups that may contain any of the given values
+ *
+ * Only the one 256-bit block each value hashes to is read from each row group filter.
+ *
+ * @param metadata - metadata object
+ * @param hty_file_path - path to hty file
+ * @param column_name - column the values belong to
+ * @param values - values to look for (float bits for float columns)
+ * @param num_values - number of values
+ * @return int* - one flag per row group, 1 if it must be read; NULL if the column has no Bloom filter
+ */
+int* bloom_row_groups_to_read(cJSON* metadata, const char* hty_file_path, const char* column_name,
+                              const int* values, int num_values);
+
+#endif // HEARTYHTY_BLOOM_H
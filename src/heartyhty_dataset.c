@@ -0,0 +1,717 @@
+/**
+ * @file heartyhty_dataset.c
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Partitioned multi-file HeartyHTY datasets
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "../third_party/cJSON/cJSON.h"
+#include "heartyhty_functions.h"
+#include "heartyhty_delete.h"
+#include "heartyhty_dataset.h"
+
+/**
+ * @brief Growable list of file paths found while walking the dataset directory
+ */
+typedef struct {
+    char** paths;
+    int count;
+    int capacity;
+} PathList;
+
+/**
+ * @brief Shared state of a parallel dataset scan
+ */
+typedef struct {
+    HtyDataset* dataset;
+    const int* selected;          // Files that survived pruning
+    char** projected_columns;     // Requested columns (may include partition keys)
+    int num_columns;
+    const char* filtered_column;  // NULL when there is no filter
+    int filter_is_partition;      // Filter on a partition key is fully answered by pruning
+    int op;
+    int value;
+    int*** results;               // Per-file result columns
+    int* row_counts;              // Per-file number of rows, -1 on error
+    int next_file;                // Next file to hand out to a worker
+    pthread_mutex_t lock;
+} DatasetScan;
+
+/**
+ * @brief Function to append a path to a path list
+ *
+ * @param list - path list
+ * @param path - path to append (copied)
+ * @return int - 0 on success, -1 on failure
+ */
+static int append_path(PathList* list, const char* path) {
+    if (list->count == list->capacity) {
+        int new_capacity = list->capacity == 0 ? 16 : list->capacity * 2;
+        char** new_paths = (char**)realloc(list->paths, new_capacity * sizeof(char*));
+        if (new_paths == NULL) {
+            return -1;
+        }
+        list->paths = new_paths;
+        list->capacity = new_capacity;
+    }
+    list->paths[list->count] = strdup(path);
+    if (list->paths[list->count] == NULL) {
+        return -1;
+    }
+    list->count++;
+    return 0;
+}
+
+/**
+ * @brief Function to check whether a file name is a finished .hty file
+ *
+ * @param name - file name
+ * @return int - 1 if the file belongs to the dataset
+ */
+static int is_hty_file(const char* name) {
+    size_t length = strlen(name);
+    if (length < 4 || strcmp(name + length - 4, ".hty") != 0) {
+        return 0;
+    }
+    // Skip the temporary files written by add_row before they are renamed
+    if (length >= 9 && strcmp(name + length - 9, "_temp.hty") == 0) {
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Function to collect every .hty file below a directory
+ *
+ * @param directory_path - directory to walk
+ * @param list - path list to append to
+ * @return int - 0 on success, -1 on failure
+ */
+static int collect_files(const char* directory_path, PathList* list) {
+    DIR* directory = opendir(directory_path);
+    if (directory == NULL) {
+        fprintf(stderr, "Error opening directory: %s\n", directory_path);
+        return -1;
+    }
+
+    struct dirent* entry;
+    int status = 0;
+    while (status == 0 && (entry = readdir(directory)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue; // Skip ".", ".." and hidden files
+        }
+        char* child_path = (char*)malloc(strlen(directory_path) + strlen(entry->d_name) + 2);
+        if (child_path == NULL) {
+            status = -1;
+            break;
+        }
+        sprintf(child_path, "%s/%s", directory_path, entry->d_name);
+
+        struct stat info;
+        if (stat(child_path, &info) == 0) {
+            if (S_ISDIR(info.st_mode)) {
+                status = collect_files(child_path, list);
+            } else if (S_ISREG(info.st_mode) && is_hty_file(entry->d_name)) {
+                status = append_path(list, child_path);
+            }
+        }
+        free(child_path);
+    }
+    closedir(directory);
+    return status;
+}
+
+/**
+ * @brief Function to compare two paths for qsort
+ */
+static int compare_paths(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+/**
+ * @brief Function to split the key=value directories of a path into partitions
+ *
+ * @param relative_path - path of the file relative to the dataset root
+ * @param keys - array to store the partition key names
+ * @param values - array to store the partition value strings
+ * @param max_partitions - capacity of keys and values
+ * @return int - number of partitions found
+ */
+static int parse_partitions(const char* relative_path, char** keys, char** values, int max_partitions) {
+    int count = 0;
+    const char* segment = relative_path;
+    const char* slash;
+    // Only directories can be partitions, so the last segment (file name) is ignored
+    while ((slash = strchr(segment, '/')) != NULL && count < max_partitions) {
+        const char* equals = memchr(segment, '=', slash - segment);
+        if (equals != NULL && equals > segment) {
+            keys[count] = strndup(segment, equals - segment);
+            values[count] = strndup(equals + 1, slash - equals - 1);
+            count++;
+        }
+        segment = slash + 1;
+    }
+    return count;
+}
+
+/**
+ * @brief Function to check that two files have the same columns
+ *
+ * @param metadata1 - metadata of the first file
+ * @param metadata2 - metadata of the second file
+ * @return int - 1 if the columns match
+ */
+static int same_columns(cJSON* metadata1, cJSON* metadata2) {
+    cJSON* columns1 = cJSON_GetObjectItemCaseSensitive(
+        cJSON_GetArrayItem(cJSON_GetObjectItemCaseSensitive(metadata1, "groups"), 0), "columns");
+    cJSON* columns2 = cJSON_GetObjectItemCaseSensitive(
+        cJSON_GetArrayItem(cJSON_GetObjectItemCaseSensitive(metadata2, "groups"), 0), "columns");
+    if (cJSON_GetArraySize(columns1) != cJSON_GetArraySize(columns2)) {
+        return 0;
+    }
+    cJSON* column2 = columns2->child;
+    cJSON* column1;
+    cJSON_ArrayForEach(column1, columns1) {
+        if (strcmp(cJSON_GetObjectItemCaseSensitive(column1, "column_name")->valuestring,
+                   cJSON_GetObjectItemCaseSensitive(column2, "column_name")->valuestring) != 0 ||
+            strcmp(cJSON_GetObjectItemCaseSensitive(column1, "column_type")->valuestring,
+                   cJSON_GetObjectItemCaseSensitive(column2, "column_type")->valuestring) != 0) {
+            return 0;
+        }
+        column2 = column2->next;
+    }
+    return 1;
+}
+
+/**
+ * @brief Function to find a column object in the metadata
+ *
+ * @param metadata - metadata object
+ * @param column_name - column name
+ * @return cJSON* - column object, NULL if not found
+ */
+static cJSON* find_column(cJSON* metadata, const char* column_name) {
+    cJSON* columns = cJSON_GetObjectItemCaseSensitive(
+        cJSON_GetArrayItem(cJSON_GetObjectItemCaseSensitive(metadata, "groups"), 0), "columns");
+    cJSON* column;
+    cJSON_ArrayForEach(column, columns) {
+        if (strcmp(cJSON_GetObjectItemCaseSensitive(column, "column_name")->valuestring, column_name) == 0) {
+            return column;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Function to find a partition key
+ *
+ * @param dataset - dataset object
+ * @param column_name - column name
+ * @return int - index of the partition key, -1 if it is not a partition key
+ */
+static int find_partition_key(HtyDataset* dataset, const char* column_name) {
+    for (int i = 0; i < dataset->num_partition_keys; i++) {
+        if (strcmp(dataset->partition_keys[i], column_name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Function to describe the columns of a dataset in the layout of a file's metadata
+ *
+ * Only names and types are kept, the statistics of one file do not hold for the
+ * others, so the SQL front end and resolve_columns() can read a dataset like a file.
+ *
+ * @param dataset - dataset object with its files and partition keys
+ * @return cJSON* - metadata object, NULL on failure
+ */
+static cJSON* describe_dataset(HtyDataset* dataset) {
+    cJSON* metadata = cJSON_CreateObject();
+    cJSON* groups = cJSON_AddArrayToObject(metadata, "groups");
+    cJSON* group = cJSON_CreateObject();
+    cJSON_AddItemToArray(groups, group);
+    cJSON* columns = cJSON_AddArrayToObject(group, "columns");
+    if (columns == NULL) {
+        cJSON_Delete(metadata);
+        return NULL;
+    }
+    long num_rows = 0;
+    for (int i = 0; i < dataset->num_files; i++) {
+        num_rows += count_live_rows(dataset->files[i].metadata);
+    }
+    cJSON_AddNumberToObject(metadata, "num_rows", num_rows);
+
+    cJSON* file_columns = cJSON_GetObjectItemCaseSensitive(
+        cJSON_GetArrayItem(cJSON_GetObjectItemCaseSensitive(dataset->files[0].metadata, "groups"), 0), "columns");
+    cJSON* file_column;
+    cJSON_ArrayForEach(file_column, file_columns) {
+        cJSON* column = cJSON_CreateObject();
+        cJSON_AddStringToObject(column, "column_name", cJSON_GetObjectItemCaseSensitive(file_column, "column_name")->valuestring);
+        cJSON_AddStringToObject(column, "column_type", cJSON_GetObjectItemCaseSensitive(file_column, "column_type")->valuestring);
+        cJSON_AddItemToArray(columns, column);
+    }
+    for (int k = 0; k < dataset->num_partition_keys; k++) {
+        cJSON* column = cJSON_CreateObject();
+        cJSON_AddStringToObject(column, "column_name", dataset->partition_keys[k]);
+        cJSON_AddStringToObject(column, "column_type", dataset->partition_types[k] ? "float" : "int");
+        cJSON_AddItemToArray(columns, column);
+    }
+    cJSON_AddNumberToObject(group, "num_columns", cJSON_GetArraySize(columns));
+    return metadata;
+}
+
+HtyDataset* open_dataset(const char* dataset_path) {
+    PathList list = {NULL, 0, 0};
+    if (collect_files(dataset_path, &list) != 0) {
+        for (int i = 0; i < list.count; i++) {
+            free(list.paths[i]);
+        }
+        free(list.paths);
+        return NULL;
+    }
+    if (list.count == 0) {
+        fprintf(stderr, "No .hty files found in: %s\n", dataset_path);
+        free(list.paths);
+        return NULL;
+    }
+    qsort(list.paths, list.count, sizeof(char*), compare_paths); // Deterministic result order
+
+    HtyDataset* dataset = (HtyDataset*)calloc(1, sizeof(HtyDataset));
+    dataset->root_path = strdup(dataset_path);
+    dataset->files = (HtyDatasetFile*)calloc(list.count, sizeof(HtyDatasetFile));
+    size_t root_length = strlen(dataset_path);
+
+    // Partition value strings of every file, converted once all types are known
+    char*** value_strings = (char***)calloc(list.count, sizeof(char**));
+    int max_partitions = 0;
+    for (int i = 0; i < list.count; i++) {
+        int depth = 0;
+        for (const char* c = list.paths[i] + root_length; *c != '\0'; c++) {
+            depth += (*c == '/');
+        }
+        max_partitions = depth > max_partitions ? depth : max_partitions;
+    }
+
+    int status = 0;
+    for (int i = 0; i < list.count && status == 0; i++) {
+        HtyDatasetFile* file = &dataset->files[i];
+        file->file_path = list.paths[i];
+        list.paths[i] = NULL;
+        dataset->num_files++;
+
+        file->metadata = extract_metadata(file->file_path);
+        if (file->metadata == NULL) {
+            status = -1;
+            break;
+        }
+        if (i > 0 && !same_columns(dataset->files[0].metadata, file->metadata)) {
+            fprintf(stderr, "Columns of %s do not match the rest of the dataset\n", file->file_path);
+            status = -1;
+            break;
+        }
+
+        // Hive-style key=value directories between the root and the file
+        char** keys = (char**)calloc(max_partitions + 1, sizeof(char*));
+        value_strings[i] = (char**)calloc(max_partitions + 1, sizeof(char*));
+        int num_keys = parse_partitions(file->file_path + root_length + 1, keys, value_strings[i], max_partitions);
+        if (i == 0) {
+            dataset->num_partition_keys = num_keys;
+            dataset->partition_keys = keys;
+            dataset->partition_types = (int*)calloc(num_keys + 1, sizeof(int));
+            for (int k = 0; k < num_keys && status == 0; k++) {
+                if (find_column(file->metadata, keys[k]) != NULL) {
+                    fprintf(stderr, "Partition key %s is also a column\n", keys[k]);
+                    status = -1;
+                }
+            }
+        } else {
+            int matches = (num_keys == dataset->num_partition_keys);
+            for (int k = 0; k < num_keys; k++) {
+                matches = matches && strcmp(keys[k], dataset->partition_keys[k]) == 0;
+                free(keys[k]);
+            }
+            free(keys);
+            if (!matches) {
+                fprintf(stderr, "Partition keys of %s do not match the rest of the dataset\n", file->file_path);
+                status = -1;
+            }
+        }
+    }
+
+    if (status == 0) {
+        // A partition key is float if any of its values is written as a decimal, like csv_to_hty does
+        for (int k = 0; k < dataset->num_partition_keys; k++) {
+            for (int i = 0; i < dataset->num_files; i++) {
+                if (strchr(value_strings[i][k], '.') != NULL) {
+                    dataset->partition_types[k] = 1;
+                }
+            }
+        }
+        for (int i = 0; i < dataset->num_files; i++) {
+            dataset->files[i].partition_values = (int*)calloc(dataset->num_partition_keys + 1, sizeof(int));
+            for (int k = 0; k < dataset->num_partition_keys; k++) {
+                if (dataset->partition_types[k] == 1) {
+                    float value = strtof(value_strings[i][k], NULL);
+                    dataset->files[i].partition_values[k] = *(int*)&value;
+                } else {
+                    dataset->files[i].partition_values[k] = atoi(value_strings[i][k]);
+                }
+            }
+        }
+        dataset->metadata = describe_dataset(dataset);
+        if (dataset->metadata == NULL) {
+            status = -1;
+        }
+    }
+
+    // Cleanup
+    for (int i = 0; i < list.count; i++) {
+        free(list.paths[i]);
+        if (value_strings[i] != NULL) {
+            for (int k = 0; k < max_partitions; k++) {
+                free(value_strings[i][k]);
+            }
+            free(value_strings[i]);
+        }
+    }
+    free(value_strings);
+    free(list.paths);
+
+    if (status != 0) {
+        close_dataset(dataset);
+        return NULL;
+    }
+    return dataset;
+}
+
+void close_dataset(HtyDataset* dataset) {
+    if (dataset == NULL) {
+        return;
+    }
+    for (int i = 0; i < dataset->num_files; i++) {
+        free(dataset->files[i].file_path);
+        cJSON_Delete(dataset->files[i].metadata);
+        free(dataset->files[i].partition_values);
+    }
+    for (int k = 0; k < dataset->num_partition_keys; k++) {
+        free(dataset->partition_keys[k]);
+    }
+    free(dataset->partition_keys);
+    free(dataset->partition_types);
+    cJSON_Delete(dataset->metadata);
+    free(dataset->files);
+    free(dataset->root_path);
+    free(dataset);
+}
+
+int dataset_column_type(HtyDataset* dataset, const char* column_name) {
+    int key = find_partition_key(dataset, column_name);
+    if (key >= 0) {
+        return dataset->partition_types[key];
+    }
+    cJSON* column = find_column(dataset->files[0].metadata, column_name);
+    if (column == NULL) {
+        return -1;
+    }
+    return strcmp(cJSON_GetObjectItemCaseSensitive(column, "column_type")->valuestring, "float") == 0 ? 1 : 0;
+}
+
+int prune_dataset(HtyDataset* dataset, const char* filtered_column, int op, int value, int* selected) {
+    int column_type = dataset_column_type(dataset, filtered_column);
+    if (column_type == -1) {
+        fprintf(stderr, "Column not found: %s\n", filtered_column);
+        return -1;
+    }
+    int key = find_partition_key(dataset, filtered_column);
+
+    int num_selected = 0;
+    for (int i = 0; i < dataset->num_files; i++) {
+        HtyDatasetFile* file = &dataset->files[i];
+        if (key >= 0) {
+            // Partition value is the same for every row of the file
+            selected[i] = compare_values(file->partition_values[key], value, op, column_type);
+        } else {
+            int min_value, max_value;
+            cJSON* column = find_column(file->metadata, filtered_column);
+            selected[i] = cJSON_GetObjectItemCaseSensitive(file->metadata, "num_rows")->valueint > 0;
+            if (selected[i] && get_column_range(column, column_type, &min_value, &max_value)) {
+                selected[i] = range_may_match(min_value, max_value, op, value, column_type);
+            }
+        }
+        num_selected += selected[i];
+    }
+    return num_selected;
+}
+
+/**
+ * @brief Function to scan one file of a dataset
+ *
+ * @param scan - shared scan state
+ * @param file_index - index of the file to scan
+ */
+static void scan_file(DatasetScan* scan, int file_index) {
+    HtyDatasetFile* file = &scan->dataset->files[file_index];
+    int num_columns = scan->num_columns;
+    int file_rows = count_live_rows(file->metadata);
+
+    // Only stored columns are read from the file, partition keys are filled in afterwards
+    char** stored_columns = (char**)malloc((num_columns + 1) * sizeof(char*));
+    int* stored_index = (int*)malloc((num_columns + 1) * sizeof(int)); // Position in stored_columns, or -1
+    int num_stored = 0;
+    for (int i = 0; i < num_columns; i++) {
+        if (find_partition_key(scan->dataset, scan->projected_columns[i]) >= 0) {
+            stored_index[i] = -1;
+        } else {
+            stored_index[i] = num_stored;
+            stored_columns[num_stored++] = scan->projected_columns[i];
+        }
+    }
+
+    int** stored_result = NULL;
+    int rows = -1;
+    if (scan->filtered_column == NULL || scan->filter_is_partition) {
+        if (num_stored > 0) {
+            stored_result = project(file->metadata, file->file_path, stored_columns, num_stored, &rows);
+            if (stored_result == NULL && file_rows > 0) {
+                rows = -1;
+            }
+        } else {
+            rows = file_rows;
+        }
+    } else if (num_stored > 0) {
+        stored_result = project_and_filter(file->metadata, file->file_path, stored_columns, num_stored,
+                                           scan->filtered_column, scan->op, scan->value, &rows);
+    } else {
+        // Only partition keys are projected, so just the number of matches is needed
+        int* matches = filter(file->metadata, file->file_path, scan->filtered_column, scan->op, scan->value, &rows);
+        free(matches);
+    }
+
+    int** result = NULL;
+    if (rows > 0) {
+        result = (int**)malloc(num_columns * sizeof(int*));
+        for (int i = 0; i < num_columns; i++) {
+            if (stored_index[i] >= 0) {
+                result[i] = stored_result[stored_index[i]];
+                stored_result[stored_index[i]] = NULL; // Ownership moved to the result
+            } else {
+                int key = find_partition_key(scan->dataset, scan->projected_columns[i]);
+                result[i] = (int*)malloc(rows * sizeof(int));
+                for (int row = 0; row < rows; row++) {
+                    result[i][row] = file->partition_values[key];
+                }
+            }
+        }
+    }
+    if (stored_result != NULL) {
+        for (int i = 0; i < num_stored; i++) {
+            free(stored_result[i]); // Only left over when no row matched
+        }
+        free(stored_result);
+    }
+    free(stored_columns);
+    free(stored_index);
+
+    scan->results[file_index] = result;
+    scan->row_counts[file_index] = rows;
+}
+
+/**
+ * @brief Worker thread that scans files until none are left
+ *
+ * @param arg - shared scan state
+ * @return void* - always NULL
+ */
+static void* scan_worker(void* arg) {
+    DatasetScan* scan = (DatasetScan*)arg;
+    for (;;) {
+        pthread_mutex_lock(&scan->lock);
+        int file_index = scan->next_file;
+        while (file_index < scan->dataset->num_files && !scan->selected[file_index]) {
+            file_index++;
+        }
+        scan->next_file = file_index + 1;
+        pthread_mutex_unlock(&scan->lock);
+
+        if (file_index >= scan->dataset->num_files) {
+            return NULL;
+        }
+        scan_file(scan, file_index);
+    }
+}
+
+/**
+ * @brief Function to run a (possibly filtered) projection over the selected files in parallel
+ *
+ * @param dataset - dataset object
+ * @param projected_columns - array of column names to project
+ * @param num_columns - number of columns to project
+ * @param filtered_column - column to apply filter on, NULL for no filter
+ * @param op - operation for filtering
+ * @param value - value to filter against
+ * @param row_count - pointer to store number of resulting rows, -1 on failure
+ * @return int** - 2D array of data, NULL on failure or when no row matches
+ */
+static int** scan_dataset(HtyDataset* dataset, char** projected_columns, int num_columns,
+                          const char* filtered_column, int op, int value, int* row_count) {
+    *row_count = -1;
+    for (int i = 0; i < num_columns; i++) {
+        if (dataset_column_type(dataset, projected_columns[i]) == -1) {
+            fprintf(stderr, "Column not found: %s\n", projected_columns[i]);
+            return NULL;
+        }
+    }
+
+    // Prune files using partition values and footer statistics
+    int* selected = (int*)malloc(dataset->num_files * sizeof(int));
+    int num_selected = dataset->num_files;
+    if (filtered_column != NULL) {
+        num_selected = prune_dataset(dataset, filtered_column, op, value, selected);
+        if (num_selected == -1) {
+            free(selected);
+            return NULL;
+        }
+    } else {
+        for (int i = 0; i < dataset->num_files; i++) {
+            selected[i] = 1;
+        }
+    }
+
+    DatasetScan scan;
+    memset(&scan, 0, sizeof(scan));
+    scan.dataset = dataset;
+    scan.selected = selected;
+    scan.projected_columns = projected_columns;
+    scan.num_columns = num_columns;
+    scan.filtered_column = filtered_column;
+    scan.filter_is_partition = filtered_column != NULL && find_partition_key(dataset, filtered_column) >= 0;
+    scan.op = op;
+    scan.value = value;
+    scan.results = (int***)calloc(dataset->num_files, sizeof(int**));
+    scan.row_counts = (int*)calloc(dataset->num_files, sizeof(int));
+    pthread_mutex_init(&scan.lock, NULL);
+
+    // Scan the surviving files in parallel
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int num_threads = num_selected < HTY_DATASET_MAX_THREADS ? num_selected : HTY_DATASET_MAX_THREADS;
+    if (num_cpus > 0 && num_threads > num_cpus) {
+        num_threads = (int)num_cpus;
+    }
+    if (num_threads <= 1) {
+        scan_worker(&scan);
+    } else {
+        pthread_t threads[HTY_DATASET_MAX_THREADS];
+        int started = 0;
+        for (int i = 0; i < num_threads; i++) {
+            if (pthread_create(&threads[started], NULL, scan_worker, &scan) == 0) {
+                started++;
+            }
+        }
+        if (started == 0) {
+            scan_worker(&scan); // Fall back to scanning on this thread
+        }
+        for (int i = 0; i < started; i++) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+    pthread_mutex_destroy(&scan.lock);
+
+    // Concatenate the per-file results in file order
+    int total_rows = 0;
+    int failed = 0;
+    for (int i = 0; i < dataset->num_files; i++) {
+        if (!selected[i]) {
+            continue;
+        }
+        if (scan.row_counts[i] < 0) {
+            failed = 1;
+        } else {
+            total_rows += scan.row_counts[i];
+        }
+    }
+
+    int** result = NULL;
+    if (!failed) {
+        result = (int**)malloc(num_columns * sizeof(int*));
+        for (int col = 0; col < num_columns; col++) {
+            result[col] = (int*)malloc(total_rows * sizeof(int));
+        }
+        int position = 0;
+        for (int i = 0; i < dataset->num_files; i++) {
+            if (scan.results[i] == NULL) {
+                continue;
+            }
+            for (int col = 0; col < num_columns; col++) {
+                memcpy(result[col] + position, scan.results[i][col], scan.row_counts[i] * sizeof(int));
+            }
+            position += scan.row_counts[i];
+        }
+        *row_count = total_rows;
+    }
+
+    // Cleanup
+    for (int i = 0; i < dataset->num_files; i++) {
+        if (scan.results[i] != NULL) {
+            for (int col = 0; col < num_columns; col++) {
+                free(scan.results[i][col]);
+            }
+            free(scan.results[i]);
+        }
+    }
+    free(scan.results);
+    free(scan.row_counts);
+    free(selected);
+    return result;
+}
+
+int* dataset_project_single_column(HtyDataset* dataset, const char* projected_column, int* size) {
+    char* columns[1] = {(char*)projected_column};
+    int** result = scan_dataset(dataset, columns, 1, NULL, 0, 0, size);
+    if (result == NULL) {
+        return NULL;
+    }
+    int* column = result[0];
+    free(result);
+    return column;
+}
+
+int* dataset_filter(HtyDataset* dataset, const char* projected_column, int operation, int filtered_value, int* size) {
+    char* columns[1] = {(char*)projected_column};
+    int** result = scan_dataset(dataset, columns, 1, projected_column, operation, filtered_value, size);
+    if (result == NULL) {
+        return NULL;
+    }
+    int* column = result[0];
+    free(result);
+    return column;
+}
+
+int** dataset_project(HtyDataset* dataset, char** projected_columns, int num_columns, int* row_count) {
+    return scan_dataset(dataset, projected_columns, num_columns, NULL, 0, 0, row_count);
+}
+
+int** dataset_project_and_filter(HtyDataset* dataset, char** projected_columns, int num_columns,
+                                 const char* filtered_column, int op, int value, int* row_count) {
+    int** result = scan_dataset(dataset, projected_columns, num_columns, filtered_column, op, value, row_count);
+    if (result != NULL && *row_count == 0) {
+        // Same as project_and_filter: no matching rows gives NULL with a row count of 0
+        for (int i = 0; i < num_columns; i++) {
+            free(result[i]);
+        }
+        free(result);
+        result = NULL;
+    }
+    return result;
+}
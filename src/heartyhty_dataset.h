@@ -0,0 +1,129 @@
+/**
+ * @file heartyhty_dataset.h
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Header file for partitioned multi-file HeartyHTY datasets
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef HEARTYHTY_DATASET_H
+#define HEARTYHTY_DATASET_H
+
+// Maximum number of files scanned at the same time
+#define HTY_DATASET_MAX_THREADS 8
+
+/**
+ * @brief One .hty file of a dataset
+ */
+typedef struct {
+    char* file_path;          // Path to the .hty file
+    cJSON* metadata;          // Metadata (footer) of the file
+    int* partition_values;    // Value of each partition key (float bits for float keys)
+} HtyDatasetFile;
+
+/**
+ * @brief A directory of .hty files sharing the same columns
+ *
+ * Directories named key=value (hive-style) become partition keys. They can be
+ * projected and filtered like ordinary columns and have the same value for
+ * every row of the files below them.
+ */
+typedef struct {
+    char* root_path;              // Directory the dataset was opened from
+    int num_files;                // Number of .hty files
+    HtyDatasetFile* files;        // Files sorted by path
+    int num_partition_keys;       // Number of hive-style partition keys
+    char** partition_keys;        // Partition key names
+    int* partition_types;         // 0 for int, 1 for float
+    cJSON* metadata;              // Columns of the files followed by the partition keys, laid out like a file's metadata
+} HtyDataset;
+
+/**
+ * @brief Function to open every .hty file below a directory as one dataset
+ *
+ * @param dataset_path - path to the dataset directory
+ * @return HtyDataset* - dataset object, NULL on failure
+ */
+HtyDataset* open_dataset(const char* dataset_path);
+
+/**
+ * @brief Function to close a dataset
+ *
+ * @param dataset - dataset object
+ */
+void close_dataset(HtyDataset* dataset);
+
+/**
+ * @brief Function to get the type of a dataset column or partition key
+ *
+ * @param dataset - dataset object
+ * @param column_name - column name
+ * @return int - 0 for int, 1 for float, -1 if not found
+ */
+int dataset_column_type(HtyDataset* dataset, const char* column_name);
+
+/**
+ * @brief Function to select the files that may contain rows matching a predicate
+ *
+ * Files are pruned by their partition values and by the footer min/max statistics.
+ *
+ * @param dataset - dataset object
+ * @param filtered_column - column to apply filter on
+ * @param op - operation for filtering
+ * @param value - value to filter against
+ * @param selected - array of num_files flags set to 1 for files that must be scanned
+ * @return int - number of files that must be scanned, -1 if the column is not found
+ */
+int prune_dataset(HtyDataset* dataset, const char* filtered_column, int op, int value, int* selected);
+
+/**
+ * @brief Function to project a single column over all files of a dataset
+ *
+ * @param dataset - dataset object
+ * @param projected_column - column to project
+ * @param size - size of the result
+ * @return int* - projected data
+ */
+int* dataset_project_single_column(HtyDataset* dataset, const char* projected_column, int* size);
+
+/**
+ * @brief Function to filter a column over all files of a dataset
+ *
+ * @param dataset - dataset object
+ * @param projected_column - column to project
+ * @param operation - operation to perform
+ * @param filtered_value - value to filter
+ * @param size - size of the result
+ * @return int* - filtered data
+ */
+int* dataset_filter(HtyDataset* dataset, const char* projected_column, int operation, int filtered_value, int* size);
+
+/**
+ * @brief Function to project multiple columns over all files of a dataset
+ *
+ * @param dataset - dataset object
+ * @param projected_columns - array of column names to project
+ * @param num_columns - number of columns to project
+ * @param row_count - pointer to store number of rows, -1 on failure
+ * @return int** - 2D array of projected data
+ */
+int** dataset_project(HtyDataset* dataset, char** projected_columns, int num_columns, int* row_count);
+
+/**
+ * @brief Function to project columns with filtering over all files of a dataset
+ *
+ * @param dataset - dataset object
+ * @param projected_columns - array of column names to project
+ * @param num_columns - number of columns to project
+ * @param filtered_column - column to apply filter on
+ * @param op - operation for filtering
+ * @param value - value to filter against
+ * @param row_count - pointer to store number of resulting rows, -1 on failure
+ * @return int** - 2D array of filtered and projected data, NULL with a row count of 0 when no row matches
+ */
+int** dataset_project_and_filter(HtyDataset* dataset, char** projected_columns, int num_columns,
+                                 const char* filtered_column, int op, int value, int* row_count);
+
+#endif // HEARTYHTY_DATASET_H
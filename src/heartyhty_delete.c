@@ -0,0 +1,890 @@
+/**
+ * @file heartyhty_delete.c
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Deletion bitmaps, in-place updates and compaction of .hty files
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "../third_party/cJSON/cJSON.h"
+#include "heartyhty_functions.h"
+#include "heartyhty_writer.h"
+#include "heartyhty_sort.h"
+#include "heartyhty_bloom.h"
+#include "heartyhty_index.h"
+#include "heartyhty_pool.h"
+#include "heartyhty_results.h"
+#include "heartyhty_snapshot.h"
+#include "heartyhty_delete.h"
+
+/**
+ * @brief Function to find the container of a key
+ *
+ * @param bitmap - bitmap
+ * @param key - upper 16 bits of a row id
+ * @return int - position of the container, or -(insert position) - 1 if there is none
+ */
+static int find_container(const HtyRowBitmap* bitmap, int key) {
+    int low = 0;
+    int high = bitmap->num_containers;
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (bitmap->containers[middle].key < key) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    if (low < bitmap->num_containers && bitmap->containers[low].key == key) {
+        return low;
+    }
+    return -low - 1;
+}
+
+/**
+ * @brief Function to find the first value of an array container that is not below a value
+ *
+ * @param values - sorted values
+ * @param count - number of values
+ * @param value - value to search for
+ * @return int - position of the first value >= value
+ */
+static int lower_bound(const uint16_t* values, int count, int value) {
+    int low = 0;
+    int high = count;
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (values[middle] < value) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+int bitmap_contains(const HtyRowBitmap* bitmap, int row) {
+    int position = find_container(bitmap, row >> 16);
+    if (position < 0) {
+        return 0;
+    }
+    const HtyBitmapContainer* container = &bitmap->containers[position];
+    int low = row & 0xffff;
+    if (container->bits != NULL) {
+        return (int)((container->bits[low >> 6] >> (low & 63)) & 1);
+    }
+    int found = lower_bound(container->values, container->cardinality, low);
+    return found < container->cardinality && container->values[found] == low;
+}
+
+int bitmap_add(HtyRowBitmap* bitmap, int row) {
+    int key = row >> 16;
+    int low = row & 0xffff;
+    int position = find_container(bitmap, key);
+    if (position < 0) {
+        position = -position - 1;
+        if (bitmap->num_containers == bitmap->capacity) {
+            int capacity = bitmap->capacity > 0 ? 2 * bitmap->capacity : 4;
+            HtyBitmapContainer* grown = (HtyBitmapContainer*)realloc(bitmap->containers,
+                                                                     capacity * sizeof(HtyBitmapContainer));
+            if (grown == NULL) {
+                fprintf(stderr, "Memory allocation failed\n");
+                return -1;
+            }
+            bitmap->containers = grown;
+            bitmap->capacity = capacity;
+        }
+        memmove(&bitmap->containers[position + 1], &bitmap->containers[position],
+                (bitmap->num_containers - position) * sizeof(HtyBitmapContainer));
+        memset(&bitmap->containers[position], 0, sizeof(HtyBitmapContainer));
+        bitmap->containers[position].key = key;
+        bitmap->num_containers++;
+    }
+    HtyBitmapContainer* container = &bitmap->containers[position];
+
+    // Array containers turn into bitmaps once a bitmap is the smaller of the two
+    if (container->bits == NULL) {
+        int found = lower_bound(container->values, container->cardinality, low);
+        if (found < container->cardinality && container->values[found] == low) {
+            return 0;
+        }
+        if (container->cardinality < HTY_BITMAP_ARRAY_MAX) {
+            int count = container->cardinality;
+            if (count == 0 || (count >= 4 && (count & (count - 1)) == 0)) {
+                uint16_t* grown = (uint16_t*)realloc(container->values, (count == 0 ? 4 : 2 * count) * sizeof(uint16_t));
+                if (grown == NULL) {
+                    fprintf(stderr, "Memory allocation failed\n");
+                    return -1;
+                }
+                container->values = grown;
+            }
+            memmove(&container->values[found + 1], &container->values[found], (count - found) * sizeof(uint16_t));
+            container->values[found] = (uint16_t)low;
+            container->cardinality++;
+            bitmap->cardinality++;
+            return 1;
+        }
+        container->bits = (uint64_t*)calloc(HTY_BITMAP_WORDS, sizeof(uint64_t));
+        if (container->bits == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            return -1;
+        }
+        for (int i = 0; i < container->cardinality; i++) {
+            container->bits[container->values[i] >> 6] |= 1ULL << (container->values[i] & 63);
+        }
+        free(container->values);
+        container->values = NULL;
+    }
+    uint64_t bit = 1ULL << (low & 63);
+    if (container->bits[low >> 6] & bit) {
+        return 0;
+    }
+    container->bits[low >> 6] |= bit;
+    container->cardinality++;
+    bitmap->cardinality++;
+    return 1;
+}
+
+void free_bitmap(HtyRowBitmap* bitmap) {
+    for (int i = 0; i < bitmap->num_containers; i++) {
+        free(bitmap->containers[i].values);
+        free(bitmap->containers[i].bits);
+    }
+    free(bitmap->containers);
+    memset(bitmap, 0, sizeof(HtyRowBitmap));
+}
+
+int select_live_rows(const HtyRowBitmap* deleted, int first_row, int num_rows, int* selection) {
+    int live = 0;
+    int row = first_row;
+    int end = first_row + num_rows;
+    while (row < end) {
+        // Rows up to the end of the container of this row
+        int key = row >> 16;
+        long container_end = (long)(key + 1) << 16;
+        int chunk_end = container_end < end ? (int)container_end : end;
+        int position = find_container(deleted, key);
+        if (position < 0) {
+            for (; row < chunk_end; row++) {
+                selection[live++] = row - first_row;
+            }
+            continue;
+        }
+        const HtyBitmapContainer* container = &deleted->containers[position];
+        if (container->bits != NULL) {
+            for (; row < chunk_end; row++) {
+                int low = row & 0xffff;
+                if (!((container->bits[low >> 6] >> (low & 63)) & 1)) {
+                    selection[live++] = row - first_row;
+                }
+            }
+        } else {
+            // Walk the sorted deleted rows alongside the row group
+            int next = lower_bound(container->values, container->cardinality, row & 0xffff);
+            for (; row < chunk_end; row++) {
+                if (next < container->cardinality && container->values[next] == (row & 0xffff)) {
+                    next++;
+                } else {
+                    selection[live++] = row - first_row;
+                }
+            }
+        }
+    }
+    return live;
+}
+
+/**
+ * @brief Function to write a bitmap
+ *
+ * Containers are written one after another as key, cardinality and either
+ * the sorted lower 16 bits or the HTY_BITMAP_WORDS bitmap words.
+ *
+ * @param bitmap - bitmap
+ * @param file - file positioned where the bitmap goes
+ * @return int - 0 on success, -1 on failure
+ */
+static int write_bitmap(const HtyRowBitmap* bitmap, FILE* file) {
+    if (fwrite(&bitmap->num_containers, sizeof(int), 1, file) != 1) {
+        return -1;
+    }
+    for (int i = 0; i < bitmap->num_containers; i++) {
+        const HtyBitmapContainer* container = &bitmap->containers[i];
+        if (fwrite(&container->key, sizeof(int), 1, file) != 1 ||
+            fwrite(&container->cardinality, sizeof(int), 1, file) != 1) {
+            return -1;
+        }
+        if (container->bits != NULL) {
+            if (fwrite(container->bits, sizeof(uint64_t), HTY_BITMAP_WORDS, file) != HTY_BITMAP_WORDS) {
+                return -1;
+            }
+        } else if (fwrite(container->values, sizeof(uint16_t), container->cardinality, file) !=
+                   (size_t)container->cardinality) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Function to read a bitmap written by write_bitmap()
+ *
+ * @param bitmap - bitmap to fill in
+ * @param file - file positioned at the bitmap
+ * @return int - 0 on success, -1 on failure
+ */
+static int read_bitmap(HtyRowBitmap* bitmap, FILE* file) {
+    memset(bitmap, 0, sizeof(HtyRowBitmap));
+    int num_containers;
+    if (fread(&num_containers, sizeof(int), 1, file) != 1 || num_containers < 0) {
+        return -1;
+    }
+    bitmap->containers = (HtyBitmapContainer*)calloc(num_containers + 1, sizeof(HtyBitmapContainer));
+    if (bitmap->containers == NULL) {
+        return -1;
+    }
+    bitmap->capacity = num_containers + 1;
+    for (int i = 0; i < num_containers; i++) {
+        HtyBitmapContainer* container = &bitmap->containers[i];
+        if (fread(&container->key, sizeof(int), 1, file) != 1 || fread(&container->cardinality, sizeof(int), 1, file) != 1 ||
+            container->cardinality <= 0 || container->cardinality > 65536) {
+            return -1;
+        }
+        bitmap->num_containers++;
+        bitmap->cardinality += container->cardinality;
+        if (container->cardinality > HTY_BITMAP_ARRAY_MAX) {
+            container->bits = (uint64_t*)malloc(HTY_BITMAP_WORDS * sizeof(uint64_t));
+            if (container->bits == NULL || fread(container->bits, sizeof(uint64_t), HTY_BITMAP_WORDS, file) != HTY_BITMAP_WORDS) {
+                return -1;
+            }
+        } else {
+            // Room for bitmap_add() to grow the array in place
+            int capacity = 4;
+            while (capacity < container->cardinality) {
+                capacity *= 2;
+            }
+            container->values = (uint16_t*)malloc(capacity * sizeof(uint16_t));
+            if (container->values == NULL ||
+                fread(container->values, sizeof(uint16_t), container->cardinality, file) != (size_t)container->cardinality) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+int load_deleted_rows(cJSON* metadata, const char* hty_file_path, HtyRowBitmap* deleted) {
+    memset(deleted, 0, sizeof(HtyRowBitmap));
+    cJSON* deletes = cJSON_GetObjectItemCaseSensitive(metadata, "deletes");
+    if (deletes == NULL) {
+        return 0; // Nothing was ever deleted
+    }
+    FILE* file = open_snapshot(hty_file_path);
+    if (file == NULL) {
+        fprintf(stderr, "Error opening file: %s\n", hty_file_path);
+        return -1;
+    }
+    fseek(file, (long)cJSON_GetObjectItemCaseSensitive(deletes, "offset")->valuedouble, SEEK_SET);
+    int status = read_bitmap(deleted, file);
+    fclose(file);
+    if (status != 0) {
+        fprintf(stderr, "Error reading deleted rows\n");
+        free_bitmap(deleted);
+        return -1;
+    }
+    return deleted->cardinality > 0;
+}
+
+int count_live_rows(cJSON* metadata) {
+    int num_rows = cJSON_GetObjectItemCaseSensitive(metadata, "num_rows")->valueint;
+    cJSON* deletes = cJSON_GetObjectItemCaseSensitive(metadata, "deletes");
+    if (deletes == NULL) {
+        return num_rows;
+    }
+    return num_rows - cJSON_GetObjectItemCaseSensitive(deletes, "rows")->valueint;
+}
+
+/**
+ * @brief Function to overwrite the deletion bitmap and metadata at the end of a file
+ *
+ * @param metadata - metadata object to write ("deletes" is set here)
+ * @param file - file opened for writing and locked with lock_snapshot_writer()
+ * @param deleted - deleted rows, empty for none
+ * @return int - 0 on success, -1 on failure
+ */
+static int write_tail(cJSON* metadata, FILE* file, const HtyRowBitmap* deleted) {
+    // The old metadata starts right after the sections before it; an old bitmap sits just before it
+    int metadata_size;
+    fseek(file, -(long)sizeof(int), SEEK_END);
+    long start = ftell(file);
+    if (fread(&metadata_size, sizeof(int), 1, file) != 1 || metadata_size <= 0 || metadata_size > start) {
+        fprintf(stderr, "Error reading metadata size\n");
+        return -1;
+    }
+    start -= metadata_size;
+    cJSON* deletes = cJSON_GetObjectItemCaseSensitive(metadata, "deletes");
+    if (deletes != NULL && (long)cJSON_GetObjectItemCaseSensitive(deletes, "offset")->valuedouble < start) {
+        start = (long)cJSON_GetObjectItemCaseSensitive(deletes, "offset")->valuedouble;
+    }
+    cJSON_DeleteItemFromObjectCaseSensitive(metadata, "deletes");
+
+    fseek(file, start, SEEK_SET);
+    int status = 0;
+    if (deleted->cardinality > 0) {
+        status = write_bitmap(deleted, file);
+        deletes = cJSON_AddObjectToObject(metadata, "deletes");
+        cJSON_AddNumberToObject(deletes, "offset", start);
+        cJSON_AddNumberToObject(deletes, "rows", deleted->cardinality);
+    }
+    char* metadata_str = status == 0 ? cJSON_PrintUnformatted(metadata) : NULL;
+    if (metadata_str != NULL) {
+        metadata_size = strlen(metadata_str);
+        if (fwrite(metadata_str, 1, metadata_size, file) != (size_t)metadata_size ||
+            fwrite(&metadata_size, sizeof(int), 1, file) != 1 || fflush(file) != 0 ||
+            ftruncate(fileno(file), ftell(file)) != 0) {
+            status = -1;
+        }
+        free(metadata_str);
+    } else {
+        status = -1;
+    }
+    return status;
+}
+
+int write_deleted_rows(cJSON* metadata, const char* hty_file_path, const HtyRowBitmap* deleted) {
+    FILE* file = fopen(hty_file_path, "r+b");
+    if (file == NULL) {
+        fprintf(stderr, "Error opening file: %s\n", hty_file_path);
+        return -1;
+    }
+    int status = lock_snapshot_writer(file);
+    if (status == 0) {
+        status = write_tail(metadata, file, deleted);
+    }
+    fclose(file);
+    if (status != 0) {
+        fprintf(stderr, "Error writing metadata: %s\n", hty_file_path);
+        return -1;
+    }
+
+    // Cached blocks and results of the old version are stale
+    invalidate_buffer_pool(hty_file_path);
+    invalidate_result_cache(hty_file_path);
+    return 0;
+}
+
+/**
+ * @brief Function to find the live rows matching a predicate
+ *
+ * @param metadata - metadata object
+ * @param hty_file_path - path to hty file
+ * @param column_index - column to filter
+ * @param column_name - name of the column
+ * @param is_float - flag to indicate if the column is float
+ * @param op - operation for filtering
+ * @param value - value to filter against
+ * @param rows - pointer to store the matching row ids, ascending (free it)
+ * @return int - number of matching rows, -1 on failure
+ */
+static int find_matching_rows(cJSON* metadata, const char* hty_file_path, int column_index, const char* column_name,
+                              int is_float, int op, int value, int** rows) {
+    int* row_groups = row_groups_to_read(metadata, hty_file_path, column_name, column_index, is_float, op, &value, 1);
+    HtyColumnReader* reader = open_column_reader(metadata, hty_file_path, &column_index, 1, row_groups);
+    free(row_groups);
+    if (reader == NULL) {
+        return -1;
+    }
+    int capacity = 1024;
+    int count = 0;
+    *rows = (int*)malloc(capacity * sizeof(int));
+    int** block;
+    int first_row, rows_in_block, got = 0;
+    while (*rows != NULL && (got = next_column_block(reader, &block, &first_row, &rows_in_block)) == 1) {
+        const int* row_ids = column_block_row_ids(reader);
+        if (count + rows_in_block > capacity) {
+            capacity = 2 * capacity > count + rows_in_block ? 2 * capacity : count + rows_in_block;
+            int* grown = (int*)realloc(*rows, capacity * sizeof(int));
+            if (grown == NULL) {
+                free(*rows);
+                *rows = NULL;
+                break;
+            }
+            *rows = grown;
+        }
+        for (int i = 0; i < rows_in_block; i++) {
+            if (compare_values(block[0][i], value, op, is_float)) {
+                (*rows)[count++] = row_ids != NULL ? row_ids[i] : first_row + i;
+            }
+        }
+    }
+    close_column_reader(reader);
+    if (*rows == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    if (got == -1) {
+        free(*rows);
+        return -1;
+    }
+    return count;
+}
+
+int delete_rows(cJSON* metadata, const char* hty_file_path, const int* rows, int num_rows) {
+    int total_rows = cJSON_GetObjectItemCaseSensitive(metadata, "num_rows")->valueint;
+    for (int i = 0; i < num_rows; i++) {
+        if (rows[i] < 0 || rows[i] >= total_rows) {
+            fprintf(stderr, "Row out of range: %d\n", rows[i]);
+            return -1;
+        }
+    }
+    HtyRowBitmap deleted;
+    if (load_deleted_rows(metadata, hty_file_path, &deleted) < 0) {
+        return -1;
+    }
+    int added = 0;
+    for (int i = 0; i < num_rows; i++) {
+        int status = bitmap_add(&deleted, rows[i]);
+        if (status < 0) {
+            free_bitmap(&deleted);
+            return -1;
+        }
+        added += status;
+    }
+    int status = added > 0 ? write_deleted_rows(metadata, hty_file_path, &deleted) : 0;
+    long num_deleted = deleted.cardinality;
+    free_bitmap(&deleted);
+    if (status != 0) {
+        return -1;
+    }
+
+    // Scans pay for every dead row they skip; rewrite the file once there are many
+    if (added > 0 && num_deleted >= HTY_COMPACT_DEAD_RATIO * total_rows && compact_file(metadata, hty_file_path) != 0) {
+        return -1;
+    }
+    return added;
+}
+
+int delete_where(cJSON* metadata, const char* hty_file_path, const char* column_name, int op, int value) {
+    int column_index, is_float;
+    char* name = (char*)column_name;
+    if (resolve_columns(metadata, &name, 1, &column_index, &is_float) != 0) {
+        return -1;
+    }
+    int* rows;
+    int count = find_matching_rows(metadata, hty_file_path, column_index, column_name, is_float, op, value, &rows);
+    if (count < 0) {
+        return -1;
+    }
+    int status = count > 0 ? delete_rows(metadata, hty_file_path, rows, count) : 0;
+    free(rows);
+    return status < 0 ? -1 : count;
+}
+
+/**
+ * @brief Function to order row ids for qsort and bsearch
+ */
+static int compare_rows(const void* a, const void* b) {
+    int row1 = *(const int*)a;
+    int row2 = *(const int*)b;
+    return (row1 > row2) - (row1 < row2);
+}
+
+/**
+ * @brief Function to widen the footer min/max of a column to cover a new value
+ *
+ * @param column - column object from the metadata
+ * @param value - new value (float bits for float columns)
+ * @param is_float - flag to indicate if the column is float
+ */
+static void widen_column_range(cJSON* column, int value, int is_float) {
+    int min_value, max_value;
+    if (!get_column_range(column, is_float, &min_value, &max_value)) {
+        return; // Unknown range stays unknown
+    }
+    float float_value = *(float*)&value;
+    if (is_float && float_value != float_value) {
+        cJSON_DeleteItemFromObjectCaseSensitive(column, "min"); // NaN has no place in a min/max range
+        cJSON_DeleteItemFromObjectCaseSensitive(column, "max");
+        return;
+    }
+    double number = is_float ? (double)float_value : (double)value;
+    if (compare_values(value, min_value, OP_LESS, is_float)) {
+        cJSON_ReplaceItemInObjectCaseSensitive(column, "min", cJSON_CreateNumber(number));
+    }
+    if (compare_values(value, max_value, OP_GREATER, is_float)) {
+        cJSON_ReplaceItemInObjectCaseSensitive(column, "max", cJSON_CreateNumber(number));
+    }
+}
+
+/**
+ * @brief Function to widen the zone maps and Bloom filters of the row groups of some rows to cover a new value
+ *
+ * @param metadata - metadata object
+ * @param file - open hty file
+ * @param rows - updated row ids, ascending
+ * @param num_rows - number of row ids
+ * @param column_index - updated column
+ * @param column_name - name of the column
+ * @param value - new value (float bits for float columns)
+ * @param is_float - flag to indicate if the column is float
+ * @return int - 0 on success, -1 on failure
+ */
+static int widen_row_groups(cJSON* metadata, FILE* file, const int* rows, int num_rows, int column_index,
+                            const char* column_name, int value, int is_float) {
+    cJSON* columns = cJSON_GetObjectItemCaseSensitive(
+        cJSON_GetArrayItem(cJSON_GetObjectItemCaseSensitive(metadata, "groups"), 0), "columns");
+    int total_columns = cJSON_GetArraySize(columns);
+    int block_rows = get_block_rows(metadata);
+    cJSON* zone_maps = cJSON_GetObjectItemCaseSensitive(metadata, "zone_maps");
+    long zone_offset = zone_maps != NULL ? (long)cJSON_GetObjectItemCaseSensitive(zone_maps, "offset")->valuedouble : -1;
+    uint32_t encoded = encode_sort_value(value, is_float);
+
+    // Position of the column among the Bloom filter columns, if it has them
+    cJSON* bloom = cJSON_GetObjectItemCaseSensitive(metadata, "bloom_filters");
+    int bloom_index = -1;
+    int num_bloom_columns = 0;
+    if (bloom != NULL) {
+        cJSON* bloom_column;
+        cJSON_ArrayForEach(bloom_column, cJSON_GetObjectItemCaseSensitive(bloom, "columns")) {
+            if (strcmp(bloom_column->valuestring, column_name) == 0) {
+                bloom_index = num_bloom_columns;
+            }
+            num_bloom_columns++;
+        }
+    }
+    int filter_bytes = bloom_index >= 0 ? cJSON_GetObjectItemCaseSensitive(bloom, "filter_bytes")->valueint : 0;
+    unsigned int* filter = bloom_index >= 0 ? (unsigned int*)malloc(filter_bytes) : NULL;
+    if (bloom_index >= 0 && filter == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+
+    int status = 0;
+    for (int i = 0; i < num_rows && status == 0; i++) {
+        long group = rows[i] / block_rows;
+        if (i > 0 && rows[i - 1] / block_rows == group) {
+            continue; // Row group already covers the value
+        }
+        if (zone_offset >= 0) {
+            uint32_t zone[2];
+            long position = zone_offset + (group * total_columns + column_index) * 2 * (long)sizeof(uint32_t);
+            fseek(file, position, SEEK_SET);
+            if (fread(zone, sizeof(uint32_t), 2, file) != 2) {
+                status = -1;
+                break;
+            }
+            if (encoded < zone[0] || encoded > zone[1]) {
+                zone[0] = encoded < zone[0] ? encoded : zone[0];
+                zone[1] = encoded > zone[1] ? encoded : zone[1];
+                fseek(file, position, SEEK_SET);
+                status = fwrite(zone, sizeof(uint32_t), 2, file) == 2 ? 0 : -1;
+            }
+        }
+        if (bloom_index >= 0 && status == 0) {
+            // Filters are stored group by group: [group 0: column 0, column 1, ...] [group 1: ...]
+            long position = (long)cJSON_GetObjectItemCaseSensitive(bloom, "offset")->valuedouble +
+                            (group * num_bloom_columns + bloom_index) * filter_bytes;
+            fseek(file, position, SEEK_SET);
+            if (fread(filter, 1, filter_bytes, file) != (size_t)filter_bytes) {
+                status = -1;
+                break;
+            }
+            bloom_insert(filter, filter_bytes / (HTY_BLOOM_BLOCK_WORDS * sizeof(unsigned int)), value, is_float);
+            fseek(file, position, SEEK_SET);
+            status = fwrite(filter, 1, filter_bytes, file) == (size_t)filter_bytes ? 0 : -1;
+        }
+    }
+    free(filter);
+    if (status != 0) {
+        fprintf(stderr, "Error updating row group statistics\n");
+    }
+    return status;
+}
+
+/**
+ * @brief Function to patch the sampled rows among some updated rows
+ *
+ * @param metadata - metadata object
+ * @param file - open hty file
+ * @param rows - updated row ids, ascending
+ * @param num_rows - number of row ids
+ * @param column_index - updated column
+ * @param value - new value (float bits for float columns)
+ * @return int - 0 on success, -1 on failure
+ */
+static int patch_row_sample(cJSON* metadata, FILE* file, const int* rows, int num_rows, int column_index, int value) {
+    cJSON* row_sample = cJSON_GetObjectItemCaseSensitive(metadata, "row_sample");
+    cJSON* row_ids_offset = cJSON_GetObjectItemCaseSensitive(row_sample, "row_ids_offset");
+    if (row_sample == NULL) {
+        return 0; // No sample to keep up to date
+    }
+    if (!cJSON_IsNumber(row_ids_offset)) {
+        cJSON_DeleteItemFromObjectCaseSensitive(metadata, "row_sample"); // Cannot tell which rows it holds
+        return 0;
+    }
+    long sample_offset = (long)cJSON_GetObjectItemCaseSensitive(row_sample, "offset")->valuedouble;
+    int sample_rows = cJSON_GetObjectItemCaseSensitive(row_sample, "rows")->valueint;
+    int* row_ids = (int*)malloc((sample_rows + 1) * sizeof(int));
+    if (row_ids == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    fseek(file, (long)row_ids_offset->valuedouble, SEEK_SET);
+    int status = fread(row_ids, sizeof(int), sample_rows, file) == (size_t)sample_rows ? 0 : -1;
+    for (int s = 0; s < sample_rows && status == 0; s++) {
+        if (bsearch(&row_ids[s], rows, num_rows, sizeof(int), compare_rows) != NULL) {
+            fseek(file, sample_offset + ((long)column_index * sample_rows + s) * sizeof(int), SEEK_SET);
+            status = fwrite(&value, sizeof(int), 1, file) == 1 ? 0 : -1;
+        }
+    }
+    free(row_ids);
+    if (status != 0) {
+        fprintf(stderr, "Error updating row sample\n");
+    }
+    return status;
+}
+
+int update_rows(cJSON* metadata, const char* hty_file_path, const int* rows, int num_rows, const char* column_name,
+                int value) {
+    int column_index, is_float;
+    char* name = (char*)column_name;
+    if (resolve_columns(metadata, &name, 1, &column_index, &is_float) != 0) {
+        return -1;
+    }
+    int total_rows = cJSON_GetObjectItemCaseSensitive(metadata, "num_rows")->valueint;
+    for (int i = 0; i < num_rows; i++) {
+        if (rows[i] < 0 || rows[i] >= total_rows) {
+            fprintf(stderr, "Row out of range: %d\n", rows[i]);
+            return -1;
+        }
+    }
+    if (num_rows == 0) {
+        return 0;
+    }
+    int* sorted_rows = (int*)malloc(num_rows * sizeof(int));
+    if (sorted_rows == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    memcpy(sorted_rows, rows, num_rows * sizeof(int));
+    qsort(sorted_rows, num_rows, sizeof(int), compare_rows);
+
+    FILE* file = fopen(hty_file_path, "r+b");
+    if (file == NULL) {
+        fprintf(stderr, "Error opening file: %s\n", hty_file_path);
+        free(sorted_rows);
+        return -1;
+    }
+    if (lock_snapshot_writer(file) != 0) {
+        fclose(file);
+        free(sorted_rows);
+        return -1;
+    }
+
+    // Rows have a fixed width, so each new value goes straight into its slot
+    HtyRowLayout layout;
+    get_row_layout(metadata, &layout);
+    int status = 0;
+    for (int i = 0; i < num_rows && status == 0; i++) {
+        fseek(file, row_position(&layout, sorted_rows[i]) + column_index * sizeof(int), SEEK_SET);
+        status = fwrite(&value, sizeof(int), 1, file) == 1 ? 0 : -1;
+    }
+    if (status != 0) {
+        fprintf(stderr, "Error writing row data\n");
+    }
+
+    // Keep everything that prunes or answers queries covering the new value
+    if (status == 0) {
+        status = widen_row_groups(metadata, file, sorted_rows, num_rows, column_index, column_name, value, is_float);
+    }
+    if (status == 0) {
+        status = patch_row_sample(metadata, file, sorted_rows, num_rows, column_index, value);
+    }
+    free(sorted_rows);
+    cJSON* column = cJSON_GetArrayItem(cJSON_GetObjectItemCaseSensitive(
+        cJSON_GetArrayItem(cJSON_GetObjectItemCaseSensitive(metadata, "groups"), 0), "columns"), column_index);
+    widen_column_range(column, value, is_float);
+
+    // Rows are no longer in the order of a sort key on this column
+    cJSON* sort_key = cJSON_GetObjectItemCaseSensitive(metadata, "sort_key");
+    cJSON* sort_column;
+    cJSON_ArrayForEach(sort_column, cJSON_GetObjectItemCaseSensitive(sort_key, "columns")) {
+        if (strcmp(sort_column->valuestring, column_name) == 0) {
+            cJSON_DeleteItemFromObjectCaseSensitive(metadata, "sort_key");
+            break;
+        }
+    }
+
+    // Write the metadata even after a failure, so it covers whatever was patched; readers wait until it is
+    HtyRowBitmap deleted;
+    if (load_deleted_rows(metadata, hty_file_path, &deleted) < 0 || write_tail(metadata, file, &deleted) != 0) {
+        fprintf(stderr, "Error writing metadata: %s\n", hty_file_path);
+        status = -1;
+    }
+    free_bitmap(&deleted);
+    fclose(file);
+    invalidate_buffer_pool(hty_file_path);
+    invalidate_result_cache(hty_file_path);
+
+    // An index on the column holds the old values
+    char* index_path = index_file_path(hty_file_path, column_name);
+    if (index_path != NULL && access(index_path, F_OK) == 0 && build_index(metadata, hty_file_path, column_name) != 0) {
+        remove(index_path); // Better no index than a wrong one
+    }
+    free(index_path);
+    return status == 0 ? num_rows : -1;
+}
+
+int update_where(cJSON* metadata, const char* hty_file_path, const char* filtered_column, int op, int filtered_value,
+                 const char* column_name, int value) {
+    int column_index, is_float;
+    char* name = (char*)filtered_column;
+    if (resolve_columns(metadata, &name, 1, &column_index, &is_float) != 0) {
+        return -1;
+    }
+    int* rows;
+    int count = find_matching_rows(metadata, hty_file_path, column_index, filtered_column, is_float, op,
+                                   filtered_value, &rows);
+    if (count < 0) {
+        return -1;
+    }
+    int status = count > 0 ? update_rows(metadata, hty_file_path, rows, count, column_name, value) : 0;
+    free(rows);
+    return status;
+}
+
+int compact_file(cJSON* metadata, const char* hty_file_path) {
+    cJSON* columns = cJSON_GetObjectItemCaseSensitive(
+        cJSON_GetArrayItem(cJSON_GetObjectItemCaseSensitive(metadata, "groups"), 0), "columns");
+    int num_columns = cJSON_GetArraySize(columns);
+    int* column_indices = (int*)malloc((num_columns + 1) * sizeof(int));
+    int* column_types = (int*)malloc((num_columns + 1) * sizeof(int));
+    int* bloom_indices = (int*)malloc((num_columns + 1) * sizeof(int));
+    int* row = (int*)malloc((num_columns + 1) * sizeof(int));
+    char* compact_path = (char*)malloc(strlen(hty_file_path) + 9);
+    cJSON* compacted = cJSON_Duplicate(metadata, 1);
+    if (!column_indices || !column_types || !bloom_indices || !row || !compact_path || !compacted) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(column_indices);
+        free(column_types);
+        free(bloom_indices);
+        free(row);
+        free(compact_path);
+        cJSON_Delete(compacted);
+        return -1;
+    }
+    sprintf(compact_path, "%s.compact", hty_file_path);
+    cJSON_DeleteItemFromObjectCaseSensitive(compacted, "file_id"); // Row ids move, so the new file gets a new id
+    int col_idx = 0;
+    cJSON* column;
+    cJSON_ArrayForEach(column, columns) {
+        column_indices[col_idx] = col_idx;
+        column_types[col_idx] = strcmp(cJSON_GetObjectItemCaseSensitive(column, "column_type")->valuestring, "float") == 0;
+        col_idx++;
+    }
+
+    // Keep the Bloom filter columns of the file
+    int num_bloom_columns = 0;
+    cJSON* bloom_column;
+    cJSON_ArrayForEach(bloom_column, cJSON_GetObjectItemCaseSensitive(
+                                         cJSON_GetObjectItemCaseSensitive(metadata, "bloom_filters"), "columns")) {
+        char* bloom_name = bloom_column->valuestring;
+        int bloom_type;
+        if (resolve_columns(metadata, &bloom_name, 1, &bloom_indices[num_bloom_columns], &bloom_type) == 0) {
+            num_bloom_columns++;
+        }
+    }
+
+    // The new file starts empty with the row group layout of the old one
+    cJSON_DeleteItemFromObjectCaseSensitive(compacted, "deletes");
+    cJSON_SetNumberValue(cJSON_GetObjectItemCaseSensitive(compacted, "num_rows"), 0);
+    HtyRowLayout layout;
+    get_row_layout(metadata, &layout);
+    int pinned = pin_snapshot(hty_file_path, NULL) == 0; // Deletes and updates wait until the copy is published
+    FILE* source_file = pinned ? open_snapshot(hty_file_path) : NULL;
+    FILE* dest_file = fopen(compact_path, "wb");
+    HtyWriter* writer = dest_file != NULL ? create_writer(dest_file, num_columns, column_types) : NULL;
+    HtyColumnReader* reader = source_file != NULL ? open_column_reader(metadata, hty_file_path, column_indices,
+                                                                       num_columns, NULL) : NULL;
+    int status = source_file != NULL && writer != NULL && reader != NULL ? 0 : -1;
+    if (status == 0) {
+        load_writer_statistics(writer, compacted);
+        status = enable_bloom_filters(writer, bloom_indices, num_bloom_columns);
+    }
+    for (long copied = 0; status == 0 && copied < layout.offset; copied++) {
+        int byte = fgetc(source_file); // Bytes before the raw data, if any
+        status = byte != EOF && fputc(byte, dest_file) != EOF ? 0 : -1;
+    }
+
+    // Write the live rows in file order; the reader already skips the deleted ones
+    int live_rows = 0;
+    int** block;
+    int first_row, rows_in_block, got = 0;
+    while (status == 0 && (got = next_column_block(reader, &block, &first_row, &rows_in_block)) == 1) {
+        for (int i = 0; i < rows_in_block && status == 0; i++) {
+            for (int j = 0; j < num_columns; j++) {
+                row[j] = block[j][i];
+            }
+            status = write_row(writer, row);
+        }
+        live_rows += rows_in_block;
+    }
+    if (got == -1) {
+        status = -1;
+    }
+    if (status == 0) {
+        cJSON_SetNumberValue(cJSON_GetObjectItemCaseSensitive(compacted, "num_rows"), live_rows);
+        status = finish_writer(writer, compacted);
+    }
+    close_column_reader(reader);
+    free_writer(writer);
+    if (source_file != NULL) {
+        fclose(source_file);
+    }
+    if (dest_file != NULL && fclose(dest_file) != 0) {
+        status = -1;
+    }
+    if (status == 0 && rename(compact_path, hty_file_path) != 0) {
+        status = -1;
+    }
+    if (pinned) {
+        unpin_snapshot(hty_file_path);
+    }
+    if (status != 0) {
+        fprintf(stderr, "Error compacting file: %s\n", hty_file_path);
+        remove(compact_path);
+        cJSON_Delete(compacted);
+    } else {
+        // Swap the contents so the caller's metadata object describes the new file
+        cJSON* old_child = metadata->child;
+        metadata->child = compacted->child;
+        compacted->child = old_child;
+        cJSON_Delete(compacted);
+        invalidate_buffer_pool(hty_file_path);
+        invalidate_result_cache(hty_file_path);
+
+        // Row ids have moved, so the indexes of the file are built again
+        columns = cJSON_GetObjectItemCaseSensitive(
+            cJSON_GetArrayItem(cJSON_GetObjectItemCaseSensitive(metadata, "groups"), 0), "columns");
+        cJSON_ArrayForEach(column, columns) {
+            const char* column_name = cJSON_GetObjectItemCaseSensitive(column, "column_name")->valuestring;
+            char* index_path = index_file_path(hty_file_path, column_name);
+            if (index_path != NULL && access(index_path, F_OK) == 0 && build_index(metadata, hty_file_path, column_name) != 0) {
+                remove(index_path);
+            }
+            free(index_path);
+        }
+    }
+    free(column_indices);
+    free(column_types);
+    free(bloom_indices);
+    free(row);
+    free(compact_path);
+    return status;
+}
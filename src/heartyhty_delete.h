@@ -0,0 +1,188 @@
+/**
+ * @file heartyhty_delete.h
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Header file for deleting and updating rows without rewriting the file, and for compacting it later
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef HEARTYHTY_DELETE_H
+#define HEARTYHTY_DELETE_H
+
+#include <stdint.h>
+
+#define HTY_BITMAP_ARRAY_MAX 4096   // Row ids a container keeps as a sorted array before it becomes a bitmap
+#define HTY_BITMAP_WORDS 1024       // 64-bit words of a bitmap container (65536 bits)
+#define HTY_COMPACT_DEAD_RATIO 0.25 // Share of deleted rows at which a delete compacts the file
+
+/**
+ * @brief Row ids that share their upper 16 bits
+ *
+ * Sparse containers keep the lower 16 bits as a sorted array, dense ones
+ * as a bitmap, so the set stays small both for a few scattered deletes and
+ * for whole deleted ranges.
+ */
+typedef struct {
+    int key;            // Upper 16 bits of the row ids
+    int cardinality;    // Row ids in the container
+    uint16_t* values;   // Sorted lower 16 bits, while cardinality <= HTY_BITMAP_ARRAY_MAX
+    uint64_t* bits;     // HTY_BITMAP_WORDS words with one bit per row, once it is larger
+} HtyBitmapContainer;
+
+/**
+ * @brief Compressed set of row ids (Roaring bitmap)
+ */
+typedef struct {
+    int num_containers;              // Containers in use
+    int capacity;                    // Containers allocated
+    HtyBitmapContainer* containers;  // Containers, sorted by key
+    long cardinality;                // Row ids in the set
+} HtyRowBitmap;
+
+/**
+ * @brief Function to check whether a row id is in a bitmap
+ *
+ * @param bitmap - bitmap
+ * @param row - row id
+ * @return int - 1 if it is in the bitmap
+ */
+int bitmap_contains(const HtyRowBitmap* bitmap, int row);
+
+/**
+ * @brief Function to add a row id to a bitmap
+ *
+ * @param bitmap - bitmap (zero initialised when empty)
+ * @param row - row id
+ * @return int - 1 if added, 0 if it was there already, -1 on failure
+ */
+int bitmap_add(HtyRowBitmap* bitmap, int row);
+
+/**
+ * @brief Function to free the containers of a bitmap
+ *
+ * @param bitmap - bitmap to free (the struct itself is not freed)
+ */
+void free_bitmap(HtyRowBitmap* bitmap);
+
+/**
+ * @brief Function to build the selection vector of the rows of a row group that are not deleted
+ *
+ * @param deleted - deleted rows
+ * @param first_row - first row of the row group
+ * @param num_rows - rows in the row group
+ * @param selection - array to store the positions of live rows within the row group
+ * @return int - number of live rows
+ */
+int select_live_rows(const HtyRowBitmap* deleted, int first_row, int num_rows, int* selection);
+
+/**
+ * @brief Function to read the deleted rows of a file
+ *
+ * @param metadata - metadata object
+ * @param hty_file_path - path to hty file
+ * @param deleted - bitmap to fill in (free it with free_bitmap)
+ * @return int - 1 if the file has deleted rows, 0 if not, -1 on failure
+ */
+int load_deleted_rows(cJSON* metadata, const char* hty_file_path, HtyRowBitmap* deleted);
+
+/**
+ * @brief Function to store the deleted rows of a file and rewrite its metadata
+ *
+ * The bitmap and the metadata are the last sections of the file, so they
+ * are overwritten in place and the file is cut after them; the raw data and
+ * the other sections stay where they are. Queries that have the file pinned
+ * (see pin_snapshot()) finish first.
+ *
+ * @param metadata - metadata object to write ("deletes" is set here)
+ * @param hty_file_path - path to hty file
+ * @param deleted - deleted rows, empty for none
+ * @return int - 0 on success, -1 on failure
+ */
+int write_deleted_rows(cJSON* metadata, const char* hty_file_path, const HtyRowBitmap* deleted);
+
+/**
+ * @brief Function to get the number of rows that are not deleted
+ *
+ * @param metadata - metadata object
+ * @return int - live rows
+ */
+int count_live_rows(cJSON* metadata);
+
+/**
+ * @brief Function to delete rows by row id
+ *
+ * The ids go into the deletion bitmap stored before the metadata; the rows
+ * stay in place and every scan skips them. Once HTY_COMPACT_DEAD_RATIO of
+ * the rows are deleted the file is compacted.
+ *
+ * @param metadata - metadata object (updated to describe the file afterwards)
+ * @param hty_file_path - path to hty file
+ * @param rows - row ids to delete
+ * @param num_rows - number of row ids
+ * @return int - rows newly deleted, -1 on failure
+ */
+int delete_rows(cJSON* metadata, const char* hty_file_path, const int* rows, int num_rows);
+
+/**
+ * @brief Function to delete the rows matching a predicate
+ *
+ * @param metadata - metadata object (updated to describe the file afterwards)
+ * @param hty_file_path - path to hty file
+ * @param column_name - column to filter
+ * @param op - operation for filtering
+ * @param value - value to filter against (float bits for float columns)
+ * @return int - rows deleted, -1 on failure
+ */
+int delete_where(cJSON* metadata, const char* hty_file_path, const char* column_name, int op, int value);
+
+/**
+ * @brief Function to set a column of some rows to a value
+ *
+ * Rows have a fixed width, so each value is patched into its slot in the
+ * raw data. The footer min/max, zone maps, Bloom filters and row sample are
+ * widened to cover it and an index on the column is rebuilt; histograms and
+ * distinct value sketches describe the rows as written until compaction.
+ * Like deletes, it waits for queries that have the file pinned.
+ *
+ * @param metadata - metadata object (updated to describe the file afterwards)
+ * @param hty_file_path - path to hty file
+ * @param rows - row ids to update
+ * @param num_rows - number of row ids
+ * @param column_name - column to set
+ * @param value - new value (float bits for float columns)
+ * @return int - rows updated, -1 on failure
+ */
+int update_rows(cJSON* metadata, const char* hty_file_path, const int* rows, int num_rows, const char* column_name,
+                int value);
+
+/**
+ * @brief Function to set a column of the rows matching a predicate to a value
+ *
+ * @param metadata - metadata object (updated to describe the file afterwards)
+ * @param hty_file_path - path to hty file
+ * @param filtered_column - column to filter
+ * @param op - operation for filtering
+ * @param filtered_value - value to filter against (float bits for float columns)
+ * @param column_name - column to set
+ * @param value - new value (float bits for float columns)
+ * @return int - rows updated, -1 on failure
+ */
+int update_where(cJSON* metadata, const char* hty_file_path, const char* filtered_column, int op, int filtered_value,
+                 const char* column_name, int value);
+
+/**
+ * @brief Function to rewrite a file without its deleted rows
+ *
+ * The live rows are written to a new file with the same row group layout,
+ * Bloom filter columns and sort key, with fresh statistics, which then
+ * replaces the file. Column indexes of the file are rebuilt.
+ *
+ * @param metadata - metadata object (replaced by the one of the new file)
+ * @param hty_file_path - path to hty file
+ * @return int - 0 on success, -1 on failure
+ */
+int compact_file(cJSON* metadata, const char* hty_file_path);
+
+#endif // HEARTYHTY_DELETE_H
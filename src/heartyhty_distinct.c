@@ -0,0 +1,539 @@
+/**
+ * @file heartyhty_distinct.c
+ * @author Panupong Dangkajitpetch (King)
+ * @brief DISTINCT and COUNT(DISTINCT) operator with per-thread hash sets and bitmaps
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "../third_party/cJSON/cJSON.h"
+#include "heartyhty_functions.h"
+#include "heartyhty_writer.h"
+#include "heartyhty_sort.h"
+#include "heartyhty_delete.h"
+#include "heartyhty_topk.h"
+#include "heartyhty_pool.h"
+#include "heartyhty_snapshot.h"
+#include "heartyhty_distinct.h"
+#include "heartyhty_stats.h"
+
+#define MIN_SET_CAPACITY 1024 // Slots of a new hash set
+
+/**
+ * @brief Open addressing hash set of 32-bit values with linear probing
+ *
+ * Slot value 0 means empty, so the value 0 itself is kept in has_zero.
+ * The set grows to keep at most half of its slots full.
+ */
+typedef struct {
+    uint32_t* slots;  // Values, 0 for an empty slot
+    int capacity;     // Number of slots, a power of two
+    int shift;        // 32 - log2(capacity): the top bits of the hash pick the slot
+    int size;         // Values in the slots
+    int has_zero;     // 1 if the set holds 0
+} DistinctSet;
+
+/**
+ * @brief Shared state of a parallel distinct scan
+ */
+typedef struct {
+    const char* hty_file_path;  // File to scan
+    HtyRowLayout layout;        // Where the rows are in the file
+    int total_columns;          // Columns per row
+    int num_rows;               // Rows in the file
+    int column_index;           // Column to find the values of
+    int is_float;               // Type of the column
+    const HtyPredicate* filters;  // Predicates a row must pass
+    int num_filters;            // Number of predicates
+    int* filter_indices;        // Column of each predicate
+    int* filter_types;          // Type of each predicate column
+    HtyRowBitmap deleted;       // Deleted rows, never counted
+    int bitmap_min;             // Value of bit 0 of the bitmaps
+    long bitmap_bits;           // Bits of each bitmap, 0 to use the hash sets only
+    int* groups;                // First row of each row group to scan
+    int num_groups;             // Number of row groups to scan
+    int next_group;             // Next row group to hand out
+    int failed;                 // 1 if a read or an allocation failed
+    DistinctSet* sets;          // Hash set of each thread (values outside the bitmap range)
+    uint64_t** bitmaps;         // Bitmap of each thread, NULL without a bitmap
+    pthread_mutex_t lock;       // Protects next_group and failed
+} DistinctScan;
+
+/**
+ * @brief Worker thread argument
+ */
+typedef struct {
+    DistinctScan* scan;  // Shared scan state
+    int thread;          // Index of the set of this thread
+} DistinctWorker;
+
+/**
+ * @brief Function to hash a value to a slot (Fibonacci hashing)
+ *
+ * @param value - value
+ * @param shift - 32 - log2(number of slots)
+ * @return uint32_t - slot
+ */
+static inline uint32_t hash_slot(uint32_t value, int shift) {
+    return (value * 0x9e3779b1U) >> shift;
+}
+
+/**
+ * @brief Function to resize a hash set and insert its values again
+ *
+ * @param set - set to resize
+ * @param capacity - new number of slots, a power of two
+ * @return int - 0 on success, -1 on failure
+ */
+static int resize_set(DistinctSet* set, int capacity) {
+    uint32_t* slots = (uint32_t*)calloc(capacity, sizeof(uint32_t));
+    if (slots == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    int shift = 32;
+    for (int bits = capacity; bits > 1; bits >>= 1) {
+        shift--;
+    }
+    uint32_t mask = (uint32_t)capacity - 1;
+    for (int i = 0; i < set->capacity; i++) {
+        uint32_t value = set->slots[i];
+        if (value != 0) {
+            uint32_t slot = hash_slot(value, shift);
+            while (slots[slot] != 0) {
+                slot = (slot + 1) & mask;
+            }
+            slots[slot] = value;
+        }
+    }
+    free(set->slots);
+    set->slots = slots;
+    set->capacity = capacity;
+    set->shift = shift;
+    return 0;
+}
+
+/**
+ * @brief Function to add a batch of values to a hash set
+ *
+ * The slots of the whole batch are computed first in one loop the compiler
+ * can vectorize, then the values are probed in order.
+ *
+ * @param set - hash set
+ * @param values - values to add
+ * @param count - number of values, at most HTY_DISTINCT_BATCH_ROWS
+ * @return int - 0 on success, -1 on failure
+ */
+static int insert_values(DistinctSet* set, const uint32_t* values, int count) {
+    int capacity = set->capacity > 0 ? set->capacity : MIN_SET_CAPACITY;
+    while ((long)(set->size + count) * 2 > capacity) {
+        capacity *= 2;
+    }
+    if (capacity != set->capacity && resize_set(set, capacity) != 0) {
+        return -1;
+    }
+    uint32_t slots[HTY_DISTINCT_BATCH_ROWS];
+    int shift = set->shift;
+    for (int i = 0; i < count; i++) {
+        slots[i] = hash_slot(values[i], shift);
+    }
+    uint32_t mask = (uint32_t)set->capacity - 1;
+    for (int i = 0; i < count; i++) {
+        uint32_t value = values[i];
+        if (value == 0) {
+            set->has_zero = 1;
+            continue;
+        }
+        uint32_t slot = slots[i];
+        while (set->slots[slot] != 0 && set->slots[slot] != value) {
+            slot = (slot + 1) & mask;
+        }
+        if (set->slots[slot] == 0) {
+            set->slots[slot] = value;
+            set->size++;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Function to record that the scan failed, so the other threads stop
+ *
+ * @param scan - scan state
+ */
+static void fail_scan(DistinctScan* scan) {
+    pthread_mutex_lock(&scan->lock);
+    scan->failed = 1;
+    pthread_mutex_unlock(&scan->lock);
+}
+
+/**
+ * @brief Worker thread that scans row groups until none are left
+ *
+ * @param arg - worker argument
+ * @return void* - always NULL
+ */
+static void* distinct_worker(void* arg) {
+    DistinctScan* scan = ((DistinctWorker*)arg)->scan;
+    int thread = ((DistinctWorker*)arg)->thread;
+    DistinctSet* set = &scan->sets[thread];
+    uint64_t* bitmap = scan->bitmaps != NULL ? scan->bitmaps[thread] : NULL;
+
+    FILE* file = open_snapshot(scan->hty_file_path);
+    int* block = (int*)malloc((long)scan->layout.block_rows * scan->total_columns * sizeof(int));
+    uint32_t* values = (uint32_t*)malloc(HTY_DISTINCT_BATCH_ROWS * sizeof(uint32_t));
+    if (file == NULL || block == NULL || values == NULL) {
+        fprintf(stderr, "Error opening file: %s\n", scan->hty_file_path);
+        fail_scan(scan);
+        if (file != NULL) {
+            fclose(file);
+        }
+        free(block);
+        free(values);
+        return NULL;
+    }
+
+    for (;;) {
+        pthread_mutex_lock(&scan->lock);
+        int group = scan->next_group < scan->num_groups && !scan->failed ? scan->groups[scan->next_group++] : -1;
+        pthread_mutex_unlock(&scan->lock);
+        if (group == -1) {
+            break;
+        }
+
+        int block_rows = scan->layout.block_rows;
+        int rows_in_block = scan->num_rows - group < block_rows ? scan->num_rows - group : block_rows;
+        HtyStageTimer timer;
+        HTY_STAGE_BEGIN(timer);
+        fseek(file, row_position(&scan->layout, group), SEEK_SET);
+        if (fread(block, scan->total_columns * sizeof(int), rows_in_block, file) != (size_t)rows_in_block) {
+            fprintf(stderr, "Error reading rows %d to %d\n", group, group + rows_in_block - 1);
+            fail_scan(scan);
+            break;
+        }
+        HTY_STAGE_END(HTY_STAGE_IO, timer);
+        HTY_STATS_ADD(io_syscalls, 1);
+        HTY_STATS_ADD(blocks_read, 1);
+        HTY_STATS_ADD(bytes_read, (long)rows_in_block * scan->total_columns * sizeof(int));
+        HTY_STATS_ADD(rows_scanned, rows_in_block);
+
+        // Gather the values of the rows that pass, a batch at a time, then add the batch to the set
+        HTY_STAGE_BEGIN(timer);
+        int failed = 0, matched = 0;
+        for (int start = 0; start < rows_in_block && !failed; start += HTY_DISTINCT_BATCH_ROWS) {
+            int end = start + HTY_DISTINCT_BATCH_ROWS < rows_in_block ? start + HTY_DISTINCT_BATCH_ROWS : rows_in_block;
+            int count = 0;
+            for (int i = start; i < end; i++) {
+                const int* row = block + (long)i * scan->total_columns;
+                int match = scan->deleted.cardinality == 0 || !bitmap_contains(&scan->deleted, group + i);
+                for (int f = 0; f < scan->num_filters && match; f++) {
+                    match = compare_values(row[scan->filter_indices[f]], scan->filters[f].value, scan->filters[f].op,
+                                           scan->filter_types[f]);
+                }
+                int value = row[scan->column_index];
+                if (scan->is_float && (value & 0x7fffffff) == 0) {
+                    value = 0; // -0.0 == 0.0
+                }
+                values[count] = (uint32_t)value;
+                count += match;
+            }
+            matched += count;
+            if (bitmap != NULL) {
+                // Values in the footer range go to the bitmap; any outside it go to the set, so the range need not be exact
+                int outside = 0;
+                for (int i = 0; i < count; i++) {
+                    uint32_t bit = values[i] - (uint32_t)scan->bitmap_min;
+                    if (bit < (uint32_t)scan->bitmap_bits) {
+                        bitmap[bit >> 6] |= 1ULL << (bit & 63);
+                    } else {
+                        values[outside++] = values[i];
+                    }
+                }
+                count = outside;
+            }
+            failed = count > 0 && insert_values(set, values, count) != 0;
+        }
+        HTY_STAGE_END(HTY_STAGE_FILTER, timer);
+        HTY_STATS_ADD(rows_matched, matched);
+        if (failed) {
+            fail_scan(scan);
+            break;
+        }
+    }
+
+    free(values);
+    free(block);
+    fclose(file);
+    return NULL;
+}
+
+/**
+ * @brief Function to order sort encoded values for qsort
+ */
+static int compare_encoded(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Function to pick the row groups that can hold rows passing every filter
+ *
+ * @param scan - scan state with the filters resolved
+ * @param metadata - metadata object
+ * @return int - 0 on success, -1 on failure
+ */
+static int plan_row_groups(DistinctScan* scan, cJSON* metadata) {
+    int block_rows = scan->layout.block_rows;
+    int total_groups = (scan->num_rows + block_rows - 1) / block_rows;
+    scan->groups = (int*)malloc((total_groups + 1) * sizeof(int));
+    if (scan->groups == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    unsigned int** zone_maps = (unsigned int**)calloc(scan->num_filters + 1, sizeof(unsigned int*));
+    for (int f = 0; f < scan->num_filters && zone_maps != NULL; f++) {
+        int zone_groups = 0;
+        zone_maps[f] = read_zone_map(metadata, scan->hty_file_path, scan->filter_indices[f], &zone_groups);
+        if (zone_maps[f] != NULL && zone_groups != total_groups) {
+            free(zone_maps[f]); // Does not describe these row groups
+            zone_maps[f] = NULL;
+        }
+    }
+    for (int g = 0; g < total_groups; g++) {
+        int may_match = 1;
+        for (int f = 0; f < scan->num_filters && zone_maps != NULL && may_match; f++) {
+            if (zone_maps[f] != NULL) {
+                int type = scan->filter_types[f];
+                may_match = range_may_match(decode_sort_value(zone_maps[f][2 * g], type),
+                                            decode_sort_value(zone_maps[f][2 * g + 1], type),
+                                            scan->filters[f].op, scan->filters[f].value, type);
+            }
+        }
+        if (may_match) {
+            scan->groups[scan->num_groups++] = g * block_rows;
+        } else {
+            HTY_STATS_ADD(blocks_skipped, 1);
+        }
+    }
+    for (int f = 0; f < scan->num_filters && zone_maps != NULL; f++) {
+        free(zone_maps[f]);
+    }
+    free(zone_maps);
+    return 0;
+}
+
+/**
+ * @brief Function to find the distinct values of a column (see distinct_values())
+ *
+ * @param metadata - metadata object
+ * @param hty_file_path - path to hty file
+ * @param column - column to find the values of
+ * @param filters - predicates a row must all pass, NULL for none
+ * @param num_filters - number of predicates
+ * @param values - pointer to store the values in ascending order, NULL to only count them
+ * @return int - number of distinct values, -1 on failure
+ */
+static int find_distinct(cJSON* metadata, const char* hty_file_path, const char* column, const HtyPredicate* filters,
+                         int num_filters, int** values) {
+    cJSON* group = cJSON_GetArrayItem(cJSON_GetObjectItemCaseSensitive(metadata, "groups"), 0);  // Assuming single group
+    cJSON* columns = cJSON_GetObjectItemCaseSensitive(group, "columns");
+    DistinctScan scan;
+    memset(&scan, 0, sizeof(scan));
+    scan.hty_file_path = hty_file_path;
+    scan.num_rows = cJSON_GetObjectItemCaseSensitive(metadata, "num_rows")->valueint;
+    scan.total_columns = cJSON_GetArraySize(columns);
+    get_row_layout(metadata, &scan.layout);
+    scan.filters = filters;
+    scan.num_filters = filters != NULL ? num_filters : 0;
+
+    // Resolve the column and the filter columns
+    char* column_name = (char*)column;
+    if (resolve_columns(metadata, &column_name, 1, &scan.column_index, &scan.is_float) != 0) {
+        return -1;
+    }
+    scan.filter_indices = (int*)malloc((scan.num_filters + 1) * sizeof(int));
+    scan.filter_types = (int*)malloc((scan.num_filters + 1) * sizeof(int));
+    int status = scan.filter_indices != NULL && scan.filter_types != NULL ? 0 : -1;
+    for (int f = 0; f < scan.num_filters && status == 0; f++) {
+        char* filter_name = (char*)filters[f].column;
+        status = resolve_columns(metadata, &filter_name, 1, &scan.filter_indices[f], &scan.filter_types[f]);
+    }
+    if (status == 0) {
+        status = load_deleted_rows(metadata, hty_file_path, &scan.deleted) < 0 ? -1 : 0;
+    }
+    if (status == 0) {
+        status = plan_row_groups(&scan, metadata);
+    }
+
+    // A narrow int range is kept as a bitmap, as long as that is no bigger than the column
+    int min_value, max_value;
+    if (status == 0 && !scan.is_float &&
+        get_column_range(cJSON_GetArrayItem(columns, scan.column_index), 0, &min_value, &max_value)) {
+        long range = (long)max_value - min_value + 1;
+        if (range > 0 && range <= HTY_DISTINCT_BITMAP_BITS && range <= 32L * scan.num_rows) {
+            scan.bitmap_min = min_value;
+            scan.bitmap_bits = range;
+        }
+    }
+
+    // Scan in parallel, each thread into its own set
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int num_threads = scan.num_groups < HTY_DISTINCT_MAX_THREADS ? scan.num_groups : HTY_DISTINCT_MAX_THREADS;
+    if (num_cpus > 0 && num_threads > num_cpus) {
+        num_threads = (int)num_cpus;
+    }
+    if (num_threads < 1) {
+        num_threads = 1;
+    }
+    long bitmap_words = (scan.bitmap_bits + 63) / 64;
+    if (status == 0) {
+        scan.sets = (DistinctSet*)calloc(num_threads, sizeof(DistinctSet));
+        status = scan.sets != NULL ? 0 : -1;
+    }
+    if (status == 0 && scan.bitmap_bits > 0) {
+        scan.bitmaps = (uint64_t**)calloc(num_threads, sizeof(uint64_t*));
+        for (int i = 0; i < num_threads && scan.bitmaps != NULL && status == 0; i++) {
+            scan.bitmaps[i] = (uint64_t*)calloc(bitmap_words, sizeof(uint64_t));
+            status = scan.bitmaps[i] != NULL ? 0 : -1;
+        }
+        status = scan.bitmaps != NULL ? status : -1;
+    }
+    if (status != 0) {
+        fprintf(stderr, "Memory allocation failed\n");
+    }
+    DistinctWorker workers[HTY_DISTINCT_MAX_THREADS];
+    for (int i = 0; i < num_threads; i++) {
+        workers[i].scan = &scan;
+        workers[i].thread = i;
+    }
+    pthread_mutex_init(&scan.lock, NULL);
+    if (status == 0 && num_threads == 1) {
+        distinct_worker(&workers[0]);
+    } else if (status == 0) {
+        pthread_t threads[HTY_DISTINCT_MAX_THREADS];
+        int started[HTY_DISTINCT_MAX_THREADS];
+        for (int i = 0; i < num_threads; i++) {
+            started[i] = pthread_create(&threads[i], NULL, distinct_worker, &workers[i]) == 0;
+        }
+        for (int i = 0; i < num_threads; i++) {
+            if (started[i]) {
+                pthread_join(threads[i], NULL);
+            }
+        }
+        if (!started[0]) {
+            distinct_worker(&workers[0]); // Fall back to scanning on this thread
+        }
+    }
+    pthread_mutex_destroy(&scan.lock);
+    if (scan.failed) {
+        status = -1;
+    }
+
+    // Merge the sets and bitmaps of the other threads into those of the first
+    uint32_t batch[HTY_DISTINCT_BATCH_ROWS];
+    for (int i = 1; i < num_threads && status == 0; i++) {
+        DistinctSet* other = &scan.sets[i];
+        int count = 0;
+        for (int slot = 0; slot < other->capacity && status == 0; slot++) {
+            if (other->slots[slot] != 0) {
+                batch[count++] = other->slots[slot];
+            }
+            if (count == HTY_DISTINCT_BATCH_ROWS || (count > 0 && slot == other->capacity - 1)) {
+                status = insert_values(&scan.sets[0], batch, count);
+                count = 0;
+            }
+        }
+        scan.sets[0].has_zero |= other->has_zero;
+        for (long word = 0; scan.bitmaps != NULL && word < bitmap_words; word++) {
+            scan.bitmaps[0][word] |= scan.bitmaps[i][word];
+        }
+    }
+    int distinct = -1;
+    if (status == 0) {
+        DistinctSet* set = &scan.sets[0];
+        distinct = set->size + set->has_zero;
+        for (long word = 0; scan.bitmaps != NULL && word < bitmap_words; word++) {
+            distinct += __builtin_popcountll(scan.bitmaps[0][word]);
+        }
+    }
+
+    // Collect the values: sort encoded, so sorting them gives ascending order
+    if (distinct >= 0 && values != NULL) {
+        uint32_t* keys = (uint32_t*)malloc((distinct + 1) * sizeof(uint32_t));
+        *values = (int*)malloc((distinct + 1) * sizeof(int));
+        if (keys == NULL || *values == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            free(*values);
+            *values = NULL;
+            distinct = -1;
+        } else {
+            DistinctSet* set = &scan.sets[0];
+            int count = 0;
+            for (int slot = 0; slot < set->capacity; slot++) {
+                if (set->slots[slot] != 0) {
+                    keys[count++] = encode_sort_value((int)set->slots[slot], scan.is_float);
+                }
+            }
+            if (set->has_zero) {
+                keys[count++] = encode_sort_value(0, scan.is_float);
+            }
+            for (long word = 0; scan.bitmaps != NULL && word < bitmap_words; word++) {
+                for (uint64_t bits = scan.bitmaps[0][word]; bits != 0; bits &= bits - 1) {
+                    int value = (int)((uint32_t)scan.bitmap_min + (uint32_t)(word * 64 + __builtin_ctzll(bits)));
+                    keys[count++] = encode_sort_value(value, 0);
+                }
+            }
+            qsort(keys, count, sizeof(uint32_t), compare_encoded);
+            for (int i = 0; i < count; i++) {
+                (*values)[i] = decode_sort_value(keys[i], scan.is_float);
+            }
+        }
+        free(keys);
+    }
+
+    for (int i = 0; scan.sets != NULL && i < num_threads; i++) {
+        free(scan.sets[i].slots);
+    }
+    for (int i = 0; scan.bitmaps != NULL && i < num_threads; i++) {
+        free(scan.bitmaps[i]);
+    }
+    free(scan.sets);
+    free(scan.bitmaps);
+    free(scan.groups);
+    free(scan.filter_indices);
+    free(scan.filter_types);
+    free_bitmap(&scan.deleted);
+    return distinct;
+}
+
+int* distinct_values(cJSON* metadata, const char* hty_file_path, const char* column, const HtyPredicate* filters,
+                     int num_filters, int* count) {
+    HtyStageTimer query_timer;
+    HTY_STAGE_BEGIN(query_timer);
+    int* values = NULL;
+    int distinct = find_distinct(metadata, hty_file_path, column, filters, num_filters, &values);
+    *count = distinct > 0 ? distinct : 0;
+    if (distinct < 0) {
+        free(values);
+        values = NULL;
+    }
+    HTY_QUERY_END("distinct_values", query_timer);
+    return values;
+}
+
+int count_distinct_values(cJSON* metadata, const char* hty_file_path, const char* column, const HtyPredicate* filters,
+                          int num_filters) {
+    HtyStageTimer query_timer;
+    HTY_STAGE_BEGIN(query_timer);
+    int distinct = find_distinct(metadata, hty_file_path, column, filters, num_filters, NULL);
+    HTY_QUERY_END("count_distinct_values", query_timer);
+    return distinct;
+}
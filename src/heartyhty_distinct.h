@@ -0,0 +1,56 @@
+/**
+ * @file heartyhty_distinct.h
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Header file for the DISTINCT and COUNT(DISTINCT) operator
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef HEARTYHTY_DISTINCT_H
+#define HEARTYHTY_DISTINCT_H
+
+#define HTY_DISTINCT_MAX_THREADS 8          // Maximum number of scan threads
+#define HTY_DISTINCT_BATCH_ROWS 1024        // Values hashed and inserted together
+#define HTY_DISTINCT_BITMAP_BITS (1L << 24) // Widest int range kept as a bitmap (2 MB per thread)
+
+/**
+ * @brief Function to find the distinct values of a column (SELECT DISTINCT)
+ *
+ * Row groups are scanned in parallel, each thread into a set of its own,
+ * and the sets are merged at the end. The filters are checked in the same
+ * pass, and row groups whose zone maps rule a filter out are not read. An
+ * int column whose footer range is narrow (at most HTY_DISTINCT_BITMAP_BITS
+ * values and no wider than the column itself) is kept as a bitmap over the
+ * range; other columns go into an open addressing hash set whose hashes are
+ * computed HTY_DISTINCT_BATCH_ROWS at a time. Deleted rows are skipped;
+ * -0.0 and 0.0 are the same value.
+ *
+ * @param metadata - metadata object
+ * @param hty_file_path - path to hty file
+ * @param column - column to find the values of
+ * @param filters - predicates a row must all pass, NULL for none
+ * @param num_filters - number of predicates
+ * @param count - pointer to store the number of distinct values
+ * @return int* - distinct values in ascending order (float bits for float columns), NULL on failure
+ */
+int* distinct_values(cJSON* metadata, const char* hty_file_path, const char* column, const HtyPredicate* filters,
+                     int num_filters, int* count);
+
+/**
+ * @brief Function to count the distinct values of a column (COUNT(DISTINCT column))
+ *
+ * Runs the scan of distinct_values() without collecting the values.
+ *
+ * @param metadata - metadata object
+ * @param hty_file_path - path to hty file
+ * @param column - column to count the values of
+ * @param filters - predicates a row must all pass, NULL for none
+ * @param num_filters - number of predicates
+ * @return int - number of distinct values, -1 on failure
+ */
+int count_distinct_values(cJSON* metadata, const char* hty_file_path, const char* column, const HtyPredicate* filters,
+                          int num_filters);
+
+#endif // HEARTYHTY_DISTINCT_H
@@ -0,0 +1,508 @@
+/**
+ * @file heartyhty_estimate.c
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Column statistics: distinct value sketches, equi-depth histograms, most common values and selectivity estimates
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../third_party/cJSON/cJSON.h"
+#include "heartyhty_functions.h"
+#include "heartyhty_estimate.h"
+#include "heartyhty_delete.h"
+#include "heartyhty_pool.h"
+#include "heartyhty_snapshot.h"
+
+/**
+ * @brief Function to hash a value to 64 bits
+ *
+ * @param value - value (float bits for float columns)
+ * @param is_float - flag to indicate if value is float
+ * @return uint64_t - hash of the value
+ */
+static uint64_t hash_value(int value, int is_float) {
+    if (is_float && (value & 0x7fffffff) == 0) {
+        value = 0; // -0.0 == 0.0, so both must count as one value
+    }
+    uint64_t hash = (uint64_t)(uint32_t)value + 0x9e3779b97f4a7c15ULL;
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+    return hash ^ (hash >> 31);
+}
+
+void sketch_add(unsigned char* registers, int value, int is_float) {
+    uint64_t hash = hash_value(value, is_float);
+    int index = (int)(hash >> (64 - HTY_SKETCH_PRECISION));
+    // Rank of the first set bit after the index bits; the guard bit keeps it in range
+    uint64_t rest = (hash << HTY_SKETCH_PRECISION) | (1ULL << (HTY_SKETCH_PRECISION - 1));
+    unsigned char rank = (unsigned char)(__builtin_clzll(rest) + 1);
+    if (rank > registers[index]) {
+        registers[index] = rank;
+    }
+}
+
+double sketch_estimate(const unsigned char* registers) {
+    double m = HTY_SKETCH_REGISTERS;
+    double sum = 0;
+    int zeros = 0;
+    for (int i = 0; i < HTY_SKETCH_REGISTERS; i++) {
+        sum += ldexp(1.0, -registers[i]);
+        zeros += registers[i] == 0;
+    }
+    double estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+    if (estimate <= 2.5 * m && zeros > 0) {
+        estimate = m * log(m / zeros); // Linear counting is more accurate for small counts
+    }
+    return estimate;
+}
+
+double sketch_error(double estimate) {
+    return HTY_CONFIDENCE_Z * 1.04 / sqrt(HTY_SKETCH_REGISTERS) * estimate;
+}
+
+int load_distinct_sketch(cJSON* metadata, const char* hty_file_path, int column_index, unsigned char* registers) {
+    cJSON* sketches = cJSON_GetObjectItemCaseSensitive(metadata, "distinct_sketches");
+    cJSON* precision = cJSON_GetObjectItemCaseSensitive(sketches, "precision");
+    if (sketches == NULL || !cJSON_IsNumber(precision) || precision->valueint != HTY_SKETCH_PRECISION) {
+        return 0;
+    }
+    FILE* file = open_snapshot(hty_file_path);
+    if (file == NULL) {
+        fprintf(stderr, "Error opening file: %s\n", hty_file_path);
+        return -1;
+    }
+    long offset = (long)cJSON_GetObjectItemCaseSensitive(sketches, "offset")->valuedouble;
+    fseek(file, offset + (long)column_index * HTY_SKETCH_REGISTERS, SEEK_SET);
+    size_t bytes_read = fread(registers, 1, HTY_SKETCH_REGISTERS, file);
+    fclose(file);
+    if (bytes_read != HTY_SKETCH_REGISTERS) {
+        fprintf(stderr, "Error reading distinct value sketches\n");
+        return -1;
+    }
+    return 1;
+}
+
+int load_row_sample(cJSON* metadata, const char* hty_file_path, HtyRowSample* sample) {
+    memset(sample, 0, sizeof(HtyRowSample));
+    cJSON* row_sample = cJSON_GetObjectItemCaseSensitive(metadata, "row_sample");
+    if (row_sample == NULL) {
+        return 0; // Files written before row samples
+    }
+    cJSON* group = cJSON_GetArrayItem(cJSON_GetObjectItemCaseSensitive(metadata, "groups"), 0);  // Assuming single group
+    int num_columns = cJSON_GetArraySize(cJSON_GetObjectItemCaseSensitive(group, "columns"));
+    sample->num_rows = (long)cJSON_GetObjectItemCaseSensitive(metadata, "num_rows")->valuedouble;
+    sample->sample_rows = cJSON_GetObjectItemCaseSensitive(row_sample, "rows")->valueint;
+    sample->columns = (int**)calloc(num_columns + 1, sizeof(int*));
+    if (sample->columns == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    FILE* file = open_snapshot(hty_file_path);
+    if (file == NULL) {
+        fprintf(stderr, "Error opening file: %s\n", hty_file_path);
+        free_row_sample(sample);
+        return -1;
+    }
+
+    // One column after another, each sample_rows values
+    fseek(file, (long)cJSON_GetObjectItemCaseSensitive(row_sample, "offset")->valuedouble, SEEK_SET);
+    for (int i = 0; i < num_columns; i++) {
+        sample->columns[i] = (int*)malloc((sample->sample_rows + 1) * sizeof(int));
+        if (sample->columns[i] == NULL ||
+            fread(sample->columns[i], sizeof(int), sample->sample_rows, file) != (size_t)sample->sample_rows) {
+            fprintf(stderr, "Error reading row sample\n");
+            fclose(file);
+            free_row_sample(sample);
+            return -1;
+        }
+    }
+
+    // Sampled rows that were deleted since leave a uniform sample of the rows that are left
+    HtyRowBitmap deleted;
+    int has_deletes = load_deleted_rows(metadata, hty_file_path, &deleted);
+    cJSON* row_ids_offset = cJSON_GetObjectItemCaseSensitive(row_sample, "row_ids_offset");
+    int* row_ids = has_deletes == 1 ? (int*)malloc((sample->sample_rows + 1) * sizeof(int)) : NULL;
+    int status = has_deletes == -1 ? -1 : 1;
+    if (has_deletes == 1 && (!cJSON_IsNumber(row_ids_offset) || row_ids == NULL)) {
+        status = 0; // Cannot tell which sampled rows are gone
+    } else if (has_deletes == 1) {
+        fseek(file, (long)row_ids_offset->valuedouble, SEEK_SET);
+        if (fread(row_ids, sizeof(int), sample->sample_rows, file) != (size_t)sample->sample_rows) {
+            fprintf(stderr, "Error reading row sample\n");
+            status = -1;
+        } else {
+            int live_rows = 0;
+            for (int s = 0; s < sample->sample_rows; s++) {
+                if (!bitmap_contains(&deleted, row_ids[s])) {
+                    for (int i = 0; i < num_columns; i++) {
+                        sample->columns[i][live_rows] = sample->columns[i][s];
+                    }
+                    live_rows++;
+                }
+            }
+            sample->sample_rows = live_rows;
+            sample->num_rows = count_live_rows(metadata);
+        }
+    }
+    free(row_ids);
+    free_bitmap(&deleted);
+    fclose(file);
+    if (status != 1) {
+        free_row_sample(sample);
+    }
+    return status;
+}
+
+void free_row_sample(HtyRowSample* sample) {
+    if (sample->columns != NULL) {
+        for (int i = 0; sample->columns[i] != NULL; i++) {
+            free(sample->columns[i]);
+        }
+    }
+    free(sample->columns);
+    memset(sample, 0, sizeof(HtyRowSample));
+}
+
+/**
+ * @brief Function to give the finite population correction of a sample
+ *
+ * A sample holding every row has no sampling error at all.
+ *
+ * @param sample - row sample
+ * @return double - factor for the variance, 0 to 1
+ */
+static double population_correction(const HtyRowSample* sample) {
+    if (sample->num_rows <= 1 || sample->sample_rows >= sample->num_rows) {
+        return 0;
+    }
+    return (double)(sample->num_rows - sample->sample_rows) / (sample->num_rows - 1);
+}
+
+/**
+ * @brief Function to read a sampled value as a number
+ *
+ * @param value - value (float bits for float columns)
+ * @param is_float - flag to indicate if value is float
+ * @return double - the value
+ */
+static double sample_number(int value, int is_float) {
+    return is_float ? (double)*(float*)&value : (double)value;
+}
+
+double estimate_count(const HtyRowSample* sample, int matches, double* error) {
+    int n = sample->sample_rows;
+    *error = 0;
+    if (n == 0) {
+        return 0;
+    }
+    double fraction = (double)matches / n;
+    if (n > 1) {
+        *error = HTY_CONFIDENCE_Z * sample->num_rows *
+                 sqrt(fraction * (1 - fraction) / (n - 1) * population_correction(sample));
+    }
+    return fraction * sample->num_rows;
+}
+
+double estimate_sum(const HtyRowSample* sample, const int* values, int is_float, const int* rows, int matches,
+                    double* error) {
+    int n = sample->sample_rows;
+    *error = 0;
+    if (n == 0) {
+        return 0;
+    }
+    // Every sampled row contributes its value if it matches and 0 otherwise
+    double sum = 0;
+    for (int i = 0; i < matches; i++) {
+        sum += sample_number(values[rows[i]], is_float);
+    }
+    double mean = sum / n;
+    double squares = (double)(n - matches) * mean * mean;
+    for (int i = 0; i < matches; i++) {
+        double deviation = sample_number(values[rows[i]], is_float) - mean;
+        squares += deviation * deviation;
+    }
+    if (n > 1) {
+        *error = HTY_CONFIDENCE_Z * sample->num_rows * sqrt(squares / (n - 1) / n * population_correction(sample));
+    }
+    return mean * sample->num_rows;
+}
+
+double estimate_average(const HtyRowSample* sample, const int* values, int is_float, const int* rows, int matches,
+                        double* error) {
+    double correction = population_correction(sample);
+    *error = 0;
+    if (matches == 0) {
+        return 0;
+    }
+    double sum = 0;
+    for (int i = 0; i < matches; i++) {
+        sum += sample_number(values[rows[i]], is_float);
+    }
+    double mean = sum / matches;
+    double squares = 0;
+    for (int i = 0; i < matches; i++) {
+        double deviation = sample_number(values[rows[i]], is_float) - mean;
+        squares += deviation * deviation;
+    }
+    if (matches > 1) {
+        *error = HTY_CONFIDENCE_Z * sqrt(squares / (matches - 1) / matches * correction);
+    } else if (correction > 0) {
+        *error = INFINITY; // One sampled row says nothing about the spread
+    }
+    return mean;
+}
+
+double estimate_distinct(const HtyRowSample* sample, int matches, int distinct, int singletons, double column_distinct,
+                         double* error) {
+    double scale = sample->sample_rows > 0 ? (double)sample->num_rows / sample->sample_rows : 1;
+    double estimate = sqrt(scale) * singletons + (distinct - singletons);
+    // At most every singleton stands for scale values, never more values than matching rows or than the column has
+    double upper = scale * singletons + (distinct - singletons);
+    double unsampled = scale * matches - matches;
+    if (upper > distinct + unsampled) {
+        upper = distinct + unsampled;
+    }
+    if (column_distinct >= distinct && upper > column_distinct) {
+        upper = column_distinct;
+    }
+    if (estimate > upper) {
+        estimate = upper;
+    }
+    *error = estimate - distinct > upper - estimate ? estimate - distinct : upper - estimate;
+    return estimate;
+}
+
+/**
+ * @brief Function to turn a sort encoded value back into a number
+ *
+ * @param encoded - value encoded by encode_sort_value()
+ * @param is_float - flag to indicate if the value is float
+ * @return double - the value
+ */
+static double decode_value(uint32_t encoded, int is_float) {
+    if (!is_float) {
+        return (double)(int)(encoded ^ 0x80000000U);
+    }
+    uint32_t bits = (encoded & 0x80000000U) ? (encoded & 0x7fffffffU) : ~encoded;
+    float value;
+    memcpy(&value, &bits, sizeof(float));
+    return value;
+}
+
+/**
+ * @brief Function to compare two sort encoded values for qsort
+ */
+static int compare_encoded(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Function to set or replace an item of a JSON object
+ *
+ * @param object - object to modify
+ * @param name - key of the item
+ * @param item - new item
+ */
+static void set_object_item(cJSON* object, const char* name, cJSON* item) {
+    if (cJSON_GetObjectItemCaseSensitive(object, name) != NULL) {
+        cJSON_ReplaceItemInObjectCaseSensitive(object, name, item);
+    } else {
+        cJSON_AddItemToObject(object, name, item);
+    }
+}
+
+int store_column_stats(cJSON* column, const uint32_t* sampled_values, int sample_rows, long num_rows, int is_float,
+                       double distinct) {
+    // Sort a copy: the sample stays in row order for the row sample section
+    uint32_t* sample = (uint32_t*)malloc((sample_rows + 1) * sizeof(uint32_t));
+    if (sample == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    // NaN sorts outside [-inf, +inf] and has no place in a histogram
+    int kept = 0;
+    for (int i = 0; i < sample_rows; i++) {
+        if (!is_float || (sampled_values[i] >= 0x007fffffU && sampled_values[i] <= 0xff800000U)) {
+            sample[kept++] = sampled_values[i];
+        }
+    }
+    if (kept == 0) {
+        remove_column_stats(column);
+        free(sample);
+        return 0;
+    }
+    qsort(sample, kept, sizeof(uint32_t), compare_encoded);
+
+    // Equi-depth bounds: the same number of sampled values falls in every bucket
+    int buckets = kept - 1 < HTY_HISTOGRAM_BUCKETS ? kept - 1 : HTY_HISTOGRAM_BUCKETS;
+    cJSON* histogram = cJSON_CreateArray();
+    for (int b = 0; b <= buckets; b++) {
+        long position = buckets > 0 ? (long)b * (kept - 1) / buckets : 0;
+        cJSON_AddItemToArray(histogram, cJSON_CreateNumber(decode_value(sample[position], is_float)));
+    }
+
+    // Most common values: runs of the sorted sample too long to be chance (three standard deviations over the average)
+    int sample_distinct = 1;
+    for (int i = 1; i < kept; i++) {
+        sample_distinct += sample[i] != sample[i - 1];
+    }
+    double average_count = (double)kept / sample_distinct;
+    int min_count = (int)(average_count + 3 * sqrt(average_count)) + 1;
+    uint32_t mcv_values[HTY_MCV_VALUES];
+    int mcv_counts[HTY_MCV_VALUES];
+    int num_mcvs = 0;
+    for (int start = 0, end; start < kept; start = end) {
+        for (end = start + 1; end < kept && sample[end] == sample[start]; end++) {
+        }
+        int count = end - start;
+        if (count < min_count || (num_mcvs == HTY_MCV_VALUES && count <= mcv_counts[num_mcvs - 1])) {
+            continue;
+        }
+        // Insert into the list kept in descending order of count
+        int slot = num_mcvs < HTY_MCV_VALUES ? num_mcvs++ : num_mcvs - 1;
+        while (slot > 0 && mcv_counts[slot - 1] < count) {
+            mcv_values[slot] = mcv_values[slot - 1];
+            mcv_counts[slot] = mcv_counts[slot - 1];
+            slot--;
+        }
+        mcv_values[slot] = sample[start];
+        mcv_counts[slot] = count;
+    }
+    cJSON* mcv = cJSON_CreateArray();
+    cJSON* mcv_frequencies = cJSON_CreateArray();
+    for (int i = 0; i < num_mcvs; i++) {
+        cJSON_AddItemToArray(mcv, cJSON_CreateNumber(decode_value(mcv_values[i], is_float)));
+        cJSON_AddItemToArray(mcv_frequencies, cJSON_CreateNumber((double)mcv_counts[i] / kept));
+    }
+
+    // A sample holding every row counts exactly; the sketch may be a little off
+    if (kept == num_rows || distinct < sample_distinct) {
+        distinct = sample_distinct;
+    }
+    set_object_item(column, "distinct", cJSON_CreateNumber(distinct < num_rows ? round(distinct) : num_rows));
+    set_object_item(column, "histogram", histogram);
+    set_object_item(column, "mcv", mcv);
+    set_object_item(column, "mcv_frequencies", mcv_frequencies);
+    free(sample);
+    return 0;
+}
+
+void remove_column_stats(cJSON* column) {
+    cJSON_DeleteItemFromObjectCaseSensitive(column, "distinct");
+    cJSON_DeleteItemFromObjectCaseSensitive(column, "histogram");
+    cJSON_DeleteItemFromObjectCaseSensitive(column, "mcv");
+    cJSON_DeleteItemFromObjectCaseSensitive(column, "mcv_frequencies");
+}
+
+int load_column_stats(cJSON* metadata, int column_index, HtyColumnStats* stats) {
+    cJSON* group = cJSON_GetArrayItem(cJSON_GetObjectItemCaseSensitive(metadata, "groups"), 0);  // Assuming single group
+    cJSON* column = cJSON_GetArrayItem(cJSON_GetObjectItemCaseSensitive(group, "columns"), column_index);
+    cJSON* distinct = cJSON_GetObjectItemCaseSensitive(column, "distinct");
+    cJSON* histogram = cJSON_GetObjectItemCaseSensitive(column, "histogram");
+    cJSON* mcv = cJSON_GetObjectItemCaseSensitive(column, "mcv");
+    cJSON* mcv_frequencies = cJSON_GetObjectItemCaseSensitive(column, "mcv_frequencies");
+    stats->num_bounds = 0;
+    stats->num_mcvs = 0;
+    if (!cJSON_IsNumber(distinct) || !cJSON_IsArray(histogram) || cJSON_GetArraySize(histogram) == 0 ||
+        cJSON_GetArraySize(histogram) > HTY_HISTOGRAM_BUCKETS + 1) {
+        return 0; // Files written before column statistics
+    }
+    stats->num_rows = (long)cJSON_GetObjectItemCaseSensitive(metadata, "num_rows")->valuedouble;
+    stats->distinct = distinct->valuedouble;
+    cJSON* item;
+    cJSON_ArrayForEach(item, histogram) {
+        stats->bounds[stats->num_bounds++] = item->valuedouble;
+    }
+    int num_mcvs = cJSON_GetArraySize(mcv);
+    for (int i = 0; i < num_mcvs && i < HTY_MCV_VALUES && i < cJSON_GetArraySize(mcv_frequencies); i++) {
+        stats->mcv_values[i] = cJSON_GetArrayItem(mcv, i)->valuedouble;
+        stats->mcv_frequencies[i] = cJSON_GetArrayItem(mcv_frequencies, i)->valuedouble;
+        stats->num_mcvs++;
+    }
+    return 1;
+}
+
+/**
+ * @brief Function to estimate the fraction of rows below a value from the histogram
+ *
+ * @param stats - statistics of the column
+ * @param value - value
+ * @return double - estimated fraction of rows less than the value
+ */
+static double fraction_below(const HtyColumnStats* stats, double value) {
+    const double* bounds = stats->bounds;
+    int last = stats->num_bounds - 1;
+    if (value <= bounds[0]) {
+        return 0;
+    }
+    if (value > bounds[last]) {
+        return 1;
+    }
+    // First bound at or above the value; assume values spread evenly inside its bucket
+    int i = 1;
+    while (bounds[i] < value) {
+        i++;
+    }
+    return (i - 1 + (value - bounds[i - 1]) / (bounds[i] - bounds[i - 1])) / last;
+}
+
+/**
+ * @brief Function to estimate the fraction of rows equal to a value
+ *
+ * @param stats - statistics of the column
+ * @param value - value
+ * @return double - estimated fraction of rows equal to the value
+ */
+static double fraction_equal(const HtyColumnStats* stats, double value) {
+    if (value < stats->bounds[0] || value > stats->bounds[stats->num_bounds - 1]) {
+        return 0;
+    }
+    double mcv_total = 0;
+    for (int i = 0; i < stats->num_mcvs; i++) {
+        if (stats->mcv_values[i] == value) {
+            return stats->mcv_frequencies[i];
+        }
+        mcv_total += stats->mcv_frequencies[i];
+    }
+    // Values outside the MCV list share the remaining rows evenly
+    double others = stats->distinct - stats->num_mcvs;
+    return (1 - mcv_total) / (others > 1 ? others : 1);
+}
+
+double estimate_selectivity(const HtyColumnStats* stats, int op, int value, int is_float) {
+    if (stats->num_bounds == 0) {
+        return 1; // Nothing known, assume everything matches
+    }
+    double number = is_float ? (double)*(float*)&value : (double)value;
+    if (number != number) {
+        return op == OP_NOT_EQUAL ? 1 : 0; // NaN only satisfies !=
+    }
+    double below = fraction_below(stats, number);
+    double equal = fraction_equal(stats, number);
+    double fraction;
+    switch (op) {
+        case OP_LESS:          fraction = below; break;
+        case OP_LESS_EQUAL:    fraction = below + equal; break;
+        case OP_GREATER:       fraction = 1 - below - equal; break;
+        case OP_GREATER_EQUAL: fraction = 1 - below; break;
+        case OP_EQUAL:         fraction = equal; break;
+        case OP_NOT_EQUAL:     fraction = 1 - equal; break;
+        default:               fraction = 1; break;
+    }
+    return fraction < 0 ? 0 : fraction > 1 ? 1 : fraction;
+}
+
+long estimate_matching_rows(cJSON* metadata, int column_index, int op, int value, int is_float) {
+    HtyColumnStats stats;
+    if (!load_column_stats(metadata, column_index, &stats)) {
+        return -1;
+    }
+    return (long)ceil(estimate_selectivity(&stats, op, value, is_float) * stats.num_rows);
+}
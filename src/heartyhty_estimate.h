@@ -0,0 +1,219 @@
+/**
+ * @file heartyhty_estimate.h
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Header file for column statistics: distinct value sketches, equi-depth histograms, most common values and selectivity estimates
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef HEARTYHTY_ESTIMATE_H
+#define HEARTYHTY_ESTIMATE_H
+
+#include <stdint.h>
+
+#define HTY_SKETCH_PRECISION 12                        // HyperLogLog index bits (about 1.6% error)
+#define HTY_SKETCH_REGISTERS (1 << HTY_SKETCH_PRECISION) // Registers of the sketch of one column
+#define HTY_SAMPLE_ROWS 32768                          // Rows of the reservoir sample behind histograms and APPROX
+#define HTY_HISTOGRAM_BUCKETS 64                       // Equi-depth buckets per column
+#define HTY_MCV_VALUES 16                              // Most common values kept per column
+#define HTY_CONFIDENCE_Z 1.96                          // Normal quantile of the 95% error bounds
+
+/**
+ * @brief Statistics of one column, read from the footer
+ *
+ * Values are doubles so int and float columns are estimated the same way.
+ * NaN is left out of the sample, so estimates cover the other values.
+ */
+typedef struct {
+    long num_rows;                                // Rows of the file
+    double distinct;                              // Estimated distinct values
+    int num_bounds;                               // Histogram bounds (buckets + 1), 0 without statistics
+    double bounds[HTY_HISTOGRAM_BUCKETS + 1];     // Equi-depth bucket bounds, ascending
+    int num_mcvs;                                 // Most common values
+    double mcv_values[HTY_MCV_VALUES];            // Most common values
+    double mcv_frequencies[HTY_MCV_VALUES];       // Fraction of the rows holding each of them
+} HtyColumnStats;
+
+/**
+ * @brief Uniform sample of whole rows, read from the footer
+ *
+ * The writer keeps it as a reservoir over every row written, so each row of
+ * the file was equally likely to be picked, also after appends.
+ */
+typedef struct {
+    long num_rows;   // Rows of the file
+    int sample_rows; // Rows in the sample
+    int** columns;   // Sampled values of every column, row aligned (float bits for float columns)
+} HtyRowSample;
+
+/**
+ * @brief Function to add a value to a distinct value sketch
+ *
+ * @param registers - HTY_SKETCH_REGISTERS registers of the column
+ * @param value - value (float bits for float columns)
+ * @param is_float - flag to indicate if value is float
+ */
+void sketch_add(unsigned char* registers, int value, int is_float);
+
+/**
+ * @brief Function to estimate the number of distinct values added to a sketch
+ *
+ * @param registers - HTY_SKETCH_REGISTERS registers of the column
+ * @return double - estimated distinct values
+ */
+double sketch_estimate(const unsigned char* registers);
+
+/**
+ * @brief Function to give the 95% error bound of a sketch estimate
+ *
+ * @param estimate - estimate from sketch_estimate()
+ * @return double - half width of the bound
+ */
+double sketch_error(double estimate);
+
+/**
+ * @brief Function to read the distinct value sketch of a column
+ *
+ * @param metadata - metadata object
+ * @param hty_file_path - path to the .hty file
+ * @param column_index - index of the column
+ * @param registers - HTY_SKETCH_REGISTERS registers to fill in
+ * @return int - 1 if read, 0 if the file has no sketches, -1 on failure
+ */
+int load_distinct_sketch(cJSON* metadata, const char* hty_file_path, int column_index, unsigned char* registers);
+
+/**
+ * @brief Function to read the row sample of a file
+ *
+ * @param metadata - metadata object
+ * @param hty_file_path - path to the .hty file
+ * @param sample - sample to fill in (free it with free_row_sample)
+ * @return int - 1 if read, 0 if the file has no row sample, -1 on failure
+ */
+int load_row_sample(cJSON* metadata, const char* hty_file_path, HtyRowSample* sample);
+
+/**
+ * @brief Function to free a row sample
+ *
+ * @param sample - sample to free (the struct itself is not freed)
+ */
+void free_row_sample(HtyRowSample* sample);
+
+/**
+ * @brief Function to estimate how many rows of the file match from the matches in the sample
+ *
+ * @param sample - row sample
+ * @param matches - sampled rows that match
+ * @param error - pointer to store the 95% error bound
+ * @return double - estimated matching rows
+ */
+double estimate_count(const HtyRowSample* sample, int matches, double* error);
+
+/**
+ * @brief Function to estimate the sum of a column over the matching rows from the sample
+ *
+ * @param sample - row sample
+ * @param values - sampled values of the column
+ * @param is_float - flag to indicate if the column is float
+ * @param rows - sampled rows that match
+ * @param matches - number of sampled rows that match
+ * @param error - pointer to store the 95% error bound
+ * @return double - estimated sum
+ */
+double estimate_sum(const HtyRowSample* sample, const int* values, int is_float, const int* rows, int matches,
+                    double* error);
+
+/**
+ * @brief Function to estimate the average of a column over the matching rows from the sample
+ *
+ * @param sample - row sample
+ * @param values - sampled values of the column
+ * @param is_float - flag to indicate if the column is float
+ * @param rows - sampled rows that match
+ * @param matches - number of sampled rows that match
+ * @param error - pointer to store the 95% error bound
+ * @return double - estimated average
+ */
+double estimate_average(const HtyRowSample* sample, const int* values, int is_float, const int* rows, int matches,
+                        double* error);
+
+/**
+ * @brief Function to estimate the distinct values of the matching rows from the sample
+ *
+ * Values seen once in the sample stand for many unseen ones, values seen
+ * more often are likely common and counted once (the GEE estimator). The
+ * bound runs from the values seen to every singleton standing for a full
+ * share of the unsampled rows, capped by the distinct values of the column.
+ * From a small share of the rows this is rough, and the bound says so.
+ *
+ * @param sample - row sample
+ * @param matches - sampled rows that match
+ * @param distinct - distinct values among them
+ * @param singletons - values seen exactly once among them
+ * @param column_distinct - distinct values of the whole column, or -1 if unknown
+ * @param error - pointer to store the error bound
+ * @return double - estimated distinct values
+ */
+double estimate_distinct(const HtyRowSample* sample, int matches, int distinct, int singletons, double column_distinct,
+                         double* error);
+
+/**
+ * @brief Function to store the statistics of a column next to its definition in the metadata
+ *
+ * Sets "distinct", "histogram" (bucket bounds), "mcv" and "mcv_frequencies"
+ * on the column object. The sample itself is left as it is.
+ *
+ * @param column - column object from the metadata
+ * @param sampled_values - sampled values, sort encoded (see encode_sort_value())
+ * @param sample_rows - number of sampled values
+ * @param num_rows - rows of the file
+ * @param is_float - flag to indicate if the column is float
+ * @param distinct - estimated distinct values
+ * @return int - 0 on success, -1 on failure
+ */
+int store_column_stats(cJSON* column, const uint32_t* sampled_values, int sample_rows, long num_rows, int is_float,
+                       double distinct);
+
+/**
+ * @brief Function to remove the statistics of a column from the metadata
+ *
+ * @param column - column object from the metadata
+ */
+void remove_column_stats(cJSON* column);
+
+/**
+ * @brief Function to read the statistics of a column
+ *
+ * @param metadata - metadata object
+ * @param column_index - index of the column
+ * @param stats - pointer to store the statistics
+ * @return int - 1 if the column has statistics, 0 if not (files written before them)
+ */
+int load_column_stats(cJSON* metadata, int column_index, HtyColumnStats* stats);
+
+/**
+ * @brief Function to estimate the fraction of rows matching a predicate
+ *
+ * @param stats - statistics of the column
+ * @param op - operation for filtering
+ * @param value - value to filter against (float bits for float columns)
+ * @param is_float - flag to indicate if the column is float
+ * @return double - estimated fraction, 0 to 1
+ */
+double estimate_selectivity(const HtyColumnStats* stats, int op, int value, int is_float);
+
+/**
+ * @brief Function to estimate the number of rows matching a predicate
+ *
+ * @param metadata - metadata object
+ * @param column_index - index of the column
+ * @param op - operation for filtering
+ * @param value - value to filter against (float bits for float columns)
+ * @param is_float - flag to indicate if the column is float
+ * @return long - estimated matching rows, -1 if the column has no statistics
+ */
+long estimate_matching_rows(cJSON* metadata, int column_index, int op, int value, int is_float);
+
+#endif // HEARTYHTY_ESTIMATE_H
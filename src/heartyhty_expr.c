@@ -0,0 +1,478 @@
+/**
+ * @file heartyhty_expr.c
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Computed columns: expression trees evaluated a batch of rows at a time
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include "../third_party/cJSON/cJSON.h"
+#include "heartyhty_functions.h"
+#include "heartyhty_expr.h"
+
+/**
+ * @brief Function to allocate an empty node
+ *
+ * @param kind - EXPR_* kind
+ * @return HtyExpr* - node, NULL on failure
+ */
+static HtyExpr* new_node(int kind) {
+    HtyExpr* expr = (HtyExpr*)calloc(1, sizeof(HtyExpr));
+    if (expr == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return NULL;
+    }
+    expr->kind = kind;
+    expr->position = -1;
+    return expr;
+}
+
+HtyExpr* make_column_expr(const char* column) {
+    HtyExpr* expr = new_node(EXPR_COLUMN);
+    if (expr != NULL && (expr->name = strdup(column)) == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(expr);
+        return NULL;
+    }
+    return expr;
+}
+
+HtyExpr* make_constant_expr(const char* text) {
+    char* end;
+    int type = strpbrk(text, ".eE") != NULL;
+    long number = 0;
+    if (!type) {
+        errno = 0;
+        number = strtol(text, &end, 10);
+        type = errno == ERANGE || number < INT_MIN || number > INT_MAX; // Too large for an int, read it as a float
+    }
+    int value;
+    if (type) {
+        float real = strtof(text, &end);
+        memcpy(&value, &real, sizeof(float)); // Store float bits as int
+    } else {
+        value = (int)number;
+    }
+    if (end == text || *end != '\0') {
+        return NULL;
+    }
+    HtyExpr* expr = new_node(EXPR_CONSTANT);
+    if (expr == NULL) {
+        return NULL;
+    }
+    expr->type = type;
+    expr->value = value;
+    expr->name = strdup(text);
+    if (expr->name == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(expr);
+        return NULL;
+    }
+    return expr;
+}
+
+/**
+ * @brief Function to negate a number in place, so "-5" stays a constant
+ *
+ * @param expr - EXPR_CONSTANT node
+ * @return HtyExpr* - the node, NULL on failure (the node is freed)
+ */
+static HtyExpr* negate_constant(HtyExpr* expr) {
+    char* name = (char*)malloc(strlen(expr->name) + 2);
+    if (name == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free_expr(expr);
+        return NULL;
+    }
+    if (expr->name[0] == '-') {
+        strcpy(name, expr->name + 1);
+    } else {
+        name[0] = '-';
+        strcpy(name + 1, expr->name);
+    }
+    free(expr->name);
+    expr->name = name;
+    expr->value = expr->type ? (int)((unsigned int)expr->value ^ 0x80000000u) : (int)(0u - (unsigned int)expr->value);
+    return expr;
+}
+
+HtyExpr* make_expr(int kind, int op, HtyExpr** args, int num_args) {
+    int complete = args != NULL;
+    for (int i = 0; i < num_args && complete; i++) {
+        complete = args[i] != NULL;
+    }
+    if (complete && kind == EXPR_NEGATE && args[0]->kind == EXPR_CONSTANT) {
+        HtyExpr* constant = args[0];
+        free(args);
+        return negate_constant(constant);
+    }
+    HtyExpr* expr = complete ? new_node(kind) : NULL;
+    if (expr == NULL) {
+        for (int i = 0; args != NULL && i < num_args; i++) {
+            free_expr(args[i]);
+        }
+        free(args);
+        return NULL;
+    }
+    expr->op = op;
+    expr->args = args;
+    expr->num_args = num_args;
+    return expr;
+}
+
+int count_expr_columns(const HtyExpr* expr) {
+    int count = expr->kind == EXPR_COLUMN;
+    for (int i = 0; i < expr->num_args; i++) {
+        count += count_expr_columns(expr->args[i]);
+    }
+    return count;
+}
+
+void collect_expr_columns(HtyExpr* expr, char** names, int* count) {
+    if (expr->kind == EXPR_COLUMN) {
+        int found = 0;
+        for (int i = 0; i < *count && !found; i++) {
+            found = strcmp(names[i], expr->name) == 0;
+        }
+        if (!found) {
+            names[(*count)++] = expr->name;
+        }
+    }
+    for (int i = 0; i < expr->num_args; i++) {
+        collect_expr_columns(expr->args[i], names, count);
+    }
+}
+
+/**
+ * @brief Function to allocate the batch buffer of a bound node
+ *
+ * @param expr - node
+ * @return int - 0 on success, -1 on failure
+ */
+static int allocate_values(HtyExpr* expr) {
+    if (expr->values == NULL) {
+        expr->values = (int*)malloc(HTY_EXPR_BATCH * sizeof(int));
+        if (expr->values == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            return -1;
+        }
+    }
+    if (expr->kind == EXPR_CONSTANT) {
+        for (int i = 0; i < HTY_EXPR_BATCH; i++) {
+            expr->values[i] = expr->value; // Constants are filled once, not per batch
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Function to convert an int operand of a node to float
+ *
+ * @param expr - node
+ * @param index - operand to convert
+ * @return int - 0 on success, -1 on failure
+ */
+static int convert_to_float(HtyExpr* expr, int index) {
+    if (expr->args[index]->type == 1) {
+        return 0;
+    }
+    HtyExpr** args = (HtyExpr**)malloc(sizeof(HtyExpr*));
+    HtyExpr* conversion = new_node(EXPR_TO_FLOAT);
+    if (args == NULL || conversion == NULL || allocate_values(conversion) != 0) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(args);
+        free(conversion);
+        return -1;
+    }
+    args[0] = expr->args[index];
+    conversion->args = args;
+    conversion->num_args = 1;
+    conversion->type = 1;
+    expr->args[index] = conversion;
+    return 0;
+}
+
+int bind_expr(HtyExpr* expr, char** column_names, const int* column_types, int num_columns) {
+    for (int i = 0; i < expr->num_args; i++) {
+        if (bind_expr(expr->args[i], column_names, column_types, num_columns) != 0) {
+            return -1;
+        }
+    }
+    int status = 0;
+    switch (expr->kind) {
+        case EXPR_COLUMN:
+            expr->position = -1;
+            for (int i = 0; i < num_columns && expr->position < 0; i++) {
+                if (strcmp(column_names[i], expr->name) == 0) {
+                    expr->position = i;
+                    expr->type = column_types[i];
+                }
+            }
+            if (expr->position < 0) {
+                fprintf(stderr, "Column not found: %s\n", expr->name);
+                return -1;
+            }
+            break;
+        case EXPR_ADD:
+        case EXPR_SUBTRACT:
+        case EXPR_MULTIPLY:
+        case EXPR_DIVIDE:
+        case EXPR_MODULO:
+        case EXPR_COMPARE:
+            // Mixed operands are compared and computed as floats
+            expr->type = expr->args[0]->type | expr->args[1]->type;
+            if (expr->type) {
+                status = convert_to_float(expr, 0) == 0 && convert_to_float(expr, 1) == 0 ? 0 : -1;
+            }
+            if (expr->kind == EXPR_COMPARE) {
+                expr->type = 0;
+            }
+            break;
+        case EXPR_NEGATE:
+            expr->type = expr->args[0]->type;
+            break;
+        case EXPR_TO_FLOAT:
+            expr->type = 1;
+            break;
+        case EXPR_CASE:
+            // The results (every second operand and the last) share one type
+            expr->type = 0;
+            for (int i = 1; i < expr->num_args; i += 2) {
+                expr->type |= expr->args[i]->type;
+            }
+            expr->type |= expr->args[expr->num_args - 1]->type;
+            for (int i = 1; i < expr->num_args && expr->type && status == 0; i += 2) {
+                status = convert_to_float(expr, i);
+            }
+            if (expr->type && status == 0) {
+                status = convert_to_float(expr, expr->num_args - 1);
+            }
+            break;
+        case EXPR_CONSTANT:
+            break;
+        default: // EXPR_TO_INT and the conditions
+            expr->type = 0;
+            break;
+    }
+    return status == 0 ? allocate_values(expr) : -1;
+}
+
+/**
+ * @brief Function to evaluate an arithmetic node on a batch
+ *
+ * @param expr - EXPR_ADD to EXPR_MODULO node
+ * @param a - values of the first operand
+ * @param b - values of the second operand
+ * @param count - number of values
+ */
+static void eval_arithmetic(HtyExpr* expr, const int* a, const int* b, int count) {
+    int* out = expr->values;
+    if (expr->type) {
+        const float* x = (const float*)a;
+        const float* y = (const float*)b;
+        float* result = (float*)out;
+        switch (expr->kind) {
+            case EXPR_ADD:      for (int i = 0; i < count; i++) result[i] = x[i] + y[i]; break;
+            case EXPR_SUBTRACT: for (int i = 0; i < count; i++) result[i] = x[i] - y[i]; break;
+            case EXPR_MULTIPLY: for (int i = 0; i < count; i++) result[i] = x[i] * y[i]; break;
+            case EXPR_DIVIDE:   for (int i = 0; i < count; i++) result[i] = x[i] / y[i]; break;
+            default:            for (int i = 0; i < count; i++) result[i] = fmodf(x[i], y[i]); break;
+        }
+        return;
+    }
+    // Ints wrap around like the hardware does; division by 0 (and the one overflowing division) give 0 or wrap
+    const unsigned int* x = (const unsigned int*)a;
+    const unsigned int* y = (const unsigned int*)b;
+    switch (expr->kind) {
+        case EXPR_ADD:      for (int i = 0; i < count; i++) out[i] = (int)(x[i] + y[i]); break;
+        case EXPR_SUBTRACT: for (int i = 0; i < count; i++) out[i] = (int)(x[i] - y[i]); break;
+        case EXPR_MULTIPLY: for (int i = 0; i < count; i++) out[i] = (int)(x[i] * y[i]); break;
+        case EXPR_DIVIDE:
+            for (int i = 0; i < count; i++) {
+                out[i] = b[i] == 0 ? 0 : b[i] == -1 ? (int)(0u - x[i]) : a[i] / b[i];
+            }
+            break;
+        default:
+            for (int i = 0; i < count; i++) {
+                out[i] = b[i] == 0 || b[i] == -1 ? 0 : a[i] % b[i];
+            }
+            break;
+    }
+}
+
+/**
+ * @brief Function to evaluate a comparison on a batch
+ *
+ * @param expr - EXPR_COMPARE node
+ * @param a - values of the first operand
+ * @param b - values of the second operand
+ * @param count - number of values
+ */
+static void eval_compare(HtyExpr* expr, const int* a, const int* b, int count) {
+    int* out = expr->values;
+    if (expr->args[0]->type) {
+        const float* x = (const float*)a;
+        const float* y = (const float*)b;
+        switch (expr->op) {
+            case OP_GREATER:       for (int i = 0; i < count; i++) out[i] = x[i] > y[i]; break;
+            case OP_GREATER_EQUAL: for (int i = 0; i < count; i++) out[i] = x[i] >= y[i]; break;
+            case OP_LESS:          for (int i = 0; i < count; i++) out[i] = x[i] < y[i]; break;
+            case OP_LESS_EQUAL:    for (int i = 0; i < count; i++) out[i] = x[i] <= y[i]; break;
+            case OP_EQUAL:         for (int i = 0; i < count; i++) out[i] = x[i] == y[i]; break;
+            default:               for (int i = 0; i < count; i++) out[i] = x[i] != y[i]; break;
+        }
+        return;
+    }
+    switch (expr->op) {
+        case OP_GREATER:       for (int i = 0; i < count; i++) out[i] = a[i] > b[i]; break;
+        case OP_GREATER_EQUAL: for (int i = 0; i < count; i++) out[i] = a[i] >= b[i]; break;
+        case OP_LESS:          for (int i = 0; i < count; i++) out[i] = a[i] < b[i]; break;
+        case OP_LESS_EQUAL:    for (int i = 0; i < count; i++) out[i] = a[i] <= b[i]; break;
+        case OP_EQUAL:         for (int i = 0; i < count; i++) out[i] = a[i] == b[i]; break;
+        default:               for (int i = 0; i < count; i++) out[i] = a[i] != b[i]; break;
+    }
+}
+
+/**
+ * @brief Function to turn a batch of values into 1 (true) or 0 (false)
+ *
+ * @param type - type of the values (0 for int, 1 for float)
+ * @param values - values
+ * @param truth - output, may be values itself
+ * @param count - number of values
+ */
+static void truth_values(int type, const int* values, int* truth, int count) {
+    if (type) {
+        const float* real = (const float*)values;
+        for (int i = 0; i < count; i++) truth[i] = real[i] != 0;
+    } else {
+        for (int i = 0; i < count; i++) truth[i] = values[i] != 0;
+    }
+}
+
+const int* eval_expr(HtyExpr* expr, int** columns, const int* rows, int count) {
+    int* out = expr->values;
+    switch (expr->kind) {
+        case EXPR_COLUMN: {
+            const int* column = columns[expr->position];
+            for (int i = 0; i < count; i++) out[i] = column[rows[i]]; // Float bits are copied the same way
+            break;
+        }
+        case EXPR_CONSTANT:
+            break;
+        case EXPR_ADD:
+        case EXPR_SUBTRACT:
+        case EXPR_MULTIPLY:
+        case EXPR_DIVIDE:
+        case EXPR_MODULO: {
+            const int* a = eval_expr(expr->args[0], columns, rows, count);
+            const int* b = eval_expr(expr->args[1], columns, rows, count);
+            eval_arithmetic(expr, a, b, count);
+            break;
+        }
+        case EXPR_COMPARE: {
+            const int* a = eval_expr(expr->args[0], columns, rows, count);
+            const int* b = eval_expr(expr->args[1], columns, rows, count);
+            eval_compare(expr, a, b, count);
+            break;
+        }
+        case EXPR_NEGATE: {
+            const unsigned int* a = (const unsigned int*)eval_expr(expr->args[0], columns, rows, count);
+            unsigned int flip = expr->type ? 0x80000000u : 0;
+            if (expr->type) {
+                for (int i = 0; i < count; i++) out[i] = (int)(a[i] ^ flip);
+            } else {
+                for (int i = 0; i < count; i++) out[i] = (int)(0u - a[i]);
+            }
+            break;
+        }
+        case EXPR_TO_INT: {
+            const int* a = eval_expr(expr->args[0], columns, rows, count);
+            if (expr->args[0]->type) {
+                const float* real = (const float*)a;
+                for (int i = 0; i < count; i++) {
+                    float value = real[i];
+                    out[i] = value != value ? 0 : value >= 2147483648.0f ? INT_MAX :
+                             value < -2147483648.0f ? INT_MIN : (int)value;
+                }
+            } else {
+                memcpy(out, a, count * sizeof(int));
+            }
+            break;
+        }
+        case EXPR_TO_FLOAT: {
+            const int* a = eval_expr(expr->args[0], columns, rows, count);
+            if (expr->args[0]->type) {
+                memcpy(out, a, count * sizeof(int));
+            } else {
+                float* result = (float*)out;
+                for (int i = 0; i < count; i++) result[i] = (float)a[i];
+            }
+            break;
+        }
+        case EXPR_AND:
+        case EXPR_OR: {
+            truth_values(expr->args[0]->type, eval_expr(expr->args[0], columns, rows, count), out, count);
+            const int* b = eval_expr(expr->args[1], columns, rows, count);
+            const float* real = (const float*)b;
+            int type = expr->args[1]->type;
+            if (expr->kind == EXPR_AND) {
+                for (int i = 0; i < count; i++) out[i] &= type ? real[i] != 0 : b[i] != 0;
+            } else {
+                for (int i = 0; i < count; i++) out[i] |= type ? real[i] != 0 : b[i] != 0;
+            }
+            break;
+        }
+        case EXPR_NOT:
+            truth_values(expr->args[0]->type, eval_expr(expr->args[0], columns, rows, count), out, count);
+            for (int i = 0; i < count; i++) out[i] ^= 1;
+            break;
+        case EXPR_CASE: {
+            // Every branch is evaluated for the whole batch, then the first true condition picks per row
+            memcpy(out, eval_expr(expr->args[expr->num_args - 1], columns, rows, count), count * sizeof(int));
+            for (int w = expr->num_args - 3; w >= 0; w -= 2) {
+                const int* condition = eval_expr(expr->args[w], columns, rows, count);
+                const int* result = eval_expr(expr->args[w + 1], columns, rows, count);
+                const float* real = (const float*)condition;
+                int type = expr->args[w]->type;
+                for (int i = 0; i < count; i++) {
+                    int taken = type ? real[i] != 0 : condition[i] != 0;
+                    out[i] = taken ? result[i] : out[i];
+                }
+            }
+            break;
+        }
+    }
+    return out;
+}
+
+int select_true_rows(int type, const int* values, int* rows, int count) {
+    int kept = 0;
+    const float* real = (const float*)values;
+    for (int i = 0; i < count; i++) {
+        rows[kept] = rows[i];
+        kept += type ? real[i] != 0 : values[i] != 0; // No branch on the outcome
+    }
+    return kept;
+}
+
+void free_expr(HtyExpr* expr) {
+    if (expr == NULL) {
+        return;
+    }
+    for (int i = 0; i < expr->num_args; i++) {
+        free_expr(expr->args[i]);
+    }
+    free(expr->args);
+    free(expr->name);
+    free(expr->values);
+    free(expr);
+}
@@ -0,0 +1,142 @@
+/**
+ * @file heartyhty_expr.h
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Header file for computed columns: expression trees evaluated a batch of rows at a time
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef HEARTYHTY_EXPR_H
+#define HEARTYHTY_EXPR_H
+
+#define HTY_EXPR_BATCH 1024 // Rows evaluated at a time; every node keeps one batch of output
+
+#define EXPR_COLUMN 0    // Value of a column
+#define EXPR_CONSTANT 1  // Number
+#define EXPR_ADD 2       // a + b
+#define EXPR_SUBTRACT 3  // a - b
+#define EXPR_MULTIPLY 4  // a * b
+#define EXPR_DIVIDE 5    // a / b (0 for an int division by zero)
+#define EXPR_MODULO 6    // a % b (0 for an int modulo by zero)
+#define EXPR_NEGATE 7    // -a
+#define EXPR_TO_INT 8    // CAST(a AS INT), truncating and clamped to the int range
+#define EXPR_TO_FLOAT 9  // CAST(a AS FLOAT)
+#define EXPR_COMPARE 10  // a op b, 1 or 0
+#define EXPR_AND 11      // a AND b, 1 or 0
+#define EXPR_OR 12       // a OR b, 1 or 0
+#define EXPR_NOT 13      // NOT a, 1 or 0
+#define EXPR_CASE 14     // CASE WHEN a THEN b [WHEN ...] ELSE c END: arguments a, b, ..., c
+
+/**
+ * @brief Node of an expression tree
+ *
+ * Values are 32-bit like the columns: ints, or float bits for floats. A
+ * condition is true when its value is not 0.
+ */
+typedef struct HtyExpr {
+    int kind;               // EXPR_* kind
+    int type;               // Type of the value (0 for int, 1 for float), set for columns by bind_expr()
+    int op;                 // OP_* comparison of EXPR_COMPARE
+    int value;              // Value of EXPR_CONSTANT
+    char* name;             // Column name of EXPR_COLUMN, text of EXPR_CONSTANT
+    int position;           // Input column of EXPR_COLUMN, set by bind_expr()
+    struct HtyExpr** args;  // Operands
+    int num_args;           // Number of operands
+    int* values;            // Output of the last batch, allocated by bind_expr()
+} HtyExpr;
+
+/**
+ * @brief Function to make a column reference
+ *
+ * @param column - column name (copied)
+ * @return HtyExpr* - expression, NULL on failure
+ */
+HtyExpr* make_column_expr(const char* column);
+
+/**
+ * @brief Function to make a number
+ *
+ * @param text - number as written, read as a float if it has a '.' or an exponent
+ * @return HtyExpr* - expression, NULL if the text is not a number
+ */
+HtyExpr* make_constant_expr(const char* text);
+
+/**
+ * @brief Function to make an operator node
+ *
+ * @param kind - EXPR_* kind other than EXPR_COLUMN and EXPR_CONSTANT
+ * @param op - OP_* comparison for EXPR_COMPARE, ignored otherwise
+ * @param args - operands, owned by the new node (freed on failure)
+ * @param num_args - number of operands
+ * @return HtyExpr* - expression, NULL on failure
+ */
+HtyExpr* make_expr(int kind, int op, HtyExpr** args, int num_args);
+
+/**
+ * @brief Function to count the column references of an expression
+ *
+ * @param expr - expression
+ * @return int - number of EXPR_COLUMN nodes
+ */
+int count_expr_columns(const HtyExpr* expr);
+
+/**
+ * @brief Function to add the columns an expression reads to a list, once each
+ *
+ * @param expr - expression
+ * @param names - list of column names (with room for count_expr_columns() more); names point into expr
+ * @param count - number of names in the list, updated
+ */
+void collect_expr_columns(HtyExpr* expr, char** names, int* count);
+
+/**
+ * @brief Function to compile an expression for the columns it will be evaluated on
+ *
+ * Finds each referenced column among the input columns, types every node
+ * (an int operand meeting a float one is converted, comparisons and
+ * conditions give ints), fills constants and allocates the batch buffers.
+ * An expression may be bound again for other input columns.
+ *
+ * @param expr - expression
+ * @param column_names - names of the input columns
+ * @param column_types - types of the input columns (0 for int, 1 for float)
+ * @param num_columns - number of input columns
+ * @return int - 0 on success, -1 on an unknown column or failure
+ */
+int bind_expr(HtyExpr* expr, char** column_names, const int* column_types, int num_columns);
+
+/**
+ * @brief Function to evaluate a bound expression on a batch of rows
+ *
+ * Each node runs one tight loop over the batch, so the compiler can
+ * vectorize it, and writes into its own buffer; nothing is allocated.
+ *
+ * @param expr - bound expression
+ * @param columns - input columns, in the order given to bind_expr()
+ * @param rows - rows of the input columns to evaluate
+ * @param count - number of rows, at most HTY_EXPR_BATCH
+ * @return const int* - count values of type expr->type, valid until the next evaluation
+ */
+const int* eval_expr(HtyExpr* expr, int** columns, const int* rows, int count);
+
+/**
+ * @brief Function to keep the rows for which a batch of values is true
+ *
+ * @param type - type of the values (0 for int, 1 for float)
+ * @param values - values from eval_expr()
+ * @param rows - rows the values belong to, compacted in place
+ * @param count - number of rows
+ * @return int - number of rows kept
+ */
+int select_true_rows(int type, const int* values, int* rows, int count);
+
+/**
+ * @brief Function to free an expression
+ *
+ * @param expr - expression, or NULL
+ */
+void free_expr(HtyExpr* expr);
+
+#endif // HEARTYHTY_EXPR_H
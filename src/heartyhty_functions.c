@@ -12,18 +12,28 @@
 #include <stdlib.h>
 #include <string.h>
 #include "../third_party/cJSON/cJSON.h"
-
-// For task 4 Filter a single column
-#define OP_GREATER 1 // >
-#define OP_GREATER_EQUAL 2 // >=
-#define OP_LESS 3 // <
-#define OP_LESS_EQUAL 4 // <=
-#define OP_EQUAL 5 // =
-#define OP_NOT_EQUAL 6 /* != */ 
+#include "heartyhty_functions.h"
+#include "heartyhty_writer.h"
+#include "heartyhty_sort.h"
+#include "heartyhty_index.h"
+#include "heartyhty_bloom.h"
+#include "heartyhty_topk.h"
+#include "heartyhty_io.h"
+#include "heartyhty_pool.h"
+#include "heartyhty_snapshot.h"
+#include "heartyhty_results.h"
+#include "heartyhty_output.h"
+#include "heartyhty_arena.h"
+#include "heartyhty_stats.h"
+#include "heartyhty_estimate.h"
+#include "heartyhty_delete.h"
 
 cJSON* extract_metadata(const char* hty_file_path) {
+    HtyStageTimer timer;
+    HTY_STAGE_BEGIN(timer);
+
     // Open the data.hty file
-    FILE* file = fopen(hty_file_path, "rb");
+    FILE* file = open_snapshot(hty_file_path);
     if (file == NULL) {
         fprintf(stderr, "Error opening file: %s\n", hty_file_path);
         return NULL;
@@ -41,10 +51,13 @@ cJSON* extract_metadata(const char* hty_file_path) {
     metadata_str[metadata_size] = '\0';
 
     fclose(file);
+    HTY_STATS_ADD(io_syscalls, 3);  // open and the two reads
+    HTY_STATS_ADD(bytes_read, metadata_size + 4);
 
     // Parse the JSON metadata
     cJSON* metadata = cJSON_Parse(metadata_str);
     free(metadata_str);
+    HTY_STAGE_END(HTY_STAGE_METADATA, timer);
 
     if (metadata == NULL) {
         const char* error_ptr = cJSON_GetErrorPtr();
@@ -58,6 +71,9 @@ cJSON* extract_metadata(const char* hty_file_path) {
 }
 
 int* project_single_column(cJSON* metadata, const char* hty_file_path, const char* projected_column, int* size) {
+    HtyStageTimer query_timer, timer;
+    HTY_STAGE_BEGIN(query_timer);
+
     // Find the column in metadata
     cJSON* groups = cJSON_GetObjectItemCaseSensitive(metadata, "groups"); // Get groups array
     cJSON* group = cJSON_GetArrayItem(groups, 0);  // Assuming single group
@@ -65,8 +81,7 @@ int* project_single_column(cJSON* metadata, const char* hty_file_path, const cha
     
     int column_index = -1; // Column index
     int column_type = -1;  // 0 for int, 1 for float
-    int num_rows = cJSON_GetObjectItemCaseSensitive(metadata, "num_rows")->valueint; // Get number of rows
-    int offset = cJSON_GetObjectItemCaseSensitive(group, "offset")->valueint; // Get offset
+    int num_rows = count_live_rows(metadata); // Get number of rows that are not deleted
     
     cJSON* column; // Column object
     cJSON_ArrayForEach(column, columns) { // Iterate over columns to get column type
@@ -77,40 +92,33 @@ int* project_single_column(cJSON* metadata, const char* hty_file_path, const cha
         }
     }
     
-    if (column_index == -1) { // If column not found, return
+    if (column_type == -1) { // If column not found, return
         fprintf(stderr, "Column not found: %s\n", projected_column);
         return NULL;
     }
     
-    // Open the file and read the data
-    FILE* file = fopen(hty_file_path, "rb");
-    if (file == NULL) {
-        fprintf(stderr, "Error opening file: %s\n", hty_file_path);
+    // Read the column one row group at a time (from the buffer pool where possible)
+    HtyColumnReader* reader = open_column_reader(metadata, hty_file_path, &column_index, 1, NULL);
+    if (reader == NULL) {
         return NULL;
     }
     
-    fseek(file, offset, SEEK_SET); // Set file pointer to offset
-    
-    int* result = (int*)malloc(num_rows * sizeof(int)); // Allocate memory for result
+    int* result = (int*)malloc((num_rows + 1) * sizeof(int)); // Allocate memory for result
     *size = num_rows;
+    HTY_STATS_ADD(allocations, 1);
+    HTY_STATS_ADD(allocated_bytes, num_rows * sizeof(int));
     
-    for (int i = 0; i < num_rows; i++) { // Iterate over rows to read data
-        for (int j = 0; j < column_index; j++) {
-            fseek(file, sizeof(int), SEEK_CUR);  // Skip other columns
-        }
-        
-        if (column_type == 0) {  // int
-            fread(&result[i], sizeof(int), 1, file);
-        } else {  // float
-            float temp;
-            fread(&temp, sizeof(float), 1, file);
-            result[i] = *(int*)&temp;  // Reinterpret float as int since we store data as int array
-        }
-        
-        // Skip to the next row
-        fseek(file, (cJSON_GetArraySize(columns) - column_index - 1) * sizeof(int), SEEK_CUR);
+    int** block;
+    int first_row, rows_in_block;
+    int result_index = 0;
+    while (next_column_block(reader, &block, &first_row, &rows_in_block) == 1) {
+        HTY_STAGE_BEGIN(timer);
+        memcpy(result + result_index, block[0], rows_in_block * sizeof(int)); // Float bits are stored the same way
+        result_index += rows_in_block;
+        HTY_STAGE_END(HTY_STAGE_GATHER, timer);
     }
-    fclose(file);
+    close_column_reader(reader);
+    HTY_QUERY_END("project_single_column", query_timer);
     return result;
 }
 
@@ -134,17 +142,9 @@ void display_column(cJSON* metadata, const char* column_name, int* data, int siz
         return;
     }
     
-    // Display column name
-    printf("%s\n", column_name);
-    
-    // Display data
-    for (int i = 0; i < size; i++) {
-        if (column_type == 0) {  // int
-            printf("%d\n", data[i]);
-        } else {  // float
-            printf("%.1f\n", *(float*)&data[i]); // Reinterpret int as float since we store data as int array
-        }
-    }
+    // Display column name and data, formatted in large buffers
+    char* column_names[1] = {(char*)column_name};
+    write_delimited(stdout, column_names, &column_type, 1, &data, size, "", HTY_FLOAT_DISPLAY);
 }
 
 int compare_values(int value1, int value2, int operation, int is_float) {
@@ -174,7 +174,161 @@ int compare_values(int value1, int value2, int operation, int is_float) {
     }
 }
 
-int* filter(cJSON* metadata, const char* hty_file_path, const char* projected_column, int operation, int filtered_value, int* size) {
+int range_may_match(int min_value, int max_value, int operation, int value, int is_float) {
+    // A range can only be ruled out when no value between min and max satisfies the predicate
+    switch (operation) {
+        case OP_GREATER:       return compare_values(max_value, value, OP_GREATER, is_float);
+        case OP_GREATER_EQUAL: return compare_values(max_value, value, OP_GREATER_EQUAL, is_float);
+        case OP_LESS:          return compare_values(min_value, value, OP_LESS, is_float);
+        case OP_LESS_EQUAL:    return compare_values(min_value, value, OP_LESS_EQUAL, is_float);
+        case OP_EQUAL:         return compare_values(min_value, value, OP_LESS_EQUAL, is_float) &&
+                                      compare_values(max_value, value, OP_GREATER_EQUAL, is_float);
+        case OP_NOT_EQUAL:     return !(compare_values(min_value, value, OP_EQUAL, is_float) &&
+                                        compare_values(max_value, value, OP_EQUAL, is_float));
+        default:               return 1;
+    }
+}
+
+int get_column_range(cJSON* column, int is_float, int* min_value, int* max_value) {
+    cJSON* min_obj = cJSON_GetObjectItemCaseSensitive(column, "min");
+    cJSON* max_obj = cJSON_GetObjectItemCaseSensitive(column, "max");
+    if (!cJSON_IsNumber(min_obj) || !cJSON_IsNumber(max_obj)) {
+        return 0; // No footer statistics for this column
+    }
+
+    if (is_float) {
+        float min_float = (float)min_obj->valuedouble;
+        float max_float = (float)max_obj->valuedouble;
+        *min_value = *(int*)&min_float; // Store float bits as int like the rest of the data
+        *max_value = *(int*)&max_float;
+    } else {
+        *min_value = min_obj->valueint;
+        *max_value = max_obj->valueint;
+    }
+    return 1;
+}
+
+/**
+ * @brief Function to check whether a row group may hold rows matching a predicate, from its zone map
+ *
+ * Zone maps hold sort-encoded values, whose order is the value order. A float
+ * zero matches both +0.0 and -0.0, which encode differently, so the predicate
+ * value is the range [low, high] of its encodings.
+ *
+ * @param zone_min - encoded minimum of the row group
+ * @param zone_max - encoded maximum of the row group
+ * @param operation - operation to perform
+ * @param value - value to compare against
+ * @param is_float - flag to indicate if value is float
+ * @return int - 0 if no row can match, 1 otherwise
+ */
+static int zone_may_match(uint32_t zone_min, uint32_t zone_max, int operation, int value, int is_float) {
+    uint32_t low = encode_sort_value(value, is_float), high = low;
+    if (is_float) {
+        if ((value & 0x7fffffff) > 0x7f800000) {
+            return 1; // NaN predicate value: leave it to the row filter
+        }
+        if ((value & 0x7fffffff) == 0) {
+            low = encode_sort_value((int)0x80000000U, 1);
+            high = encode_sort_value(0, 1);
+        }
+    }
+    switch (operation) {
+        case OP_GREATER:       return zone_max > high;
+        case OP_GREATER_EQUAL: return zone_max >= low;
+        case OP_LESS:          return zone_min < low;
+        case OP_LESS_EQUAL:    return zone_min <= high;
+        case OP_EQUAL:         return zone_min <= high && zone_max >= low;
+        case OP_NOT_EQUAL:     return !(zone_min >= low && zone_max <= high);
+        default:               return 1;
+    }
+}
+
+int* row_groups_to_read(cJSON* metadata, const char* hty_file_path, const char* column_name, int column_index,
+                        int is_float, int operation, const int* values, int num_values) {
+    int* row_groups = operation == OP_EQUAL ?
+        bloom_row_groups_to_read(metadata, hty_file_path, column_name, values, num_values) : NULL;
+    int num_row_groups = 0;
+    unsigned int* zone_map = read_zone_map(metadata, hty_file_path, column_index, &num_row_groups);
+    if (zone_map == NULL) {
+        return row_groups; // File was written before zone maps existed
+    }
+    if (row_groups == NULL) {
+        row_groups = (int*)malloc((num_row_groups + 1) * sizeof(int));
+        for (int group = 0; group < num_row_groups && row_groups != NULL; group++) {
+            row_groups[group] = 1;
+        }
+    }
+    for (int group = 0; group < num_row_groups && row_groups != NULL; group++) {
+        int may_match = 0;
+        for (int i = 0; i < num_values && row_groups[group] && !may_match; i++) {
+            // A list of values matches a row group holding any of them
+            may_match = zone_may_match(zone_map[2 * group], zone_map[2 * group + 1],
+                                       num_values == 1 ? operation : OP_EQUAL, values[i], is_float);
+        }
+        row_groups[group] = may_match;
+    }
+    free(zone_map);
+    return row_groups;
+}
+
+unsigned long long get_file_id(cJSON* metadata) {
+    cJSON* file_id = cJSON_GetObjectItemCaseSensitive(metadata, "file_id");
+    if (!cJSON_IsString(file_id)) {
+        return 0; // Written before file ids
+    }
+    return strtoull(file_id->valuestring, NULL, 16);
+}
+
+int get_block_rows(cJSON* metadata) {
+    cJSON* block_rows = cJSON_GetObjectItemCaseSensitive(metadata, "block_rows");
+    if (!cJSON_IsNumber(block_rows) || block_rows->valueint <= 0) {
+        return HTY_DEFAULT_BLOCK_ROWS; // Older files are scanned in default sized row groups
+    }
+    return block_rows->valueint;
+}
+
+/**
+ * @brief Function to check a value against one predicate or a list of values
+ * 
+ * @param value - value to check
+ * @param operation - operation to perform (OP_EQUAL for a list)
+ * @param values - value to compare against, or list of values
+ * @param num_values - number of values (more than 1 means "equal to any")
+ * @param is_float - flag to indicate if value is float
+ * @return int - 1 if the value matches
+ */
+static int value_matches(int value, int operation, const int* values, int num_values, int is_float) {
+    if (num_values == 1) {
+        return compare_values(value, values[0], operation, is_float);
+    }
+    for (int i = 0; i < num_values; i++) {
+        if (compare_values(value, values[i], OP_EQUAL, is_float)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Function to scan a column for values matching a predicate or a list of values
+ * 
+ * Row groups whose zone map rules the predicate out, or whose Bloom filter
+ * rules out every value of an equality predicate, are skipped without being read. When the column has statistics
+ * the result is sized from the estimated matches and filled in one pass;
+ * otherwise a first pass counts the matches.
+ * 
+ * @param metadata - metadata object
+ * @param hty_file_path - path to hty file
+ * @param projected_column - column to filter
+ * @param operation - operation to perform (OP_EQUAL for a list)
+ * @param values - value to compare against, or list of values
+ * @param num_values - number of values
+ * @param size - size of the result
+ * @return int* - matching values in row order
+ */
+static int* scan_filter(cJSON* metadata, const char* hty_file_path, const char* projected_column,
+                        int operation, const int* values, int num_values, int* size) {
     // Find the column in metadata
     cJSON* groups = cJSON_GetObjectItemCaseSensitive(metadata, "groups"); // Get groups array
     cJSON* group = cJSON_GetArrayItem(groups, 0);  // Assuming single group
@@ -182,16 +336,16 @@ int* filter(cJSON* metadata, const char* hty_file_path, const char* projected_co
     
     int column_index = -1; // Column index
     int column_type = -1;  // 0 for int, 1 for float
-    int num_rows = cJSON_GetObjectItemCaseSensitive(metadata, "num_rows")->valueint; // Get number of rows
-    int offset = cJSON_GetObjectItemCaseSensitive(group, "offset")->valueint; // Get offset
     
+    int col_idx = 0;
     cJSON* column; // Column object
     cJSON_ArrayForEach(column, columns) { // Iterate over columns to get column type
-        column_index++;
         if (strcmp(cJSON_GetObjectItemCaseSensitive(column, "column_name")->valuestring, projected_column) == 0) {
+            column_index = col_idx;
             column_type = strcmp(cJSON_GetObjectItemCaseSensitive(column, "column_type")->valuestring, "float") == 0 ? 1 : 0;
             break; //got column type!
         }
+        col_idx++;
     }
 
     if (column_index == -1) { // If column not found, return
@@ -199,96 +353,184 @@ int* filter(cJSON* metadata, const char* hty_file_path, const char* projected_co
         return NULL;
     }
     
-    // Open the file and read the data
-    FILE* file = fopen(hty_file_path, "rb");
-    if (file == NULL) {
-        fprintf(stderr, "Error opening file: %s\n", hty_file_path);
-        return NULL;
-    }
+    // Skip the row groups that the zone maps (or, for equality, the Bloom filters) rule out
+    int* row_groups = row_groups_to_read(metadata, hty_file_path, projected_column, column_index, column_type,
+                                         operation, values, num_values);
+    int** block;
+    int first_row, rows_in_block;
+    HtyStageTimer timer;
+    HtyColumnReader* reader;
     
-    fseek(file, offset, SEEK_SET); // Set file pointer to offset
+    // One pass into a buffer sized from the statistics, grown if the estimate was low
+    long estimate = num_values == 1 ? estimate_matching_rows(metadata, column_index, operation, values[0], column_type) : -1;
+    if (estimate >= 0) {
+        long capacity = estimate + estimate / 4 + get_block_rows(metadata);
+        int* result = (int*)malloc(capacity * sizeof(int));
+        int result_index = 0;
+        reader = result != NULL ? open_column_reader(metadata, hty_file_path, &column_index, 1, row_groups) : NULL;
+        while (reader != NULL && next_column_block(reader, &block, &first_row, &rows_in_block) == 1) {
+            if (result_index + (long)rows_in_block > capacity) {
+                capacity = 2 * capacity > result_index + (long)rows_in_block ? 2 * capacity : result_index + (long)rows_in_block;
+                int* grown = (int*)realloc(result, capacity * sizeof(int));
+                if (grown == NULL) {
+                    fprintf(stderr, "Memory allocation failed\n");
+                    free(result);
+                    result = NULL;
+                    break;
+                }
+                result = grown;
+            }
+            HTY_STAGE_BEGIN(timer);
+            for (int i = 0; i < rows_in_block; i++) {
+                int current_value = block[0][i];
+                result[result_index] = current_value;
+                result_index += value_matches(current_value, operation, values, num_values, column_type);
+            }
+            HTY_STAGE_END(HTY_STAGE_FILTER, timer);
+        }
+        close_column_reader(reader);
+        HTY_STATS_ADD(allocations, 1);
+        HTY_STATS_ADD(allocated_bytes, capacity * sizeof(int));
+        *size = result_index;
+        free(row_groups);
+        return result;
+    }
     
-    // First pass the count of matching rows
+    // First pass the count of matching rows (row groups ruled out above are never read)
     int matching_rows = 0;
-    int total_columns = cJSON_GetArraySize(columns);
-    int row_size = total_columns * sizeof(int);
-
-    for (int i = 0; i < num_rows; i++) {
-        // Skip to target column
-        fseek(file, column_index * sizeof(int), SEEK_CUR);
-
-        // Read the value
-        int current_value;
-        if (column_type == 0) {  // int
-            fread(&current_value, sizeof(int), 1, file);
-        } else {  // float
-            float temp;
-            fread(&temp, sizeof(float), 1, file);
-            current_value = *(int*)&temp;  // Reinterpret float as int since we store data as int array
-        }
-
-        // Compare and match the value
-        if (compare_values(current_value, filtered_value, operation, column_type)) {
-            matching_rows++;
+    reader = open_column_reader(metadata, hty_file_path, &column_index, 1, row_groups);
+    while (reader != NULL && next_column_block(reader, &block, &first_row, &rows_in_block) == 1) {
+        HTY_STAGE_BEGIN(timer);
+        for (int i = 0; i < rows_in_block; i++) {
+            if (value_matches(block[0][i], operation, values, num_values, column_type)) {
+                matching_rows++;
+            }
         }
-
-        // Skip to next row
-        fseek(file, (total_columns - column_index - 1) * sizeof(int), SEEK_CUR);
+        HTY_STAGE_END(HTY_STAGE_FILTER, timer);
     }
+    close_column_reader(reader);
     
     // Allocate result array
     int* result = (int*)malloc(matching_rows * sizeof(int));
     *size = matching_rows;
+    HTY_STATS_ADD(allocations, 1);
+    HTY_STATS_ADD(allocated_bytes, matching_rows * sizeof(int));
 
     // Second pass: collect matching values
-    fseek(file, offset, SEEK_SET);
     int result_index = 0;
-    
-    for (int i = 0; i < num_rows; i++) {
-        // Skip to the target column
-        fseek(file, column_index * sizeof(int), SEEK_CUR);
-        
-        // Read the value
-        int current_value;
-        if (column_type == 0) {  // int
-            fread(&current_value, sizeof(int), 1, file);
-        } else {  // float
-            float temp;
-            fread(&temp, sizeof(float), 1, file);
-            current_value = *(int*)&temp;
-        }
-        
-        // Store if matches
-        if (compare_values(current_value, filtered_value, operation, column_type)) {
-            result[result_index++] = current_value;
+    reader = open_column_reader(metadata, hty_file_path, &column_index, 1, row_groups);
+    while (reader != NULL && result_index < matching_rows && next_column_block(reader, &block, &first_row, &rows_in_block) == 1) {
+        HTY_STAGE_BEGIN(timer);
+        for (int i = 0; i < rows_in_block && result_index < matching_rows; i++) {
+            int current_value = block[0][i];
+            if (value_matches(current_value, operation, values, num_values, column_type)) {
+                result[result_index++] = current_value;
+            }
         }
-        
-        // Skip to next row
-        fseek(file, (total_columns - column_index - 1) * sizeof(int), SEEK_CUR);
+        HTY_STAGE_END(HTY_STAGE_FILTER, timer);
     }
-    fclose(file);
+    close_column_reader(reader);
+    *size = result_index;
+    free(row_groups);
     return result;
 }
 
-int** project(cJSON* metadata, const char* hty_file_path, char** projected_columns, int num_columns, int* row_count) {
-    // Get basic metadata info
+/**
+ * @brief Function to decide from the column statistics whether probing the column index can pay off
+ * 
+ * index_lookup() only finds out how many rows match after opening the index
+ * and searching it; predicates estimated to match well beyond
+ * HTY_INDEX_MAX_SELECTIVITY go straight to the scan. The margin covers the
+ * estimation error.
+ * 
+ * @param metadata - metadata object
+ * @param column_index - index of the filtered column
+ * @param op - operation for filtering
+ * @param value - value to filter against
+ * @param is_float - flag to indicate if the column is float
+ * @return int - 1 to try the index, 0 to scan
+ */
+static int index_may_help(cJSON* metadata, int column_index, int op, int value, int is_float) {
+    long estimate = estimate_matching_rows(metadata, column_index, op, value, is_float);
+    int num_rows = cJSON_GetObjectItemCaseSensitive(metadata, "num_rows")->valueint;
+    return estimate < 0 || estimate <= 2 * HTY_INDEX_MAX_SELECTIVITY * num_rows;
+}
+
+int* filter(cJSON* metadata, const char* hty_file_path, const char* projected_column, int operation, int filtered_value, int* size) {
+    HtyStageTimer query_timer;
+    HTY_STAGE_BEGIN(query_timer);
+    int column_index, is_float;
+    char* column_name = (char*)projected_column;
+    if (resolve_columns(metadata, &column_name, 1, &column_index, &is_float) != 0) {
+        return NULL;
+    }
+    
+    // Repeated and tighter predicates are answered from the result cache
+    HtyFileVersion version;
+    int* result;
+    if (lookup_result(hty_file_path, &version, NULL, 0, column_index, is_float, operation, filtered_value,
+                      &result, NULL, size) == 1) {
+        HTY_STATS_ADD(rows_matched, *size);
+        HTY_QUERY_END("filter", query_timer);
+        return result;
+    }
+    
+    // Answer selective predicates from the column index, if there is one
+    if (!index_may_help(metadata, column_index, operation, filtered_value, is_float) ||
+        index_lookup(metadata, hty_file_path, projected_column, operation, filtered_value, NULL, &result, size) != 1) {
+        result = scan_filter(metadata, hty_file_path, projected_column, operation, &filtered_value, 1, size);
+    }
+    if (result != NULL) {
+        store_result(&version, NULL, 0, column_index, is_float, operation, filtered_value, result, NULL, *size);
+        HTY_STATS_ADD(rows_matched, *size);
+    }
+    HTY_QUERY_END("filter", query_timer);
+    return result;
+}
+
+int* filter_in(cJSON* metadata, const char* hty_file_path, const char* projected_column, const int* values, int num_values, int* size) {
+    if (num_values <= 0) {
+        *size = 0;
+        return (int*)malloc(sizeof(int)); // Empty IN list matches nothing
+    }
+    HtyStageTimer query_timer;
+    HTY_STAGE_BEGIN(query_timer);
+    int* result = scan_filter(metadata, hty_file_path, projected_column, OP_EQUAL, values, num_values, size);
+    if (result != NULL) {
+        HTY_STATS_ADD(rows_matched, *size);
+    }
+    HTY_QUERY_END("filter_in", query_timer);
+    return result;
+}
+
+void get_row_layout(cJSON* metadata, HtyRowLayout* layout) {
+    cJSON* group = cJSON_GetArrayItem(cJSON_GetObjectItemCaseSensitive(metadata, "groups"), 0);  // Assuming single group
+    layout->offset = (long)cJSON_GetObjectItemCaseSensitive(group, "offset")->valuedouble;
+    layout->row_bytes = cJSON_GetArraySize(cJSON_GetObjectItemCaseSensitive(group, "columns")) * sizeof(int);
+    layout->block_rows = get_block_rows(metadata);
+    layout->block_stride = (long)layout->block_rows * layout->row_bytes;
+    cJSON* block_stride = cJSON_GetObjectItemCaseSensitive(metadata, "block_stride");
+    if (cJSON_IsNumber(block_stride) && (long)block_stride->valuedouble >= layout->block_stride) {
+        layout->block_stride = (long)block_stride->valuedouble;
+    }
+}
+
+long row_position(const HtyRowLayout* layout, int row) {
+    return layout->offset + (long)(row / layout->block_rows) * layout->block_stride +
+           (long)(row % layout->block_rows) * layout->row_bytes;
+}
+
+int resolve_columns(cJSON* metadata, char** column_names, int num_columns, int* column_indices, int* column_types) {
     cJSON* groups = cJSON_GetObjectItemCaseSensitive(metadata, "groups");
     cJSON* group = cJSON_GetArrayItem(groups, 0);  // Assuming single group
     cJSON* columns = cJSON_GetObjectItemCaseSensitive(group, "columns");
-    int num_rows = cJSON_GetObjectItemCaseSensitive(metadata, "num_rows")->valueint;
-    int offset = cJSON_GetObjectItemCaseSensitive(group, "offset")->valueint;
-    int total_columns = cJSON_GetArraySize(columns);
-    
-    // Find indices and types for all projected columns
-    int* column_indices = (int*)malloc(num_columns  * sizeof(int)); 
-    int* column_types = (int*)malloc(num_columns * sizeof(int));  // 0 for int, 1 for float
     
-    for (int i = 0; i < num_columns; i++) { // Iterate over projected columns
+    for (int i = 0; i < num_columns; i++) { // Iterate over requested columns
         column_indices[i] = -1;
         int col_idx = 0;
         cJSON* column;
         cJSON_ArrayForEach(column, columns) {
-            if (strcmp(cJSON_GetObjectItemCaseSensitive(column, "column_name")->valuestring, projected_columns[i]) == 0) { 
+            if (strcmp(cJSON_GetObjectItemCaseSensitive(column, "column_name")->valuestring, column_names[i]) == 0) { 
                 column_indices[i] = col_idx;  //if column found, store index and type
                 column_types[i] = strcmp(cJSON_GetObjectItemCaseSensitive(column, "column_type")->valuestring, "float") == 0 ? 1 : 0;
                 break; //got column index and type!
@@ -296,55 +538,85 @@ int** project(cJSON* metadata, const char* hty_file_path, char** projected_colum
             col_idx++;
         }
         if (column_indices[i] == -1) { // If column not found, return
-            fprintf(stderr, "Column not found: %s\n", projected_columns[i]);
-            free(column_indices);
-            free(column_types);
-            return NULL;
+            fprintf(stderr, "Column not found: %s\n", column_names[i]);
+            return -1;
         }
     }
+    return 0;
+}
+
+int** project(cJSON* metadata, const char* hty_file_path, char** projected_columns, int num_columns, int* row_count) {
+    return project_into_arena(NULL, metadata, hty_file_path, projected_columns, num_columns, row_count);
+}
+
+/**
+ * @brief Function to project multiple columns (see project_into_arena())
+ *
+ * @param arena - arena, or NULL
+ * @param metadata - metadata object
+ * @param hty_file_path - path to hty file
+ * @param projected_columns - array of column names to project
+ * @param num_columns - number of columns to project
+ * @param row_count - pointer to store number of rows
+ * @return int** - 2D array of projected data
+ */
+static int** project_columns(HtyArena* arena, cJSON* metadata, const char* hty_file_path, char** projected_columns,
+                             int num_columns, int* row_count) {
+    // Get basic metadata info
+    int num_rows = count_live_rows(metadata);
+    
+    // Find indices and types for all projected columns
+    int* column_indices = (int*)arena_alloc(arena, num_columns * sizeof(int)); 
+    int* column_types = (int*)arena_alloc(arena, num_columns * sizeof(int));  // 0 for int, 1 for float
+    if (resolve_columns(metadata, projected_columns, num_columns, column_indices, column_types) != 0) {
+        arena_release(arena, column_indices);
+        arena_release(arena, column_types);
+        return NULL;
+    }
 
     // Allocate result array
-    int** result = (int**)malloc(num_columns * sizeof(int*)); // Allocate for number of columns to point to rows
+    int** result = (int**)arena_alloc(arena, num_columns * sizeof(int*)); // Allocate for number of columns to point to rows
     for (int i = 0; i < num_columns; i++) { // Loops through each columns index
-        result[i] = (int*)malloc(num_rows * sizeof(int)); // Allocate memory for number of rows
+        result[i] = (int*)arena_alloc(arena, num_rows * sizeof(int)); // Allocate memory for number of rows
     }
     *row_count = num_rows;
     
-    // Open file and read data
-    FILE* file = fopen(hty_file_path, "rb");
-    if (file == NULL) {
-        fprintf(stderr, "Error opening file: %s\n", hty_file_path);
+    // Read the projected columns one row group at a time (from the buffer pool where possible)
+    HtyColumnReader* reader = open_column_reader_in_arena(arena, metadata, hty_file_path, column_indices, num_columns, NULL);
+    if (reader == NULL) {
         for (int i = 0; i < num_columns; i++) {
-            free(result[i]);
+            arena_release(arena, result[i]);
         }
-        free(result);
-        free(column_indices);
-        free(column_types);
+        arena_release(arena, result);
+        arena_release(arena, column_indices);
+        arena_release(arena, column_types);
         return NULL;
     }
     
-    // Loop over each row int he file
-    for (int row = 0; row < num_rows; row++) {
-        // Set file pointer to start of current row by adding offset and row index * total columns * size of int
-        fseek(file, offset + (row * total_columns * sizeof(int)), SEEK_SET);
-        // Loop over each column in the row
+    int** block;
+    int first_row, rows_in_block;
+    HtyStageTimer timer;
+    int result_index = 0;
+    while (next_column_block(reader, &block, &first_row, &rows_in_block) == 1) {
+        HTY_STAGE_BEGIN(timer);
         for (int col = 0; col < num_columns; col++) {
-            // Move to column position by adding column index * size of int
-            fseek(file, offset + (row * total_columns * sizeof(int)) + 
-                  (column_indices[col] * sizeof(int)), SEEK_SET);
-            
-            if (column_types[col] == 0) {  // int
-                fread(&result[col][row], sizeof(int), 1, file); // stor data in result array
-            } else {  // float
-                float temp; //cast to float 
-                fread(&temp, sizeof(float), 1, file); 
-                result[col][row] = *(int*)&temp; // Reinterpret float as int since we store data as int array
-            }
+            memcpy(result[col] + result_index, block[col], rows_in_block * sizeof(int)); // Float bits are stored the same way
         }
+        result_index += rows_in_block;
+        HTY_STAGE_END(HTY_STAGE_GATHER, timer);
     }
-    fclose(file);
-    free(column_indices);
-    free(column_types);
+    close_column_reader(reader);
+    arena_release(arena, column_indices);
+    arena_release(arena, column_types);
+    return result;
+}
+
+int** project_into_arena(HtyArena* arena, cJSON* metadata, const char* hty_file_path, char** projected_columns,
+                         int num_columns, int* row_count) {
+    HtyStageTimer query_timer;
+    HTY_STAGE_BEGIN(query_timer);
+    int** result = project_columns(arena, metadata, hty_file_path, projected_columns, num_columns, row_count);
+    HTY_QUERY_END("project", query_timer);
     return result;
 }
 
@@ -368,38 +640,103 @@ void display_result_set(cJSON* metadata, char** column_names, int num_columns, i
             }
         }
     }
-    
-    // Print header
-    for (int i = 0; i < num_columns; i++) {
-        printf("%s", column_names[i]);
-        if (i < num_columns - 1) printf(", ");
-    }
-    printf("\n");
-    
-    // Print data rows
-    for (int row = 0; row < row_count; row++) {
-        for (int col = 0; col < num_columns; col++) {
-            if (column_types[col] == 0) {  // int
-                printf("%d", result_set[col][row]);  
-            } else {  // float
-                printf("%.1f", *(float*)&result_set[col][row]);
-            }
-            if (col < num_columns - 1) printf(", ");
-        }
-        printf("\n");
-    }
+    display_typed_result_set(column_names, column_types, num_columns, result_set, row_count);
     free(column_types);
 }
 
+void display_typed_result_set(char** column_names, const int* column_types, int num_columns, int** result_set, int row_count) {
+    // Print header and data rows, formatted in large buffers
+    write_delimited(stdout, column_names, column_types, num_columns, result_set, row_count, ", ", HTY_FLOAT_DISPLAY);
+}
+
 int** project_and_filter(cJSON* metadata, const char* hty_file_path, char** projected_columns, 
                         int num_columns, const char* filtered_column, int op, int value, int* row_count) {
+    return project_and_filter_into_arena(NULL, metadata, hty_file_path, projected_columns, num_columns,
+                                         filtered_column, op, value, row_count);
+}
+
+/**
+ * @brief Function to move a result the result cache returned into an arena
+ *
+ * @param arena - arena
+ * @param result - result columns from the cache (freed)
+ * @param num_columns - number of columns
+ * @param row_count - number of rows
+ * @return int** - result columns in the arena
+ */
+static int** move_result_into_arena(HtyArena* arena, int** result, int num_columns, int row_count) {
+    if (arena == NULL || result == NULL) {
+        return result;
+    }
+    int** moved = (int**)arena_alloc(arena, num_columns * sizeof(int*));
+    for (int i = 0; i < num_columns && moved != NULL; i++) {
+        moved[i] = (int*)arena_alloc(arena, row_count * sizeof(int));
+        if (moved[i] != NULL && row_count > 0) {
+            memcpy(moved[i], result[i], row_count * sizeof(int));
+        }
+    }
+    for (int i = 0; i < num_columns; i++) {
+        free(result[i]);
+    }
+    free(result);
+    return moved;
+}
+
+/**
+ * @brief Function to grow the matching row ids and values of project_and_filter
+ * 
+ * @param arena - arena of the arrays, or NULL
+ * @param indices - pointer to the row ids
+ * @param values - pointer to the values
+ * @param count - number of matches so far
+ * @param capacity - pointer to the capacity, doubled (at most max_rows)
+ * @param max_rows - rows of the table
+ * @return int - 0 on success, -1 if out of memory
+ */
+static int grow_matches(HtyArena* arena, int** indices, int** values, int count, long* capacity, int max_rows) {
+    long grown = 2 * *capacity < max_rows ? 2 * *capacity : max_rows;
+    int* grown_indices = (int*)arena_alloc(arena, (grown + 1) * sizeof(int));
+    int* grown_values = (int*)arena_alloc(arena, (grown + 1) * sizeof(int));
+    if (grown_indices == NULL || grown_values == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        arena_release(arena, grown_indices);
+        arena_release(arena, grown_values);
+        return -1;
+    }
+    memcpy(grown_indices, *indices, count * sizeof(int));
+    memcpy(grown_values, *values, count * sizeof(int));
+    arena_release(arena, *indices);
+    arena_release(arena, *values);
+    *indices = grown_indices;
+    *values = grown_values;
+    *capacity = grown;
+    return 0;
+}
+
+/**
+ * @brief Function to project columns with filtering (see project_and_filter_into_arena())
+ *
+ * @param arena - arena, or NULL
+ * @param metadata - metadata object
+ * @param hty_file_path - path to hty file
+ * @param projected_columns - array of column names to project
+ * @param num_columns - number of columns to project
+ * @param filtered_column - column to apply filter on
+ * @param op - operation for filtering
+ * @param value - value to filter against
+ * @param row_count - pointer to store number of resulting rows
+ * @return int** - 2D array of filtered and projected data
+ */
+static int** project_and_filter_columns(HtyArena* arena, cJSON* metadata, const char* hty_file_path,
+                                        char** projected_columns, int num_columns, const char* filtered_column,
+                                        int op, int value, int* row_count) {
     // Get basic metadata info
     cJSON* groups = cJSON_GetObjectItemCaseSensitive(metadata, "groups");
     cJSON* group = cJSON_GetArrayItem(groups, 0);
     cJSON* columns = cJSON_GetObjectItemCaseSensitive(group, "columns");
     int total_rows = cJSON_GetObjectItemCaseSensitive(metadata, "num_rows")->valueint;
-    int offset = cJSON_GetObjectItemCaseSensitive(group, "offset")->valueint;
-    int total_columns = cJSON_GetArraySize(columns);
+    HtyRowLayout layout;
+    get_row_layout(metadata, &layout);
     
     // Find filter column index and type
     int filter_column_index = -1;
@@ -422,77 +759,105 @@ int** project_and_filter(cJSON* metadata, const char* hty_file_path, char** proj
     }
     
     // Find indices and types for projected columns
-    int* column_indices = (int*)malloc(num_columns * sizeof(int));
-    int* column_types = (int*)malloc(num_columns * sizeof(int));
+    int* column_indices = (int*)arena_alloc(arena, num_columns * sizeof(int));
+    int* column_types = (int*)arena_alloc(arena, num_columns * sizeof(int));
+    if (resolve_columns(metadata, projected_columns, num_columns, column_indices, column_types) != 0) {
+        arena_release(arena, column_indices);
+        arena_release(arena, column_types);
+        return NULL;
+    }
     
-    for (int i = 0; i < num_columns; i++) {
-        column_indices[i] = -1;
-        col_idx = 0;
-        cJSON_ArrayForEach(column, columns) {
-            if (strcmp(cJSON_GetObjectItemCaseSensitive(column, "column_name")->valuestring, 
-                      projected_columns[i]) == 0) {
-                column_indices[i] = col_idx;
-                column_types[i] = strcmp(cJSON_GetObjectItemCaseSensitive(column, "column_type")->valuestring, 
-                                       "float") == 0 ? 1 : 0;
-                break;
-            }
-            col_idx++;
-        }
-        if (column_indices[i] == -1) {
-            fprintf(stderr, "Projected column not found: %s\n", projected_columns[i]);
-            free(column_indices);
-            free(column_types);
-            return NULL;
-        }
+    // Repeated and tighter predicates are answered from the result cache
+    HtyFileVersion version;
+    int** result = NULL;
+    if (lookup_result(hty_file_path, &version, column_indices, num_columns, filter_column_index, filter_column_type,
+                      op, value, NULL, &result, row_count) == 1) {
+        arena_release(arena, column_indices);
+        arena_release(arena, column_types);
+        return move_result_into_arena(arena, result, num_columns, *row_count);
     }
     
     // Open file
-    FILE* file = fopen(hty_file_path, "rb");
+    FILE* file = open_snapshot(hty_file_path);
     if (file == NULL) {
         fprintf(stderr, "Error opening file: %s\n", hty_file_path);
-        free(column_indices);
-        free(column_types);
+        arena_release(arena, column_indices);
+        arena_release(arena, column_types);
         return NULL;
     }
     
     // First pass: count matching rows
     int matching_rows = 0;
-    int* matching_indices = (int*)malloc(total_rows * sizeof(int));
+    int* matching_indices = NULL;
+    int* matching_values = NULL;  // Filter column values, kept for the result cache
+    HtyArena* matching_arena = NULL; // Arena of matching_indices and matching_values (index_lookup mallocs them)
+    int scan_failed = 0;
     
-    for (int row = 0; row < total_rows; row++) {
-        // Read filter column value
-        fseek(file, offset + (row * total_columns * sizeof(int)) + 
-              (filter_column_index * sizeof(int)), SEEK_SET);
+    // Selective predicates get their matching rows from the column index, if there is one
+    if (!index_may_help(metadata, filter_column_index, op, value, filter_column_type) ||
+        index_lookup(metadata, hty_file_path, filtered_column, op, value, &matching_indices, &matching_values,
+                     &matching_rows) != 1) {
+        // Size the matches from the statistics instead of the whole table, growing them if the estimate was low
+        long estimate = estimate_matching_rows(metadata, filter_column_index, op, value, filter_column_type);
+        long capacity = estimate < 0 ? total_rows : estimate + estimate / 4 + layout.block_rows;
+        capacity = capacity < total_rows ? capacity : total_rows;
+        matching_arena = arena;
+        matching_indices = (int*)arena_alloc(arena, (capacity + 1) * sizeof(int));
+        matching_values = (int*)arena_alloc(arena, (capacity + 1) * sizeof(int));
         
-        int current_value;
-        if (filter_column_type == 0) {  // int
-            fread(&current_value, sizeof(int), 1, file);
-        } else {  // float
-            float temp;
-            fread(&temp, sizeof(float), 1, file);
-            current_value = *(int*)&temp;
-        }
-        
-        // Check if row matches filter condition
-        if (compare_values(current_value, value, op, filter_column_type)) {
-            matching_indices[matching_rows] = row;
-            matching_rows++;
+        // Skip the row groups that the zone maps (or, for equality, the Bloom filters) rule out
+        int* row_groups = row_groups_to_read(metadata, hty_file_path, filtered_column, filter_column_index,
+                                             filter_column_type, op, &value, 1);
+        int** block;
+        int first_row, rows_in_block;
+        HtyStageTimer timer;
+        HtyColumnReader* reader = open_column_reader_in_arena(arena, metadata, hty_file_path, &filter_column_index, 1,
+                                                              row_groups);
+        while (reader != NULL && next_column_block(reader, &block, &first_row, &rows_in_block) == 1) {
+            if (matching_rows + (long)rows_in_block > capacity &&
+                grow_matches(arena, &matching_indices, &matching_values, matching_rows, &capacity, total_rows) != 0) {
+                scan_failed = 1;
+                break;
+            }
+            // Check if each row matches filter condition
+            HTY_STAGE_BEGIN(timer);
+            const int* row_ids = column_block_row_ids(reader); // Set when deleted rows were left out
+            for (int i = 0; i < rows_in_block; i++) {
+                if (compare_values(block[0][i], value, op, filter_column_type)) {
+                    matching_indices[matching_rows] = row_ids != NULL ? row_ids[i] : first_row + i;
+                    matching_values[matching_rows] = block[0][i];
+                    matching_rows++;
+                }
+            }
+            HTY_STAGE_END(HTY_STAGE_FILTER, timer);
         }
+        close_column_reader(reader);
+        free(row_groups);
+    }
+    if (scan_failed) {
+        fclose(file);
+        arena_release(matching_arena, matching_indices);
+        arena_release(matching_arena, matching_values);
+        arena_release(arena, column_indices);
+        arena_release(arena, column_types);
+        return NULL;
     }
     
     // Allocate result array
-    int** result = NULL;
     if (matching_rows > 0) {
-        result = (int**)malloc(num_columns * sizeof(int*));
+        result = (int**)arena_alloc(arena, num_columns * sizeof(int*));
         for (int i = 0; i < num_columns; i++) {
-            result[i] = (int*)malloc(matching_rows * sizeof(int));
+            result[i] = (int*)arena_alloc(arena, matching_rows * sizeof(int));
         }
         
         // Read matching rows for each projected column
+        HtyStageTimer timer;
+        HTY_STAGE_BEGIN(timer);
+        HTY_STATS_ADD(io_syscalls, (long)num_columns * matching_rows);
+        HTY_STATS_ADD(bytes_read, (long)num_columns * matching_rows * sizeof(int));
         for (int i = 0; i < num_columns; i++) {
             for (int j = 0; j < matching_rows; j++) {
-                fseek(file, offset + (matching_indices[j] * total_columns * sizeof(int)) + 
-                      (column_indices[i] * sizeof(int)), SEEK_SET);
+                fseek(file, row_position(&layout, matching_indices[j]) + column_indices[i] * sizeof(int), SEEK_SET);
                 
                 if (column_types[i] == 0) {  // int
                     fread(&result[i][j], sizeof(int), 1, file);
@@ -503,26 +868,42 @@ int** project_and_filter(cJSON* metadata, const char* hty_file_path, char** proj
                 }
             }
         }
+        HTY_STAGE_END(HTY_STAGE_GATHER, timer);
     }
     
     *row_count = matching_rows;
+    store_result(&version, column_indices, num_columns, filter_column_index, filter_column_type, op, value,
+                 matching_values, result, matching_rows);
     
     // Cleanup
     fclose(file);
-    free(matching_indices);
-    free(column_indices);
-    free(column_types);
+    arena_release(matching_arena, matching_indices);
+    arena_release(matching_arena, matching_values);
+    arena_release(arena, column_indices);
+    arena_release(arena, column_types);
     
     return result;
 }
 
+int** project_and_filter_into_arena(HtyArena* arena, cJSON* metadata, const char* hty_file_path, char** projected_columns,
+                                    int num_columns, const char* filtered_column, int op, int value, int* row_count) {
+    HtyStageTimer query_timer;
+    HTY_STAGE_BEGIN(query_timer);
+    int** result = project_and_filter_columns(arena, metadata, hty_file_path, projected_columns, num_columns,
+                                              filtered_column, op, value, row_count);
+    if (result != NULL) {
+        HTY_STATS_ADD(rows_matched, *row_count);
+    }
+    HTY_QUERY_END("project_and_filter", query_timer);
+    return result;
+}
+
 void add_row(cJSON* metadata, const char* hty_file_path, const char* modified_hty_file_path, int** rows, int num_rows, int num_columns) {
     // Get basic metadata info
     cJSON* groups = cJSON_GetObjectItemCaseSensitive(metadata, "groups");
     cJSON* group = cJSON_GetArrayItem(groups, 0);
     cJSON* columns = cJSON_GetObjectItemCaseSensitive(group, "columns");
     int current_rows = cJSON_GetObjectItemCaseSensitive(metadata, "num_rows")->valueint;
-    int offset = cJSON_GetObjectItemCaseSensitive(group, "offset")->valueint;
     int total_columns = cJSON_GetArraySize(columns);
 
     // Verify number of columns matches
@@ -533,7 +914,7 @@ void add_row(cJSON* metadata, const char* hty_file_path, const char* modified_ht
     }
 
     // Open the source file for reading
-    FILE* source_file = fopen(hty_file_path, "rb");
+    FILE* source_file = open_snapshot(hty_file_path);
     if (source_file == NULL) {
         fprintf(stderr, "Error opening source file: %s\n", hty_file_path);
         return;
@@ -547,11 +928,10 @@ void add_row(cJSON* metadata, const char* hty_file_path, const char* modified_ht
         return;
     }
 
-    // Get metadata size and position
-    fseek(source_file, -4, SEEK_END);
-    int metadata_size;
-    fread(&metadata_size, sizeof(int), 1, source_file);
-    long metadata_position = ftell(source_file) - metadata_size - 4;
+    // Raw data ends after the last row (and the padding of a full last row group); what follows it is rewritten
+    HtyRowLayout layout;
+    get_row_layout(metadata, &layout);
+    long data_end = row_position(&layout, current_rows);
 
     // Copy data section from source to destination
     char buffer[4096];
@@ -559,7 +939,7 @@ void add_row(cJSON* metadata, const char* hty_file_path, const char* modified_ht
     fseek(source_file, 0, SEEK_SET);
 
     // Copy up to the original data end
-    for (long remaining = metadata_position; remaining > 0; remaining -= bytes_read) {
+    for (long remaining = data_end; remaining > 0; remaining -= bytes_read) {
         bytes_read = fread(buffer, 1, (remaining < sizeof(buffer)) ? remaining : sizeof(buffer), source_file);
         fwrite(buffer, 1, bytes_read, dest_file);
     }
@@ -589,37 +969,65 @@ void add_row(cJSON* metadata, const char* hty_file_path, const char* modified_ht
         col_idx++;
     }
 
-    // Write each new row
+    // Write each new row, keeping the footer statistics up to date
+    HtyWriter* writer = create_writer(dest_file, total_columns, column_types);
+    int* row = (int*)malloc(total_columns * sizeof(int));
+    free(column_types);
+    if (writer == NULL || row == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free_writer(writer);
+        free(row);
+        fclose(source_file);
+        fclose(dest_file);
+        return;
+    }
+    load_writer_statistics(writer, metadata);
+    if (load_writer_bloom_filters(writer, metadata, source_file) != 0 ||
+        load_writer_zone_maps(writer, metadata, source_file) != 0 ||
+        load_writer_column_stats(writer, metadata, source_file) != 0) {
+        free_writer(writer);
+        free(row);
+        fclose(source_file);
+        fclose(dest_file);
+        return;
+    }
+
     for (int i = 0; i < num_rows; i++) {
         for (int j = 0; j < total_columns; j++) {
-            if (column_types[j] == 0) { // int
-                fwrite(&rows[j][i], sizeof(int), 1, dest_file);
-            } else { // float
-                float float_val = *(float*)&rows[j][i];
-                fwrite(&float_val, sizeof(float), 1, dest_file);
-            }
+            row[j] = rows[j][i]; // int values and float bits are stored the same way
         }
+        write_row(writer, row);
     }
+    free(row);
 
-    free(column_types);
+    // Merge the new rows into the column indexes of the file
+    append_to_indexes(metadata, hty_file_path, modified_hty_file_path, rows, num_rows);
 
-    // Update metadata
-    cJSON_SetNumberValue(cJSON_GetObjectItemCaseSensitive(metadata, "num_rows"), current_rows + num_rows);
-
-    // Write updated metadata
-    char* metadata_str = cJSON_PrintUnformatted(metadata);
-    if (!metadata_str) {
-        fprintf(stderr, "Error creating metadata string\n");
+    // Deleted rows keep their ids; their bitmap goes back after the new footer
+    HtyRowBitmap deleted;
+    if (load_deleted_rows(metadata, hty_file_path, &deleted) < 0) {
+        free_writer(writer);
         fclose(source_file);
         fclose(dest_file);
         return;
     }
+    cJSON_DeleteItemFromObjectCaseSensitive(metadata, "deletes");
 
-    int new_metadata_size = strlen(metadata_str);
-    fwrite(metadata_str, 1, new_metadata_size, dest_file);
-    fwrite(&new_metadata_size, sizeof(int), 1, dest_file);
+    // Update metadata
+    cJSON_SetNumberValue(cJSON_GetObjectItemCaseSensitive(metadata, "num_rows"), current_rows + num_rows);
+
+    // Write updated metadata
+    finish_writer(writer, metadata);
+    free_writer(writer);
 
-    free(metadata_str);
     fclose(source_file);
     fclose(dest_file);
+    if (deleted.cardinality > 0) {
+        write_deleted_rows(metadata, modified_hty_file_path, &deleted);
+    }
+    free_bitmap(&deleted);
+
+    // Cached blocks and results of an overwritten file are stale
+    invalidate_buffer_pool(modified_hty_file_path);
+    invalidate_result_cache(modified_hty_file_path);
 }
\ No newline at end of file
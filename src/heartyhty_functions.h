@@ -11,6 +11,48 @@
 #ifndef HEARTYHTY_FUNCTIONS_H
 #define HEARTYHTY_FUNCTIONS_H
 
+// For task 4 Filter a single column
+#define OP_GREATER 1 // >
+#define OP_GREATER_EQUAL 2 // >=
+#define OP_LESS 3 // <
+#define OP_LESS_EQUAL 4 // <=
+#define OP_EQUAL 5 // =
+#define OP_NOT_EQUAL 6 /* != */ 
+
+// Rows per row group when the metadata does not say otherwise
+#ifndef HTY_DEFAULT_BLOCK_ROWS
+#define HTY_DEFAULT_BLOCK_ROWS 65536
+#endif
+
+// Boundary the writer aligns row groups to (64 for SIMD loads, 4096 for O_DIRECT)
+#ifndef HTY_DEFAULT_ALIGNMENT
+#define HTY_DEFAULT_ALIGNMENT 4096
+#endif
+
+struct HtyArena; // See heartyhty_arena.h
+
+/**
+ * @brief Where the rows of the (single) group are in the file
+ *
+ * Row groups start every block_stride bytes; the bytes between the last row
+ * of a row group and the start of the next one are padding.
+ */
+typedef struct {
+    long offset;        // Offset of the first row
+    int row_bytes;      // Bytes per row
+    int block_rows;     // Rows per row group
+    long block_stride;  // Bytes from the start of one row group to the next
+} HtyRowLayout;
+
+/**
+ * @brief Single-column predicate pushed down into a scan
+ */
+typedef struct {
+    const char* column;  // Column to filter on
+    int op;              // One of the OP_* operations
+    int value;           // Value to compare against (float bits for float columns)
+} HtyPredicate;
+
 /**
  * @brief Function to extract metadata from hty file
  * 
@@ -51,6 +93,48 @@ void display_column(cJSON* metadata, const char* column_name, int* data, int siz
  */
 int compare_values(int value1, int value2, int operation, int is_float);
 
+/**
+ * @brief Function to check whether any value in [min_value, max_value] can satisfy a predicate
+ * 
+ * @param min_value - smallest value in the range
+ * @param max_value - largest value in the range
+ * @param operation - operation to perform
+ * @param value - value to compare against
+ * @param is_float - flag to indicate if value is float
+ * @return int - 0 if the whole range can be skipped, 1 otherwise
+ */
+int range_may_match(int min_value, int max_value, int operation, int value, int is_float);
+
+/**
+ * @brief Function to read the footer min/max statistics of a column
+ * 
+ * @param column - column object from the metadata
+ * @param is_float - flag to indicate if column is float
+ * @param min_value - pointer to store the minimum value
+ * @param max_value - pointer to store the maximum value
+ * @return int - 1 if the statistics exist, 0 otherwise
+ */
+int get_column_range(cJSON* column, int is_float, int* min_value, int* max_value);
+
+/**
+ * @brief Function to find the row groups that may hold rows matching a predicate
+ * 
+ * A row group is skipped when its zone map rules the predicate out, or, for
+ * equality, when its Bloom filter rules out every value.
+ * 
+ * @param metadata - metadata object
+ * @param hty_file_path - path to hty file
+ * @param column_name - column the predicate is on
+ * @param column_index - index of the column in the group
+ * @param is_float - flag to indicate if the column is float
+ * @param operation - operation to perform (OP_EQUAL for a list of values)
+ * @param values - value to compare against, or list of values
+ * @param num_values - number of values
+ * @return int* - one flag per row group, 1 if it must be read; NULL to read them all
+ */
+int* row_groups_to_read(cJSON* metadata, const char* hty_file_path, const char* column_name, int column_index,
+                        int is_float, int operation, const int* values, int num_values);
+
 /**
  * @brief Function to filter a column
  * 
@@ -64,6 +148,71 @@ int compare_values(int value1, int value2, int operation, int is_float);
  */
 int* filter(cJSON* metadata, const char* hty_file_path, const char* projected_column, int operation, int filtered_value, int* size);
 
+/**
+ * @brief Function to filter a column against a list of values (IN list)
+ * 
+ * @param metadata - metadata object
+ * @param hty_file_path - path to hty file
+ * @param projected_column - column to project
+ * @param values - values to match (float bits for float columns)
+ * @param num_values - number of values
+ * @param size - size of the result
+ * @return int* - filtered data
+ */
+int* filter_in(cJSON* metadata, const char* hty_file_path, const char* projected_column, const int* values, int num_values, int* size);
+
+/**
+ * @brief Function to get the number of rows per row group
+ * 
+ * @param metadata - metadata object
+ * @return int - rows per row group
+ */
+int get_block_rows(cJSON* metadata);
+
+/**
+ * @brief Function to get the id the writer gave a file
+ * 
+ * Converting, generating or compacting a file gives it a new id; appends,
+ * deletes and updates keep it. Index files record the id of the file they
+ * were built from.
+ * 
+ * @param metadata - metadata object
+ * @return unsigned long long - file id, 0 for files written before file ids
+ */
+unsigned long long get_file_id(cJSON* metadata);
+
+/**
+ * @brief Function to read the row layout of a file from its metadata
+ * 
+ * Files written before row groups were aligned have no "block_stride" and
+ * are packed.
+ * 
+ * @param metadata - metadata object
+ * @param layout - layout to fill
+ */
+void get_row_layout(cJSON* metadata, HtyRowLayout* layout);
+
+/**
+ * @brief Function to get the file position of a row
+ * 
+ * @param layout - row layout of the file
+ * @param row - row number (num_rows gives the end of the raw data)
+ * @return long - file offset of the row
+ */
+long row_position(const HtyRowLayout* layout, int row);
+
+/**
+ * @brief Function to find the index and type of columns by name
+ * 
+ * @param metadata - metadata object
+ * @param column_names - array of column names
+ * @param num_columns - number of columns
+ * @param column_indices - array to store the index of each column
+ * @param column_types - array to store the type of each column (0 for int, 1 for float)
+ * @return int - 0 on success, -1 if a column is not found
+ */
+int resolve_columns(cJSON* metadata, char** column_names, int num_columns, int* column_indices, int* column_types);
+
 /**
  * @brief Function to project multiple columns
  * 
@@ -76,6 +225,23 @@ int* filter(cJSON* metadata, const char* hty_file_path, const char* projected_co
  */
 int** project(cJSON* metadata, const char* hty_file_path, char** projected_columns, int num_columns, int* row_count);
 
+/**
+ * @brief Function to project multiple columns into an arena
+ * 
+ * The result, the intermediates and the scan buffers all come from the
+ * arena and are released together by reset_arena() or free_arena().
+ * 
+ * @param arena - arena, NULL to allocate the result with malloc() like project()
+ * @param metadata - metadata object
+ * @param hty_file_path - path to hty file
+ * @param projected_columns - array of column names to project
+ * @param num_columns - number of columns to project
+ * @param row_count - pointer to store number of rows
+ * @return int** - 2D array of projected data
+ */
+int** project_into_arena(struct HtyArena* arena, cJSON* metadata, const char* hty_file_path, char** projected_columns,
+                         int num_columns, int* row_count);
+
 /**
  * @brief Function to display multiple columns
  * 
@@ -87,6 +253,17 @@ int** project(cJSON* metadata, const char* hty_file_path, char** projected_colum
  */
 void display_result_set(cJSON* metadata, char** column_names, int num_columns, int** result_set, int row_count);
 
+/**
+ * @brief Function to display multiple columns whose types are already known
+ * 
+ * @param column_names - array of column names
+ * @param column_types - type of each column (0 for int, 1 for float)
+ * @param num_columns - number of columns
+ * @param result_set - 2D array of data
+ * @param row_count - number of rows
+ */
+void display_typed_result_set(char** column_names, const int* column_types, int num_columns, int** result_set, int row_count);
+
 /**
  * @brief Function to project columns with filtering
  * 
@@ -102,6 +279,24 @@ void display_result_set(cJSON* metadata, char** column_names, int num_columns, i
  */
 int** project_and_filter(cJSON* metadata, const char* hty_file_path, char** projected_columns, int num_columns, const char* filtered_column, int op, int value, int* row_count);
 
+/**
+ * @brief Function to project columns with filtering into an arena
+ * 
+ * @param arena - arena for the result and the intermediates, NULL to allocate with malloc() like project_and_filter()
+ * @param metadata - metadata object
+ * @param hty_file_path - path to hty file
+ * @param projected_columns - array of column names to project
+ * @param num_columns - number of columns to project
+ * @param filtered_column - column to apply filter on
+ * @param op - operation for filtering
+ * @param value - value to filter against
+ * @param row_count - pointer to store number of resulting rows
+ * @return int** - 2D array of filtered and projected data
+ */
+int** project_and_filter_into_arena(struct HtyArena* arena, cJSON* metadata, const char* hty_file_path,
+                                    char** projected_columns, int num_columns, const char* filtered_column, int op,
+                                    int value, int* row_count);
+
 /**
  * @brief Function to add a row to the hty file
  * 
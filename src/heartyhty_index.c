@@ -0,0 +1,427 @@
+/**
+ * @file heartyhty_index.c
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Sorted secondary index sidecar files
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../third_party/cJSON/cJSON.h"
+#include "heartyhty_functions.h"
+#include "heartyhty_pool.h"
+#include "heartyhty_delete.h"
+#include "heartyhty_index.h"
+
+// Index file layout: [magic (8 bytes)] [num_rows (4 bytes)] [column_type (4 bytes)] [file_id (8 bytes)] [entries]
+#define INDEX_MAGIC "HTYIDX02"
+#define INDEX_HEADER_SIZE 24
+
+/**
+ * @brief Function to find the position and type of a column
+ *
+ * @param metadata - metadata object
+ * @param column_name - column name
+ * @param column_type - pointer to store the type (0 for int, 1 for float)
+ * @return int - column index, -1 if not found
+ */
+static int find_column_type(cJSON* metadata, const char* column_name, int* column_type) {
+    cJSON* columns = cJSON_GetObjectItemCaseSensitive(
+        cJSON_GetArrayItem(cJSON_GetObjectItemCaseSensitive(metadata, "groups"), 0), "columns");
+    int col_idx = 0;
+    cJSON* column;
+    cJSON_ArrayForEach(column, columns) {
+        if (strcmp(cJSON_GetObjectItemCaseSensitive(column, "column_name")->valuestring, column_name) == 0) {
+            *column_type = strcmp(cJSON_GetObjectItemCaseSensitive(column, "column_type")->valuestring, "float") == 0 ? 1 : 0;
+            return col_idx;
+        }
+        col_idx++;
+    }
+    return -1;
+}
+
+/**
+ * @brief Function to order two values, with float NaN sorted after everything else
+ *
+ * @param value1 - first value
+ * @param value2 - second value
+ * @param is_float - flag to indicate if value is float
+ * @return int - negative, zero or positive like strcmp
+ */
+static int order_values(int value1, int value2, int is_float) {
+    if (is_float) {
+        float f1 = *(float*)&value1;
+        float f2 = *(float*)&value2;
+        int nan1 = (f1 != f1);
+        int nan2 = (f2 != f2);
+        if (nan1 || nan2) {
+            return nan1 - nan2;
+        }
+        return (f1 > f2) - (f1 < f2);
+    }
+    return (value1 > value2) - (value1 < value2);
+}
+
+/**
+ * @brief Functions to compare two index entries for qsort
+ */
+static int compare_int_entries(const void* a, const void* b) {
+    const HtyIndexEntry* e1 = (const HtyIndexEntry*)a;
+    const HtyIndexEntry* e2 = (const HtyIndexEntry*)b;
+    int order = order_values(e1->value, e2->value, 0);
+    return order != 0 ? order : (e1->row_id > e2->row_id) - (e1->row_id < e2->row_id);
+}
+
+static int compare_float_entries(const void* a, const void* b) {
+    const HtyIndexEntry* e1 = (const HtyIndexEntry*)a;
+    const HtyIndexEntry* e2 = (const HtyIndexEntry*)b;
+    int order = order_values(e1->value, e2->value, 1);
+    return order != 0 ? order : (e1->row_id > e2->row_id) - (e1->row_id < e2->row_id);
+}
+
+static int compare_row_ids(const void* a, const void* b) {
+    const HtyIndexEntry* e1 = (const HtyIndexEntry*)a;
+    const HtyIndexEntry* e2 = (const HtyIndexEntry*)b;
+    return (e1->row_id > e2->row_id) - (e1->row_id < e2->row_id);
+}
+
+/**
+ * @brief Function to write an index file
+ *
+ * @param index_path - path of the index file
+ * @param column_type - type of the column (0 for int, 1 for float)
+ * @param file_id - id of the indexed file (see get_file_id())
+ * @param entries - sorted entries
+ * @param num_entries - number of entries
+ * @return int - 0 on success, -1 on failure
+ */
+static int write_index_file(const char* index_path, int column_type, unsigned long long file_id,
+                            const HtyIndexEntry* entries, int num_entries) {
+    FILE* file = fopen(index_path, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "Error creating index file: %s\n", index_path);
+        return -1;
+    }
+    fwrite(INDEX_MAGIC, 1, 8, file);
+    fwrite(&num_entries, sizeof(int), 1, file);
+    fwrite(&column_type, sizeof(int), 1, file);
+    fwrite(&file_id, sizeof(file_id), 1, file);
+    size_t written = fwrite(entries, sizeof(HtyIndexEntry), num_entries, file);
+    fclose(file);
+    if (written != (size_t)num_entries) {
+        fprintf(stderr, "Error writing index file: %s\n", index_path);
+        remove(index_path);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Function to open an index file and check that it matches the table
+ *
+ * An index built from another file at the same path (e.g. the file was
+ * converted again) has another file id and is ignored, even with the same
+ * number of rows.
+ *
+ * @param index_path - path of the index file
+ * @param num_rows - number of rows the index must cover
+ * @param column_type - type the index must have
+ * @param file_id - id of the file the index must have been built from
+ * @return FILE* - open index file, NULL if missing or out of date
+ */
+static FILE* open_index_file(const char* index_path, int num_rows, int column_type, unsigned long long file_id) {
+    FILE* file = fopen(index_path, "rb");
+    if (file == NULL) {
+        return NULL; // No index for this column
+    }
+    char magic[8];
+    int index_rows, index_type;
+    unsigned long long index_file_id;
+    if (fread(magic, 1, 8, file) != 8 || memcmp(magic, INDEX_MAGIC, 8) != 0 ||
+        fread(&index_rows, sizeof(int), 1, file) != 1 || fread(&index_type, sizeof(int), 1, file) != 1 ||
+        fread(&index_file_id, sizeof(index_file_id), 1, file) != 1 ||
+        index_rows != num_rows || index_type != column_type || index_file_id != file_id) {
+        fclose(file); // Stale or foreign index, the caller falls back to a scan
+        return NULL;
+    }
+    return file;
+}
+
+/**
+ * @brief Function to read the value of one index entry
+ *
+ * @param file - open index file
+ * @param position - entry position
+ * @return int - value of the entry
+ */
+static int read_entry_value(FILE* file, int position) {
+    HtyIndexEntry entry;
+    fseek(file, INDEX_HEADER_SIZE + (long)position * sizeof(HtyIndexEntry), SEEK_SET);
+    fread(&entry, sizeof(HtyIndexEntry), 1, file);
+    return entry.value;
+}
+
+/**
+ * @brief Function to binary search the index file
+ *
+ * @param file - open index file
+ * @param num_entries - number of entries
+ * @param value - value to search for
+ * @param is_float - flag to indicate if value is float
+ * @param strict - 0 for the first entry >= value, 1 for the first entry > value
+ * @return int - position of the first entry past the bound
+ */
+static int search_index(FILE* file, int num_entries, int value, int is_float, int strict) {
+    int low = 0;
+    int high = num_entries;
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        int order = order_values(read_entry_value(file, middle), value, is_float);
+        if (order < 0 || (strict && order == 0)) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+char* index_file_path(const char* hty_file_path, const char* column_name) {
+    char* path = (char*)malloc(strlen(hty_file_path) + strlen(column_name) + 6);
+    if (path != NULL) {
+        sprintf(path, "%s.%s.idx", hty_file_path, column_name);
+    }
+    return path;
+}
+
+int build_index(cJSON* metadata, const char* hty_file_path, const char* column_name) {
+    int column_type;
+    if (find_column_type(metadata, column_name, &column_type) == -1) {
+        fprintf(stderr, "Column not found: %s\n", column_name);
+        return -1;
+    }
+
+    // Deleted rows are indexed too, so row ids stay positions in the file; lookups skip them
+    int num_rows = cJSON_GetObjectItemCaseSensitive(metadata, "num_rows")->valueint;
+    int column_index;
+    char* name = (char*)column_name;
+    resolve_columns(metadata, &name, 1, &column_index, &column_type);
+    HtyColumnReader* reader = open_column_reader(metadata, hty_file_path, &column_index, 1, NULL);
+    HtyIndexEntry* entries = (HtyIndexEntry*)malloc((num_rows + 1) * sizeof(HtyIndexEntry));
+    if (reader == NULL || entries == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        close_column_reader(reader);
+        free(entries);
+        return -1;
+    }
+    keep_deleted_rows(reader);
+    int** block;
+    int first_row, rows_in_block, got;
+    while ((got = next_column_block(reader, &block, &first_row, &rows_in_block)) == 1) {
+        for (int i = 0; i < rows_in_block; i++) {
+            entries[first_row + i].value = block[0][i];
+            entries[first_row + i].row_id = first_row + i;
+        }
+    }
+    close_column_reader(reader);
+    if (got == -1) {
+        free(entries);
+        return -1;
+    }
+
+    // Sort (value, row_id) pairs
+    qsort(entries, num_rows, sizeof(HtyIndexEntry), column_type ? compare_float_entries : compare_int_entries);
+
+    char* index_path = index_file_path(hty_file_path, column_name);
+    int status = write_index_file(index_path, column_type, get_file_id(metadata), entries, num_rows);
+    free(index_path);
+    free(entries);
+    return status;
+}
+
+int index_lookup(cJSON* metadata, const char* hty_file_path, const char* column_name, int op, int value,
+                 int** row_ids, int** values, int* count) {
+    if (op == OP_NOT_EQUAL || op < OP_GREATER || op > OP_NOT_EQUAL) {
+        return 0; // != matches almost everything, a scan is always cheaper
+    }
+    int column_type;
+    if (find_column_type(metadata, column_name, &column_type) == -1) {
+        return 0;
+    }
+    int num_rows = cJSON_GetObjectItemCaseSensitive(metadata, "num_rows")->valueint;
+
+    char* index_path = index_file_path(hty_file_path, column_name);
+    FILE* file = open_index_file(index_path, num_rows, column_type, get_file_id(metadata));
+    free(index_path);
+    if (file == NULL) {
+        return 0;
+    }
+
+    // Find the range of matching entries; NaN values are sorted last and never match
+    int first = 0;
+    int last = 0;
+    float float_value = *(float*)&value;
+    if (!(column_type == 1 && float_value != float_value)) {
+        int nan_start = num_rows;
+        if (column_type == 1) {
+            int nan_bits = 0x7fc00000; // Any NaN sorts after every number
+            nan_start = search_index(file, num_rows, nan_bits, 1, 0);
+        }
+        switch (op) {
+            case OP_EQUAL:
+                first = search_index(file, num_rows, value, column_type, 0);
+                last = search_index(file, num_rows, value, column_type, 1);
+                break;
+            case OP_LESS:
+                last = search_index(file, num_rows, value, column_type, 0);
+                break;
+            case OP_LESS_EQUAL:
+                last = search_index(file, num_rows, value, column_type, 1);
+                break;
+            case OP_GREATER:
+                first = search_index(file, num_rows, value, column_type, 1);
+                last = nan_start;
+                break;
+            case OP_GREATER_EQUAL:
+                first = search_index(file, num_rows, value, column_type, 0);
+                last = nan_start;
+                break;
+        }
+    }
+
+    // The range size is the exact selectivity, only use the index when it is low
+    int matching_rows = last - first;
+    if (matching_rows > HTY_INDEX_MAX_SELECTIVITY * num_rows) {
+        fclose(file);
+        return 0;
+    }
+
+    HtyIndexEntry* entries = (HtyIndexEntry*)malloc((matching_rows + 1) * sizeof(HtyIndexEntry));
+    if (entries == NULL) {
+        fclose(file);
+        return 0;
+    }
+    fseek(file, INDEX_HEADER_SIZE + (long)first * sizeof(HtyIndexEntry), SEEK_SET);
+    if (fread(entries, sizeof(HtyIndexEntry), matching_rows, file) != (size_t)matching_rows) {
+        free(entries);
+        fclose(file);
+        return 0;
+    }
+    fclose(file);
+
+    // Return the matches in row order, the same order a scan produces, without deleted rows
+    qsort(entries, matching_rows, sizeof(HtyIndexEntry), compare_row_ids);
+    HtyRowBitmap deleted;
+    int has_deletes = load_deleted_rows(metadata, hty_file_path, &deleted);
+    if (has_deletes == -1) {
+        free(entries);
+        return 0;
+    }
+    if (has_deletes == 1) {
+        int live_rows = 0;
+        for (int i = 0; i < matching_rows; i++) {
+            if (!bitmap_contains(&deleted, entries[i].row_id)) {
+                entries[live_rows++] = entries[i];
+            }
+        }
+        matching_rows = live_rows;
+    }
+    free_bitmap(&deleted);
+    if (row_ids != NULL) {
+        *row_ids = (int*)malloc((matching_rows + 1) * sizeof(int));
+        for (int i = 0; i < matching_rows; i++) {
+            (*row_ids)[i] = entries[i].row_id;
+        }
+    }
+    if (values != NULL) {
+        *values = (int*)malloc((matching_rows + 1) * sizeof(int));
+        for (int i = 0; i < matching_rows; i++) {
+            (*values)[i] = entries[i].value;
+        }
+    }
+    *count = matching_rows;
+    free(entries);
+    return 1;
+}
+
+void append_to_indexes(cJSON* metadata, const char* hty_file_path, const char* modified_hty_file_path,
+                       int** rows, int num_rows) {
+    cJSON* columns = cJSON_GetObjectItemCaseSensitive(
+        cJSON_GetArrayItem(cJSON_GetObjectItemCaseSensitive(metadata, "groups"), 0), "columns");
+    int current_rows = cJSON_GetObjectItemCaseSensitive(metadata, "num_rows")->valueint;
+
+    int col_idx = 0;
+    cJSON* column;
+    cJSON_ArrayForEach(column, columns) {
+        const char* column_name = cJSON_GetObjectItemCaseSensitive(column, "column_name")->valuestring;
+        int column_type = strcmp(cJSON_GetObjectItemCaseSensitive(column, "column_type")->valuestring, "float") == 0 ? 1 : 0;
+        char* index_path = index_file_path(hty_file_path, column_name);
+        FILE* file = open_index_file(index_path, current_rows, column_type, get_file_id(metadata));
+        free(index_path);
+        if (file == NULL) {
+            col_idx++;
+            continue; // Column has no usable index
+        }
+
+        // Sort only the new entries, then merge them with the existing sorted run
+        int (*compare)(const void*, const void*) = column_type ? compare_float_entries : compare_int_entries;
+        HtyIndexEntry* old_entries = (HtyIndexEntry*)malloc((current_rows + 1) * sizeof(HtyIndexEntry));
+        HtyIndexEntry* new_entries = (HtyIndexEntry*)malloc((num_rows + 1) * sizeof(HtyIndexEntry));
+        HtyIndexEntry* merged = (HtyIndexEntry*)malloc((current_rows + num_rows + 1) * sizeof(HtyIndexEntry));
+        if (old_entries != NULL && new_entries != NULL && merged != NULL &&
+            fread(old_entries, sizeof(HtyIndexEntry), current_rows, file) == (size_t)current_rows) {
+            for (int i = 0; i < num_rows; i++) {
+                new_entries[i].value = rows[col_idx][i];
+                new_entries[i].row_id = current_rows + i;
+            }
+            qsort(new_entries, num_rows, sizeof(HtyIndexEntry), compare);
+
+            int i = 0, j = 0, k = 0;
+            while (i < current_rows && j < num_rows) {
+                merged[k++] = compare(&old_entries[i], &new_entries[j]) <= 0 ? old_entries[i++] : new_entries[j++];
+            }
+            while (i < current_rows) {
+                merged[k++] = old_entries[i++];
+            }
+            while (j < num_rows) {
+                merged[k++] = new_entries[j++];
+            }
+
+            char* modified_index_path = index_file_path(modified_hty_file_path, column_name);
+            write_index_file(modified_index_path, column_type, get_file_id(metadata), merged, k); // add_row() keeps the id
+            free(modified_index_path);
+        } else {
+            fprintf(stderr, "Error updating index of column: %s\n", column_name);
+        }
+        free(old_entries);
+        free(new_entries);
+        free(merged);
+        fclose(file);
+        col_idx++;
+    }
+}
+
+void rename_indexes(cJSON* metadata, const char* old_hty_file_path, const char* new_hty_file_path) {
+    cJSON* columns = cJSON_GetObjectItemCaseSensitive(
+        cJSON_GetArrayItem(cJSON_GetObjectItemCaseSensitive(metadata, "groups"), 0), "columns");
+    cJSON* column;
+    cJSON_ArrayForEach(column, columns) {
+        const char* column_name = cJSON_GetObjectItemCaseSensitive(column, "column_name")->valuestring;
+        char* old_path = index_file_path(old_hty_file_path, column_name);
+        char* new_path = index_file_path(new_hty_file_path, column_name);
+        FILE* file = fopen(old_path, "rb");
+        if (file != NULL) {
+            fclose(file);
+            rename(old_path, new_path);
+        } else {
+            // The old index (if any) no longer matches the renamed file
+            remove(new_path);
+        }
+        free(old_path);
+        free(new_path);
+    }
+}
@@ -0,0 +1,90 @@
+/**
+ * @file heartyhty_index.h
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Header file for sorted secondary index sidecar files
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef HEARTYHTY_INDEX_H
+#define HEARTYHTY_INDEX_H
+
+// Index is only used when at most this fraction of the rows match
+#define HTY_INDEX_MAX_SELECTIVITY 0.1
+
+/**
+ * @brief One entry of an index file, entries are sorted by value then row id
+ */
+typedef struct {
+    int value;   // Column value (float bits for float columns)
+    int row_id;  // Row the value belongs to
+} HtyIndexEntry;
+
+/**
+ * @brief Function to get the path of the index file of a column
+ *
+ * The index of column "id" of "data.hty" lives next to it in "data.hty.id.idx".
+ *
+ * @param hty_file_path - path to hty file
+ * @param column_name - indexed column
+ * @return char* - path of the index file (must be freed)
+ */
+char* index_file_path(const char* hty_file_path, const char* column_name);
+
+/**
+ * @brief Function to build the index file of a column
+ *
+ * @param metadata - metadata object
+ * @param hty_file_path - path to hty file
+ * @param column_name - column to index
+ * @return int - 0 on success, -1 on failure
+ */
+int build_index(cJSON* metadata, const char* hty_file_path, const char* column_name);
+
+/**
+ * @brief Function to answer a predicate from the index of a column
+ *
+ * The index is only used when it exists, is up to date, the operation is one of
+ * =, <, <=, >, >= and the number of matching rows is at most
+ * HTY_INDEX_MAX_SELECTIVITY of the table. Otherwise the caller should scan.
+ *
+ * @param metadata - metadata object
+ * @param hty_file_path - path to hty file
+ * @param column_name - column to apply filter on
+ * @param op - operation for filtering
+ * @param value - value to filter against
+ * @param row_ids - pointer to store the matching row ids in row order (may be NULL)
+ * @param values - pointer to store the matching values in row order (may be NULL)
+ * @param count - pointer to store the number of matching rows
+ * @return int - 1 if answered from the index, 0 if the caller should scan
+ */
+int index_lookup(cJSON* metadata, const char* hty_file_path, const char* column_name, int op, int value,
+                 int** row_ids, int** values, int* count);
+
+/**
+ * @brief Function to extend the index files of a file with appended rows
+ *
+ * Every up-to-date index of hty_file_path gets the new rows merged in and is
+ * written as the index of modified_hty_file_path. Only the new rows are sorted.
+ *
+ * @param metadata - metadata object of the file before the append
+ * @param hty_file_path - path to the original hty file
+ * @param modified_hty_file_path - path to the rewritten hty file
+ * @param rows - 2D array of appended rows (column-major like add_row)
+ * @param num_rows - number of appended rows
+ */
+void append_to_indexes(cJSON* metadata, const char* hty_file_path, const char* modified_hty_file_path,
+                       int** rows, int num_rows);
+
+/**
+ * @brief Function to move the index files of a file along with it
+ *
+ * @param metadata - metadata object
+ * @param old_hty_file_path - current path of the hty file
+ * @param new_hty_file_path - new path of the hty file
+ */
+void rename_indexes(cJSON* metadata, const char* old_hty_file_path, const char* new_hty_file_path);
+
+#endif // HEARTYHTY_INDEX_H
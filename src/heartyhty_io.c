@@ -0,0 +1,550 @@
+/**
+ * @file heartyhty_io.c
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Asynchronous row group reader (io_uring with a pread thread pool fallback)
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#define _GNU_SOURCE // O_DIRECT
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#define HTY_HAVE_IO_URING 1
+#endif
+#endif
+#include "../third_party/cJSON/cJSON.h"
+#include "heartyhty_functions.h"
+#include "heartyhty_io.h"
+#include "heartyhty_pool.h"
+#include "heartyhty_snapshot.h"
+#include "heartyhty_arena.h"
+#include "heartyhty_stats.h"
+
+#define SLOT_FREE 0     // Slot has no read
+#define SLOT_PENDING 1  // Read issued, not picked up by a reader thread yet
+#define SLOT_READING 2  // Read in progress
+#define SLOT_DONE 3     // Read finished
+
+/**
+ * @brief One row group read
+ */
+typedef struct {
+    char* buffer;        // Aligned read buffer
+    long file_offset;    // Where the read starts (aligned for O_DIRECT)
+    size_t length;       // Bytes to read
+    size_t skip;         // Bytes before the first row (O_DIRECT alignment)
+    size_t needed;       // Bytes that must be read for the rows
+    int first_row;       // First row of the row group
+    int num_rows;        // Rows in the row group
+    int state;           // SLOT_* state
+    long result;         // Bytes read, or -errno
+    struct iovec iov;    // Target of the io_uring read
+} IoSlot;
+
+struct HtyBlockReader {
+    int fd;                    // File descriptor
+    HtyArena* arena;           // Arena the read buffers come from, NULL for posix_memalign()
+    HtyRowLayout layout;       // Where the rows are in the file
+    int num_rows;              // Rows in the file
+    int num_groups;            // Row groups in the file
+    int* row_groups;           // Row groups to read, NULL for all
+    int next_group;            // Next row group to issue
+    int direct;                // 1 if the file was opened with O_DIRECT
+    IoSlot slots[HTY_IO_QUEUE_DEPTH];  // Reads, used round robin
+    int head;                  // Oldest slot in flight
+    int in_flight;             // Slots in flight
+    int returned;              // 1 if the head slot was handed to the caller
+#ifdef HTY_HAVE_IO_URING
+    int ring_fd;               // io_uring instance, -1 if not used
+    void* sq_ring;             // Submission ring mapping
+    void* cq_ring;             // Completion ring mapping (may equal sq_ring)
+    size_t sq_ring_size;       // Size of the submission ring mapping
+    size_t cq_ring_size;       // Size of the completion ring mapping
+    struct io_uring_sqe* sqes; // Submission queue entries
+    size_t sqes_size;          // Size of the submission queue entries mapping
+    unsigned* sq_tail;         // Submission ring tail
+    unsigned* sq_mask;         // Submission ring mask
+    unsigned* sq_array;        // Submission ring index array
+    unsigned* cq_head;         // Completion ring head
+    unsigned* cq_tail;         // Completion ring tail
+    unsigned* cq_mask;         // Completion ring mask
+    struct io_uring_cqe* cqes; // Completion queue entries
+#endif
+    int pool_ready;            // 1 once lock and changed are initialised
+    int num_threads;           // Reader threads (thread pool fallback)
+    pthread_t threads[HTY_IO_THREADS];
+    pthread_mutex_t lock;      // Protects slot states in the thread pool fallback
+    pthread_cond_t changed;    // Signalled when a slot changes state
+    int stop;                  // Tells the reader threads to exit
+};
+
+static int direct_io_enabled = 0; // Set by set_direct_io
+
+void set_direct_io(int enabled) {
+    direct_io_enabled = enabled;
+}
+
+/**
+ * @brief Function to read a whole range with pread, retrying short reads
+ *
+ * @param fd - file descriptor
+ * @param buffer - destination
+ * @param length - bytes to read
+ * @param offset - file offset
+ * @return long - bytes read (less than length only at end of file), or -errno
+ */
+static long read_fully(int fd, char* buffer, size_t length, long offset) {
+    size_t total = 0;
+    while (total < length) {
+        ssize_t bytes_read = pread(fd, buffer + total, length - total, offset + total);
+        HTY_STATS_ADD(io_syscalls, 1);
+        if (bytes_read < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        if (bytes_read == 0) {
+            break; // End of file
+        }
+        total += bytes_read;
+    }
+    return (long)total;
+}
+
+#ifdef HTY_HAVE_IO_URING
+/**
+ * @brief Function to set up an io_uring instance with raw system calls
+ *
+ * @param reader - reader object
+ * @return int - 0 on success, -1 if io_uring is not available
+ */
+static int setup_ring(HtyBlockReader* reader) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    reader->ring_fd = (int)syscall(__NR_io_uring_setup, HTY_IO_QUEUE_DEPTH, &params);
+    if (reader->ring_fd < 0) {
+        reader->ring_fd = -1;
+        return -1; // Old kernel, or blocked by a sandbox
+    }
+
+    reader->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    reader->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (reader->cq_ring_size > reader->sq_ring_size) {
+            reader->sq_ring_size = reader->cq_ring_size;
+        }
+        reader->cq_ring_size = reader->sq_ring_size;
+    }
+    reader->sq_ring = mmap(NULL, reader->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                           reader->ring_fd, IORING_OFF_SQ_RING);
+    reader->cq_ring = reader->sq_ring;
+    if (reader->sq_ring != MAP_FAILED && !(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        reader->cq_ring = mmap(NULL, reader->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                               reader->ring_fd, IORING_OFF_CQ_RING);
+    }
+    reader->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    reader->sqes = (struct io_uring_sqe*)mmap(NULL, reader->sqes_size,
+                                              PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                              reader->ring_fd, IORING_OFF_SQES);
+    if (reader->sq_ring == MAP_FAILED || reader->cq_ring == MAP_FAILED || reader->sqes == MAP_FAILED) {
+        if (reader->sqes != MAP_FAILED) {
+            munmap(reader->sqes, reader->sqes_size);
+        }
+        if (reader->cq_ring != MAP_FAILED && reader->cq_ring != reader->sq_ring) {
+            munmap(reader->cq_ring, reader->cq_ring_size);
+        }
+        if (reader->sq_ring != MAP_FAILED) {
+            munmap(reader->sq_ring, reader->sq_ring_size);
+        }
+        close(reader->ring_fd);
+        reader->ring_fd = -1;
+        return -1;
+    }
+
+    char* sq = (char*)reader->sq_ring;
+    char* cq = (char*)reader->cq_ring;
+    reader->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    reader->sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+    reader->sq_array = (unsigned*)(sq + params.sq_off.array);
+    reader->cq_head = (unsigned*)(cq + params.cq_off.head);
+    reader->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    reader->cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+    reader->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    return 0;
+}
+
+/**
+ * @brief Function to queue a read of a slot on the ring and submit it
+ *
+ * @param reader - reader object
+ * @param slot_index - slot to read into
+ * @return int - 0 on success, -1 on failure
+ */
+static int submit_ring_read(HtyBlockReader* reader, int slot_index) {
+    IoSlot* slot = &reader->slots[slot_index];
+    unsigned tail = *reader->sq_tail; // Only this thread writes the tail
+    unsigned index = tail & *reader->sq_mask;
+    struct io_uring_sqe* sqe = &reader->sqes[index];
+
+    slot->iov.iov_base = slot->buffer;
+    slot->iov.iov_len = slot->length;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READV; // Available since the first io_uring kernels
+    sqe->fd = reader->fd;
+    sqe->addr = (unsigned long)&slot->iov;
+    sqe->len = 1;
+    sqe->off = slot->file_offset;
+    sqe->user_data = slot_index;
+    reader->sq_array[index] = index;
+    __atomic_store_n(reader->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    HTY_STATS_ADD(io_syscalls, 1);
+    while (syscall(__NR_io_uring_enter, reader->ring_fd, 1, 0, 0, NULL, 0) < 0) {
+        if (errno != EINTR && errno != EAGAIN) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Function to wait until a slot's ring read has completed
+ *
+ * @param reader - reader object
+ * @param slot_index - slot to wait for
+ * @return int - 0 on success, -1 on failure
+ */
+static int wait_ring_read(HtyBlockReader* reader, int slot_index) {
+    while (reader->slots[slot_index].state != SLOT_DONE) {
+        unsigned head = *reader->cq_head;
+        if (head == __atomic_load_n(reader->cq_tail, __ATOMIC_ACQUIRE)) {
+            HTY_STATS_ADD(io_syscalls, 1);
+            if (syscall(__NR_io_uring_enter, reader->ring_fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 &&
+                errno != EINTR) {
+                return -1;
+            }
+            continue;
+        }
+        // Completions can arrive out of order; mark whichever slot finished
+        struct io_uring_cqe* cqe = &reader->cqes[head & *reader->cq_mask];
+        IoSlot* done = &reader->slots[cqe->user_data];
+        done->result = cqe->res;
+        done->state = SLOT_DONE;
+        __atomic_store_n(reader->cq_head, head + 1, __ATOMIC_RELEASE);
+    }
+    return 0;
+}
+
+/**
+ * @brief Function to unmap and close the ring
+ *
+ * @param reader - reader object
+ */
+static void close_ring(HtyBlockReader* reader) {
+    munmap(reader->sqes, reader->sqes_size);
+    if (reader->cq_ring != reader->sq_ring) {
+        munmap(reader->cq_ring, reader->cq_ring_size);
+    }
+    munmap(reader->sq_ring, reader->sq_ring_size);
+    close(reader->ring_fd);
+}
+#endif
+
+/**
+ * @brief Reader thread of the thread pool fallback
+ *
+ * @param arg - reader object
+ * @return void* - always NULL
+ */
+static void* read_worker(void* arg) {
+    HtyBlockReader* reader = (HtyBlockReader*)arg;
+    pthread_mutex_lock(&reader->lock);
+    for (;;) {
+        // Take the oldest read that nobody has started
+        IoSlot* slot = NULL;
+        for (int i = 0; i < reader->in_flight && slot == NULL; i++) {
+            IoSlot* candidate = &reader->slots[(reader->head + i) % HTY_IO_QUEUE_DEPTH];
+            if (candidate->state == SLOT_PENDING) {
+                slot = candidate;
+            }
+        }
+        if (slot == NULL) {
+            if (reader->stop) {
+                break;
+            }
+            pthread_cond_wait(&reader->changed, &reader->lock);
+            continue;
+        }
+        slot->state = SLOT_READING;
+        pthread_mutex_unlock(&reader->lock);
+        long result = read_fully(reader->fd, slot->buffer, slot->length, slot->file_offset);
+        pthread_mutex_lock(&reader->lock);
+        slot->result = result;
+        slot->state = SLOT_DONE;
+        pthread_cond_broadcast(&reader->changed);
+    }
+    pthread_mutex_unlock(&reader->lock);
+    return NULL;
+}
+
+/**
+ * @brief Function to issue the read of the next row group that must be read
+ *
+ * @param reader - reader object
+ * @return int - 1 if a read was issued, 0 if no row group is left, -1 on failure
+ */
+static int issue_next_read(HtyBlockReader* reader) {
+    while (reader->next_group < reader->num_groups && reader->row_groups != NULL &&
+           !reader->row_groups[reader->next_group]) {
+        reader->next_group++; // Row group was ruled out by the caller
+    }
+    if (reader->next_group >= reader->num_groups || reader->in_flight == HTY_IO_QUEUE_DEPTH) {
+        return 0;
+    }
+
+    int slot_index = (reader->head + reader->in_flight) % HTY_IO_QUEUE_DEPTH;
+    IoSlot* slot = &reader->slots[slot_index];
+    int group = reader->next_group++;
+    int block_rows = reader->layout.block_rows;
+    slot->first_row = group * block_rows;
+    slot->num_rows = reader->num_rows - slot->first_row < block_rows ? reader->num_rows - slot->first_row : block_rows;
+    long start = row_position(&reader->layout, slot->first_row);
+    slot->needed = (size_t)slot->num_rows * reader->layout.row_bytes;
+    slot->file_offset = start;
+    slot->skip = 0;
+    slot->length = slot->needed;
+    if (reader->direct) {
+        // O_DIRECT needs aligned offsets and lengths; read around the rows and skip the extra bytes
+        slot->file_offset = start & ~(long)(HTY_IO_ALIGNMENT - 1);
+        slot->skip = start - slot->file_offset;
+        slot->length = (slot->skip + slot->needed + HTY_IO_ALIGNMENT - 1) & ~(size_t)(HTY_IO_ALIGNMENT - 1);
+    }
+    slot->result = 0;
+
+    // Let the kernel start fetching the row group after this one too
+    if (!reader->direct && group + 1 < reader->num_groups) {
+        posix_fadvise(reader->fd, start + reader->layout.block_stride, (long)block_rows * reader->layout.row_bytes,
+                      POSIX_FADV_WILLNEED);
+    }
+
+#ifdef HTY_HAVE_IO_URING
+    if (reader->ring_fd >= 0) {
+        slot->state = SLOT_PENDING;
+        reader->in_flight++;
+        if (submit_ring_read(reader, slot_index) != 0) {
+            reader->in_flight--;
+            slot->state = SLOT_FREE;
+            return -1;
+        }
+        return 1;
+    }
+#endif
+    if (reader->num_threads > 0) {
+        pthread_mutex_lock(&reader->lock);
+        slot->state = SLOT_PENDING;
+        reader->in_flight++;
+        pthread_cond_broadcast(&reader->changed);
+        pthread_mutex_unlock(&reader->lock);
+    } else {
+        slot->state = SLOT_PENDING; // No threads either; read on demand in next_block
+        reader->in_flight++;
+    }
+    return 1;
+}
+
+HtyBlockReader* open_block_reader(const char* hty_file_path, const HtyRowLayout* layout, int num_rows,
+                                  const int* row_groups) {
+    return open_block_reader_in_arena(NULL, hty_file_path, layout, num_rows, row_groups);
+}
+
+HtyBlockReader* open_block_reader_in_arena(HtyArena* arena, const char* hty_file_path, const HtyRowLayout* layout,
+                                           int num_rows, const int* row_groups) {
+    HtyBlockReader* reader = (HtyBlockReader*)calloc(1, sizeof(HtyBlockReader));
+    if (reader == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return NULL;
+    }
+    reader->arena = arena;
+    reader->layout = *layout;
+    reader->num_rows = num_rows;
+    reader->num_groups = (num_rows + layout->block_rows - 1) / layout->block_rows;
+    long data_bytes = row_position(layout, num_rows) - layout->offset;
+#ifdef HTY_HAVE_IO_URING
+    reader->ring_fd = -1;
+#endif
+
+    // Bypass the page cache only for scans that would flush it anyway
+    reader->fd = -1;
+    if (direct_io_enabled && data_bytes >= HTY_IO_DIRECT_MIN_BYTES) {
+        reader->fd = open_snapshot_fd(hty_file_path, O_RDONLY | O_DIRECT);
+        reader->direct = reader->fd >= 0;
+    }
+    if (reader->fd < 0) {
+        reader->fd = open_snapshot_fd(hty_file_path, O_RDONLY);
+    }
+    HTY_STATS_ADD(io_syscalls, 1);
+    if (reader->fd < 0) {
+        fprintf(stderr, "Error opening file: %s\n", hty_file_path);
+        free(reader);
+        return NULL;
+    }
+    if (!reader->direct) {
+        posix_fadvise(reader->fd, layout->offset, data_bytes, POSIX_FADV_SEQUENTIAL);
+    }
+
+    if (row_groups != NULL) {
+        reader->row_groups = (int*)malloc((reader->num_groups + 1) * sizeof(int));
+        if (reader->row_groups != NULL) {
+            memcpy(reader->row_groups, row_groups, reader->num_groups * sizeof(int));
+        }
+    }
+    size_t capacity = (size_t)layout->block_rows * layout->row_bytes + 2 * HTY_IO_ALIGNMENT;
+    for (int i = 0; i < HTY_IO_QUEUE_DEPTH; i++) {
+        reader->slots[i].buffer = (char*)arena_alloc_aligned(arena, capacity, HTY_IO_ALIGNMENT);
+        if (reader->slots[i].buffer == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            close_block_reader(reader);
+            return NULL;
+        }
+    }
+
+    // Prefer io_uring, then reader threads, then plain synchronous reads
+#ifdef HTY_HAVE_IO_URING
+    if (setup_ring(reader) == 0) {
+        return reader;
+    }
+#endif
+    pthread_mutex_init(&reader->lock, NULL);
+    pthread_cond_init(&reader->changed, NULL);
+    reader->pool_ready = 1;
+    for (int i = 0; i < HTY_IO_THREADS; i++) {
+        if (pthread_create(&reader->threads[reader->num_threads], NULL, read_worker, reader) == 0) {
+            reader->num_threads++;
+        }
+    }
+    return reader;
+}
+
+int next_block(HtyBlockReader* reader, int** rows, int* first_row, int* num_rows) {
+    // The row group handed out last time is done with; reuse its slot
+    if (reader->returned) {
+        if (reader->num_threads > 0) {
+            pthread_mutex_lock(&reader->lock); // Reader threads walk the slots from head
+        }
+        reader->slots[reader->head].state = SLOT_FREE;
+        reader->head = (reader->head + 1) % HTY_IO_QUEUE_DEPTH;
+        reader->in_flight--;
+        if (reader->num_threads > 0) {
+            pthread_mutex_unlock(&reader->lock);
+        }
+        reader->returned = 0;
+    }
+    int issued;
+    while ((issued = issue_next_read(reader)) == 1) {
+        // Keep the queue full
+    }
+    if (issued == -1) {
+        fprintf(stderr, "Error submitting read\n");
+        return -1;
+    }
+    if (reader->in_flight == 0) {
+        return 0;
+    }
+
+    // Wait for the oldest read
+    IoSlot* slot = &reader->slots[reader->head];
+    HtyStageTimer timer;
+    HTY_STAGE_BEGIN(timer);
+#ifdef HTY_HAVE_IO_URING
+    if (reader->ring_fd >= 0 && wait_ring_read(reader, reader->head) != 0) {
+        fprintf(stderr, "Error waiting for read\n");
+        return -1;
+    }
+#endif
+    if (reader->num_threads > 0) {
+        pthread_mutex_lock(&reader->lock);
+        while (slot->state != SLOT_DONE) {
+            pthread_cond_wait(&reader->changed, &reader->lock);
+        }
+        pthread_mutex_unlock(&reader->lock);
+    } else if (slot->state != SLOT_DONE) {
+        slot->result = read_fully(reader->fd, slot->buffer, slot->length, slot->file_offset);
+        slot->state = SLOT_DONE;
+    }
+
+    // A short read (interrupted or at an unaligned end of file) is finished synchronously
+    if (slot->result >= 0 && (size_t)slot->result < slot->skip + slot->needed) {
+        long rest = read_fully(reader->fd, slot->buffer + slot->result, slot->length - slot->result,
+                               slot->file_offset + slot->result);
+        slot->result = rest < 0 ? rest : slot->result + rest;
+    }
+    reader->returned = 1;
+    HTY_STAGE_END(HTY_STAGE_IO, timer);
+    if (slot->result < 0 || (size_t)slot->result < slot->skip + slot->needed) {
+        fprintf(stderr, "Error reading rows %d to %d\n", slot->first_row, slot->first_row + slot->num_rows - 1);
+        return -1;
+    }
+    HTY_STATS_ADD(blocks_read, 1);
+    HTY_STATS_ADD(bytes_read, slot->result);
+    *rows = (int*)(slot->buffer + slot->skip);
+    *first_row = slot->first_row;
+    *num_rows = slot->num_rows;
+    return 1;
+}
+
+void close_block_reader(HtyBlockReader* reader) {
+    if (reader == NULL) {
+        return;
+    }
+#ifdef HTY_HAVE_IO_URING
+    if (reader->ring_fd >= 0) {
+        // Buffers must outlive the reads the kernel still owns
+        for (int i = 0; i < reader->in_flight; i++) {
+            int slot_index = (reader->head + i) % HTY_IO_QUEUE_DEPTH;
+            if (reader->slots[slot_index].state != SLOT_DONE) {
+                wait_ring_read(reader, slot_index);
+            }
+        }
+        close_ring(reader);
+    }
+#endif
+    if (reader->num_threads > 0) {
+        pthread_mutex_lock(&reader->lock);
+        reader->stop = 1;
+        // Threads only exit once no pending read is left, so cancel the unstarted ones
+        for (int i = 0; i < HTY_IO_QUEUE_DEPTH; i++) {
+            if (reader->slots[i].state == SLOT_PENDING) {
+                reader->slots[i].state = SLOT_FREE;
+            }
+        }
+        pthread_cond_broadcast(&reader->changed);
+        pthread_mutex_unlock(&reader->lock);
+        for (int i = 0; i < reader->num_threads; i++) {
+            pthread_join(reader->threads[i], NULL);
+        }
+    }
+    if (reader->pool_ready) {
+        pthread_mutex_destroy(&reader->lock);
+        pthread_cond_destroy(&reader->changed);
+    }
+    for (int i = 0; i < HTY_IO_QUEUE_DEPTH; i++) {
+        arena_release(reader->arena, reader->slots[i].buffer);
+    }
+    free(reader->row_groups);
+    close(reader->fd);
+    free(reader);
+}
@@ -0,0 +1,92 @@
+/**
+ * @file heartyhty_io.h
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Header file for the asynchronous row group reader used by the scans
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef HEARTYHTY_IO_H
+#define HEARTYHTY_IO_H
+
+#define HTY_IO_QUEUE_DEPTH 4  // Row group reads kept in flight
+#define HTY_IO_THREADS 2      // Reader threads when io_uring is not available
+#define HTY_IO_ALIGNMENT 4096 // Buffer, offset and length alignment for O_DIRECT
+
+// Scans smaller than this always go through the page cache
+#ifndef HTY_IO_DIRECT_MIN_BYTES
+#define HTY_IO_DIRECT_MIN_BYTES (256L * 1024 * 1024)
+#endif
+
+/**
+ * @brief Reader that streams the row groups of a file in order
+ *
+ * Up to HTY_IO_QUEUE_DEPTH row groups are read ahead with io_uring, or with
+ * a small pool of pread threads where io_uring is not available, while the
+ * caller works on earlier ones.
+ */
+typedef struct HtyBlockReader HtyBlockReader;
+
+struct HtyArena; // See heartyhty_arena.h
+
+/**
+ * @brief Function to choose whether large scans bypass the page cache (O_DIRECT)
+ *
+ * Only scans of at least HTY_IO_DIRECT_MIN_BYTES use it; file systems that
+ * refuse O_DIRECT fall back to normal reads.
+ *
+ * @param enabled - 1 to use O_DIRECT for large scans, 0 to always use the page cache
+ */
+void set_direct_io(int enabled);
+
+/**
+ * @brief Function to open a row group reader
+ *
+ * @param hty_file_path - path to hty file
+ * @param layout - row layout of the file
+ * @param num_rows - rows in the file
+ * @param row_groups - one flag per row group, 1 if it must be read; NULL to read all
+ * @return HtyBlockReader* - reader object, NULL on failure
+ */
+HtyBlockReader* open_block_reader(const char* hty_file_path, const HtyRowLayout* layout, int num_rows,
+                                  const int* row_groups);
+
+/**
+ * @brief Function to open a row group reader whose read buffers come from an arena
+ *
+ * The buffers stay in the arena after close_block_reader(), so the next
+ * scan after reset_arena() reuses them instead of allocating new ones.
+ *
+ * @param arena - arena for the read buffers, NULL to allocate them with posix_memalign()
+ * @param hty_file_path - path to hty file
+ * @param layout - row layout of the file
+ * @param num_rows - rows in the file
+ * @param row_groups - one flag per row group, 1 if it must be read; NULL to read all
+ * @return HtyBlockReader* - reader object, NULL on failure
+ */
+HtyBlockReader* open_block_reader_in_arena(struct HtyArena* arena, const char* hty_file_path, const HtyRowLayout* layout,
+                                           int num_rows, const int* row_groups);
+
+/**
+ * @brief Function to get the next row group
+ *
+ * The rows stay valid until the next call.
+ *
+ * @param reader - reader object
+ * @param rows - pointer to store the rows of the row group
+ * @param first_row - pointer to store the first row of the row group
+ * @param num_rows - pointer to store the number of rows
+ * @return int - 1 if a row group was returned, 0 at the end, -1 on failure
+ */
+int next_block(HtyBlockReader* reader, int** rows, int* first_row, int* num_rows);
+
+/**
+ * @brief Function to close a reader, waiting for reads still in flight
+ *
+ * @param reader - reader object
+ */
+void close_block_reader(HtyBlockReader* reader);
+
+#endif // HEARTYHTY_IO_H
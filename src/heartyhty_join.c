@@ -0,0 +1,529 @@
+/**
+ * @file heartyhty_join.c
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Hash equi-join between two HTY files
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "../third_party/cJSON/cJSON.h"
+#include "heartyhty_functions.h"
+#include "heartyhty_bloom.h"
+#include "heartyhty_io.h"
+#include "heartyhty_delete.h"
+#include "heartyhty_join.h"
+#include "heartyhty_stats.h"
+
+/**
+ * @brief One input of the join
+ */
+typedef struct {
+    cJSON* metadata;        // Metadata object of the file
+    const char* path;       // Path to the hty file
+    int num_rows;           // Rows in the file
+    HtyRowLayout layout;    // Where the rows are in the file
+    int total_columns;      // Columns per row
+    int key_index;          // Join key column
+    int num_columns;        // Projected columns
+    int* column_indices;    // Index of each projected column
+    int output_base;        // First output column of this side
+    const HtyPredicate* filter;  // Pushed down filter, NULL for none
+    int filter_index;       // Filter column
+    int filter_type;        // Filter column type (0 for int, 1 for float)
+    HtyRowBitmap deleted;   // Deleted rows of the file, never joined
+} JoinSide;
+
+/**
+ * @brief Hash table over the rows of the build side
+ *
+ * Entries are grouped by radix partition. Each partition has its own
+ * power-of-two bucket array; entries of a bucket are chained through next
+ * in build file order.
+ */
+typedef struct {
+    int num_entries;        // Rows in the table
+    int* keys;              // Join key of each entry
+    int* payload;           // Projected values of each entry, one entry after another
+    int radix_bits;         // Hash bits that pick the partition
+    int* partition_start;   // First entry of each partition (num_partitions + 1)
+    int* bucket_start;      // First bucket of each partition
+    unsigned int* bucket_mask;  // Bucket count - 1 of each partition
+    int* buckets;           // First entry of each bucket, -1 if empty
+    int* next;              // Next entry of the same bucket, -1 at the end
+} JoinTable;
+
+/**
+ * @brief Joined rows collected so far
+ */
+typedef struct {
+    int num_columns;   // Output columns
+    int** columns;     // Output values, one array per column
+    int num_rows;      // Rows collected
+    int capacity;      // Rows the arrays can hold
+} JoinOutput;
+
+/**
+ * @brief Function to hash a join key (murmur3 finalizer)
+ *
+ * @param key - join key
+ * @return uint32_t - hash; the top bits pick the partition, the low bits the bucket
+ */
+static uint32_t hash_key(int key) {
+    uint32_t hash = (uint32_t)key;
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bU;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35U;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+/**
+ * @brief Function to resolve the columns of one side of the join
+ *
+ * @param side - side to fill
+ * @param metadata - metadata object
+ * @param path - path to hty file
+ * @param key_column - join key column
+ * @param columns - projected column names
+ * @param num_columns - number of projected columns
+ * @param filter - filter on this side, NULL for none
+ * @param output_base - first output column of this side
+ * @return int - 0 on success, -1 on failure
+ */
+static int prepare_side(JoinSide* side, cJSON* metadata, const char* path, const char* key_column,
+                        char** columns, int num_columns, const HtyPredicate* filter, int output_base) {
+    cJSON* group = cJSON_GetArrayItem(cJSON_GetObjectItemCaseSensitive(metadata, "groups"), 0);  // Assuming single group
+    memset(side, 0, sizeof(JoinSide));
+    side->metadata = metadata;
+    side->path = path;
+    side->num_rows = cJSON_GetObjectItemCaseSensitive(metadata, "num_rows")->valueint;
+    side->total_columns = cJSON_GetArraySize(cJSON_GetObjectItemCaseSensitive(group, "columns"));
+    get_row_layout(metadata, &side->layout);
+    side->num_columns = num_columns;
+    side->output_base = output_base;
+    side->filter = filter;
+    if (load_deleted_rows(metadata, path, &side->deleted) < 0) {
+        return -1;
+    }
+
+    int key_type;
+    char* key_name = (char*)key_column;
+    if (resolve_columns(metadata, &key_name, 1, &side->key_index, &key_type) != 0) {
+        return -1;
+    }
+    if (key_type != 0) {
+        fprintf(stderr, "Join key must be an int column: %s\n", key_column);
+        return -1;
+    }
+    if (filter != NULL) {
+        char* filter_name = (char*)filter->column;
+        if (resolve_columns(metadata, &filter_name, 1, &side->filter_index, &side->filter_type) != 0) {
+            return -1;
+        }
+    }
+    side->column_indices = (int*)malloc((num_columns + 1) * sizeof(int));
+    int* column_types = (int*)malloc((num_columns + 1) * sizeof(int));
+    int status = resolve_columns(metadata, columns, num_columns, side->column_indices, column_types);
+    free(column_types);
+    return status;
+}
+
+/**
+ * @brief Function to find the rows of a block that are not deleted and pass the filter of a side
+ *
+ * @param side - side of the join
+ * @param block - rows of the block
+ * @param first_row - first row of the block
+ * @param num_rows - rows in the block
+ * @param selection - array to store the positions of passing rows
+ * @return int - number of passing rows
+ */
+static int select_rows(const JoinSide* side, const int* block, int first_row, int num_rows, int* selection) {
+    int live_rows = num_rows;
+    if (side->deleted.cardinality > 0) {
+        live_rows = select_live_rows(&side->deleted, first_row, num_rows, selection);
+    } else {
+        for (int i = 0; i < num_rows; i++) {
+            selection[i] = i;
+        }
+    }
+    if (side->filter == NULL) {
+        return live_rows;
+    }
+    int selected = 0;
+    for (int i = 0; i < live_rows; i++) {
+        int row = selection[i];
+        if (compare_values(block[(long)row * side->total_columns + side->filter_index], side->filter->value,
+                           side->filter->op, side->filter_type)) {
+            selection[selected++] = row;
+        }
+    }
+    return selected;
+}
+
+/**
+ * @brief Function to read a side block by block, calling a handler with the rows that pass its filter
+ *
+ * @param side - side of the join
+ * @param handle_block - handler called with each block and its selected rows
+ * @param context - handler state
+ * @return int - 0 on success, -1 on failure
+ */
+static int scan_side(const JoinSide* side, int (*handle_block)(void*, const int*, const int*, int), void* context) {
+    // Skip the row groups that the zone maps (or, for equality, the Bloom filters) rule out
+    int* row_groups = NULL;
+    if (side->filter != NULL) {
+        row_groups = row_groups_to_read(side->metadata, side->path, side->filter->column, side->filter_index,
+                                        side->filter_type, side->filter->op, &side->filter->value, 1);
+    }
+    HtyBlockReader* reader = open_block_reader(side->path, &side->layout, side->num_rows, row_groups);
+    free(row_groups);
+    if (reader == NULL) {
+        return -1;
+    }
+    int* selection = (int*)malloc(side->layout.block_rows * sizeof(int));
+
+    // Following row groups are read while this one is filtered and joined
+    int status = 0;
+    int* block;
+    int first_row, rows_in_block, got;
+    while (status == 0 && (got = next_block(reader, &block, &first_row, &rows_in_block)) == 1) {
+        int selected = select_rows(side, block, first_row, rows_in_block, selection);
+        status = handle_block(context, block, selection, selected);
+    }
+    if (got == -1) {
+        status = -1;
+    }
+    free(selection);
+    close_block_reader(reader);
+    return status;
+}
+
+/**
+ * @brief Build side state while its rows are collected
+ */
+typedef struct {
+    const JoinSide* side;  // Build side
+    JoinTable* table;      // Table being filled
+    int capacity;          // Entries the arrays can hold
+} BuildState;
+
+/**
+ * @brief Function to collect the key and projected values of selected build rows
+ */
+static int collect_build_rows(void* context, const int* block, const int* selection, int num_selected) {
+    BuildState* state = (BuildState*)context;
+    const JoinSide* side = state->side;
+    JoinTable* table = state->table;
+    if (table->num_entries + num_selected > state->capacity) {
+        int capacity = state->capacity * 2 > table->num_entries + num_selected ?
+                       state->capacity * 2 : table->num_entries + num_selected;
+        int* keys = (int*)realloc(table->keys, (capacity + 1) * sizeof(int));
+        int* payload = (int*)realloc(table->payload, ((long)capacity * side->num_columns + 1) * sizeof(int));
+        if (keys != NULL) {
+            table->keys = keys;
+        }
+        if (payload != NULL) {
+            table->payload = payload;
+        }
+        if (keys == NULL || payload == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            return -1;
+        }
+        state->capacity = capacity;
+    }
+    for (int i = 0; i < num_selected; i++) {
+        const int* row = block + (long)selection[i] * side->total_columns;
+        table->keys[table->num_entries] = row[side->key_index];
+        for (int col = 0; col < side->num_columns; col++) {
+            table->payload[(long)table->num_entries * side->num_columns + col] = row[side->column_indices[col]];
+        }
+        table->num_entries++;
+    }
+    return 0;
+}
+
+/**
+ * @brief Function to build the hash table, radix partitioned when it does not fit in cache
+ *
+ * @param side - build side
+ * @param table - table to build
+ * @return int - 0 on success, -1 on failure
+ */
+static int build_table(const JoinSide* side, JoinTable* table) {
+    BuildState state = {side, table, 0};
+    memset(table, 0, sizeof(JoinTable));
+    if (scan_side(side, collect_build_rows, &state) != 0) {
+        return -1;
+    }
+    int n = table->num_entries;
+
+    // Pick enough partitions that each one (keys, chains, buckets and values) fits in cache
+    long entry_bytes = (3L + side->num_columns) * sizeof(int);
+    while (table->radix_bits < HTY_JOIN_MAX_RADIX_BITS &&
+           ((long)n * entry_bytes >> table->radix_bits) > HTY_JOIN_CACHE_BYTES) {
+        table->radix_bits++;
+    }
+    int num_partitions = 1 << table->radix_bits;
+    table->partition_start = (int*)calloc(num_partitions + 1, sizeof(int));
+    table->bucket_start = (int*)malloc((num_partitions + 1) * sizeof(int));
+    table->bucket_mask = (unsigned int*)malloc(num_partitions * sizeof(unsigned int));
+    table->next = (int*)malloc((n + 1) * sizeof(int));
+    if (!table->partition_start || !table->bucket_start || !table->bucket_mask || !table->next) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+
+    if (table->radix_bits > 0) {
+        // Histogram, prefix sum, then scatter the entries into their partitions (keeps build order)
+        int* keys = (int*)malloc((n + 1) * sizeof(int));
+        int* payload = (int*)malloc(((long)n * side->num_columns + 1) * sizeof(int));
+        int* cursor = (int*)malloc(num_partitions * sizeof(int));
+        if (keys == NULL || payload == NULL || cursor == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            free(keys);
+            free(payload);
+            free(cursor);
+            return -1;
+        }
+        for (int i = 0; i < n; i++) {
+            table->partition_start[(hash_key(table->keys[i]) >> (32 - table->radix_bits)) + 1]++;
+        }
+        for (int p = 0; p < num_partitions; p++) {
+            table->partition_start[p + 1] += table->partition_start[p];
+            cursor[p] = table->partition_start[p];
+        }
+        for (int i = 0; i < n; i++) {
+            int position = cursor[hash_key(table->keys[i]) >> (32 - table->radix_bits)]++;
+            keys[position] = table->keys[i];
+            memcpy(payload + (long)position * side->num_columns, table->payload + (long)i * side->num_columns,
+                   side->num_columns * sizeof(int));
+        }
+        free(cursor);
+        free(table->keys);
+        free(table->payload);
+        table->keys = keys;
+        table->payload = payload;
+    } else {
+        table->partition_start[1] = n;
+    }
+
+    // Give each partition at least two buckets per entry
+    int total_buckets = 0;
+    for (int p = 0; p < num_partitions; p++) {
+        int entries = table->partition_start[p + 1] - table->partition_start[p];
+        unsigned int buckets = 1;
+        while (buckets < 2U * (unsigned int)entries) {
+            buckets <<= 1;
+        }
+        table->bucket_start[p] = total_buckets;
+        table->bucket_mask[p] = buckets - 1;
+        total_buckets += buckets;
+    }
+    table->buckets = (int*)malloc(total_buckets * sizeof(int));
+    if (table->buckets == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    memset(table->buckets, -1, total_buckets * sizeof(int));
+
+    // Insert backwards so that every chain lists its entries in build order
+    for (int p = 0; p < num_partitions; p++) {
+        for (int i = table->partition_start[p + 1] - 1; i >= table->partition_start[p]; i--) {
+            int* bucket = &table->buckets[table->bucket_start[p] + (hash_key(table->keys[i]) & table->bucket_mask[p])];
+            table->next[i] = *bucket;
+            *bucket = i;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Function to free the arrays of a hash table
+ *
+ * @param table - table to free
+ */
+static void free_table(JoinTable* table) {
+    free(table->keys);
+    free(table->payload);
+    free(table->partition_start);
+    free(table->bucket_start);
+    free(table->bucket_mask);
+    free(table->buckets);
+    free(table->next);
+}
+
+/**
+ * @brief Probe side state while it is streamed past the hash table
+ */
+typedef struct {
+    const JoinSide* probe;  // Probe side
+    const JoinSide* build;  // Build side
+    const JoinTable* table; // Hash table over the build side
+    JoinOutput* output;     // Joined rows
+} ProbeState;
+
+/**
+ * @brief Function to make room for one more output row
+ *
+ * @param output - joined rows
+ * @return int - 0 on success, -1 on failure
+ */
+static int reserve_output_row(JoinOutput* output) {
+    if (output->num_rows < output->capacity) {
+        return 0;
+    }
+    int capacity = output->capacity * 2 + 1024;
+    for (int col = 0; col < output->num_columns; col++) {
+        int* values = (int*)realloc(output->columns[col], capacity * sizeof(int));
+        if (values == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            return -1;
+        }
+        output->columns[col] = values;
+    }
+    output->capacity = capacity;
+    return 0;
+}
+
+/**
+ * @brief Function to probe the hash table with the selected rows of a block, a batch at a time
+ */
+static int probe_block(void* context, const int* block, const int* selection, int num_selected) {
+    ProbeState* state = (ProbeState*)context;
+    const JoinSide* probe = state->probe;
+    const JoinSide* build = state->build;
+    const JoinTable* table = state->table;
+    JoinOutput* output = state->output;
+    uint32_t hashes[HTY_JOIN_BATCH_ROWS];
+    int heads[HTY_JOIN_BATCH_ROWS];
+
+    for (int start = 0; start < num_selected; start += HTY_JOIN_BATCH_ROWS) {
+        int batch = num_selected - start < HTY_JOIN_BATCH_ROWS ? num_selected - start : HTY_JOIN_BATCH_ROWS;
+
+        // Hash the whole batch first, then look up all bucket heads, then follow the chains
+        for (int i = 0; i < batch; i++) {
+            hashes[i] = hash_key(block[(long)selection[start + i] * probe->total_columns + probe->key_index]);
+        }
+        for (int i = 0; i < batch; i++) {
+            int partition = table->radix_bits > 0 ? (int)(hashes[i] >> (32 - table->radix_bits)) : 0;
+            heads[i] = table->buckets[table->bucket_start[partition] + (hashes[i] & table->bucket_mask[partition])];
+        }
+        for (int i = 0; i < batch; i++) {
+            const int* row = block + (long)selection[start + i] * probe->total_columns;
+            int key = row[probe->key_index];
+            for (int entry = heads[i]; entry != -1; entry = table->next[entry]) {
+                if (table->keys[entry] != key) {
+                    continue;
+                }
+                if (reserve_output_row(output) != 0) {
+                    return -1;
+                }
+                for (int col = 0; col < probe->num_columns; col++) {
+                    output->columns[probe->output_base + col][output->num_rows] = row[probe->column_indices[col]];
+                }
+                for (int col = 0; col < build->num_columns; col++) {
+                    output->columns[build->output_base + col][output->num_rows] =
+                        table->payload[(long)entry * build->num_columns + col];
+                }
+                output->num_rows++;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Function to join two files on a key (see hash_join())
+ *
+ * @param left_metadata - metadata of the left file
+ * @param left_path - path to the left file
+ * @param left_key - join key column of the left file
+ * @param left_columns - columns to return from the left file
+ * @param num_left_columns - number of left columns
+ * @param left_filter - filter on the left file, or NULL
+ * @param right_metadata - metadata of the right file
+ * @param right_path - path to the right file
+ * @param right_key - join key column of the right file
+ * @param right_columns - columns to return from the right file
+ * @param num_right_columns - number of right columns
+ * @param right_filter - filter on the right file, or NULL
+ * @param row_count - pointer to store number of joined rows
+ * @return int** - joined columns, left columns first
+ */
+static int** join_files(cJSON* left_metadata, const char* left_path, const char* left_key,
+                        char** left_columns, int num_left_columns, const HtyPredicate* left_filter,
+                        cJSON* right_metadata, const char* right_path, const char* right_key,
+                        char** right_columns, int num_right_columns, const HtyPredicate* right_filter,
+                        int* row_count) {
+    JoinSide left, right;
+    memset(&left, 0, sizeof(JoinSide));
+    memset(&right, 0, sizeof(JoinSide));
+    if (prepare_side(&left, left_metadata, left_path, left_key, left_columns, num_left_columns, left_filter, 0) != 0 ||
+        prepare_side(&right, right_metadata, right_path, right_key, right_columns, num_right_columns, right_filter,
+                     num_left_columns) != 0) {
+        free(left.column_indices);
+        free(right.column_indices);
+        free_bitmap(&left.deleted);
+        free_bitmap(&right.deleted);
+        return NULL;
+    }
+
+    // Build on the smaller file, stream the larger one
+    JoinSide* build = right.num_rows <= left.num_rows ? &right : &left;
+    JoinSide* probe = build == &right ? &left : &right;
+
+    JoinOutput output;
+    output.num_columns = num_left_columns + num_right_columns;
+    output.columns = (int**)calloc(output.num_columns + 1, sizeof(int*));
+    output.num_rows = 0;
+    output.capacity = 0;
+
+    JoinTable table;
+    int status = build_table(build, &table);
+    if (status == 0) {
+        ProbeState state = {probe, build, &table, &output};
+        status = scan_side(probe, probe_block, &state);
+    }
+    free_table(&table);
+    free(left.column_indices);
+    free(right.column_indices);
+    free_bitmap(&left.deleted);
+    free_bitmap(&right.deleted);
+
+    if (status != 0) {
+        for (int col = 0; col < output.num_columns; col++) {
+            free(output.columns[col]);
+        }
+        free(output.columns);
+        return NULL;
+    }
+    for (int col = 0; col < output.num_columns; col++) {
+        if (output.columns[col] == NULL) {
+            output.columns[col] = (int*)malloc(sizeof(int)); // No rows, keep the result freeable column by column
+        }
+    }
+    *row_count = output.num_rows;
+    return output.columns;
+}
+
+int** hash_join(cJSON* left_metadata, const char* left_path, const char* left_key,
+                char** left_columns, int num_left_columns, const HtyPredicate* left_filter,
+                cJSON* right_metadata, const char* right_path, const char* right_key,
+                char** right_columns, int num_right_columns, const HtyPredicate* right_filter,
+                int* row_count) {
+    HtyStageTimer query_timer;
+    HTY_STAGE_BEGIN(query_timer);
+    int** result = join_files(left_metadata, left_path, left_key, left_columns, num_left_columns, left_filter,
+                              right_metadata, right_path, right_key, right_columns, num_right_columns, right_filter,
+                              row_count);
+    HTY_QUERY_END("hash_join", query_timer);
+    return result;
+}
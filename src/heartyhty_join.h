@@ -0,0 +1,53 @@
+/**
+ * @file heartyhty_join.h
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Header file for the hash equi-join between two HTY files
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef HEARTYHTY_JOIN_H
+#define HEARTYHTY_JOIN_H
+
+// Hash tables larger than this are split into radix partitions that each fit in it
+#ifndef HTY_JOIN_CACHE_BYTES
+#define HTY_JOIN_CACHE_BYTES (256 * 1024)
+#endif
+
+#define HTY_JOIN_MAX_RADIX_BITS 12 // At most 4096 partitions
+#define HTY_JOIN_BATCH_ROWS 1024   // Probe rows hashed and looked up together
+
+/**
+ * @brief Function to join two files on equal int keys (inner hash join)
+ *
+ * The hash table is built on the file with fewer rows, then the other file
+ * is streamed past it in batches. Filters are applied to each file before
+ * its rows reach the join. The result has the projected left columns
+ * followed by the projected right columns. Rows come in the order of the
+ * streamed (larger) file; several matches of one row come in the order of
+ * the other file.
+ *
+ * @param left_metadata - metadata object of the left file
+ * @param left_path - path to the left hty file
+ * @param left_key - int join key column of the left file
+ * @param left_columns - array of left column names to project
+ * @param num_left_columns - number of left columns to project
+ * @param left_filter - filter on the left file, NULL for none
+ * @param right_metadata - metadata object of the right file
+ * @param right_path - path to the right hty file
+ * @param right_key - int join key column of the right file
+ * @param right_columns - array of right column names to project
+ * @param num_right_columns - number of right columns to project
+ * @param right_filter - filter on the right file, NULL for none
+ * @param row_count - pointer to store number of resulting rows
+ * @return int** - 2D array of joined data, NULL on failure
+ */
+int** hash_join(cJSON* left_metadata, const char* left_path, const char* left_key,
+                char** left_columns, int num_left_columns, const HtyPredicate* left_filter,
+                cJSON* right_metadata, const char* right_path, const char* right_key,
+                char** right_columns, int num_right_columns, const HtyPredicate* right_filter,
+                int* row_count);
+
+#endif // HEARTYHTY_JOIN_H
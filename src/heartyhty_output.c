@@ -0,0 +1,376 @@
+/**
+ * @file heartyhty_output.c
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Fast result output: buffered value formatting, parallel CSV/TSV writers and columnar export
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "heartyhty_output.h"
+#include "heartyhty_stats.h"
+
+// Two digit pairs "00" to "99", so integers are formatted two digits at a time
+static const char digit_pairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+/**
+ * @brief Function to format an unsigned integer
+ *
+ * @param text - buffer of at least 21 bytes
+ * @param value - value
+ * @return int - length of the text
+ */
+static int format_unsigned(char* text, uint64_t value) {
+    char digits[24];
+    char* end = digits + sizeof(digits);
+    char* at = end;
+    while (value >= 100) {
+        int pair = (int)(value % 100) * 2;
+        value /= 100;
+        *--at = digit_pairs[pair + 1];
+        *--at = digit_pairs[pair];
+    }
+    if (value >= 10) {
+        *--at = digit_pairs[value * 2 + 1];
+        *--at = digit_pairs[value * 2];
+    } else {
+        *--at = (char)('0' + value);
+    }
+    memcpy(text, at, end - at);
+    return (int)(end - at);
+}
+
+int format_int(char* text, int value) {
+    if (value < 0) {
+        text[0] = '-';
+        return 1 + format_unsigned(text + 1, (uint64_t)0 - (uint64_t)(int64_t)value);
+    }
+    return format_unsigned(text, (uint64_t)value);
+}
+
+/**
+ * @brief Function to format a scaled integer as a decimal, e.g. 12345 with 2 decimals as 123.45
+ *
+ * @param text - buffer of at least HTY_FORMAT_MAX bytes
+ * @param negative - 1 to put a minus sign in front
+ * @param value - absolute value times 10^decimals
+ * @param decimals - number of digits after the decimal point (0 gives ".0")
+ * @return int - length of the text
+ */
+static int format_scaled(char* text, int negative, uint64_t value, int decimals) {
+    static const uint64_t powers[] = {1, 10, 100, 1000};
+    int length = 0;
+    if (negative) {
+        text[length++] = '-';
+    }
+    length += format_unsigned(text + length, value / powers[decimals]);
+    text[length++] = '.';
+    if (decimals == 0) {
+        text[length++] = '0';
+        return length;
+    }
+    uint64_t fraction = value % powers[decimals];
+    for (int i = decimals - 1; i >= 0; i--) {
+        text[length + i] = (char)('0' + fraction % 10);
+        fraction /= 10;
+    }
+    return length + decimals;
+}
+
+/**
+ * @brief Function to format a float that has no short exact decimal, with the fewest digits that read back
+ *
+ * @param text - buffer of at least HTY_FORMAT_MAX bytes
+ * @param value - value
+ * @return int - length of the text
+ */
+static int format_float_shortest(char* text, float value) {
+    int length = 0;
+    for (int precision = 1; precision <= 9; precision++) {  // 9 significant digits always read back
+        length = snprintf(text, HTY_FORMAT_MAX, "%.*g", precision, value);
+        if (strtof(text, NULL) == value) {
+            break;
+        }
+    }
+
+    // Write exponents out in full and keep a decimal point, so the text still reads as a float column
+    char* exponent = strchr(text, 'e');
+    if (exponent != NULL) {
+        int power = atoi(exponent + 1);
+        char significant[16];
+        int count = 0;
+        for (char* c = text; c < exponent; c++) {
+            if (*c >= '0' && *c <= '9') {
+                significant[count++] = *c;
+            }
+        }
+        if (power < 0) {
+            return snprintf(text, HTY_FORMAT_MAX, "%.*f", count - 1 - power, value);
+        }
+        // Large value: the significant digits followed by zeros, e.g. 1e+30 as 1000...0.0
+        length = value < 0 ? 1 : 0;  // Keep the sign already in text
+        for (int i = 0; i <= power; i++) {
+            text[length++] = i < count ? significant[i] : '0';
+        }
+        text[length++] = '.';
+        text[length++] = '0';
+    } else if (strchr(text, '.') == NULL) {
+        text[length++] = '.';
+        text[length++] = '0';
+    }
+    return length;
+}
+
+int format_float(char* text, int bits, int float_format) {
+    float value;
+    memcpy(&value, &bits, sizeof(float));
+    int negative = bits < 0;
+    if (((bits >> 23) & 0xff) == 0xff) {
+        return snprintf(text, HTY_FORMAT_MAX, "%f", value);  // NaN and infinity
+    }
+    double magnitude = negative ? -(double)value : (double)value;
+
+    if (float_format == HTY_FLOAT_DISPLAY) {
+        // A float times 10 is exact in a double, so rounding it to an integer is
+        // rounding the exact value to one decimal, ties to even like printf
+        double scaled = magnitude * 10;
+        if (scaled >= 9e15) {
+            return snprintf(text, HTY_FORMAT_MAX, "%.1f", value);
+        }
+        uint64_t rounded = (uint64_t)scaled;
+        double fraction = scaled - (double)rounded;
+        if (fraction > 0.5 || (fraction == 0.5 && (rounded & 1))) {
+            rounded++;
+        }
+        return format_scaled(text, negative, rounded, 1);
+    }
+
+    // Values with at most 3 decimals (most data) are printed exactly; float times 10^3 is exact in a double
+    double scaled = magnitude;
+    for (int decimals = 0; decimals <= 3 && scaled < 9e15; decimals++, scaled *= 10) {
+        if (scaled == (double)(uint64_t)scaled) {
+            return format_scaled(text, negative, (uint64_t)scaled, decimals);
+        }
+    }
+    return format_float_shortest(text, value);
+}
+
+/**
+ * @brief Rows of a write_delimited call formatted by one thread
+ */
+typedef struct {
+    int** columns;             // Columns to format
+    const int* column_types;   // Type of each column
+    int num_columns;           // Number of columns
+    const char* separator;     // Text between values
+    int float_format;          // HTY_FLOAT_DISPLAY or HTY_FLOAT_EXACT
+    int first_row;             // First row of the chunk
+    int num_rows;              // Rows in the chunk
+    char* text;                // Formatted rows
+    size_t length;             // Bytes of text used
+    size_t capacity;           // Bytes of text allocated
+    int failed;                // 1 if memory ran out
+} FormatChunk;
+
+/**
+ * @brief Function to format the rows of a chunk into its text buffer
+ *
+ * @param arg - chunk to format
+ * @return void* - NULL
+ */
+static void* format_chunk(void* arg) {
+    FormatChunk* chunk = (FormatChunk*)arg;
+    size_t separator_length = strlen(chunk->separator);
+    size_t row_bytes = chunk->num_columns * (HTY_FORMAT_MAX + separator_length) + 1;  // Longest possible row
+    chunk->length = 0;
+    chunk->failed = 0;
+    for (int row = chunk->first_row; row < chunk->first_row + chunk->num_rows; row++) {
+        if (chunk->capacity - chunk->length < row_bytes) {
+            size_t capacity = chunk->capacity > 0 ? chunk->capacity * 2 : 64 * row_bytes;
+            char* text = (char*)realloc(chunk->text, capacity);
+            if (text == NULL) {
+                chunk->failed = 1;
+                return NULL;
+            }
+            chunk->text = text;
+            chunk->capacity = capacity;
+        }
+        char* at = chunk->text + chunk->length;
+        for (int col = 0; col < chunk->num_columns; col++) {
+            if (col > 0) {
+                memcpy(at, chunk->separator, separator_length);
+                at += separator_length;
+            }
+            int value = chunk->columns[col][row];
+            at += chunk->column_types[col] == 0 ? format_int(at, value) : format_float(at, value, chunk->float_format);
+        }
+        *at++ = '\n';
+        chunk->length = at - chunk->text;
+    }
+    return NULL;
+}
+
+int write_delimited(FILE* file, char** column_names, const int* column_types, int num_columns, int** columns,
+                    int row_count, const char* separator, int float_format) {
+    int status = 0;
+    HtyStageTimer timer;
+    HTY_STAGE_BEGIN(timer);
+    if (column_names != NULL) {
+        for (int i = 0; i < num_columns; i++) {
+            if (i > 0) {
+                fputs(separator, file);
+            }
+            fputs(column_names[i], file);
+        }
+        fputc('\n', file);
+    }
+
+    // Format up to one chunk per thread at a time, then write the chunks in order
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int num_chunks = (row_count + HTY_OUTPUT_CHUNK_ROWS - 1) / HTY_OUTPUT_CHUNK_ROWS;
+    int num_threads = num_chunks < HTY_OUTPUT_MAX_THREADS ? num_chunks : HTY_OUTPUT_MAX_THREADS;
+    if (num_cpus > 0 && num_threads > num_cpus) {
+        num_threads = (int)num_cpus;
+    }
+    if (num_threads < 1) {
+        num_threads = 1;
+    }
+    FormatChunk chunks[HTY_OUTPUT_MAX_THREADS];
+    memset(chunks, 0, sizeof(chunks));
+    for (int first_row = 0; first_row < row_count && status == 0;) {
+        int round = 0;
+        for (; round < num_threads && first_row < row_count; round++) {
+            FormatChunk* chunk = &chunks[round];
+            chunk->columns = columns;
+            chunk->column_types = column_types;
+            chunk->num_columns = num_columns;
+            chunk->separator = separator;
+            chunk->float_format = float_format;
+            chunk->first_row = first_row;
+            chunk->num_rows = row_count - first_row < HTY_OUTPUT_CHUNK_ROWS ? row_count - first_row : HTY_OUTPUT_CHUNK_ROWS;
+            first_row += chunk->num_rows;
+        }
+        if (round == 1) {
+            format_chunk(&chunks[0]);
+        } else {
+            pthread_t threads[HTY_OUTPUT_MAX_THREADS];
+            int started[HTY_OUTPUT_MAX_THREADS];
+            for (int i = 0; i < round; i++) {
+                started[i] = pthread_create(&threads[i], NULL, format_chunk, &chunks[i]) == 0;
+            }
+            for (int i = 0; i < round; i++) {
+                if (started[i]) {
+                    pthread_join(threads[i], NULL);
+                } else {
+                    format_chunk(&chunks[i]); // Fall back to formatting on this thread
+                }
+            }
+        }
+        for (int i = 0; i < round && status == 0; i++) {
+            if (chunks[i].failed) {
+                fprintf(stderr, "Memory allocation failed\n");
+                status = -1;
+            } else if (fwrite(chunks[i].text, 1, chunks[i].length, file) != chunks[i].length) {
+                fprintf(stderr, "Error writing output\n");
+                status = -1;
+            }
+        }
+    }
+    for (int i = 0; i < num_threads; i++) {
+        free(chunks[i].text);
+    }
+    HTY_STAGE_END(HTY_STAGE_OUTPUT, timer);
+    return status;
+}
+
+/**
+ * @brief Function to write bytes to a columnar export
+ *
+ * @param writer - columnar writer
+ * @param data - bytes to write
+ * @param size - number of bytes
+ */
+static void columnar_write(HtyColumnarWriter* writer, const void* data, size_t size) {
+    if (!writer->failed && size > 0 && fwrite(data, 1, size, writer->file) != size) {
+        fprintf(stderr, "Error writing columnar output\n");
+        writer->failed = 1;
+    }
+    writer->offset += size;
+}
+
+/**
+ * @brief Function to pad a columnar export with zeros up to HTY_COLUMNAR_ALIGNMENT
+ *
+ * @param writer - columnar writer
+ */
+static void columnar_pad(HtyColumnarWriter* writer) {
+    static const char zeros[HTY_COLUMNAR_ALIGNMENT] = {0};
+    columnar_write(writer, zeros, (HTY_COLUMNAR_ALIGNMENT - writer->offset % HTY_COLUMNAR_ALIGNMENT) % HTY_COLUMNAR_ALIGNMENT);
+}
+
+// File layout, every part starting on a multiple of HTY_COLUMNAR_ALIGNMENT:
+//   schema: magic (8 bytes), int32 number of columns, int32 0, then per column
+//           int32 type, int32 name length, name bytes
+//   batch:  int64 row count, then each column as row count int32 values
+//   end:    int64 0
+
+HtyColumnarWriter* open_columnar_writer(const char* path, char** column_names, const int* column_types, int num_columns) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "Error opening file: %s\n", path);
+        return NULL;
+    }
+    HtyColumnarWriter* writer = (HtyColumnarWriter*)calloc(1, sizeof(HtyColumnarWriter));
+    if (writer == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        fclose(file);
+        return NULL;
+    }
+    writer->file = file;
+    writer->num_columns = num_columns;
+    int32_t header[2] = {num_columns, 0};
+    columnar_write(writer, HTY_COLUMNAR_MAGIC, sizeof(HTY_COLUMNAR_MAGIC));
+    columnar_write(writer, header, sizeof(header));
+    for (int i = 0; i < num_columns; i++) {
+        int32_t column[2] = {column_types[i], (int32_t)strlen(column_names[i])};
+        columnar_write(writer, column, sizeof(column));
+        columnar_write(writer, column_names[i], column[1]);
+    }
+    columnar_pad(writer);
+    return writer;
+}
+
+int write_columnar_batch(HtyColumnarWriter* writer, int** columns, int row_count) {
+    if (row_count <= 0) {
+        return writer->failed ? -1 : 0;  // A zero row count marks the end of the file
+    }
+    int64_t rows = row_count;
+    columnar_write(writer, &rows, sizeof(rows));
+    columnar_pad(writer);
+    for (int i = 0; i < writer->num_columns; i++) {
+        columnar_write(writer, columns[i], (size_t)row_count * sizeof(int));
+        columnar_pad(writer);
+    }
+    return writer->failed ? -1 : 0;
+}
+
+int close_columnar_writer(HtyColumnarWriter* writer) {
+    int64_t end = 0;
+    columnar_write(writer, &end, sizeof(end));
+    int status = writer->failed ? -1 : 0;
+    if (fclose(writer->file) != 0) {
+        status = -1;
+    }
+    free(writer);
+    return status;
+}
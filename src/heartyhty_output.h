@@ -0,0 +1,115 @@
+/**
+ * @file heartyhty_output.h
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Header file for fast result output: buffered value formatting, parallel CSV/TSV writers and columnar export
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef HEARTYHTY_OUTPUT_H
+#define HEARTYHTY_OUTPUT_H
+
+#include <stdio.h>
+
+#define HTY_FORMAT_MAX 64 // Longest formatted value, including the terminating null
+
+#define HTY_OUTPUT_CHUNK_ROWS 65536 // Rows formatted by one thread at a time
+#define HTY_OUTPUT_MAX_THREADS 8    // Maximum number of formatting threads
+
+#define HTY_FLOAT_DISPLAY 0 // Floats as "%.1f", like display_column
+#define HTY_FLOAT_EXACT 1   // Floats as the shortest decimal that reads back as the same float
+
+#define HTY_COLUMNAR_MAGIC "HTYCOL1" // First 8 bytes (with the null) of a columnar export
+#define HTY_COLUMNAR_ALIGNMENT 64    // Alignment of every buffer in a columnar export
+
+/**
+ * @brief Writer of a columnar export
+ */
+typedef struct {
+    FILE* file;       // Output file
+    int num_columns;  // Number of columns per batch
+    long offset;      // Bytes written so far
+    int failed;       // 1 once a write failed
+} HtyColumnarWriter;
+
+/**
+ * @brief Function to format an int
+ *
+ * @param text - buffer of at least HTY_FORMAT_MAX bytes
+ * @param value - value
+ * @return int - length of the text (not null terminated)
+ */
+int format_int(char* text, int value);
+
+/**
+ * @brief Function to format a float stored as int bits
+ *
+ * HTY_FLOAT_DISPLAY gives the same text as printf("%.1f"). HTY_FLOAT_EXACT
+ * always has a decimal point (so csv_to_hty reads the column back as float)
+ * and strtof() gives back the same bits.
+ *
+ * @param text - buffer of at least HTY_FORMAT_MAX bytes
+ * @param bits - float bits
+ * @param float_format - HTY_FLOAT_DISPLAY or HTY_FLOAT_EXACT
+ * @return int - length of the text (not null terminated)
+ */
+int format_float(char* text, int bits, int float_format);
+
+/**
+ * @brief Function to write columns as delimited text, one row per line
+ *
+ * Rows are formatted in chunks of HTY_OUTPUT_CHUNK_ROWS on up to
+ * HTY_OUTPUT_MAX_THREADS threads and written in order with large writes.
+ *
+ * @param file - output file
+ * @param column_names - names for the header line, NULL for no header
+ * @param column_types - type of each column (0 for int, 1 for float)
+ * @param num_columns - number of columns
+ * @param columns - 2D array of data
+ * @param row_count - number of rows
+ * @param separator - text between values, e.g. ", ", "," or "\t"
+ * @param float_format - HTY_FLOAT_DISPLAY or HTY_FLOAT_EXACT
+ * @return int - 0 on success, -1 on failure
+ */
+int write_delimited(FILE* file, char** column_names, const int* column_types, int num_columns, int** columns,
+                    int row_count, const char* separator, int float_format);
+
+/**
+ * @brief Function to start a columnar export
+ *
+ * The file holds a schema followed by batches; each column of a batch is a
+ * raw array of 32-bit little-endian values (float bits for float columns)
+ * aligned to HTY_COLUMNAR_ALIGNMENT bytes, so readers can map the buffers
+ * without parsing.
+ *
+ * @param path - path of the file to create
+ * @param column_names - name of each column
+ * @param column_types - type of each column (0 for int, 1 for float)
+ * @param num_columns - number of columns
+ * @return HtyColumnarWriter* - writer, NULL on failure
+ */
+HtyColumnarWriter* open_columnar_writer(const char* path, char** column_names, const int* column_types, int num_columns);
+
+/**
+ * @brief Function to append a batch of rows to a columnar export
+ *
+ * The columns are written as they are, e.g. straight from a column block.
+ *
+ * @param writer - columnar writer
+ * @param columns - 2D array of data
+ * @param row_count - number of rows
+ * @return int - 0 on success, -1 on failure
+ */
+int write_columnar_batch(HtyColumnarWriter* writer, int** columns, int row_count);
+
+/**
+ * @brief Function to finish a columnar export and close the file
+ *
+ * @param writer - columnar writer
+ * @return int - 0 if every write succeeded, -1 otherwise
+ */
+int close_columnar_writer(HtyColumnarWriter* writer);
+
+#endif // HEARTYHTY_OUTPUT_H
@@ -0,0 +1,587 @@
+/**
+ * @file heartyhty_pipeline.c
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Conversion pipeline: a reader, parser threads and an asynchronous writer connected by bounded queues
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#define _GNU_SOURCE // fopencookie
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "heartyhty_pipeline.h"
+
+#define HTY_QUEUE_SLOTS 4 // Queue capacity (a power of two): every chunk or block of a lane plus the end marker
+
+/**
+ * @brief Bounded lock-free queue for one producer thread and one consumer thread
+ */
+typedef struct {
+    void* items[HTY_QUEUE_SLOTS];                  // Queued items
+    unsigned head __attribute__((aligned(64)));    // Next item to take, written by the consumer only
+    unsigned tail __attribute__((aligned(64)));    // Next free slot, written by the producer only
+} SpscQueue;
+
+// Item that marks the end of a queue; the queues never carry NULL items
+static char end_marker;
+#define END_OF_QUEUE ((void*)&end_marker)
+
+/**
+ * @brief Function to wait a little longer for another stage
+ *
+ * Spins first, then gives the processor away, then sleeps, so a stage that
+ * waits for long costs nothing and the other stages still run on a single
+ * processor.
+ *
+ * @param spins - number of times the caller waited so far, incremented
+ */
+static void wait_for_stage(int* spins) {
+    (*spins)++;
+    if (*spins < 64) {
+        __asm__ __volatile__("" ::: "memory");
+    } else if (*spins < 128) {
+        sched_yield();
+    } else {
+        struct timespec pause = {0, 50000};
+        nanosleep(&pause, NULL);
+    }
+}
+
+/**
+ * @brief Function to add an item to a queue, waiting while it is full
+ *
+ * @param queue - queue object
+ * @param item - item to add
+ * @param stop - flag that ends the wait when set
+ * @return int - 0 on success, -1 if stopped
+ */
+static int push_item(SpscQueue* queue, void* item, const int* stop) {
+    unsigned tail = queue->tail;
+    int spins = 0;
+    while (tail - __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) == HTY_QUEUE_SLOTS) {
+        if (__atomic_load_n(stop, __ATOMIC_RELAXED)) {
+            return -1;
+        }
+        wait_for_stage(&spins);
+    }
+    queue->items[tail % HTY_QUEUE_SLOTS] = item;
+    __atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * @brief Function to take an item from a queue, waiting while it is empty
+ *
+ * @param queue - queue object
+ * @param stop - flag that ends the wait when set
+ * @return void* - item, NULL if stopped
+ */
+static void* pop_item(SpscQueue* queue, const int* stop) {
+    unsigned head = queue->head;
+    int spins = 0;
+    while (head == __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE)) {
+        if (__atomic_load_n(stop, __ATOMIC_RELAXED)) {
+            return NULL;
+        }
+        wait_for_stage(&spins);
+    }
+    void* item = queue->items[head % HTY_QUEUE_SLOTS];
+    __atomic_store_n(&queue->head, head + 1, __ATOMIC_RELEASE);
+    return item;
+}
+
+/**
+ * @brief Chunk of a line pipeline with its buffer
+ */
+typedef struct {
+    HtyLineChunk chunk; // Chunk as seen by the parser and the consumer; first so the two convert
+    long capacity;      // Bytes allocated for chunk.text
+    int lane;           // Parser lane the chunk belongs to
+} PipelineChunk;
+
+/**
+ * @brief Parser thread with its chunks and queues
+ */
+typedef struct {
+    HtyLinePipeline* pipeline;                        // Pipeline the lane belongs to
+    PipelineChunk chunks[HTY_PIPELINE_LANE_CHUNKS];   // Chunks of the lane
+    SpscQueue free_chunks;                            // Consumer to reader: chunks to fill
+    SpscQueue read_chunks;                            // Reader to parser: chunks to parse
+    SpscQueue parsed_chunks;                          // Parser to consumer: chunks to consume
+    pthread_t thread;                                 // Parser thread
+} PipelineLane;
+
+struct HtyLinePipeline {
+    int fd;                              // File being read
+    long offset;                         // Offset of the next read
+    HtyLineParser parse;                 // Parser function
+    void* context;                       // Parser context
+    void (*free_result)(void*);          // Function to free chunk results
+    int num_lanes;                       // Number of parser lanes
+    PipelineLane* lanes;                 // Parser lanes
+    long next_chunk;                     // Number of chunks taken by the consumer
+    int finished;                        // Set when the consumer took the end
+    pthread_t reader;                    // Reader thread
+    int reader_started;                  // Check if the reader thread runs
+    int started_lanes;                   // Number of parser threads started
+    int failed;                          // Set when reading or parsing failed
+    int stop;                            // Set to stop every thread
+};
+
+/**
+ * @brief Function to read until a buffer is full or the file ends
+ *
+ * @param pipeline - pipeline object
+ * @param buffer - buffer to read into
+ * @param size - bytes to read
+ * @return long - bytes read (less than size only at the end of the file), -1 on failure
+ */
+static long read_fully(HtyLinePipeline* pipeline, char* buffer, long size) {
+    long done = 0;
+    while (done < size) {
+        ssize_t bytes = pread(pipeline->fd, buffer + done, size - done, pipeline->offset);
+        if (bytes < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes < 0) {
+            fprintf(stderr, "Error reading file\n");
+            return -1;
+        }
+        if (bytes == 0) {
+            break;
+        }
+        done += bytes;
+        pipeline->offset += bytes;
+    }
+    return done;
+}
+
+/**
+ * @brief Function to make room in the buffer of a chunk, keeping its text
+ *
+ * @param chunk - chunk object
+ * @param capacity - bytes needed
+ * @return int - 0 on success, -1 on failure
+ */
+static int reserve_chunk(PipelineChunk* chunk, long capacity) {
+    if (chunk->capacity >= capacity) {
+        return 0;
+    }
+    char* text = (char*)realloc(chunk->chunk.text, capacity);
+    if (text == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    chunk->chunk.text = text;
+    chunk->capacity = capacity;
+    return 0;
+}
+
+/**
+ * @brief Reader thread: fill chunks with whole lines and hand them to the lanes in turn
+ *
+ * A line cut at the end of a read is carried over to the start of the next
+ * chunk. A chunk without any line end keeps reading, so lines longer than
+ * a read still go to one parser whole.
+ *
+ * @param arg - pipeline object
+ * @return void* - NULL
+ */
+static void* read_chunks(void* arg) {
+    HtyLinePipeline* pipeline = (HtyLinePipeline*)arg;
+    char* carry = NULL;         // Start of a line cut by the previous read
+    long carry_length = 0;
+    long carry_capacity = 0;
+    int at_end = 0;
+    for (long index = 0; !at_end; index++) {
+        PipelineLane* lane = &pipeline->lanes[index % pipeline->num_lanes];
+        PipelineChunk* chunk = (PipelineChunk*)pop_item(&lane->free_chunks, &pipeline->stop);
+        if (chunk == NULL) {
+            break;
+        }
+        if (reserve_chunk(chunk, carry_length + HTY_PIPELINE_CHUNK_BYTES + 1) != 0) {
+            __atomic_store_n(&pipeline->failed, 1, __ATOMIC_RELAXED);
+            break;
+        }
+        if (carry_length > 0) {
+            memcpy(chunk->chunk.text, carry, carry_length);
+        }
+        long length = carry_length;
+        long line_end = -1;
+        while (line_end < 0 && !at_end) {
+            if (reserve_chunk(chunk, length + HTY_PIPELINE_CHUNK_BYTES + 1) != 0) {
+                length = -1;
+                break;
+            }
+            long bytes = read_fully(pipeline, chunk->chunk.text + length, HTY_PIPELINE_CHUNK_BYTES);
+            if (bytes < 0) {
+                length = -1;
+                break;
+            }
+            at_end = bytes < HTY_PIPELINE_CHUNK_BYTES;
+            char* last = (char*)memrchr(chunk->chunk.text + length, '\n', bytes);
+            length += bytes;
+            if (last != NULL) {
+                line_end = last - chunk->chunk.text + 1;
+            }
+        }
+        if (length < 0) {
+            __atomic_store_n(&pipeline->failed, 1, __ATOMIC_RELAXED);
+            break;
+        }
+        if (at_end) {
+            line_end = length; // The last line of the file may have no line end
+        }
+
+        // Keep the cut line for the next chunk
+        carry_length = length - line_end;
+        if (carry_length > carry_capacity) {
+            char* grown = (char*)realloc(carry, carry_length);
+            if (grown == NULL) {
+                fprintf(stderr, "Memory allocation failed\n");
+                __atomic_store_n(&pipeline->failed, 1, __ATOMIC_RELAXED);
+                break;
+            }
+            carry = grown;
+            carry_capacity = carry_length;
+        }
+        if (carry_length > 0) {
+            memcpy(carry, chunk->chunk.text + line_end, carry_length);
+        }
+
+        if (line_end == 0) {
+            break; // Nothing left to parse, the chunk is not handed out
+        }
+        chunk->chunk.text[line_end] = '\0';
+        chunk->chunk.length = line_end;
+        if (push_item(&lane->read_chunks, chunk, &pipeline->stop) != 0) {
+            break;
+        }
+    }
+
+    // Every parser ends after its last chunk, so the consumer finds the end of the lane after the last chunk
+    for (int i = 0; i < pipeline->num_lanes; i++) {
+        push_item(&pipeline->lanes[i].read_chunks, END_OF_QUEUE, &pipeline->stop);
+    }
+    free(carry);
+    return NULL;
+}
+
+/**
+ * @brief Parser thread: parse the chunks of one lane until its end marker
+ *
+ * @param arg - lane object
+ * @return void* - NULL
+ */
+static void* parse_chunks(void* arg) {
+    PipelineLane* lane = (PipelineLane*)arg;
+    HtyLinePipeline* pipeline = lane->pipeline;
+    while (1) {
+        void* item = pop_item(&lane->read_chunks, &pipeline->stop);
+        if (item == NULL) {
+            return NULL;
+        }
+        if (item != END_OF_QUEUE && !__atomic_load_n(&pipeline->failed, __ATOMIC_RELAXED) &&
+            pipeline->parse(&((PipelineChunk*)item)->chunk, pipeline->context) != 0) {
+            __atomic_store_n(&pipeline->failed, 1, __ATOMIC_RELAXED);
+        }
+        if (push_item(&lane->parsed_chunks, item, &pipeline->stop) != 0 || item == END_OF_QUEUE) {
+            return NULL;
+        }
+    }
+}
+
+HtyLinePipeline* open_line_pipeline(const char* path, long offset, HtyLineParser parse, void* context,
+                                    void (*free_result)(void*)) {
+    HtyLinePipeline* pipeline = (HtyLinePipeline*)calloc(1, sizeof(HtyLinePipeline));
+    if (pipeline == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return NULL;
+    }
+    pipeline->fd = open(path, O_RDONLY);
+    if (pipeline->fd < 0) {
+        fprintf(stderr, "Error opening input file: %s\n", path);
+        free(pipeline);
+        return NULL;
+    }
+    posix_fadvise(pipeline->fd, offset, 0, POSIX_FADV_SEQUENTIAL);
+    pipeline->offset = offset;
+    pipeline->parse = parse;
+    pipeline->context = context;
+    pipeline->free_result = free_result;
+
+    // One parser per processor left over by the reader and the consumer
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    pipeline->num_lanes = num_cpus > 2 ? (int)num_cpus - 2 : 1;
+    if (pipeline->num_lanes > HTY_PIPELINE_MAX_PARSERS) {
+        pipeline->num_lanes = HTY_PIPELINE_MAX_PARSERS;
+    }
+    pipeline->lanes = (PipelineLane*)calloc(pipeline->num_lanes, sizeof(PipelineLane));
+    if (pipeline->lanes == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        close(pipeline->fd);
+        free(pipeline);
+        return NULL;
+    }
+    for (int i = 0; i < pipeline->num_lanes; i++) {
+        PipelineLane* lane = &pipeline->lanes[i];
+        lane->pipeline = pipeline;
+        for (int c = 0; c < HTY_PIPELINE_LANE_CHUNKS; c++) {
+            lane->chunks[c].lane = i;
+            push_item(&lane->free_chunks, &lane->chunks[c], &pipeline->stop);
+        }
+    }
+
+    for (int i = 0; i < pipeline->num_lanes; i++) {
+        if (pthread_create(&pipeline->lanes[i].thread, NULL, parse_chunks, &pipeline->lanes[i]) != 0) {
+            fprintf(stderr, "Error creating parser thread\n");
+            close_line_pipeline(pipeline);
+            return NULL;
+        }
+        pipeline->started_lanes++;
+    }
+    if (pthread_create(&pipeline->reader, NULL, read_chunks, pipeline) != 0) {
+        fprintf(stderr, "Error creating reader thread\n");
+        close_line_pipeline(pipeline);
+        return NULL;
+    }
+    pipeline->reader_started = 1;
+    return pipeline;
+}
+
+int next_line_chunk(HtyLinePipeline* pipeline, HtyLineChunk** chunk) {
+    void* item = END_OF_QUEUE;
+    if (!pipeline->finished) {
+        item = pop_item(&pipeline->lanes[pipeline->next_chunk % pipeline->num_lanes].parsed_chunks, &pipeline->stop);
+    }
+    if (item == END_OF_QUEUE) {
+        pipeline->finished = 1;
+        return __atomic_load_n(&pipeline->failed, __ATOMIC_RELAXED) ? -1 : 0;
+    }
+    if (__atomic_load_n(&pipeline->failed, __ATOMIC_RELAXED)) {
+        release_line_chunk(pipeline, &((PipelineChunk*)item)->chunk);
+        return -1;
+    }
+    pipeline->next_chunk++;
+    *chunk = &((PipelineChunk*)item)->chunk;
+    return 1;
+}
+
+void release_line_chunk(HtyLinePipeline* pipeline, HtyLineChunk* chunk) {
+    PipelineChunk* owner = (PipelineChunk*)chunk;
+    push_item(&pipeline->lanes[owner->lane].free_chunks, owner, &pipeline->stop);
+}
+
+int close_line_pipeline(HtyLinePipeline* pipeline) {
+    if (pipeline == NULL) {
+        return 0;
+    }
+    __atomic_store_n(&pipeline->stop, 1, __ATOMIC_RELAXED);
+    if (pipeline->reader_started) {
+        pthread_join(pipeline->reader, NULL);
+    }
+    for (int i = 0; i < pipeline->started_lanes; i++) {
+        pthread_join(pipeline->lanes[i].thread, NULL);
+    }
+    for (int i = 0; i < pipeline->num_lanes; i++) {
+        for (int c = 0; c < HTY_PIPELINE_LANE_CHUNKS; c++) {
+            HtyLineChunk* chunk = &pipeline->lanes[i].chunks[c].chunk;
+            free(chunk->text);
+            if (chunk->result != NULL && pipeline->free_result != NULL) {
+                pipeline->free_result(chunk->result);
+            }
+        }
+    }
+    int failed = pipeline->failed;
+    close(pipeline->fd);
+    free(pipeline->lanes);
+    free(pipeline);
+    return failed ? -1 : 0;
+}
+
+/**
+ * @brief Block of output waiting for the writer thread
+ */
+typedef struct {
+    char* data;   // Bytes to write
+    long length;  // Bytes used
+} OutputBlock;
+
+/**
+ * @brief Stream state of an asynchronous output
+ */
+typedef struct {
+    int fd;                                         // File written by the writer thread
+    long position;                                  // Bytes accepted by the stream so far, from the start of the file
+    OutputBlock blocks[HTY_PIPELINE_WRITE_BLOCKS];  // Output blocks
+    OutputBlock* current;                           // Block being filled
+    SpscQueue full_blocks;                          // Stream to writer: blocks to write
+    SpscQueue empty_blocks;                         // Writer to stream: blocks to fill
+    pthread_t thread;                               // Writer thread
+    int failed;                                     // Set when a write failed
+    int stop;                                       // Never set: the writer always drains its queue
+} AsyncOutput;
+
+/**
+ * @brief Writer thread: write the full blocks in order until the end marker
+ *
+ * @param arg - output object
+ * @return void* - NULL
+ */
+static void* write_blocks(void* arg) {
+    AsyncOutput* output = (AsyncOutput*)arg;
+    while (1) {
+        OutputBlock* block = (OutputBlock*)pop_item(&output->full_blocks, &output->stop);
+        if (block == END_OF_QUEUE) {
+            return NULL;
+        }
+        long done = 0;
+        while (done < block->length && !output->failed) {
+            ssize_t bytes = write(output->fd, block->data + done, block->length - done);
+            if (bytes < 0 && errno == EINTR) {
+                continue;
+            }
+            if (bytes <= 0) {
+                fprintf(stderr, "Error writing file\n");
+                __atomic_store_n(&output->failed, 1, __ATOMIC_RELAXED);
+                break;
+            }
+            done += bytes;
+        }
+        block->length = 0;
+        push_item(&output->empty_blocks, block, &output->stop);
+    }
+}
+
+/**
+ * @brief Function to copy written bytes into the output blocks (stream write callback)
+ *
+ * @param cookie - output object
+ * @param buffer - bytes written
+ * @param size - number of bytes
+ * @return ssize_t - number of bytes accepted, -1 on failure
+ */
+static ssize_t write_async_output(void* cookie, const char* buffer, size_t size) {
+    AsyncOutput* output = (AsyncOutput*)cookie;
+    size_t done = 0;
+    while (done < size) {
+        if (__atomic_load_n(&output->failed, __ATOMIC_RELAXED)) {
+            errno = EIO;
+            return -1;
+        }
+        long room = HTY_PIPELINE_BLOCK_BYTES - output->current->length;
+        long bytes = (long)(size - done) < room ? (long)(size - done) : room;
+        memcpy(output->current->data + output->current->length, buffer + done, bytes);
+        output->current->length += bytes;
+        done += bytes;
+        if (output->current->length == HTY_PIPELINE_BLOCK_BYTES) {
+            // Hand the block over and wait for an empty one if the writer is behind
+            push_item(&output->full_blocks, output->current, &output->stop);
+            output->current = (OutputBlock*)pop_item(&output->empty_blocks, &output->stop);
+        }
+    }
+    output->position += size;
+    return size;
+}
+
+/**
+ * @brief Function to report the stream position (stream seek callback, only for ftell())
+ *
+ * @param cookie - output object
+ * @param offset - offset to seek by, replaced by the new position
+ * @param whence - SEEK_SET, SEEK_CUR or SEEK_END
+ * @return int - 0 on success, -1 for a seek that would move
+ */
+static int seek_async_output(void* cookie, off64_t* offset, int whence) {
+    AsyncOutput* output = (AsyncOutput*)cookie;
+    if ((whence == SEEK_CUR && *offset != 0) || (whence == SEEK_SET && *offset != output->position) ||
+        whence == SEEK_END) {
+        errno = ESPIPE;
+        return -1;
+    }
+    *offset = output->position;
+    return 0;
+}
+
+/**
+ * @brief Function to write the last block, stop the writer thread and free the output (stream close callback)
+ *
+ * @param cookie - output object
+ * @return int - 0 on success, -1 if a write failed
+ */
+static int close_async_output(void* cookie) {
+    AsyncOutput* output = (AsyncOutput*)cookie;
+    if (output->current->length > 0) {
+        push_item(&output->full_blocks, output->current, &output->stop);
+    }
+    push_item(&output->full_blocks, END_OF_QUEUE, &output->stop);
+    pthread_join(output->thread, NULL);
+    int failed = output->failed;
+    for (int i = 0; i < HTY_PIPELINE_WRITE_BLOCKS; i++) {
+        free(output->blocks[i].data);
+    }
+    free(output);
+    if (failed) {
+        errno = EIO;
+        return -1;
+    }
+    return 0;
+}
+
+FILE* open_async_output(FILE* file) {
+    // Bytes already buffered in file go first, and the writer continues where they end
+    long position = ftell(file);
+    if (position < 0 || fflush(file) != 0) {
+        fprintf(stderr, "Error preparing output file\n");
+        return NULL;
+    }
+    AsyncOutput* output = (AsyncOutput*)calloc(1, sizeof(AsyncOutput));
+    if (output == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return NULL;
+    }
+    output->fd = fileno(file);
+    output->position = position;
+    for (int i = 0; i < HTY_PIPELINE_WRITE_BLOCKS; i++) {
+        output->blocks[i].data = (char*)malloc(HTY_PIPELINE_BLOCK_BYTES);
+        if (output->blocks[i].data == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            for (int j = 0; j < i; j++) {
+                free(output->blocks[j].data);
+            }
+            free(output);
+            return NULL;
+        }
+    }
+    output->current = &output->blocks[0];
+    for (int i = 1; i < HTY_PIPELINE_WRITE_BLOCKS; i++) {
+        push_item(&output->empty_blocks, &output->blocks[i], &output->stop);
+    }
+    if (pthread_create(&output->thread, NULL, write_blocks, output) != 0) {
+        fprintf(stderr, "Error creating writer thread\n");
+        for (int i = 0; i < HTY_PIPELINE_WRITE_BLOCKS; i++) {
+            free(output->blocks[i].data);
+        }
+        free(output);
+        return NULL;
+    }
+
+    cookie_io_functions_t functions = {NULL, write_async_output, seek_async_output, close_async_output};
+    FILE* stream = fopencookie(output, "wb", functions);
+    if (stream == NULL) {
+        fprintf(stderr, "Error opening output stream\n");
+        close_async_output(output);
+        return NULL;
+    }
+    setvbuf(stream, NULL, _IOFBF, 1 << 16);
+    return stream;
+}
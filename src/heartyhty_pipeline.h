@@ -0,0 +1,106 @@
+/**
+ * @file heartyhty_pipeline.h
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Header file for the conversion pipeline: a reader, parser threads and an asynchronous writer connected by bounded queues
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef HEARTYHTY_PIPELINE_H
+#define HEARTYHTY_PIPELINE_H
+
+#include <stdio.h>
+
+#define HTY_PIPELINE_CHUNK_BYTES (1L << 20) // Bytes the reader reads at a time and hands to a parser (plus the end of a cut line)
+#define HTY_PIPELINE_LANE_CHUNKS 2          // Chunks per parser: one being parsed while the other is filled or consumed
+#define HTY_PIPELINE_MAX_PARSERS 8          // Maximum number of parser threads
+#define HTY_PIPELINE_BLOCK_BYTES (1L << 20) // Bytes handed to the writer thread at a time
+#define HTY_PIPELINE_WRITE_BLOCKS 4         // Output blocks: one being filled, the others queued or being written
+
+/**
+ * @brief Whole lines of a text file, as handed to a parser thread
+ */
+typedef struct {
+    char* text;    // Lines, each ending in '\n' except possibly the last line of the file; null terminated, may be modified
+    long length;   // Bytes of text
+    void* result;  // Parser output, kept with the chunk and handed to the parser again for a later chunk
+} HtyLineChunk;
+
+/**
+ * @brief Function a parser thread runs on every chunk
+ *
+ * @param chunk - chunk to parse; the parser stores what it found in chunk->result
+ * @param context - context given to open_line_pipeline()
+ * @return int - 0 on success, -1 to stop the pipeline
+ */
+typedef int (*HtyLineParser)(HtyLineChunk* chunk, void* context);
+
+/**
+ * @brief Reader and parser threads over the lines of a file
+ *
+ * The reader thread reads the file sequentially in HTY_PIPELINE_CHUNK_BYTES
+ * reads, cuts each chunk after its last complete line and hands the chunks
+ * round robin to the parser threads. Every parser has its own
+ * HTY_PIPELINE_LANE_CHUNKS chunks and lock-free single producer, single
+ * consumer queues to and from the reader and the consumer, so taking the
+ * chunks back round robin returns them in file order, and a stage that runs
+ * ahead waits for a free chunk, which bounds the memory.
+ */
+typedef struct HtyLinePipeline HtyLinePipeline;
+
+/**
+ * @brief Function to start reading and parsing the lines of a file
+ *
+ * @param path - path to the file
+ * @param offset - byte offset of the first line to read
+ * @param parse - function the parser threads run on every chunk
+ * @param context - context passed to parse, shared by the parser threads
+ * @param free_result - function to free the result of a chunk, or NULL
+ * @return HtyLinePipeline* - pipeline object, NULL on failure
+ */
+HtyLinePipeline* open_line_pipeline(const char* path, long offset, HtyLineParser parse, void* context,
+                                    void (*free_result)(void*));
+
+/**
+ * @brief Function to take the next parsed chunk, in file order
+ *
+ * @param pipeline - pipeline object
+ * @param chunk - pointer to store the chunk, to give back with release_line_chunk()
+ * @return int - 1 if a chunk was returned, 0 at the end of the file, -1 on failure
+ */
+int next_line_chunk(HtyLinePipeline* pipeline, HtyLineChunk** chunk);
+
+/**
+ * @brief Function to give a chunk back to the reader
+ *
+ * @param pipeline - pipeline object
+ * @param chunk - chunk from next_line_chunk()
+ */
+void release_line_chunk(HtyLinePipeline* pipeline, HtyLineChunk* chunk);
+
+/**
+ * @brief Function to stop the threads of a pipeline and free it
+ *
+ * @param pipeline - pipeline object, or NULL
+ * @return int - 0 if every chunk was read and parsed, -1 otherwise
+ */
+int close_line_pipeline(HtyLinePipeline* pipeline);
+
+/**
+ * @brief Function to open a stream whose writes go to a file from a writer thread
+ *
+ * Writes are copied into HTY_PIPELINE_BLOCK_BYTES blocks and a writer
+ * thread writes the full ones, so the caller keeps encoding while the
+ * previous blocks go to disk. When all HTY_PIPELINE_WRITE_BLOCKS blocks are
+ * waiting, writes wait too. The stream supports ftell() but no other seeks.
+ * Closing it writes the rest and waits for the writer thread; the file
+ * itself stays open.
+ *
+ * @param file - file to write to, positioned where the writes should go
+ * @return FILE* - stream to write to, NULL on failure
+ */
+FILE* open_async_output(FILE* file);
+
+#endif // HEARTYHTY_PIPELINE_H
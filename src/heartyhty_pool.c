@@ -0,0 +1,524 @@
+/**
+ * @file heartyhty_pool.c
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Buffer pool of decoded column blocks with LRU eviction
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#define _GNU_SOURCE // st_mtim
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "../third_party/cJSON/cJSON.h"
+#include "heartyhty_functions.h"
+#include "heartyhty_io.h"
+#include "heartyhty_pool.h"
+#include "heartyhty_arena.h"
+#include "heartyhty_stats.h"
+#include "heartyhty_delete.h"
+#include "heartyhty_snapshot.h"
+
+/**
+ * @brief One cached column block (one column of one row group)
+ */
+typedef struct PoolEntry {
+    HtyFileVersion file;         // File version the block belongs to
+    int column;                  // Column index
+    int group;                   // Row group
+    int num_rows;                // Values in the block
+    int* values;                 // Decoded values (float bits for float columns)
+    struct PoolEntry* hash_next; // Next entry in the same bucket
+    struct PoolEntry* lru_prev;  // More recently used entry
+    struct PoolEntry* lru_next;  // Less recently used entry
+} PoolEntry;
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static PoolEntry* pool_buckets[HTY_POOL_BUCKETS];
+static PoolEntry* lru_head = NULL;  // Most recently used
+static PoolEntry* lru_tail = NULL;  // Least recently used, evicted first
+static long pool_budget = HTY_POOL_BYTES;
+static long pool_bytes = 0;
+static long pool_hits = 0;
+static long pool_misses = 0;
+
+struct HtyColumnReader {
+    HtyArena* arena;           // Arena values and columns come from, NULL for malloc()
+    HtyFileVersion file;       // File version being read
+    int use_pool;              // 0 if the pool is disabled or the file could not be identified
+    const char* hty_file_path; // Path to the hty file
+    HtyRowLayout layout;       // Where the rows are in the file
+    int num_rows;              // Rows in the file
+    int num_groups;            // Row groups in the file
+    int total_columns;         // Columns per row
+    int num_columns;           // Requested columns
+    int* column_indices;       // Index of each requested column
+    int* row_groups;           // Row groups to return, NULL for all
+    int* from_disk;            // 1 for row groups that were not in the pool when the reader was opened
+    int next_group;            // Next row group to look at
+    HtyBlockReader* blocks;    // Reads the row groups in from_disk, NULL if there are none
+    int* values;               // Column blocks of the current row group
+    int** columns;             // Start of each column block in values
+    FILE* evicted_file;        // Reads row groups evicted after the reader was opened
+    int* row_buffer;           // Rows read through file
+    HtyRowBitmap deleted;      // Deleted rows, left out of the returned row groups
+    int* row_ids;              // Row id of each returned row, when deleted rows were left out
+    int block_has_row_ids;     // 1 if row_ids describes the current row group
+};
+
+/**
+ * @brief Function to find the bucket of a column block
+ *
+ * @param file - file version
+ * @param column - column index
+ * @param group - row group
+ * @return unsigned int - bucket index
+ */
+static unsigned int bucket_of(const HtyFileVersion* file, int column, int group) {
+    unsigned long long hash = (unsigned long long)file->inode * 0x9E3779B97F4A7C15ULL;
+    hash ^= (unsigned long long)file->device + ((unsigned long long)file->mtime_nsec << 20);
+    hash = (hash ^ (unsigned long long)column * 0xC2B2AE3D27D4EB4FULL) * 0x165667B19E3779F9ULL;
+    hash ^= (unsigned long long)group * 0x27D4EB2F165667C5ULL;
+    return (unsigned int)((hash ^ (hash >> 29)) % HTY_POOL_BUCKETS);
+}
+
+/**
+ * @brief Function to find a column block (pool_lock held)
+ *
+ * @param file - file version
+ * @param column - column index
+ * @param group - row group
+ * @return PoolEntry* - entry, NULL if the block is not cached
+ */
+static PoolEntry* find_entry(const HtyFileVersion* file, int column, int group) {
+    PoolEntry* entry = pool_buckets[bucket_of(file, column, group)];
+    while (entry != NULL && !(entry->column == column && entry->group == group && same_file_version(&entry->file, file))) {
+        entry = entry->hash_next;
+    }
+    return entry;
+}
+
+/**
+ * @brief Function to get the memory used by a column block
+ *
+ * @param num_rows - values in the block
+ * @return long - bytes
+ */
+static long entry_bytes(int num_rows) {
+    return (long)sizeof(PoolEntry) + (long)num_rows * sizeof(int);
+}
+
+/**
+ * @brief Function to unlink an entry from the LRU list (pool_lock held)
+ *
+ * @param entry - entry to unlink
+ */
+static void lru_unlink(PoolEntry* entry) {
+    if (entry->lru_prev != NULL) {
+        entry->lru_prev->lru_next = entry->lru_next;
+    } else {
+        lru_head = entry->lru_next;
+    }
+    if (entry->lru_next != NULL) {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    } else {
+        lru_tail = entry->lru_prev;
+    }
+    entry->lru_prev = entry->lru_next = NULL;
+}
+
+/**
+ * @brief Function to make an entry the most recently used one (pool_lock held)
+ *
+ * @param entry - entry to move, not linked yet or already linked
+ */
+static void lru_push_front(PoolEntry* entry) {
+    entry->lru_next = lru_head;
+    entry->lru_prev = NULL;
+    if (lru_head != NULL) {
+        lru_head->lru_prev = entry;
+    }
+    lru_head = entry;
+    if (lru_tail == NULL) {
+        lru_tail = entry;
+    }
+}
+
+/**
+ * @brief Function to remove and free an entry (pool_lock held)
+ *
+ * @param entry - entry to remove
+ */
+static void remove_entry(PoolEntry* entry) {
+    PoolEntry** link = &pool_buckets[bucket_of(&entry->file, entry->column, entry->group)];
+    while (*link != entry) {
+        link = &(*link)->hash_next;
+    }
+    *link = entry->hash_next;
+    lru_unlink(entry);
+    pool_bytes -= entry_bytes(entry->num_rows);
+    free(entry->values);
+    free(entry);
+}
+
+/**
+ * @brief Function to evict least recently used blocks until some more bytes fit (pool_lock held)
+ *
+ * @param bytes - bytes that must fit
+ */
+static void make_room(long bytes) {
+    while (lru_tail != NULL && pool_bytes + bytes > pool_budget) {
+        remove_entry(lru_tail);
+    }
+}
+
+/**
+ * @brief Function to copy a cached column block
+ *
+ * @param file - file version
+ * @param column - column index
+ * @param group - row group
+ * @param values - array to copy the values to
+ * @param num_rows - values expected in the block
+ * @return int - 1 if the block was cached, 0 otherwise
+ */
+static int pool_get(const HtyFileVersion* file, int column, int group, int* values, int num_rows) {
+    pthread_mutex_lock(&pool_lock);
+    PoolEntry* entry = find_entry(file, column, group);
+    int found = entry != NULL && entry->num_rows == num_rows;
+    if (found) {
+        memcpy(values, entry->values, num_rows * sizeof(int));
+        lru_unlink(entry);
+        lru_push_front(entry);
+        pool_hits++;
+    }
+    pthread_mutex_unlock(&pool_lock);
+    return found;
+}
+
+/**
+ * @brief Function to check whether a column block is cached
+ *
+ * @param file - file version
+ * @param column - column index
+ * @param group - row group
+ * @return int - 1 if the block is cached, 0 otherwise
+ */
+static int pool_contains(const HtyFileVersion* file, int column, int group) {
+    pthread_mutex_lock(&pool_lock);
+    int found = find_entry(file, column, group) != NULL;
+    pthread_mutex_unlock(&pool_lock);
+    return found;
+}
+
+/**
+ * @brief Function to add a column block to the pool
+ *
+ * @param file - file version
+ * @param column - column index
+ * @param group - row group
+ * @param values - values of the block
+ * @param num_rows - values in the block
+ */
+static void pool_put(const HtyFileVersion* file, int column, int group, const int* values, int num_rows) {
+    long bytes = entry_bytes(num_rows);
+    pthread_mutex_lock(&pool_lock);
+    pool_misses++;
+    if (bytes > pool_budget || find_entry(file, column, group) != NULL) {
+        pthread_mutex_unlock(&pool_lock);
+        return; // Too large to cache, or another reader cached it first
+    }
+    make_room(bytes);
+    PoolEntry* entry = (PoolEntry*)calloc(1, sizeof(PoolEntry));
+    int* copy = (int*)malloc(num_rows * sizeof(int) + 1);
+    if (entry == NULL || copy == NULL) {
+        free(entry);
+        free(copy);
+        pthread_mutex_unlock(&pool_lock);
+        return; // Caching is best effort
+    }
+    memcpy(copy, values, num_rows * sizeof(int));
+    entry->file = *file;
+    entry->column = column;
+    entry->group = group;
+    entry->num_rows = num_rows;
+    entry->values = copy;
+    unsigned int bucket = bucket_of(file, column, group);
+    entry->hash_next = pool_buckets[bucket];
+    pool_buckets[bucket] = entry;
+    lru_push_front(entry);
+    pool_bytes += bytes;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+int get_file_version(const char* hty_file_path, HtyFileVersion* version) {
+    struct stat info;
+    char buffer[HTY_SNAPSHOT_PATH_MAX];
+    if (stat(snapshot_path(hty_file_path, buffer), &info) != 0) { // The pinned version, if there is one
+        return -1;
+    }
+    memset(version, 0, sizeof(HtyFileVersion));
+    version->device = info.st_dev;
+    version->inode = info.st_ino;
+    version->size = info.st_size;
+    version->mtime_sec = info.st_mtim.tv_sec;
+    version->mtime_nsec = info.st_mtim.tv_nsec;
+    return 0;
+}
+
+int same_file_version(const HtyFileVersion* a, const HtyFileVersion* b) {
+    return a->device == b->device && a->inode == b->inode && a->size == b->size &&
+           a->mtime_sec == b->mtime_sec && a->mtime_nsec == b->mtime_nsec;
+}
+
+void set_buffer_pool_bytes(long bytes) {
+    pthread_mutex_lock(&pool_lock);
+    pool_budget = bytes > 0 ? bytes : 0;
+    make_room(0);
+    pthread_mutex_unlock(&pool_lock);
+}
+
+void invalidate_buffer_pool(const char* hty_file_path) {
+    HtyFileVersion file;
+    if (get_file_version(hty_file_path, &file) != 0) {
+        return;
+    }
+    // Drop every version of the file, not only the current one
+    pthread_mutex_lock(&pool_lock);
+    PoolEntry* entry = lru_head;
+    while (entry != NULL) {
+        PoolEntry* next = entry->lru_next;
+        if (entry->file.device == file.device && entry->file.inode == file.inode) {
+            remove_entry(entry);
+        }
+        entry = next;
+    }
+    pthread_mutex_unlock(&pool_lock);
+}
+
+void clear_buffer_pool(void) {
+    pthread_mutex_lock(&pool_lock);
+    while (lru_head != NULL) {
+        remove_entry(lru_head);
+    }
+    pthread_mutex_unlock(&pool_lock);
+}
+
+void get_buffer_pool_stats(long* hits, long* misses, long* bytes) {
+    pthread_mutex_lock(&pool_lock);
+    *hits = pool_hits;
+    *misses = pool_misses;
+    *bytes = pool_bytes;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+HtyColumnReader* open_column_reader(cJSON* metadata, const char* hty_file_path, const int* column_indices,
+                                    int num_columns, const int* row_groups) {
+    return open_column_reader_in_arena(NULL, metadata, hty_file_path, column_indices, num_columns, row_groups);
+}
+
+HtyColumnReader* open_column_reader_in_arena(HtyArena* arena, cJSON* metadata, const char* hty_file_path,
+                                             const int* column_indices, int num_columns, const int* row_groups) {
+    HtyColumnReader* reader = (HtyColumnReader*)calloc(1, sizeof(HtyColumnReader));
+    if (reader == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return NULL;
+    }
+    reader->arena = arena;
+    get_row_layout(metadata, &reader->layout);
+    reader->hty_file_path = hty_file_path;
+    reader->num_rows = cJSON_GetObjectItemCaseSensitive(metadata, "num_rows")->valueint;
+    reader->num_groups = (reader->num_rows + reader->layout.block_rows - 1) / reader->layout.block_rows;
+    reader->total_columns = reader->layout.row_bytes / sizeof(int);
+    reader->num_columns = num_columns;
+    reader->column_indices = (int*)malloc((num_columns + 1) * sizeof(int));
+    reader->from_disk = (int*)calloc(reader->num_groups + 1, sizeof(int));
+    reader->values = (int*)arena_alloc(arena, ((long)num_columns * reader->layout.block_rows + 1) * sizeof(int));
+    reader->columns = (int**)arena_alloc(arena, (num_columns + 1) * sizeof(int*));
+    if (row_groups != NULL) {
+        reader->row_groups = (int*)malloc((reader->num_groups + 1) * sizeof(int));
+    }
+    if (!reader->column_indices || !reader->from_disk || !reader->values || !reader->columns ||
+        (row_groups != NULL && !reader->row_groups)) {
+        fprintf(stderr, "Memory allocation failed\n");
+        close_column_reader(reader);
+        return NULL;
+    }
+    memcpy(reader->column_indices, column_indices, num_columns * sizeof(int));
+    for (int i = 0; i < num_columns; i++) {
+        reader->columns[i] = reader->values + (long)i * reader->layout.block_rows;
+    }
+    if (row_groups != NULL) {
+        memcpy(reader->row_groups, row_groups, reader->num_groups * sizeof(int));
+    }
+    int has_deletes = load_deleted_rows(metadata, hty_file_path, &reader->deleted);
+    if (has_deletes == 1) {
+        reader->row_ids = (int*)arena_alloc(arena, ((long)reader->layout.block_rows + 1) * sizeof(int));
+    }
+    if (has_deletes == -1 || (has_deletes == 1 && reader->row_ids == NULL)) {
+        close_column_reader(reader);
+        return NULL;
+    }
+
+    // Row groups with every requested column in the pool are not read from disk
+    pthread_mutex_lock(&pool_lock);
+    long budget = pool_budget;
+    pthread_mutex_unlock(&pool_lock);
+    reader->use_pool = budget > 0 && get_file_version(hty_file_path, &reader->file) == 0;
+    int disk_groups = 0;
+    for (int group = 0; group < reader->num_groups; group++) {
+        if (row_groups != NULL && !row_groups[group]) {
+            continue;
+        }
+        int cached = reader->use_pool;
+        for (int i = 0; cached && i < num_columns; i++) {
+            cached = pool_contains(&reader->file, column_indices[i], group);
+        }
+        reader->from_disk[group] = !cached;
+        disk_groups += !cached;
+    }
+    if (disk_groups > 0) {
+        reader->blocks = open_block_reader_in_arena(arena, hty_file_path, &reader->layout, reader->num_rows,
+                                                    reader->from_disk);
+        if (reader->blocks == NULL) {
+            close_column_reader(reader);
+            return NULL;
+        }
+    }
+    return reader;
+}
+
+/**
+ * @brief Function to read a row group that was evicted after the reader was opened
+ *
+ * @param reader - reader object
+ * @param first_row - first row of the row group
+ * @param num_rows - rows in the row group
+ * @return int* - rows of the row group, NULL on failure
+ */
+static int* read_evicted_group(HtyColumnReader* reader, int first_row, int num_rows) {
+    if (reader->evicted_file == NULL) {
+        reader->evicted_file = open_snapshot(reader->hty_file_path);
+        reader->row_buffer = (int*)malloc((long)reader->layout.block_rows * reader->layout.row_bytes + 1);
+        if (reader->evicted_file == NULL || reader->row_buffer == NULL) {
+            fprintf(stderr, "Error opening file: %s\n", reader->hty_file_path);
+            return NULL;
+        }
+    }
+    fseek(reader->evicted_file, row_position(&reader->layout, first_row), SEEK_SET);
+    if (fread(reader->row_buffer, reader->layout.row_bytes, num_rows, reader->evicted_file) != (size_t)num_rows) {
+        fprintf(stderr, "Error reading rows %d to %d\n", first_row, first_row + num_rows - 1);
+        return NULL;
+    }
+    HTY_STATS_ADD(blocks_read, 1);
+    HTY_STATS_ADD(bytes_read, (long)num_rows * reader->layout.row_bytes);
+    return reader->row_buffer;
+}
+
+int next_column_block(HtyColumnReader* reader, int*** columns, int* first_row, int* num_rows) {
+    while (reader->next_group < reader->num_groups) {
+        int group = reader->next_group++;
+        if (reader->row_groups != NULL && !reader->row_groups[group]) {
+            HTY_STATS_ADD(blocks_skipped, 1);
+            continue;
+        }
+        int block_rows = reader->layout.block_rows;
+        int group_first = group * block_rows;
+        int group_rows = reader->num_rows - group_first < block_rows ? reader->num_rows - group_first : block_rows;
+
+        // Serve the row group from the pool if it is still there
+        int* rows = NULL;
+        HtyStageTimer timer;
+        if (reader->from_disk[group]) {
+            int read_first, read_rows;
+            if (next_block(reader->blocks, &rows, &read_first, &read_rows) != 1 || read_first != group_first) {
+                return -1;
+            }
+            HTY_STAGE_BEGIN(timer);
+        } else {
+            HTY_STAGE_BEGIN(timer);
+            int cached = 1;
+            for (int i = 0; cached && i < reader->num_columns; i++) {
+                cached = pool_get(&reader->file, reader->column_indices[i], group, reader->columns[i], group_rows);
+            }
+            if (!cached && (rows = read_evicted_group(reader, group_first, group_rows)) == NULL) {
+                return -1;
+            }
+            HTY_STATS_ADD(blocks_from_pool, cached);
+        }
+
+        // Decode the requested columns and keep them for later queries
+        if (rows != NULL) {
+            for (int i = 0; i < reader->num_columns; i++) {
+                int* column = reader->columns[i];
+                const int* value = rows + reader->column_indices[i];
+                for (int row = 0; row < group_rows; row++) {
+                    column[row] = value[(long)row * reader->total_columns];
+                }
+                if (reader->use_pool) {
+                    pool_put(&reader->file, reader->column_indices[i], group, column, group_rows);
+                }
+            }
+        }
+
+        // Deleted rows are dropped through a selection vector before any caller sees them
+        reader->block_has_row_ids = 0;
+        int live_rows = group_rows;
+        if (reader->deleted.cardinality > 0) {
+            live_rows = select_live_rows(&reader->deleted, group_first, group_rows, reader->row_ids);
+            if (live_rows < group_rows) {
+                for (int i = 0; i < reader->num_columns; i++) {
+                    int* column = reader->columns[i];
+                    for (int row = 0; row < live_rows; row++) {
+                        column[row] = column[reader->row_ids[row]];
+                    }
+                }
+                for (int row = 0; row < live_rows; row++) {
+                    reader->row_ids[row] += group_first;
+                }
+                reader->block_has_row_ids = 1;
+            }
+        }
+        HTY_STAGE_END(HTY_STAGE_DECODE, timer);
+        HTY_STATS_ADD(rows_scanned, group_rows);
+        if (live_rows == 0) {
+            continue; // Every row of the row group is deleted
+        }
+        *columns = reader->columns;
+        *first_row = group_first;
+        *num_rows = live_rows;
+        return 1;
+    }
+    return 0;
+}
+
+const int* column_block_row_ids(HtyColumnReader* reader) {
+    return reader->block_has_row_ids ? reader->row_ids : NULL;
+}
+
+void keep_deleted_rows(HtyColumnReader* reader) {
+    free_bitmap(&reader->deleted);
+}
+
+void close_column_reader(HtyColumnReader* reader) {
+    if (reader == NULL) {
+        return;
+    }
+    close_block_reader(reader->blocks);
+    if (reader->evicted_file != NULL) {
+        fclose(reader->evicted_file);
+    }
+    free(reader->row_buffer);
+    free(reader->column_indices);
+    free(reader->row_groups);
+    free(reader->from_disk);
+    arena_release(reader->arena, reader->values);
+    arena_release(reader->arena, reader->columns);
+    arena_release(reader->arena, reader->row_ids);
+    free_bitmap(&reader->deleted);
+    free(reader);
+}
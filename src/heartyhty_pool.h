@@ -0,0 +1,168 @@
+/**
+ * @file heartyhty_pool.h
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Header file for the buffer pool of decoded column blocks
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef HEARTYHTY_POOL_H
+#define HEARTYHTY_POOL_H
+
+#include <sys/types.h>
+
+// Memory the buffer pool may use before it evicts the least recently used blocks
+#ifndef HTY_POOL_BYTES
+#define HTY_POOL_BYTES (64L * 1024 * 1024)
+#endif
+
+#define HTY_POOL_BUCKETS 4096 // Hash buckets of the buffer pool
+
+/**
+ * @brief Identity of one version of a file
+ */
+typedef struct {
+    dev_t device;     // Device of the file
+    ino_t inode;      // Inode of the file
+    off_t size;       // Size in bytes
+    long mtime_sec;   // Modification time, seconds
+    long mtime_nsec;  // Modification time, nanoseconds
+} HtyFileVersion;
+
+/**
+ * @brief Reader that returns the values of some columns one row group at a time
+ *
+ * Row groups whose columns are all in the buffer pool are served from
+ * memory; the others are read with the row group reader and their columns
+ * are added to the pool.
+ */
+typedef struct HtyColumnReader HtyColumnReader;
+
+struct HtyArena; // See heartyhty_arena.h
+
+/**
+ * @brief Function to get the identity of the current version of a file
+ *
+ * @param hty_file_path - path to hty file
+ * @param version - pointer to store the identity
+ * @return int - 0 on success, -1 if the file cannot be examined
+ */
+int get_file_version(const char* hty_file_path, HtyFileVersion* version);
+
+/**
+ * @brief Function to compare two file versions
+ *
+ * @param a - first file version
+ * @param b - second file version
+ * @return int - 1 if they are the same version, 0 otherwise
+ */
+int same_file_version(const HtyFileVersion* a, const HtyFileVersion* b);
+
+/**
+ * @brief Function to set the memory budget of the buffer pool
+ *
+ * Blocks are evicted, least recently used first, until the pool fits.
+ *
+ * @param bytes - memory budget in bytes, 0 to disable the pool
+ */
+void set_buffer_pool_bytes(long bytes);
+
+/**
+ * @brief Function to drop all cached blocks of a file
+ *
+ * Blocks are keyed by the file's device, inode, size and modification
+ * time, so a rewritten file is never served stale data; this also frees
+ * the memory of the old blocks right away.
+ *
+ * @param hty_file_path - path to hty file
+ */
+void invalidate_buffer_pool(const char* hty_file_path);
+
+/**
+ * @brief Function to drop every cached block
+ */
+void clear_buffer_pool(void);
+
+/**
+ * @brief Function to get the buffer pool counters
+ *
+ * @param hits - pointer to store the blocks served from memory
+ * @param misses - pointer to store the blocks read from disk
+ * @param bytes - pointer to store the memory in use
+ */
+void get_buffer_pool_stats(long* hits, long* misses, long* bytes);
+
+/**
+ * @brief Function to open a column reader
+ *
+ * @param metadata - metadata object
+ * @param hty_file_path - path to hty file
+ * @param column_indices - index of each column to read
+ * @param num_columns - number of columns to read
+ * @param row_groups - one flag per row group, 1 if it must be read; NULL to read all
+ * @return HtyColumnReader* - reader object, NULL on failure
+ */
+HtyColumnReader* open_column_reader(cJSON* metadata, const char* hty_file_path, const int* column_indices,
+                                    int num_columns, const int* row_groups);
+
+/**
+ * @brief Function to open a column reader whose buffers come from an arena
+ *
+ * The column blocks and read buffers stay in the arena after
+ * close_column_reader(), so scans run after reset_arena() reuse them.
+ *
+ * @param arena - arena for the buffers, NULL to allocate them with malloc()
+ * @param metadata - metadata object
+ * @param hty_file_path - path to hty file
+ * @param column_indices - index of each column to read
+ * @param num_columns - number of columns to read
+ * @param row_groups - one flag per row group, 1 if it must be read; NULL to read all
+ * @return HtyColumnReader* - reader object, NULL on failure
+ */
+HtyColumnReader* open_column_reader_in_arena(struct HtyArena* arena, cJSON* metadata, const char* hty_file_path,
+                                             const int* column_indices, int num_columns, const int* row_groups);
+
+/**
+ * @brief Function to get the next row group
+ *
+ * columns[i] holds the values of the i-th requested column (float bits
+ * for float columns). They stay valid until the next call. Deleted rows
+ * are left out, so num_rows can be less than the rows of the row group;
+ * column_block_row_ids() then gives the row id of each returned row.
+ *
+ * @param reader - reader object
+ * @param columns - pointer to store the column arrays of the row group
+ * @param first_row - pointer to store the first row of the row group
+ * @param num_rows - pointer to store the number of rows
+ * @return int - 1 if a row group was returned, 0 at the end, -1 on failure
+ */
+int next_column_block(HtyColumnReader* reader, int*** columns, int* first_row, int* num_rows);
+
+/**
+ * @brief Function to get the row ids of the rows of the current row group
+ *
+ * @param reader - reader object
+ * @return const int* - row id of each returned row, NULL if they are first_row, first_row + 1, ...
+ */
+const int* column_block_row_ids(HtyColumnReader* reader);
+
+/**
+ * @brief Function to make a reader return deleted rows as well
+ *
+ * For callers that need every row id of the file, such as index builds.
+ * Must be called before the first row group is read.
+ *
+ * @param reader - reader object
+ */
+void keep_deleted_rows(HtyColumnReader* reader);
+
+/**
+ * @brief Function to close a column reader
+ *
+ * @param reader - reader object
+ */
+void close_column_reader(HtyColumnReader* reader);
+
+#endif // HEARTYHTY_POOL_H
@@ -0,0 +1,358 @@
+/**
+ * @file heartyhty_results.c
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Query result cache that also answers tighter predicates from looser cached ones
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "../third_party/cJSON/cJSON.h"
+#include "heartyhty_functions.h"
+#include "heartyhty_pool.h"
+#include "heartyhty_results.h"
+
+/**
+ * @brief One cached query result
+ */
+typedef struct ResultEntry {
+    HtyFileVersion file;       // File version the result belongs to
+    int num_columns;           // Projected columns, 0 for filter()
+    int* column_indices;       // Index of each projected column
+    int filter_column;         // Filter column
+    int is_float;              // 1 if the filter column is float
+    int op;                    // Filter operation
+    int value;                 // Filter value
+    int row_count;             // Matching rows
+    int* filter_values;        // Filter column value of each matching row
+    int** columns;             // Projected columns of the matching rows
+    long bytes;                // Memory used by the entry
+    struct ResultEntry* prev;  // More recently used entry
+    struct ResultEntry* next;  // Less recently used entry
+} ResultEntry;
+
+static pthread_mutex_t results_lock = PTHREAD_MUTEX_INITIALIZER;
+static ResultEntry* results_head = NULL;  // Most recently used
+static ResultEntry* results_tail = NULL;  // Least recently used, evicted first
+static long results_budget = HTY_RESULT_CACHE_BYTES;
+static long results_bytes = 0;
+
+/**
+ * @brief Function to check whether every value matching one predicate also matches another
+ *
+ * @param new_op - operation of the new predicate
+ * @param new_value - value of the new predicate
+ * @param old_op - operation of the cached predicate
+ * @param old_value - value of the cached predicate
+ * @param is_float - flag to indicate if the values are float
+ * @return int - 1 if the new predicate implies the cached one, 0 if it does not or cannot be shown
+ */
+static int predicate_implies(int new_op, int new_value, int old_op, int old_value, int is_float) {
+    if (new_op == OP_EQUAL) {
+        return compare_values(new_value, old_value, old_op, is_float); // The one value must pass the old predicate
+    }
+    switch (old_op) {
+        case OP_GREATER:
+            if (new_op == OP_GREATER) return compare_values(new_value, old_value, OP_GREATER_EQUAL, is_float);
+            if (new_op == OP_GREATER_EQUAL) return compare_values(new_value, old_value, OP_GREATER, is_float);
+            return 0;
+        case OP_GREATER_EQUAL:
+            if (new_op == OP_GREATER || new_op == OP_GREATER_EQUAL) {
+                return compare_values(new_value, old_value, OP_GREATER_EQUAL, is_float);
+            }
+            return 0;
+        case OP_LESS:
+            if (new_op == OP_LESS) return compare_values(new_value, old_value, OP_LESS_EQUAL, is_float);
+            if (new_op == OP_LESS_EQUAL) return compare_values(new_value, old_value, OP_LESS, is_float);
+            return 0;
+        case OP_LESS_EQUAL:
+            if (new_op == OP_LESS || new_op == OP_LESS_EQUAL) {
+                return compare_values(new_value, old_value, OP_LESS_EQUAL, is_float);
+            }
+            return 0;
+        case OP_NOT_EQUAL:
+            switch (new_op) {
+                case OP_NOT_EQUAL:     return compare_values(new_value, old_value, OP_EQUAL, is_float);
+                case OP_GREATER:       return compare_values(new_value, old_value, OP_GREATER_EQUAL, is_float);
+                case OP_GREATER_EQUAL: return compare_values(new_value, old_value, OP_GREATER, is_float);
+                case OP_LESS:          return compare_values(new_value, old_value, OP_LESS_EQUAL, is_float);
+                case OP_LESS_EQUAL:    return compare_values(new_value, old_value, OP_LESS, is_float);
+                default:               return 0;
+            }
+        default:
+            return 0;
+    }
+}
+
+/**
+ * @brief Function to find where a column is in a cached result
+ *
+ * @param entry - cached result
+ * @param column_index - column to find
+ * @return int - position in entry->columns, -1 if the result does not have the column
+ */
+static int find_column(const ResultEntry* entry, int column_index) {
+    for (int i = 0; i < entry->num_columns; i++) {
+        if (entry->column_indices[i] == column_index) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Function to check whether a cached result can answer a query
+ *
+ * @param entry - cached result
+ * @param version - current file version
+ * @param column_indices - index of each projected column
+ * @param num_columns - number of projected columns
+ * @param filter_column - index of the filter column
+ * @param op - operation for filtering
+ * @param value - value to filter against
+ * @return int - 2 for the same predicate, 1 for a looser one, 0 if it cannot answer
+ */
+static int can_answer(const ResultEntry* entry, const HtyFileVersion* version, const int* column_indices,
+                      int num_columns, int filter_column, int op, int value) {
+    if (!same_file_version(&entry->file, version) || entry->filter_column != filter_column) {
+        return 0;
+    }
+    for (int i = 0; i < num_columns; i++) {
+        if (find_column(entry, column_indices[i]) == -1) {
+            return 0;
+        }
+    }
+    if (entry->op == op && entry->value == value) {
+        return 2;
+    }
+    return predicate_implies(op, value, entry->op, entry->value, entry->is_float);
+}
+
+/**
+ * @brief Function to unlink a result from the LRU list (results_lock held)
+ *
+ * @param entry - entry to unlink
+ */
+static void unlink_result(ResultEntry* entry) {
+    if (entry->prev != NULL) {
+        entry->prev->next = entry->next;
+    } else {
+        results_head = entry->next;
+    }
+    if (entry->next != NULL) {
+        entry->next->prev = entry->prev;
+    } else {
+        results_tail = entry->prev;
+    }
+    entry->prev = entry->next = NULL;
+}
+
+/**
+ * @brief Function to make a result the most recently used one (results_lock held)
+ *
+ * @param entry - entry, not linked
+ */
+static void push_result(ResultEntry* entry) {
+    entry->next = results_head;
+    entry->prev = NULL;
+    if (results_head != NULL) {
+        results_head->prev = entry;
+    }
+    results_head = entry;
+    if (results_tail == NULL) {
+        results_tail = entry;
+    }
+}
+
+/**
+ * @brief Function to free a cached result
+ *
+ * @param entry - entry to free, already unlinked
+ */
+static void free_result(ResultEntry* entry) {
+    if (entry->columns != NULL) {
+        for (int i = 0; i < entry->num_columns; i++) {
+            free(entry->columns[i]);
+        }
+    }
+    free(entry->columns);
+    free(entry->column_indices);
+    free(entry->filter_values);
+    free(entry);
+}
+
+/**
+ * @brief Function to remove and free a cached result (results_lock held)
+ *
+ * @param entry - entry to remove
+ */
+static void remove_result(ResultEntry* entry) {
+    unlink_result(entry);
+    results_bytes -= entry->bytes;
+    free_result(entry);
+}
+
+int lookup_result(const char* hty_file_path, HtyFileVersion* version, const int* column_indices, int num_columns,
+                  int filter_column, int is_float, int op, int value, int** filter_values, int*** columns,
+                  int* row_count) {
+    if (get_file_version(hty_file_path, version) != 0) {
+        memset(version, 0, sizeof(HtyFileVersion)); // Unknown version, never stored
+        return 0;
+    }
+    pthread_mutex_lock(&results_lock);
+
+    // Prefer the same predicate, then the looser result with the fewest rows to filter again
+    ResultEntry* best = NULL;
+    int best_match = 0;
+    for (ResultEntry* entry = results_head; entry != NULL; entry = entry->next) {
+        int match = can_answer(entry, version, column_indices, num_columns, filter_column, op, value);
+        if (match > best_match || (match == 1 && best_match == 1 && entry->row_count < best->row_count)) {
+            best = entry;
+            best_match = match;
+        }
+    }
+    if (best == NULL) {
+        pthread_mutex_unlock(&results_lock);
+        return 0;
+    }
+
+    // Keep the rows that pass the new predicate
+    int* values = (int*)malloc((best->row_count + 1) * sizeof(int));
+    int* rows = (int*)malloc((best->row_count + 1) * sizeof(int));
+    int** result = NULL;
+    int count = 0;
+    for (int i = 0; i < best->row_count; i++) {
+        if (best_match == 2 || compare_values(best->filter_values[i], value, op, is_float)) {
+            values[count] = best->filter_values[i];
+            rows[count++] = i;
+        }
+    }
+    if (num_columns > 0 && count > 0) { // Same shape as project_and_filter: no columns when nothing matches
+        result = (int**)malloc(num_columns * sizeof(int*));
+        for (int col = 0; col < num_columns; col++) {
+            const int* cached = best->columns[find_column(best, column_indices[col])];
+            result[col] = (int*)malloc(count * sizeof(int));
+            for (int i = 0; i < count; i++) {
+                result[col][i] = cached[rows[i]];
+            }
+        }
+    }
+    unlink_result(best);
+    push_result(best);
+    pthread_mutex_unlock(&results_lock);
+
+    free(rows);
+    if (filter_values != NULL) {
+        *filter_values = values;
+    } else {
+        free(values);
+    }
+    if (columns != NULL) {
+        *columns = result;
+    }
+    *row_count = count;
+    return 1;
+}
+
+void store_result(const HtyFileVersion* version, const int* column_indices, int num_columns, int filter_column,
+                  int is_float, int op, int value, const int* filter_values, int** columns, int row_count) {
+    if (version->device == 0 && version->inode == 0) {
+        return; // File version unknown
+    }
+    long bytes = (long)sizeof(ResultEntry) + (long)num_columns * (sizeof(int) + sizeof(int*)) +
+                 (long)(num_columns + 1) * row_count * sizeof(int);
+    pthread_mutex_lock(&results_lock);
+    long budget = results_budget;
+    pthread_mutex_unlock(&results_lock);
+    if (bytes > budget) {
+        return; // Too large to cache
+    }
+
+    // Copy the result outside the lock
+    ResultEntry* entry = (ResultEntry*)calloc(1, sizeof(ResultEntry));
+    if (entry == NULL) {
+        return; // Caching is best effort
+    }
+    entry->file = *version;
+    entry->num_columns = num_columns;
+    entry->filter_column = filter_column;
+    entry->is_float = is_float;
+    entry->op = op;
+    entry->value = value;
+    entry->row_count = row_count;
+    entry->bytes = bytes;
+    entry->column_indices = (int*)malloc((num_columns + 1) * sizeof(int));
+    entry->filter_values = (int*)malloc((row_count + 1) * sizeof(int));
+    entry->columns = (int**)calloc(num_columns + 1, sizeof(int*));
+    int copied = entry->column_indices != NULL && entry->filter_values != NULL && entry->columns != NULL;
+    for (int i = 0; copied && i < num_columns; i++) {
+        entry->columns[i] = (int*)malloc((row_count + 1) * sizeof(int));
+        copied = entry->columns[i] != NULL;
+        if (copied && row_count > 0) {
+            memcpy(entry->columns[i], columns[i], row_count * sizeof(int));
+        }
+    }
+    if (!copied) {
+        free_result(entry);
+        return;
+    }
+    if (num_columns > 0) {
+        memcpy(entry->column_indices, column_indices, num_columns * sizeof(int));
+    }
+    if (row_count > 0) {
+        memcpy(entry->filter_values, filter_values, row_count * sizeof(int));
+    }
+
+    pthread_mutex_lock(&results_lock);
+    while (results_tail != NULL && results_bytes + bytes > results_budget) {
+        remove_result(results_tail);
+    }
+    if (bytes > results_budget) {
+        pthread_mutex_unlock(&results_lock);
+        free_result(entry); // Budget shrank meanwhile
+        return;
+    }
+    push_result(entry);
+    results_bytes += bytes;
+    pthread_mutex_unlock(&results_lock);
+}
+
+void set_result_cache_bytes(long bytes) {
+    pthread_mutex_lock(&results_lock);
+    results_budget = bytes > 0 ? bytes : 0;
+    while (results_tail != NULL && results_bytes > results_budget) {
+        remove_result(results_tail);
+    }
+    pthread_mutex_unlock(&results_lock);
+}
+
+void invalidate_result_cache(const char* hty_file_path) {
+    HtyFileVersion version;
+    if (get_file_version(hty_file_path, &version) != 0) {
+        return;
+    }
+    // Drop every version of the file, not only the current one
+    pthread_mutex_lock(&results_lock);
+    ResultEntry* entry = results_head;
+    while (entry != NULL) {
+        ResultEntry* next = entry->next;
+        if (entry->file.device == version.device && entry->file.inode == version.inode) {
+            remove_result(entry);
+        }
+        entry = next;
+    }
+    pthread_mutex_unlock(&results_lock);
+}
+
+void clear_result_cache(void) {
+    pthread_mutex_lock(&results_lock);
+    while (results_head != NULL) {
+        remove_result(results_head);
+    }
+    pthread_mutex_unlock(&results_lock);
+}
@@ -0,0 +1,81 @@
+/**
+ * @file heartyhty_results.h
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Header file for the query result cache used by filter and project_and_filter
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef HEARTYHTY_RESULTS_H
+#define HEARTYHTY_RESULTS_H
+
+// Memory the result cache may use before it evicts the least recently used results
+#ifndef HTY_RESULT_CACHE_BYTES
+#define HTY_RESULT_CACHE_BYTES (16L * 1024 * 1024)
+#endif
+
+/**
+ * @brief Function to answer a query from the result cache
+ *
+ * A cached result answers the query when it is for the same version of the
+ * file, has every requested column and its predicate on the same column
+ * holds for every row the new predicate can match (e.g. salary > 50000
+ * answers salary > 60000). The cached rows are then filtered again with
+ * the new predicate.
+ *
+ * @param hty_file_path - path to hty file
+ * @param version - pointer to store the file version to pass to store_result on a miss
+ * @param column_indices - index of each projected column
+ * @param num_columns - number of projected columns, 0 for filter() (values of the filter column only)
+ * @param filter_column - index of the filter column
+ * @param is_float - 1 if the filter column is float
+ * @param op - operation for filtering
+ * @param value - value to filter against
+ * @param filter_values - pointer to store the matching values of the filter column
+ * @param columns - pointer to store the projected columns (NULL when num_columns is 0)
+ * @param row_count - pointer to store the number of matching rows
+ * @return int - 1 if answered from the cache, 0 otherwise
+ */
+int lookup_result(const char* hty_file_path, HtyFileVersion* version, const int* column_indices, int num_columns,
+                  int filter_column, int is_float, int op, int value, int** filter_values, int*** columns,
+                  int* row_count);
+
+/**
+ * @brief Function to add the result of a query to the cache (the arrays are copied)
+ *
+ * @param version - file version filled in by lookup_result before the query ran
+ * @param column_indices - index of each projected column
+ * @param num_columns - number of projected columns, 0 for filter()
+ * @param filter_column - index of the filter column
+ * @param is_float - 1 if the filter column is float
+ * @param op - operation for filtering
+ * @param value - value to filter against
+ * @param filter_values - matching values of the filter column
+ * @param columns - projected columns
+ * @param row_count - number of matching rows
+ */
+void store_result(const HtyFileVersion* version, const int* column_indices, int num_columns, int filter_column,
+                  int is_float, int op, int value, const int* filter_values, int** columns, int row_count);
+
+/**
+ * @brief Function to set the memory budget of the result cache
+ *
+ * @param bytes - memory budget in bytes, 0 to disable the cache
+ */
+void set_result_cache_bytes(long bytes);
+
+/**
+ * @brief Function to drop all cached results of a file
+ *
+ * @param hty_file_path - path to hty file
+ */
+void invalidate_result_cache(const char* hty_file_path);
+
+/**
+ * @brief Function to drop every cached result
+ */
+void clear_result_cache(void);
+
+#endif // HEARTYHTY_RESULTS_H
@@ -0,0 +1,190 @@
+/**
+ * @file heartyhty_snapshot.c
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Snapshots: pinning one version of a file while a writer replaces it
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include "../third_party/cJSON/cJSON.h"
+#include "heartyhty_pool.h"
+#include "heartyhty_snapshot.h"
+
+/**
+ * @brief One pinned file version
+ */
+typedef struct PinnedFile {
+    char* path;                               // Path the version was pinned for
+    int fd;                                   // Open descriptor that keeps the version alive
+    int pins;                                 // Pins still held
+    char reopen_path[HTY_SNAPSHOT_PATH_MAX];  // Path that opens the version again, empty if there is none
+    struct PinnedFile* next;                  // Next pinned file
+} PinnedFile;
+
+static pthread_mutex_t snapshot_lock = PTHREAD_MUTEX_INITIALIZER;
+static PinnedFile* pinned_files = NULL;
+
+/**
+ * @brief Function to find the pinned version of a path (snapshot_lock held)
+ *
+ * @param hty_file_path - path to hty file
+ * @return PinnedFile* - pinned version, NULL if the path is not pinned
+ */
+static PinnedFile* find_pinned(const char* hty_file_path) {
+    PinnedFile* pinned = pinned_files;
+    while (pinned != NULL && strcmp(pinned->path, hty_file_path) != 0) {
+        pinned = pinned->next;
+    }
+    return pinned;
+}
+
+/**
+ * @brief Function to open and lock the current version of a file
+ *
+ * The descriptor is opened again through /proc/self/fd, which gives every
+ * reader its own file offset on the same version; without it reads fall
+ * back to the path and only the lock is kept.
+ *
+ * @param hty_file_path - path to hty file
+ * @return PinnedFile* - pinned version with no pins yet, NULL on failure
+ */
+static PinnedFile* open_pinned(const char* hty_file_path) {
+    PinnedFile* pinned = (PinnedFile*)calloc(1, sizeof(PinnedFile));
+    if (pinned == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return NULL;
+    }
+    pinned->path = strdup(hty_file_path);
+    pinned->fd = open(hty_file_path, O_RDONLY | O_CLOEXEC);
+    if (pinned->path == NULL || pinned->fd < 0) {
+        fprintf(stderr, "Error opening file: %s\n", hty_file_path);
+        if (pinned->fd >= 0) {
+            close(pinned->fd);
+        }
+        free(pinned->path);
+        free(pinned);
+        return NULL;
+    }
+
+    // Wait for a delete or update in progress; file systems without locks still get the snapshot
+    while (flock(pinned->fd, LOCK_SH) != 0 && errno == EINTR) {
+    }
+
+    struct stat opened, reopened;
+    snprintf(pinned->reopen_path, HTY_SNAPSHOT_PATH_MAX, "/proc/self/fd/%d", pinned->fd);
+    if (fstat(pinned->fd, &opened) != 0 || stat(pinned->reopen_path, &reopened) != 0 ||
+        opened.st_dev != reopened.st_dev || opened.st_ino != reopened.st_ino) {
+        pinned->reopen_path[0] = '\0';
+    }
+    return pinned;
+}
+
+/**
+ * @brief Function to close a pinned version and free it
+ *
+ * @param pinned - pinned version
+ */
+static void close_pinned(PinnedFile* pinned) {
+    close(pinned->fd); // Also releases the lock; the file system frees a replaced version with its last descriptor
+    free(pinned->path);
+    free(pinned);
+}
+
+int pin_snapshot(const char* hty_file_path, HtyFileVersion* version) {
+    pthread_mutex_lock(&snapshot_lock);
+    PinnedFile* pinned = find_pinned(hty_file_path);
+    if (pinned != NULL) {
+        pinned->pins++;
+    }
+    pthread_mutex_unlock(&snapshot_lock);
+
+    if (pinned == NULL) {
+        // Open outside the lock, a writer may keep the file locked for a while
+        PinnedFile* opened = open_pinned(hty_file_path);
+        if (opened == NULL) {
+            return -1;
+        }
+        pthread_mutex_lock(&snapshot_lock);
+        pinned = find_pinned(hty_file_path);
+        if (pinned == NULL) {
+            opened->next = pinned_files;
+            pinned_files = opened;
+            pinned = opened;
+            opened = NULL;
+        }
+        pinned->pins++;
+        pthread_mutex_unlock(&snapshot_lock);
+        if (opened != NULL) {
+            close_pinned(opened); // Another thread pinned the path first
+        }
+    }
+
+    if (version != NULL && get_file_version(hty_file_path, version) != 0) {
+        unpin_snapshot(hty_file_path);
+        return -1;
+    }
+    return 0;
+}
+
+void unpin_snapshot(const char* hty_file_path) {
+    pthread_mutex_lock(&snapshot_lock);
+    PinnedFile** link = &pinned_files;
+    while (*link != NULL && strcmp((*link)->path, hty_file_path) != 0) {
+        link = &(*link)->next;
+    }
+    PinnedFile* released = NULL;
+    if (*link != NULL && --(*link)->pins == 0) {
+        released = *link;
+        *link = released->next;
+    }
+    pthread_mutex_unlock(&snapshot_lock);
+    if (released != NULL) {
+        close_pinned(released);
+    }
+}
+
+const char* snapshot_path(const char* hty_file_path, char* buffer) {
+    const char* path = hty_file_path;
+    pthread_mutex_lock(&snapshot_lock);
+    PinnedFile* pinned = find_pinned(hty_file_path);
+    if (pinned != NULL && pinned->reopen_path[0] != '\0') {
+        memcpy(buffer, pinned->reopen_path, HTY_SNAPSHOT_PATH_MAX);
+        path = buffer;
+    }
+    pthread_mutex_unlock(&snapshot_lock);
+    return path;
+}
+
+FILE* open_snapshot(const char* hty_file_path) {
+    char buffer[HTY_SNAPSHOT_PATH_MAX];
+    return fopen(snapshot_path(hty_file_path, buffer), "rb");
+}
+
+int open_snapshot_fd(const char* hty_file_path, int flags) {
+    char buffer[HTY_SNAPSHOT_PATH_MAX];
+    return open(snapshot_path(hty_file_path, buffer), flags);
+}
+
+int lock_snapshot_writer(FILE* file) {
+    while (flock(fileno(file), LOCK_EX) != 0) {
+        if (errno == ENOLCK || errno == EOPNOTSUPP) {
+            return 0; // The file system has no locks, write without one
+        }
+        if (errno != EINTR) {
+            fprintf(stderr, "Error locking file for writing\n");
+            return -1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,82 @@
+/**
+ * @file heartyhty_snapshot.h
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Header file for snapshots: pinning one version of a file while a writer replaces it
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef HEARTYHTY_SNAPSHOT_H
+#define HEARTYHTY_SNAPSHOT_H
+
+#include <stdio.h>
+
+#define HTY_SNAPSHOT_PATH_MAX 64 // Buffer size for the path of a pinned version
+
+/**
+ * @brief Function to pin the current version of a file for this process
+ *
+ * Writers publish a new version by writing it next to the file and renaming
+ * it over the file. While a path is pinned, every read of it in this
+ * process opens the pinned version, so a query sees one footer and the data
+ * it describes even if the file is replaced meanwhile. The old version is
+ * freed by the file system once no process holds it any more.
+ *
+ * A pin also holds a shared lock on its version, so deletes and updates,
+ * which change a version in place, wait for the queries reading it. Pins
+ * nest: a path that is already pinned keeps its version until every pin is
+ * released.
+ *
+ * @param hty_file_path - path to hty file
+ * @param version - pointer to store the pinned version, or NULL
+ * @return int - 0 on success, -1 if the file cannot be opened
+ */
+int pin_snapshot(const char* hty_file_path, HtyFileVersion* version);
+
+/**
+ * @brief Function to release a pin taken with pin_snapshot()
+ *
+ * @param hty_file_path - path to hty file
+ */
+void unpin_snapshot(const char* hty_file_path);
+
+/**
+ * @brief Function to get the path that opens the pinned version of a file
+ *
+ * @param hty_file_path - path to hty file
+ * @param buffer - HTY_SNAPSHOT_PATH_MAX bytes for the path of the pinned version
+ * @return const char* - buffer if the file is pinned, hty_file_path otherwise
+ */
+const char* snapshot_path(const char* hty_file_path, char* buffer);
+
+/**
+ * @brief Function to open the pinned version of a file for reading
+ *
+ * @param hty_file_path - path to hty file
+ * @return FILE* - file opened "rb" (the current version if it is not pinned), NULL on failure
+ */
+FILE* open_snapshot(const char* hty_file_path);
+
+/**
+ * @brief Function to open the pinned version of a file as a file descriptor
+ *
+ * @param hty_file_path - path to hty file
+ * @param flags - flags for open()
+ * @return int - file descriptor (of the current version if it is not pinned), -1 on failure
+ */
+int open_snapshot_fd(const char* hty_file_path, int flags);
+
+/**
+ * @brief Function to wait until no process reads the current version of a file and lock it for writing in place
+ *
+ * The lock is released when the file is closed. A process must not write a
+ * file in place while it has the file pinned itself.
+ *
+ * @param file - file opened for writing
+ * @return int - 0 on success, -1 on failure
+ */
+int lock_snapshot_writer(FILE* file);
+
+#endif // HEARTYHTY_SNAPSHOT_H
@@ -0,0 +1,334 @@
+/**
+ * @file heartyhty_sort.c
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Bounded-memory external row sorter used for sort-on-write
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "../third_party/cJSON/cJSON.h"
+#include "heartyhty_writer.h"
+#include "heartyhty_sort.h"
+
+// Buffered row layout: [key (8 bytes)] [sequence number (4 bytes)] [padding (4 bytes)] [values]
+#define RECORD_HEADER_SIZE 16
+
+/**
+ * @brief Cursor over one sorted run during a merge
+ */
+typedef struct {
+    FILE* file;    // Run being read
+    char* record;  // Current record of the run
+} RunCursor;
+
+uint32_t encode_sort_value(int value, int is_float) {
+    uint32_t bits = (uint32_t)value;
+    if (is_float) {
+        // Negative floats order backwards by their bits, positive ones forwards
+        return (bits & 0x80000000U) ? ~bits : (bits | 0x80000000U);
+    }
+    return bits ^ 0x80000000U; // Two's complement to offset binary
+}
+
+int decode_sort_value(uint32_t encoded, int is_float) {
+    if (is_float) {
+        return (int)((encoded & 0x80000000U) ? (encoded & 0x7fffffffU) : ~encoded);
+    }
+    return (int)(encoded ^ 0x80000000U);
+}
+
+/**
+ * @brief Function to compare two buffered records for qsort and the merge heap
+ */
+static int compare_records(const void* a, const void* b) {
+    uint64_t key1, key2;
+    uint32_t sequence1, sequence2;
+    memcpy(&key1, a, sizeof(key1));
+    memcpy(&key2, b, sizeof(key2));
+    if (key1 != key2) {
+        return key1 < key2 ? -1 : 1;
+    }
+    memcpy(&sequence1, (const char*)a + 8, sizeof(sequence1));
+    memcpy(&sequence2, (const char*)b + 8, sizeof(sequence2));
+    return (sequence1 > sequence2) - (sequence1 < sequence2);
+}
+
+/**
+ * @brief Function to compute the sort key of a row
+ *
+ * @param sorter - sorter object
+ * @param row - values of the row
+ * @return uint64_t - sort key
+ */
+static uint64_t compute_key(HtySorter* sorter, const int* row) {
+    if (sorter->num_key_columns == 1) {
+        int col_idx = sorter->key_columns[0];
+        return (uint64_t)encode_sort_value(row[col_idx], sorter->column_types[col_idx]) << 32;
+    }
+
+    // Stretch every key column over 32 bits, then interleave the top bits of each
+    uint32_t normalized[64];
+    for (int k = 0; k < sorter->num_key_columns; k++) {
+        int col_idx = sorter->key_columns[k];
+        uint32_t encoded = encode_sort_value(row[col_idx], sorter->column_types[col_idx]);
+        if (encoded < sorter->key_min[k]) {
+            encoded = sorter->key_min[k];
+        } else if (encoded > sorter->key_max[k]) {
+            encoded = sorter->key_max[k];
+        }
+        uint64_t range = (uint64_t)(sorter->key_max[k] - sorter->key_min[k]) + 1;
+        normalized[k] = (uint32_t)(((uint64_t)(encoded - sorter->key_min[k]) << 32) / range);
+    }
+    int bits_per_column = 64 / sorter->num_key_columns;
+    if (bits_per_column > 32) {
+        bits_per_column = 32;
+    }
+    uint64_t key = 0;
+    for (int bit = 31; bit >= 32 - bits_per_column; bit--) {
+        for (int k = 0; k < sorter->num_key_columns; k++) {
+            key = (key << 1) | ((normalized[k] >> bit) & 1U);
+        }
+    }
+    return key;
+}
+
+/**
+ * @brief Function to sort the buffered rows and write them to a new run
+ *
+ * @param sorter - sorter object
+ * @return int - 0 on success, -1 on failure
+ */
+static int spill_run(HtySorter* sorter) {
+    qsort(sorter->buffer, sorter->buffered_rows, sorter->record_size, compare_records);
+    FILE* run = tmpfile();
+    if (run == NULL) {
+        fprintf(stderr, "Error creating sort run file\n");
+        return -1;
+    }
+    if (fwrite(sorter->buffer, sorter->record_size, sorter->buffered_rows, run) != (size_t)sorter->buffered_rows) {
+        fprintf(stderr, "Error writing sort run\n");
+        fclose(run);
+        return -1;
+    }
+    FILE** runs = (FILE**)realloc(sorter->runs, (sorter->num_runs + 1) * sizeof(FILE*));
+    if (runs == NULL) {
+        fclose(run);
+        return -1;
+    }
+    sorter->runs = runs;
+    sorter->runs[sorter->num_runs++] = run;
+    sorter->buffered_rows = 0;
+    return 0;
+}
+
+/**
+ * @brief Function to restore the heap order below a position
+ *
+ * @param heap - min-heap of cursors
+ * @param size - number of cursors in the heap
+ * @param position - position to sift down from
+ */
+static void sift_down(RunCursor* heap, int size, int position) {
+    for (;;) {
+        int smallest = position;
+        int left = 2 * position + 1;
+        int right = left + 1;
+        if (left < size && compare_records(heap[left].record, heap[smallest].record) < 0) {
+            smallest = left;
+        }
+        if (right < size && compare_records(heap[right].record, heap[smallest].record) < 0) {
+            smallest = right;
+        }
+        if (smallest == position) {
+            return;
+        }
+        RunCursor temp = heap[position];
+        heap[position] = heap[smallest];
+        heap[smallest] = temp;
+        position = smallest;
+    }
+}
+
+/**
+ * @brief Function to k-way merge sorted runs into a new run or into the writer
+ *
+ * @param sorter - sorter object
+ * @param runs - runs to merge (closed afterwards)
+ * @param num_runs - number of runs
+ * @param output_run - run to write to, or NULL to write to the writer
+ * @param writer - writer receiving the rows when output_run is NULL
+ * @return int - 0 on success, -1 on failure
+ */
+static int merge_runs(HtySorter* sorter, FILE** runs, int num_runs, FILE* output_run, HtyWriter* writer) {
+    RunCursor* heap = (RunCursor*)malloc(num_runs * sizeof(RunCursor));
+    char* records = (char*)malloc(num_runs * sorter->record_size);
+    if (heap == NULL || records == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(heap);
+        free(records);
+        return -1;
+    }
+
+    int heap_size = 0;
+    for (int i = 0; i < num_runs; i++) {
+        rewind(runs[i]);
+        heap[heap_size].file = runs[i];
+        heap[heap_size].record = records + i * sorter->record_size;
+        if (fread(heap[heap_size].record, sorter->record_size, 1, runs[i]) == 1) {
+            heap_size++;
+        }
+    }
+    for (int i = heap_size / 2 - 1; i >= 0; i--) {
+        sift_down(heap, heap_size, i);
+    }
+
+    int status = 0;
+    while (heap_size > 0 && status == 0) {
+        // Emit the smallest record, then advance its run
+        if (output_run != NULL) {
+            if (fwrite(heap[0].record, sorter->record_size, 1, output_run) != 1) {
+                fprintf(stderr, "Error writing sort run\n");
+                status = -1;
+            }
+        } else {
+            status = write_row(writer, (const int*)(heap[0].record + RECORD_HEADER_SIZE));
+        }
+        if (fread(heap[0].record, sorter->record_size, 1, heap[0].file) != 1) {
+            heap[0] = heap[--heap_size]; // Run exhausted
+        }
+        sift_down(heap, heap_size, 0);
+    }
+
+    for (int i = 0; i < num_runs; i++) {
+        fclose(runs[i]);
+    }
+    free(heap);
+    free(records);
+    return status;
+}
+
+HtySorter* create_sorter(int num_columns, const int* column_types, const int* key_columns,
+                         int num_key_columns, long memory_bytes) {
+    if (num_key_columns < 1 || num_key_columns > 64) {
+        fprintf(stderr, "Sort key must have between 1 and 64 columns\n");
+        return NULL;
+    }
+    HtySorter* sorter = (HtySorter*)calloc(1, sizeof(HtySorter));
+    if (sorter == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return NULL;
+    }
+    sorter->num_columns = num_columns;
+    sorter->num_key_columns = num_key_columns;
+    sorter->memory_bytes = memory_bytes;
+    sorter->record_size = RECORD_HEADER_SIZE + num_columns * sizeof(int);
+    sorter->buffer_capacity = memory_bytes / (long)sorter->record_size;
+    if (sorter->buffer_capacity < 1) {
+        sorter->buffer_capacity = 1;
+    }
+    sorter->column_types = (int*)malloc(num_columns * sizeof(int));
+    sorter->key_columns = (int*)malloc(num_key_columns * sizeof(int));
+    sorter->key_min = (uint32_t*)malloc(num_key_columns * sizeof(uint32_t));
+    sorter->key_max = (uint32_t*)malloc(num_key_columns * sizeof(uint32_t));
+    sorter->buffer = (char*)malloc(sorter->buffer_capacity * sorter->record_size);
+    if (!sorter->column_types || !sorter->key_columns || !sorter->key_min || !sorter->key_max || !sorter->buffer) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free_sorter(sorter);
+        return NULL;
+    }
+    memcpy(sorter->column_types, column_types, num_columns * sizeof(int));
+    memcpy(sorter->key_columns, key_columns, num_key_columns * sizeof(int));
+    for (int k = 0; k < num_key_columns; k++) {
+        sorter->key_min[k] = 0;
+        sorter->key_max[k] = UINT32_MAX;
+    }
+    return sorter;
+}
+
+void set_sorter_key_range(HtySorter* sorter, int key, int min_value, int max_value) {
+    int is_float = sorter->column_types[sorter->key_columns[key]];
+    uint32_t encoded_min = encode_sort_value(min_value, is_float);
+    uint32_t encoded_max = encode_sort_value(max_value, is_float);
+    if (encoded_min <= encoded_max) {
+        sorter->key_min[key] = encoded_min;
+        sorter->key_max[key] = encoded_max;
+    }
+}
+
+int sorter_add_row(HtySorter* sorter, const int* row) {
+    if (sorter->buffered_rows == sorter->buffer_capacity && spill_run(sorter) != 0) {
+        return -1;
+    }
+    char* record = sorter->buffer + sorter->buffered_rows * sorter->record_size;
+    uint64_t key = compute_key(sorter, row);
+    uint32_t sequence = sorter->next_sequence++;
+    uint32_t padding = 0;
+    memcpy(record, &key, sizeof(key));
+    memcpy(record + 8, &sequence, sizeof(sequence));
+    memcpy(record + 12, &padding, sizeof(padding));
+    memcpy(record + RECORD_HEADER_SIZE, row, sorter->num_columns * sizeof(int));
+    sorter->buffered_rows++;
+    return 0;
+}
+
+int sorter_write_sorted(HtySorter* sorter, HtyWriter* writer) {
+    if (sorter->num_runs == 0) {
+        // Everything fit in memory, no merge needed
+        qsort(sorter->buffer, sorter->buffered_rows, sorter->record_size, compare_records);
+        for (long i = 0; i < sorter->buffered_rows; i++) {
+            if (write_row(writer, (const int*)(sorter->buffer + i * sorter->record_size + RECORD_HEADER_SIZE)) != 0) {
+                return -1;
+            }
+        }
+        sorter->buffered_rows = 0;
+        return 0;
+    }
+
+    if (sorter->buffered_rows > 0 && spill_run(sorter) != 0) {
+        return -1;
+    }
+    free(sorter->buffer); // Give the row buffer back before merging
+    sorter->buffer = NULL;
+
+    // Merge in passes of at most HTY_SORT_MAX_FAN_IN runs until one pass is enough
+    while (sorter->num_runs > HTY_SORT_MAX_FAN_IN) {
+        FILE* merged = tmpfile();
+        if (merged == NULL) {
+            fprintf(stderr, "Error creating sort run file\n");
+            return -1;
+        }
+        int status = merge_runs(sorter, sorter->runs, HTY_SORT_MAX_FAN_IN, merged, NULL);
+        memmove(sorter->runs, sorter->runs + HTY_SORT_MAX_FAN_IN,
+                (sorter->num_runs - HTY_SORT_MAX_FAN_IN) * sizeof(FILE*));
+        sorter->num_runs -= HTY_SORT_MAX_FAN_IN;
+        sorter->runs[sorter->num_runs++] = merged; // Later input, so equal keys stay in order
+        if (status != 0) {
+            return -1;
+        }
+    }
+    int status = merge_runs(sorter, sorter->runs, sorter->num_runs, NULL, writer);
+    sorter->num_runs = 0;
+    return status;
+}
+
+void free_sorter(HtySorter* sorter) {
+    if (sorter == NULL) {
+        return;
+    }
+    for (int i = 0; i < sorter->num_runs; i++) {
+        fclose(sorter->runs[i]);
+    }
+    free(sorter->runs);
+    free(sorter->buffer);
+    free(sorter->column_types);
+    free(sorter->key_columns);
+    free(sorter->key_min);
+    free(sorter->key_max);
+    free(sorter);
+}
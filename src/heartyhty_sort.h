@@ -0,0 +1,119 @@
+/**
+ * @file heartyhty_sort.h
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Header file for the bounded-memory external row sorter used for sort-on-write
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef HEARTYHTY_SORT_H
+#define HEARTYHTY_SORT_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// Memory used for buffered rows before a sorted run is spilled to disk
+#ifndef HTY_SORT_MEMORY_BYTES
+#define HTY_SORT_MEMORY_BYTES (64L * 1024 * 1024)
+#endif
+
+// Maximum number of runs merged at once, more runs are merged in several passes
+#define HTY_SORT_MAX_FAN_IN 64
+
+/**
+ * @brief External sorter state
+ *
+ * Rows are ordered by a 64-bit key. With one key column the key is the
+ * order-preserving encoding of its value. With several key columns it is
+ * their Z-order (Morton) code, so rows close in every key column end up
+ * close in the file.
+ */
+typedef struct {
+    int num_columns;          // Number of columns in each row
+    int* column_types;        // 0 for int, 1 for float
+    int num_key_columns;      // Number of sort key columns
+    int* key_columns;         // Column index of each key column
+    uint32_t* key_min;        // Smallest encoded value of each key column (Z-order only)
+    uint32_t* key_max;        // Largest encoded value of each key column (Z-order only)
+    size_t record_size;       // Bytes per buffered row (key, sequence number, values)
+    char* buffer;             // Buffered rows of the current run
+    long buffer_capacity;     // Rows that fit in the buffer
+    long buffered_rows;       // Rows in the buffer
+    uint32_t next_sequence;   // Input position of the next row, keeps equal keys in input order
+    int num_runs;             // Sorted runs spilled to disk
+    FILE** runs;              // Spilled runs
+    long memory_bytes;        // Memory budget
+} HtySorter;
+
+/**
+ * @brief Function to create an external sorter
+ *
+ * @param num_columns - number of columns in each row
+ * @param column_types - type of each column (0 for int, 1 for float)
+ * @param key_columns - index of each sort key column
+ * @param num_key_columns - number of key columns (1 for a plain sort, more for Z-order)
+ * @param memory_bytes - memory budget for buffered rows
+ * @return HtySorter* - sorter object, NULL on failure
+ */
+HtySorter* create_sorter(int num_columns, const int* column_types, const int* key_columns,
+                         int num_key_columns, long memory_bytes);
+
+/**
+ * @brief Function to set the value range of a Z-order key column
+ *
+ * Z-order interleaves the top bits of each key column. Stretching every key
+ * column to its full range keeps narrow columns from being ignored.
+ *
+ * @param sorter - sorter object
+ * @param key - position of the column among the key columns
+ * @param min_value - smallest value of the column (float bits for float columns)
+ * @param max_value - largest value of the column (float bits for float columns)
+ */
+void set_sorter_key_range(HtySorter* sorter, int key, int min_value, int max_value);
+
+/**
+ * @brief Function to add a row to the sorter
+ *
+ * @param sorter - sorter object
+ * @param row - values of the row (float bits for float columns)
+ * @return int - 0 on success, -1 on failure
+ */
+int sorter_add_row(HtySorter* sorter, const int* row);
+
+/**
+ * @brief Function to merge all rows in sorted order into a writer
+ *
+ * @param sorter - sorter object
+ * @param writer - writer receiving the sorted rows
+ * @return int - 0 on success, -1 on failure
+ */
+int sorter_write_sorted(HtySorter* sorter, HtyWriter* writer);
+
+/**
+ * @brief Function to encode a value as an unsigned integer with the same order
+ *
+ * @param value - value (float bits for float columns)
+ * @param is_float - flag to indicate if value is float
+ * @return uint32_t - order-preserving encoding
+ */
+uint32_t encode_sort_value(int value, int is_float);
+
+/**
+ * @brief Function to turn an encoded value back into the value
+ *
+ * @param encoded - value from encode_sort_value()
+ * @param is_float - flag to indicate if value is float
+ * @return int - value (float bits for float columns)
+ */
+int decode_sort_value(uint32_t encoded, int is_float);
+
+/**
+ * @brief Function to free a sorter and its spilled runs
+ *
+ * @param sorter - sorter object
+ */
+void free_sorter(HtySorter* sorter);
+
+#endif // HEARTYHTY_SORT_H
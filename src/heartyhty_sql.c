@@ -0,0 +1,1800 @@
+/**
+ * @file heartyhty_sql.c
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Mini-SQL front end: statements parsed once into a plan over project, project_and_filter and top_k
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include "../third_party/cJSON/cJSON.h"
+#include "heartyhty_functions.h"
+#include "heartyhty_expr.h"
+#include "heartyhty_distinct.h"
+#include "heartyhty_writer.h"
+#include "heartyhty_sort.h"
+#include "heartyhty_topk.h"
+#include "heartyhty_pool.h"
+#include "heartyhty_arena.h"
+#include "heartyhty_estimate.h"
+#include "heartyhty_table.h"
+#include "heartyhty_dataset.h"
+#include "heartyhty_sql.h"
+
+static HtyTable* sql_table = NULL; // Table of the last statement, kept for the next one
+static HtyArena* dataset_arena = NULL; // Memory of statements on a dataset, reset for each one
+
+#define TOKEN_END 0       // End of the statement
+#define TOKEN_WORD 1      // Keyword, name, number or path
+#define TOKEN_SYMBOL 2    // One of , ( ) * ; + - / %
+#define TOKEN_OPERATOR 3  // Comparison operator
+
+/**
+ * @brief One token of a statement
+ */
+typedef struct {
+    int type;    // TOKEN_* type
+    char* text;  // Token text
+} Token;
+
+/**
+ * @brief Parser state
+ */
+typedef struct {
+    Token* tokens;  // Tokens of the statement, ending with TOKEN_END
+    int count;      // Number of tokens
+    int at;         // Next token
+} Parser;
+
+/**
+ * @brief Function to check whether a character may appear in a word
+ *
+ * @param c - character
+ * @param path - 1 for the word after FROM, which may also hold the path characters - / ~ +
+ * @return int - 1 if it may, 0 otherwise
+ */
+static int is_word_char(char c, int path) {
+    return c != '\0' && (isalnum((unsigned char)c) || strchr(path ? "_.-/~+" : "_.", c) != NULL);
+}
+
+/**
+ * @brief Function to split a statement into tokens
+ *
+ * @param text - statement
+ * @param parser - parser to fill in
+ * @return int - 0 on success, -1 on an unexpected character
+ */
+static int tokenize(const char* text, Parser* parser) {
+    int capacity = (int)strlen(text) + 1;  // Never more tokens than characters
+    parser->tokens = (Token*)calloc(capacity, sizeof(Token));
+    parser->count = 0;
+    parser->at = 0;
+    if (parser->tokens == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    const char* c = text;
+    while (*c != '\0') {
+        if (isspace((unsigned char)*c)) {
+            c++;
+            continue;
+        }
+        const char* start = c;
+        int type;
+        // Paths follow FROM; elsewhere - + / are operators, and - + only belong to a word in the exponent of a number
+        int path = parser->count > 0 && parser->tokens[parser->count - 1].type == TOKEN_WORD &&
+                   strcasecmp(parser->tokens[parser->count - 1].text, "FROM") == 0;
+        if (*c == '\'' || *c == '"') {
+            // Quoted word, e.g. a path with spaces
+            const char* end = strchr(c + 1, *c);
+            if (end == NULL) {
+                fprintf(stderr, "Unterminated string: %s\n", c);
+                return -1;
+            }
+            parser->tokens[parser->count].type = TOKEN_WORD;
+            parser->tokens[parser->count++].text = strndup(c + 1, end - c - 1);
+            c = end + 1;
+            continue;
+        } else if (is_word_char(*c, path)) {
+            int number = isdigit((unsigned char)*c) || *c == '.';
+            while (is_word_char(*c, path) ||
+                   (number && (*c == '-' || *c == '+') && (c[-1] == 'e' || c[-1] == 'E'))) {
+                c++;
+            }
+            type = TOKEN_WORD;
+        } else if (strchr(",()*;+-/%", *c) != NULL) {
+            c++;
+            type = TOKEN_SYMBOL;
+        } else if (strchr("<>=!", *c) != NULL) {
+            c++;
+            if (*c == '=' || (start[0] == '<' && *c == '>')) {
+                c++;
+            }
+            type = TOKEN_OPERATOR;
+        } else {
+            fprintf(stderr, "Unexpected character '%c' in statement\n", *c);
+            return -1;
+        }
+        parser->tokens[parser->count].type = type;
+        parser->tokens[parser->count++].text = strndup(start, c - start);
+    }
+    parser->tokens[parser->count].type = TOKEN_END;
+    return 0;
+}
+
+/**
+ * @brief Function to free the tokens of a parser
+ *
+ * @param parser - parser
+ */
+static void free_tokens(Parser* parser) {
+    for (int i = 0; i < parser->count; i++) {
+        free(parser->tokens[i].text);
+    }
+    free(parser->tokens);
+}
+
+/**
+ * @brief Function to look at the next token without consuming it
+ *
+ * @param parser - parser
+ * @return Token* - next token
+ */
+static Token* peek(Parser* parser) {
+    return &parser->tokens[parser->at];
+}
+
+/**
+ * @brief Function to consume the next token if it is the given keyword or symbol
+ *
+ * @param parser - parser
+ * @param text - keyword (any case) or symbol
+ * @return int - 1 if consumed, 0 otherwise
+ */
+static int accept(Parser* parser, const char* text) {
+    Token* token = peek(parser);
+    if (token->type != TOKEN_END && strcasecmp(token->text, text) == 0) {
+        parser->at++;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Function to consume a keyword or symbol that must come next
+ *
+ * @param parser - parser
+ * @param text - keyword or symbol
+ * @return int - 0 on success, -1 on a syntax error
+ */
+static int expect(Parser* parser, const char* text) {
+    if (accept(parser, text)) {
+        return 0;
+    }
+    Token* token = peek(parser);
+    fprintf(stderr, "Expected %s near '%s'\n", text, token->type == TOKEN_END ? "end of statement" : token->text);
+    return -1;
+}
+
+/**
+ * @brief Function to consume a word that must come next
+ *
+ * @param parser - parser
+ * @param what - what the word is, for the error message
+ * @return char* - copy of the word, NULL on a syntax error
+ */
+static char* expect_word(Parser* parser, const char* what) {
+    Token* token = peek(parser);
+    if (token->type != TOKEN_WORD) {
+        fprintf(stderr, "Expected %s near '%s'\n", what, token->type == TOKEN_END ? "end of statement" : token->text);
+        return NULL;
+    }
+    parser->at++;
+    return strdup(token->text);
+}
+
+/**
+ * @brief Function to turn an operator into one of the OP_* operations
+ *
+ * @param text - operator text
+ * @return int - operation, -1 if unknown
+ */
+static int parse_operation(const char* text) {
+    if (strcmp(text, ">") == 0) return OP_GREATER;
+    if (strcmp(text, ">=") == 0) return OP_GREATER_EQUAL;
+    if (strcmp(text, "<") == 0) return OP_LESS;
+    if (strcmp(text, "<=") == 0) return OP_LESS_EQUAL;
+    if (strcmp(text, "=") == 0) return OP_EQUAL;
+    if (strcmp(text, "!=") == 0 || strcmp(text, "<>") == 0) return OP_NOT_EQUAL;
+    return -1;
+}
+
+static HtyExpr* parse_expression(Parser* parser);
+
+/**
+ * @brief Function to check whether the next token is the given symbol
+ *
+ * @param parser - parser
+ * @param symbol - symbol
+ * @return int - 1 if it is, 0 otherwise
+ */
+static int next_is_symbol(Parser* parser, const char* symbol) {
+    Token* token = peek(parser);
+    return token->type == TOKEN_SYMBOL && strcmp(token->text, symbol) == 0;
+}
+
+/**
+ * @brief Function to make an operator node with one or two operands
+ *
+ * @param kind - EXPR_* kind
+ * @param op - OP_* comparison for EXPR_COMPARE
+ * @param a - first operand (freed on failure)
+ * @param b - second operand (freed on failure), NULL for one operand
+ * @return HtyExpr* - expression, NULL on failure
+ */
+static HtyExpr* make_operator(int kind, int op, HtyExpr* a, HtyExpr* b) {
+    int num_args = kind == EXPR_NEGATE || kind == EXPR_NOT || kind == EXPR_TO_INT || kind == EXPR_TO_FLOAT ? 1 : 2;
+    HtyExpr** args = (HtyExpr**)malloc(2 * sizeof(HtyExpr*));
+    if (args == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free_expr(a);
+        free_expr(b);
+        return NULL;
+    }
+    args[0] = a;
+    args[1] = b;
+    return make_expr(kind, op, args, num_args);
+}
+
+/**
+ * @brief Function to parse CASE WHEN condition THEN value [WHEN ...] [ELSE value] END, after CASE
+ *
+ * @param parser - parser
+ * @return HtyExpr* - expression, NULL on a syntax error
+ */
+static HtyExpr* parse_case(Parser* parser) {
+    int capacity = 8, num_args = 0, status = 0;
+    HtyExpr** args = (HtyExpr**)malloc(capacity * sizeof(HtyExpr*));
+    if (args == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return NULL;
+    }
+    do {
+        if (num_args + 3 > capacity) {
+            capacity *= 2;
+            HtyExpr** grown = (HtyExpr**)realloc(args, capacity * sizeof(HtyExpr*));
+            if (grown == NULL) {
+                fprintf(stderr, "Memory allocation failed\n");
+                status = -1;
+                break;
+            }
+            args = grown;
+        }
+        status = expect(parser, "WHEN");
+        if (status == 0 && (args[num_args++] = parse_expression(parser)) == NULL) {
+            status = -1;
+        }
+        if (status == 0) {
+            status = expect(parser, "THEN");
+        }
+        if (status == 0 && (args[num_args++] = parse_expression(parser)) == NULL) {
+            status = -1;
+        }
+    } while (status == 0 && peek(parser)->type == TOKEN_WORD && strcasecmp(peek(parser)->text, "WHEN") == 0);
+    if (status == 0) {
+        args[num_args++] = accept(parser, "ELSE") ? parse_expression(parser) : make_constant_expr("0");
+        if (args[num_args - 1] == NULL || expect(parser, "END") != 0) {
+            status = -1;
+        }
+    }
+    if (status != 0) {
+        for (int i = 0; i < num_args; i++) {
+            free_expr(args[i]);
+        }
+        free(args);
+        return NULL;
+    }
+    return make_expr(EXPR_CASE, 0, args, num_args);
+}
+
+/**
+ * @brief Function to parse a number, column, parenthesized expression, CAST or CASE
+ *
+ * @param parser - parser
+ * @return HtyExpr* - expression, NULL on a syntax error
+ */
+static HtyExpr* parse_primary(Parser* parser) {
+    Token* token = peek(parser);
+    if (accept(parser, "(")) {
+        HtyExpr* expr = parse_expression(parser);
+        if (expr != NULL && expect(parser, ")") != 0) {
+            free_expr(expr);
+            return NULL;
+        }
+        return expr;
+    }
+    if (token->type != TOKEN_WORD) {
+        fprintf(stderr, "Expected expression near '%s'\n", token->type == TOKEN_END ? "end of statement" : token->text);
+        return NULL;
+    }
+    parser->at++;
+    if (strcasecmp(token->text, "CASE") == 0) {
+        return parse_case(parser);
+    }
+    if (!next_is_symbol(parser, "(")) {
+        if (isdigit((unsigned char)token->text[0]) || token->text[0] == '.') {
+            HtyExpr* constant = make_constant_expr(token->text);
+            if (constant == NULL) {
+                fprintf(stderr, "Invalid number: %s\n", token->text);
+            }
+            return constant;
+        }
+        return make_column_expr(token->text);
+    }
+    if (strcasecmp(token->text, "CAST") != 0) {
+        fprintf(stderr, "Unknown function: %s\n", token->text);
+        return NULL;
+    }
+
+    // CAST(expression AS INT|FLOAT)
+    parser->at++;
+    HtyExpr* expr = parse_expression(parser);
+    int kind = -1;
+    if (expr != NULL && expect(parser, "AS") == 0) {
+        if (accept(parser, "INT") || accept(parser, "INTEGER")) {
+            kind = EXPR_TO_INT;
+        } else if (accept(parser, "FLOAT") || accept(parser, "REAL")) {
+            kind = EXPR_TO_FLOAT;
+        } else {
+            fprintf(stderr, "Expected INT or FLOAT near '%s'\n", peek(parser)->type == TOKEN_END ? "end of statement" : peek(parser)->text);
+        }
+    }
+    if (kind == -1 || expect(parser, ")") != 0) {
+        free_expr(expr);
+        return NULL;
+    }
+    return make_operator(kind, 0, expr, NULL);
+}
+
+/**
+ * @brief Function to parse a primary with any number of unary minus and plus signs
+ *
+ * @param parser - parser
+ * @return HtyExpr* - expression, NULL on a syntax error
+ */
+static HtyExpr* parse_unary(Parser* parser) {
+    if (accept(parser, "-")) {
+        HtyExpr* operand = parse_unary(parser);
+        return operand != NULL ? make_operator(EXPR_NEGATE, 0, operand, NULL) : NULL;
+    }
+    if (accept(parser, "+")) {
+        return parse_unary(parser);
+    }
+    return parse_primary(parser);
+}
+
+/**
+ * @brief Function to parse products: unary [* / % unary ...]
+ *
+ * @param parser - parser
+ * @return HtyExpr* - expression, NULL on a syntax error
+ */
+static HtyExpr* parse_product(Parser* parser) {
+    HtyExpr* expr = parse_unary(parser);
+    while (expr != NULL && (next_is_symbol(parser, "*") || next_is_symbol(parser, "/") || next_is_symbol(parser, "%"))) {
+        char symbol = peek(parser)->text[0];
+        parser->at++;
+        HtyExpr* operand = parse_unary(parser);
+        int kind = symbol == '*' ? EXPR_MULTIPLY : symbol == '/' ? EXPR_DIVIDE : EXPR_MODULO;
+        expr = operand != NULL ? make_operator(kind, 0, expr, operand) : (free_expr(expr), NULL);
+    }
+    return expr;
+}
+
+/**
+ * @brief Function to parse sums: product [+ - product ...]
+ *
+ * @param parser - parser
+ * @return HtyExpr* - expression, NULL on a syntax error
+ */
+static HtyExpr* parse_sum(Parser* parser) {
+    HtyExpr* expr = parse_product(parser);
+    while (expr != NULL && (next_is_symbol(parser, "+") || next_is_symbol(parser, "-"))) {
+        int kind = peek(parser)->text[0] == '+' ? EXPR_ADD : EXPR_SUBTRACT;
+        parser->at++;
+        HtyExpr* operand = parse_product(parser);
+        expr = operand != NULL ? make_operator(kind, 0, expr, operand) : (free_expr(expr), NULL);
+    }
+    return expr;
+}
+
+/**
+ * @brief Function to parse [NOT] IN (number, ...) after its column, as equalities joined by OR
+ *
+ * column IN (1, 2) becomes column = 1 OR column = 2, so it is evaluated like
+ * any other condition; a WHERE that is only such a list is answered by
+ * filter_in() (see in_list_values()).
+ *
+ * @param parser - parser, at NOT or IN
+ * @param operand - column before IN (freed)
+ * @return HtyExpr* - expression, NULL on a syntax error
+ */
+static HtyExpr* parse_in_list(Parser* parser, HtyExpr* operand) {
+    int negated = accept(parser, "NOT");
+    accept(parser, "IN");
+    if (operand->kind != EXPR_COLUMN) {
+        fprintf(stderr, "IN needs a column on its left\n");
+        free_expr(operand);
+        return NULL;
+    }
+    if (expect(parser, "(") != 0) {
+        free_expr(operand);
+        return NULL;
+    }
+    HtyExpr* list = NULL;
+    do {
+        // A number with its sign, so negative values stay constants
+        int negative = next_is_symbol(parser, "-");
+        if (negative || next_is_symbol(parser, "+")) {
+            parser->at++;
+        }
+        Token* token = peek(parser);
+        HtyExpr* constant = NULL;
+        if (token->type == TOKEN_WORD) {
+            char* number = (char*)malloc(strlen(token->text) + 2);
+            if (number != NULL) {
+                sprintf(number, "%s%s", negative ? "-" : "", token->text);
+                constant = make_constant_expr(number);
+                free(number);
+            }
+        }
+        if (constant == NULL) {
+            fprintf(stderr, "Expected number near '%s'\n", token->type == TOKEN_END ? "end of statement" : token->text);
+            free_expr(list);
+            free_expr(operand);
+            return NULL;
+        }
+        parser->at++;
+        HtyExpr* column = make_column_expr(operand->name);
+        HtyExpr* equal = column != NULL ? make_operator(EXPR_COMPARE, OP_EQUAL, column, constant) : (free_expr(constant), NULL);
+        if (equal == NULL) {
+            list = (free_expr(list), NULL);
+        } else {
+            list = list == NULL ? equal : make_operator(EXPR_OR, 0, list, equal);
+        }
+    } while (list != NULL && accept(parser, ","));
+    free_expr(operand);
+    if (list == NULL || expect(parser, ")") != 0) {
+        free_expr(list);
+        return NULL;
+    }
+    return negated ? make_operator(EXPR_NOT, 0, list, NULL) : list;
+}
+
+/**
+ * @brief Function to parse a sum, a comparison of two sums or a column [NOT] IN list
+ *
+ * @param parser - parser
+ * @return HtyExpr* - expression, NULL on a syntax error
+ */
+static HtyExpr* parse_comparison(Parser* parser) {
+    HtyExpr* expr = parse_sum(parser);
+    Token* token = peek(parser);
+    if (expr != NULL && token->type == TOKEN_WORD &&
+        (strcasecmp(token->text, "IN") == 0 ||
+         (strcasecmp(token->text, "NOT") == 0 && parser->tokens[parser->at + 1].type == TOKEN_WORD &&
+          strcasecmp(parser->tokens[parser->at + 1].text, "IN") == 0))) {
+        return parse_in_list(parser, expr);
+    }
+    if (expr == NULL || token->type != TOKEN_OPERATOR) {
+        return expr;
+    }
+    int op = parse_operation(token->text);
+    if (op == -1) {
+        fprintf(stderr, "Unknown operator: %s\n", token->text);
+        free_expr(expr);
+        return NULL;
+    }
+    parser->at++;
+    HtyExpr* operand = parse_sum(parser);
+    return operand != NULL ? make_operator(EXPR_COMPARE, op, expr, operand) : (free_expr(expr), NULL);
+}
+
+/**
+ * @brief Function to parse a comparison with any number of NOTs
+ *
+ * @param parser - parser
+ * @return HtyExpr* - expression, NULL on a syntax error
+ */
+static HtyExpr* parse_negation(Parser* parser) {
+    if (accept(parser, "NOT")) {
+        HtyExpr* operand = parse_negation(parser);
+        return operand != NULL ? make_operator(EXPR_NOT, 0, operand, NULL) : NULL;
+    }
+    return parse_comparison(parser);
+}
+
+/**
+ * @brief Function to parse conjunctions: negation [AND negation ...]
+ *
+ * @param parser - parser
+ * @return HtyExpr* - expression, NULL on a syntax error
+ */
+static HtyExpr* parse_conjunction(Parser* parser) {
+    HtyExpr* expr = parse_negation(parser);
+    while (expr != NULL && accept(parser, "AND")) {
+        HtyExpr* operand = parse_negation(parser);
+        expr = operand != NULL ? make_operator(EXPR_AND, 0, expr, operand) : (free_expr(expr), NULL);
+    }
+    return expr;
+}
+
+/**
+ * @brief Function to parse an expression: conjunction [OR conjunction ...]
+ *
+ * @param parser - parser
+ * @return HtyExpr* - expression, NULL on a syntax error
+ */
+static HtyExpr* parse_expression(Parser* parser) {
+    HtyExpr* expr = parse_conjunction(parser);
+    while (expr != NULL && accept(parser, "OR")) {
+        HtyExpr* operand = parse_conjunction(parser);
+        expr = operand != NULL ? make_operator(EXPR_OR, 0, expr, operand) : (free_expr(expr), NULL);
+    }
+    return expr;
+}
+
+/**
+ * @brief Function to write tokens back as text, e.g. for the name of an expression
+ *
+ * @param parser - parser
+ * @param start - first token
+ * @param end - token after the last one
+ * @return char* - text, NULL on failure
+ */
+static char* join_tokens(Parser* parser, int start, int end) {
+    size_t length = 1;
+    for (int i = start; i < end; i++) {
+        length += strlen(parser->tokens[i].text) + 1;
+    }
+    char* text = (char*)malloc(length);
+    if (text == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return NULL;
+    }
+    char* at = text;
+    for (int i = start; i < end; i++) {
+        const char* word = parser->tokens[i].text;
+        Token* previous = &parser->tokens[i - 1];
+        // No space inside parentheses, before a comma, before the ( of a function or after a sign: CAST(x AS INT), -x
+        int sign = i > start && (strcmp(previous->text, "-") == 0 || strcmp(previous->text, "+") == 0) &&
+                   (i - 1 == start || parser->tokens[i - 2].type == TOKEN_OPERATOR ||
+                    (parser->tokens[i - 2].type == TOKEN_SYMBOL && strcmp(parser->tokens[i - 2].text, ")") != 0));
+        if (i > start && strcmp(word, ")") != 0 && strcmp(word, ",") != 0 && strcmp(previous->text, "(") != 0 &&
+            !(strcmp(word, "(") == 0 && previous->type == TOKEN_WORD) && !sign) {
+            *at++ = ' ';
+        }
+        at += sprintf(at, "%s", word);
+    }
+    *at = '\0';
+    return text;
+}
+
+/**
+ * @brief Function to parse one item of the SELECT list (or the ORDER BY column)
+ *
+ * @param parser - parser
+ * @param item - item to fill in
+ * @return int - 0 on success, -1 on a syntax error
+ */
+static int parse_item(Parser* parser, HtySqlItem* item) {
+    static const char* functions[] = {"count", "sum", "min", "max", "avg"};
+    memset(item, 0, sizeof(HtySqlItem));
+    int start = parser->at;
+    Token* token = peek(parser);
+    if (token->type == TOKEN_WORD && parser->tokens[start + 1].type == TOKEN_SYMBOL &&
+        strcmp(parser->tokens[start + 1].text, "(") == 0) {
+        for (int i = 0; i < 5; i++) {
+            if (strcasecmp(token->text, functions[i]) == 0) {
+                item->aggregate = AGG_COUNT + i;
+            }
+        }
+    }
+
+    // Aggregate: function(expression) or COUNT(*); otherwise an expression, often just a column
+    int argument = start, argument_end;
+    HtyExpr* expr = NULL;
+    if (item->aggregate != AGG_NONE) {
+        parser->at += 2;
+        argument = parser->at;
+        if (item->aggregate != AGG_COUNT || !accept(parser, "*")) {
+            if (item->aggregate == AGG_COUNT && accept(parser, "DISTINCT")) {
+                item->aggregate = AGG_COUNT_DISTINCT;
+                argument = parser->at;
+            }
+            if ((expr = parse_expression(parser)) == NULL) {
+                return -1;
+            }
+        }
+        argument_end = parser->at;
+        if (expect(parser, ")") != 0) {
+            free_expr(expr);
+            return -1;
+        }
+    } else {
+        if ((expr = parse_expression(parser)) == NULL) {
+            return -1;
+        }
+        argument_end = parser->at;
+    }
+    if (expr != NULL && expr->kind == EXPR_COLUMN) {
+        item->column = expr->name;
+        expr->name = NULL;
+        free_expr(expr);
+    } else {
+        item->expr = expr;
+    }
+
+    // Name: the column, the expression as written or function(argument), unless AS gives one
+    if (accept(parser, "AS")) {
+        item->name = expect_word(parser, "name");
+        return item->name != NULL ? 0 : -1;
+    }
+    if (item->aggregate == AGG_NONE) {
+        item->name = item->column != NULL ? strdup(item->column) : join_tokens(parser, start, argument_end);
+        return item->name != NULL ? 0 : -1;
+    }
+    int distinct = item->aggregate == AGG_COUNT_DISTINCT;
+    const char* function = functions[distinct ? 0 : item->aggregate - AGG_COUNT];
+    char* argument_text = item->column != NULL ? strdup(item->column) :
+                          item->expr != NULL ? join_tokens(parser, argument, argument_end) : strdup("*");
+    if (argument_text == NULL) {
+        return -1;
+    }
+    item->name = (char*)malloc(strlen(function) + strlen(argument_text) + 12);
+    if (item->name != NULL) {
+        sprintf(item->name, "%s(%s%s)", function, distinct ? "distinct " : "", argument_text);
+    }
+    free(argument_text);
+    return item->name != NULL ? 0 : -1;
+}
+
+/**
+ * @brief Function to turn a comparison around, so the column comes first
+ *
+ * @param op - OP_* comparison
+ * @return int - comparison with the operands swapped
+ */
+static int swap_operation(int op) {
+    switch (op) {
+        case OP_GREATER:       return OP_LESS;
+        case OP_GREATER_EQUAL: return OP_LESS_EQUAL;
+        case OP_LESS:          return OP_GREATER;
+        case OP_LESS_EQUAL:    return OP_GREATER_EQUAL;
+        default:               return op;
+    }
+}
+
+/**
+ * @brief Function to split a WHERE condition at its ANDs into predicates and other conditions
+ *
+ * Comparisons of a column with a number become predicates, which the scan
+ * or an index can evaluate; everything else is kept as an expression.
+ *
+ * @param query - statement to add the conditions to
+ * @param expr - condition (owned by the statement afterwards, or freed)
+ * @return int - 0 on success, -1 if there are too many conditions
+ */
+static int add_conditions(HtySqlQuery* query, HtyExpr* expr) {
+    if (expr->kind == EXPR_AND) {
+        HtyExpr* second = expr->args[1];
+        int status = add_conditions(query, expr->args[0]);
+        expr->num_args = 0; // The operands now belong to the statement
+        free_expr(expr);
+        if (status != 0) {
+            free_expr(second);
+            return -1;
+        }
+        return add_conditions(query, second);
+    }
+    if (query->num_conditions + query->num_filters == SQL_MAX_CONDITIONS) {
+        fprintf(stderr, "Too many conditions (at most %d)\n", SQL_MAX_CONDITIONS);
+        free_expr(expr);
+        return -1;
+    }
+    if (expr->kind == EXPR_COMPARE) {
+        int swapped = expr->args[0]->kind == EXPR_CONSTANT;
+        HtyExpr* column = expr->args[swapped];
+        HtyExpr* constant = expr->args[!swapped];
+        if (column->kind == EXPR_COLUMN && constant->kind == EXPR_CONSTANT) {
+            HtyPredicate* condition = &query->conditions[query->num_conditions];
+            condition->column = column->name;
+            condition->op = swapped ? swap_operation(expr->op) : expr->op;
+            query->condition_text[query->num_conditions++] = constant->name;
+            column->name = NULL;
+            constant->name = NULL;
+            free_expr(expr);
+            return 0;
+        }
+    }
+    query->filters[query->num_filters++] = expr;
+    return 0;
+}
+
+/**
+ * @brief Function to free the strings of an item
+ *
+ * @param item - item
+ */
+static void free_item(HtySqlItem* item) {
+    free(item->column);
+    free_expr(item->expr);
+    free(item->name);
+}
+
+int parse_sql(const char* text, HtySqlQuery* query) {
+    memset(query, 0, sizeof(HtySqlQuery));
+    query->limit = -1;
+    Parser parser;
+    int status = tokenize(text, &parser);
+    if (parser.tokens == NULL) {
+        return -1;
+    }
+
+    // SELECT list
+    if (status == 0) {
+        status = expect(&parser, "SELECT");
+    }
+    // APPROX, unless it is a column: SELECT approx FROM ... or SELECT approx, ...
+    if (status == 0 && peek(&parser)->type == TOKEN_WORD && strcasecmp(peek(&parser)->text, "APPROX") == 0 &&
+        parser.tokens[parser.at + 1].type == TOKEN_WORD && strcasecmp(parser.tokens[parser.at + 1].text, "FROM") != 0) {
+        parser.at++;
+        query->approximate = 1;
+    }
+    // DISTINCT, unless it is a column, as for APPROX
+    if (status == 0 && peek(&parser)->type == TOKEN_WORD && strcasecmp(peek(&parser)->text, "DISTINCT") == 0 &&
+        parser.tokens[parser.at + 1].type == TOKEN_WORD && strcasecmp(parser.tokens[parser.at + 1].text, "FROM") != 0) {
+        parser.at++;
+        query->distinct = 1;
+    }
+    if (status == 0 && !accept(&parser, "*")) {
+        int capacity = 0;
+        do {
+            if (query->num_items == capacity) {
+                capacity = capacity > 0 ? capacity * 2 : 8;
+                query->items = (HtySqlItem*)realloc(query->items, capacity * sizeof(HtySqlItem));
+            }
+            status = parse_item(&parser, &query->items[query->num_items]);
+            query->num_items++;
+        } while (status == 0 && accept(&parser, ","));
+    }
+
+    // FROM file
+    if (status == 0 && (status = expect(&parser, "FROM")) == 0) {
+        query->file = expect_word(&parser, "file");
+        status = query->file != NULL ? 0 : -1;
+    }
+
+    // WHERE condition: comparisons of a column with a number joined by AND become predicates
+    if (status == 0 && accept(&parser, "WHERE")) {
+        HtyExpr* where = parse_expression(&parser);
+        status = where != NULL ? add_conditions(query, where) : -1;
+    }
+
+    // GROUP BY column
+    if (status == 0 && accept(&parser, "GROUP")) {
+        if ((status = expect(&parser, "BY")) == 0) {
+            query->group_by = expect_word(&parser, "column");
+            status = query->group_by != NULL ? 0 : -1;
+        }
+    }
+
+    // ORDER BY column [ASC|DESC]; aggregates are named like the SELECT list names them
+    if (status == 0 && accept(&parser, "ORDER")) {
+        HtySqlItem order = {0};
+        if ((status = expect(&parser, "BY")) == 0 && (status = parse_item(&parser, &order)) == 0) {
+            query->order_by = order.name;
+            order.name = NULL;
+            if (accept(&parser, "DESC")) {
+                query->descending = 1;
+            } else {
+                accept(&parser, "ASC");
+            }
+        }
+        free_item(&order);
+    }
+
+    // LIMIT n
+    if (status == 0 && accept(&parser, "LIMIT")) {
+        char* end = NULL;
+        Token* token = peek(&parser);
+        if (token->type == TOKEN_WORD) {
+            query->limit = (int)strtol(token->text, &end, 10);
+            parser.at++;
+        }
+        if (end == NULL || *end != '\0' || query->limit < 0) {
+            fprintf(stderr, "Invalid LIMIT\n");
+            status = -1;
+        }
+    }
+
+    accept(&parser, ";");
+    if (status == 0 && peek(&parser)->type != TOKEN_END) {
+        fprintf(stderr, "Unexpected '%s' at end of statement\n", peek(&parser)->text);
+        status = -1;
+    }
+    free_tokens(&parser);
+    if (status != 0) {
+        free_sql_query(query);
+    }
+    return status;
+}
+
+/**
+ * @brief Function to add a column to the list of columns to fetch, once
+ *
+ * @param names - columns to fetch
+ * @param count - number of columns to fetch
+ * @param name - column to add
+ * @return int - position of the column in the list
+ */
+static int add_fetched_column(char** names, int* count, char* name) {
+    for (int i = 0; i < *count; i++) {
+        if (strcmp(names[i], name) == 0) {
+            return i;
+        }
+    }
+    names[*count] = name;
+    return (*count)++;
+}
+
+/**
+ * @brief Function to compare two sort keys for qsort
+ *
+ * @param a - first key
+ * @param b - second key
+ * @return int - negative, zero or positive
+ */
+static int compare_keys(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Function to sort row numbers by a column, keeping the original order of ties
+ *
+ * @param arena - arena for the sort keys
+ * @param values - column the rows index into
+ * @param is_float - 1 if the column is float
+ * @param rows - row numbers to sort in place
+ * @param count - number of row numbers
+ * @param descending - 1 for descending order
+ * @return int - 0 on success, -1 on failure
+ */
+static int sort_rows(HtyArena* arena, const int* values, int is_float, int* rows, int count, int descending) {
+    uint64_t* keys = (uint64_t*)arena_alloc(arena, (count + 1) * sizeof(uint64_t));
+    int* sorted = (int*)arena_alloc(arena, (count + 1) * sizeof(int));
+    if (keys == NULL || sorted == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        uint32_t key = encode_sort_value(values[rows[i]], is_float);
+        keys[i] = ((uint64_t)(descending ? ~key : key) << 32) | (uint32_t)i;
+    }
+    qsort(keys, count, sizeof(uint64_t), compare_keys);
+    for (int i = 0; i < count; i++) {
+        sorted[i] = rows[(uint32_t)keys[i]];
+    }
+    memcpy(rows, sorted, count * sizeof(int));
+    return 0;
+}
+
+/**
+ * @brief Function to sum an int column over a group of rows
+ *
+ * @param values - column the rows index into
+ * @param rows - row numbers of the group
+ * @param count - number of rows in the group
+ * @return int64_t - exact sum (2^31 rows of 2^31 cannot overflow it)
+ */
+static int64_t sum_int_rows(const int* values, const int* rows, int count) {
+    int64_t sum = 0;
+    for (int i = 0; i < count; i++) {
+        sum += values[rows[i]];
+    }
+    return sum;
+}
+
+/**
+ * @brief Function to compute one aggregate over a group of rows
+ *
+ * @param aggregate - AGG_* function
+ * @param values - column to aggregate (NULL for COUNT(*))
+ * @param is_float - 1 if the column is float
+ * @param rows - row numbers of the group
+ * @param count - number of rows in the group
+ * @return int - aggregate (float bits for AVG, float SUM and float MIN/MAX); SUM of an int column is sum_int_rows()
+ */
+static int compute_aggregate(int aggregate, const int* values, int is_float, const int* rows, int count) {
+    if (aggregate == AGG_COUNT) {
+        return count;
+    }
+    if (aggregate == AGG_MIN || aggregate == AGG_MAX) {
+        if (count == 0) {
+            return 0;
+        }
+        int best = values[rows[0]];
+        for (int i = 1; i < count; i++) {
+            uint32_t key = encode_sort_value(values[rows[i]], is_float);
+            uint32_t best_key = encode_sort_value(best, is_float);
+            if (aggregate == AGG_MIN ? key < best_key : key > best_key) {
+                best = values[rows[i]];
+            }
+        }
+        return best;
+    }
+    double sum = 0;
+    if (!is_float) {
+        sum = (double)sum_int_rows(values, rows, count);
+    } else {
+        for (int i = 0; i < count; i++) {
+            float number;
+            memcpy(&number, &values[rows[i]], sizeof(float));
+            sum += number;
+        }
+    }
+    float result = (float)(aggregate == AGG_AVG ? (count > 0 ? sum / count : 0) : sum);
+    int value;
+    memcpy(&value, &result, sizeof(float));  // Store float bits as int
+    return value;
+}
+
+/**
+ * @brief Function to count the distinct values of a group of rows
+ *
+ * @param arena - arena for the sorted values
+ * @param values - column the rows index into
+ * @param is_float - 1 if the column is float
+ * @param rows - row numbers of the group
+ * @param count - number of rows in the group
+ * @param singletons - pointer to store the number of values held by one row only, or NULL
+ * @return int - distinct values, -1 on failure
+ */
+static int count_distinct(HtyArena* arena, const int* values, int is_float, const int* rows, int count, int* singletons) {
+    uint64_t* keys = (uint64_t*)arena_alloc(arena, (count + 1) * sizeof(uint64_t));
+    if (keys == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        int value = values[rows[i]];
+        if (is_float && (value & 0x7fffffff) == 0) {
+            value = 0; // -0.0 == 0.0
+        }
+        keys[i] = encode_sort_value(value, is_float);
+    }
+    qsort(keys, count, sizeof(uint64_t), compare_keys);
+    int distinct = 0, once = 0;
+    for (int start = 0, end; start < count; start = end) {
+        for (end = start + 1; end < count && keys[end] == keys[start]; end++) {
+        }
+        distinct++;
+        once += end - start == 1;
+    }
+    if (singletons != NULL) {
+        *singletons = once;
+    }
+    return distinct;
+}
+
+/**
+ * @brief Function to estimate one aggregate over a group of sampled rows
+ *
+ * @param arena - arena for intermediates
+ * @param sample - row sample the rows index into
+ * @param aggregate - AGG_* function (not MIN or MAX)
+ * @param values - sampled column to aggregate (NULL for COUNT(*))
+ * @param is_float - 1 if the column is float
+ * @param rows - sampled rows of the group
+ * @param count - number of sampled rows in the group
+ * @param column_stats - statistics of the aggregated column, for COUNT(DISTINCT)
+ * @param value - pointer to store the estimate (float bits for SUM and AVG)
+ * @param error - pointer to store its error bound
+ * @return int - 0 on success, -1 on failure
+ */
+static int estimate_aggregate(HtyArena* arena, const HtyRowSample* sample, int aggregate, const int* values,
+                              int is_float, const int* rows, int count, const HtyColumnStats* column_stats,
+                              int* value, double* error) {
+    if (aggregate == AGG_COUNT) {
+        *value = (int)(estimate_count(sample, count, error) + 0.5);
+    } else if (aggregate == AGG_COUNT_DISTINCT) {
+        int singletons;
+        int distinct = count_distinct(arena, values, is_float, rows, count, &singletons);
+        if (distinct < 0) {
+            return -1;
+        }
+        // The column count is itself a sketch estimate, so allow for its error
+        double column_distinct = column_stats->num_bounds > 0 ?
+                                 column_stats->distinct + sketch_error(column_stats->distinct) : -1;
+        *value = (int)(estimate_distinct(sample, count, distinct, singletons, column_distinct, error) + 0.5);
+    } else {
+        float result = (float)(aggregate == AGG_SUM ? estimate_sum(sample, values, is_float, rows, count, error) :
+                                                      estimate_average(sample, values, is_float, rows, count, error));
+        memcpy(value, &result, sizeof(float));  // Store float bits as int
+    }
+    return 0;
+}
+
+/**
+ * @brief Function to allocate the output columns of a result
+ *
+ * @param result - result with num_columns set
+ * @param rows - rows each column must hold
+ * @return int - 0 on success, -1 on failure
+ */
+static int allocate_output(HtySqlResult* result, int rows) {
+    result->columns = (int**)calloc(result->num_columns + 1, sizeof(int*));
+    if (result->columns == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    for (int i = 0; i < result->num_columns; i++) {
+        result->columns[i] = (int*)malloc((rows + 1) * sizeof(int));
+        if (result->columns[i] == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Function to expand SELECT * and type the WHERE values once the file is known
+ *
+ * @param metadata - metadata object
+ * @param query - parsed statement
+ * @return int - 0 on success, -1 on an unknown column or invalid value
+ */
+static int bind_query(cJSON* metadata, HtySqlQuery* query) {
+    if (query->num_items == 0) {
+        cJSON* group = cJSON_GetArrayItem(cJSON_GetObjectItemCaseSensitive(metadata, "groups"), 0);  // Assuming single group
+        cJSON* columns = cJSON_GetObjectItemCaseSensitive(group, "columns");
+        query->num_items = cJSON_GetArraySize(columns);
+        query->items = (HtySqlItem*)calloc(query->num_items + 1, sizeof(HtySqlItem));
+        for (int i = 0; i < query->num_items; i++) {
+            const char* name = cJSON_GetObjectItemCaseSensitive(cJSON_GetArrayItem(columns, i), "column_name")->valuestring;
+            query->items[i].column = strdup(name);
+            query->items[i].name = strdup(name);
+        }
+    }
+    for (int i = 0; i < query->num_conditions; i++) {
+        if (query->condition_text[i] == NULL) {
+            continue;  // Already typed
+        }
+        char* column_name = (char*)query->conditions[i].column;
+        int column_index, is_float;
+        if (resolve_columns(metadata, &column_name, 1, &column_index, &is_float) != 0) {
+            return -1;
+        }
+        char* end;
+        if (is_float) {
+            float value = strtof(query->condition_text[i], &end);
+            memcpy(&query->conditions[i].value, &value, sizeof(float));  // Store float bits as int for comparison
+        } else {
+            query->conditions[i].value = (int)strtol(query->condition_text[i], &end, 10);
+        }
+        if (*end != '\0' || end == query->condition_text[i]) {
+            fprintf(stderr, "Invalid value for %s: %s\n", column_name, query->condition_text[i]);
+            return -1;
+        }
+        free(query->condition_text[i]);
+        query->condition_text[i] = NULL;
+    }
+    return 0;
+}
+
+/**
+ * @brief Function to order the WHERE predicates by their estimated matches
+ *
+ * The first predicate drives the scan (or the index) and the others are
+ * checked in memory in order, so the most selective one goes first and
+ * the rest short-circuit as early as possible. Predicates without
+ * statistics keep their place behind the estimated ones.
+ *
+ * @param table - table handle
+ * @param query - bound statement
+ */
+static void order_conditions(HtyTable* table, HtySqlQuery* query) {
+    long estimates[SQL_MAX_CONDITIONS];
+    for (int i = 0; i < query->num_conditions; i++) {
+        estimates[i] = table_estimate_rows(table, query->conditions[i].column, query->conditions[i].op,
+                                           query->conditions[i].value);
+        estimates[i] = estimates[i] < 0 ? LONG_MAX : estimates[i];
+    }
+    // Stable insertion sort, there are only a handful of predicates
+    for (int i = 1; i < query->num_conditions; i++) {
+        HtyPredicate condition = query->conditions[i];
+        long estimate = estimates[i];
+        int j = i;
+        for (; j > 0 && estimates[j - 1] > estimate; j--) {
+            query->conditions[j] = query->conditions[j - 1];
+            estimates[j] = estimates[j - 1];
+        }
+        query->conditions[j] = condition;
+        estimates[j] = estimate;
+    }
+}
+
+/**
+ * @brief Function to run SELECT DISTINCT column or a lone COUNT(DISTINCT column) with the distinct operator
+ *
+ * @param query - bound statement
+ * @param result - zeroed result to fill in
+ * @return int - 0 on success, -1 on failure
+ */
+static int run_distinct(HtySqlQuery* query, HtySqlResult* result) {
+    const HtySqlItem* item = &query->items[0];
+    if (query->num_items != 1 || item->column == NULL || item->aggregate != (query->distinct ? AGG_NONE : AGG_COUNT_DISTINCT) ||
+        query->group_by != NULL || query->num_filters > 0 || query->approximate) {
+        fprintf(stderr, "SELECT DISTINCT takes one column, no GROUP BY and WHERE conditions of the form column op number\n");
+        return -1;
+    }
+    if (query->order_by != NULL && strcmp(query->order_by, item->name) != 0) {
+        fprintf(stderr, "ORDER BY %s must name a selected column\n", query->order_by);
+        return -1;
+    }
+    char* column_name = item->column;
+    int column_index, is_float;
+    if (resolve_columns(sql_table->metadata, &column_name, 1, &column_index, &is_float) != 0) {
+        return -1;
+    }
+    result->plan = "distinct";
+    result->num_columns = 1;
+    result->column_names = (char**)calloc(2, sizeof(char*));
+    result->column_types = (int*)calloc(2, sizeof(int));
+    result->columns = (int**)calloc(2, sizeof(int*));
+    if (result->column_names == NULL || result->column_types == NULL || result->columns == NULL ||
+        (result->column_names[0] = strdup(item->name)) == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free_sql_result(result);
+        return -1;
+    }
+
+    if (item->aggregate == AGG_COUNT_DISTINCT) {
+        int distinct = count_distinct_values(sql_table->metadata, query->file, item->column, query->conditions,
+                                             query->num_conditions);
+        result->columns[0] = (int*)malloc(2 * sizeof(int));
+        if (distinct < 0 || result->columns[0] == NULL) {
+            free_sql_result(result);
+            return -1;
+        }
+        result->columns[0][0] = distinct;
+        result->row_count = 1;
+        return 0;
+    }
+
+    // Values come back in ascending order
+    int count;
+    int* values = distinct_values(sql_table->metadata, query->file, item->column, query->conditions,
+                                  query->num_conditions, &count);
+    if (values == NULL) {
+        free_sql_result(result);
+        return -1;
+    }
+    if (query->order_by != NULL && query->descending) {
+        for (int i = 0, j = count - 1; i < j; i++, j--) {
+            int value = values[i];
+            values[i] = values[j];
+            values[j] = value;
+        }
+    }
+    result->columns[0] = values;
+    result->column_types[0] = is_float;
+    result->row_count = query->limit >= 0 && count > query->limit ? query->limit : count;
+    return 0;
+}
+
+/**
+ * @brief Function to find the values of a condition that is a list of equalities on one column
+ *
+ * Matches column IN (...), which the parser turns into column = a OR
+ * column = b ..., and the same written out by hand.
+ *
+ * @param expr - condition, before bind_expr()
+ * @param column - column the equalities must be on
+ * @param is_float - 1 if the column is float
+ * @param values - pointer to store the values (float bits for a float column), room for count_expr_columns(expr)
+ * @param count - pointer to the number of values stored so far
+ * @return int - 1 if the condition is such a list, 0 otherwise
+ */
+static int in_list_values(const HtyExpr* expr, const char* column, int is_float, int* values, int* count) {
+    if (expr->kind == EXPR_OR) {
+        return in_list_values(expr->args[0], column, is_float, values, count) &&
+               in_list_values(expr->args[1], column, is_float, values, count);
+    }
+    if (expr->kind != EXPR_COMPARE || expr->op != OP_EQUAL) {
+        return 0;
+    }
+    int swapped = expr->args[0]->kind == EXPR_CONSTANT;
+    const HtyExpr* reference = expr->args[swapped];
+    const HtyExpr* constant = expr->args[!swapped];
+    if (reference->kind != EXPR_COLUMN || constant->kind != EXPR_CONSTANT || strcmp(reference->name, column) != 0 ||
+        (constant->type && !is_float)) {
+        return 0; // An int column meeting a float is compared as float, which filter_in() does not do
+    }
+    int value = constant->value;
+    if (is_float && !constant->type) {
+        float real = (float)value;
+        memcpy(&value, &real, sizeof(float));  // Store float bits as int
+    }
+    values[(*count)++] = value;
+    return 1;
+}
+
+/**
+ * @brief Function to run a statement on the table of the current query, or on a dataset
+ *
+ * @param query - parsed statement
+ * @param result - zeroed result to fill in
+ * @param dataset - dataset named by FROM, NULL to run on the table
+ * @return int - 0 on success, -1 on failure
+ */
+static int run_table_sql(HtySqlQuery* query, HtySqlResult* result, HtyDataset* dataset) {
+    cJSON* metadata = dataset != NULL ? dataset->metadata : sql_table->metadata;
+    HtyArena* arena = dataset != NULL ? dataset_arena : sql_table->arena;
+    if (bind_query(metadata, query) != 0) {
+        return -1;
+    }
+    if (dataset == NULL) {
+        order_conditions(sql_table, query);
+    }
+
+    // SELECT DISTINCT, and COUNT(DISTINCT column) on its own, go to the distinct operator
+    const HtySqlItem* first_item = &query->items[0];
+    if (dataset == NULL && (query->distinct || (query->num_items == 1 && first_item->aggregate == AGG_COUNT_DISTINCT &&
+                                                first_item->column != NULL && query->group_by == NULL &&
+                                                query->num_filters == 0 && !query->approximate))) {
+        return run_distinct(query, result);
+    }
+    if (query->distinct) {
+        // A dataset has no distinct operator: its distinct values are the groups of the column
+        if (query->num_items != 1 || first_item->column == NULL || first_item->aggregate != AGG_NONE ||
+            query->group_by != NULL) {
+            fprintf(stderr, "SELECT DISTINCT takes one column and no GROUP BY\n");
+            return -1;
+        }
+        query->group_by = strdup(first_item->column);
+        query->distinct = 0;
+        if (query->group_by == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            return -1;
+        }
+    }
+
+    // Check the SELECT list: with aggregates, plain columns must be the GROUP BY column
+    int grouped = query->group_by != NULL;
+    for (int i = 0; i < query->num_items; i++) {
+        grouped |= query->items[i].aggregate != AGG_NONE;
+    }
+    for (int i = 0; i < query->num_items && grouped; i++) {
+        const HtySqlItem* item = &query->items[i];
+        if (item->aggregate == AGG_NONE &&
+            (item->column == NULL || query->group_by == NULL || strcmp(item->column, query->group_by) != 0)) {
+            fprintf(stderr, "Column %s must appear in GROUP BY or in an aggregate\n", item->column != NULL ? item->column : item->name);
+            return -1;
+        }
+    }
+
+    // APPROX: aggregates from the row sample, each followed by its error bound
+    const HtyRowSample* sample = NULL;
+    if (query->approximate) {
+        for (int i = 0; i < query->num_items; i++) {
+            if (query->items[i].aggregate == AGG_MIN || query->items[i].aggregate == AGG_MAX) {
+                fprintf(stderr, "%s cannot be estimated from a sample, run it without APPROX\n", query->items[i].name);
+                return -1;
+            }
+        }
+        if (!grouped) {
+            fprintf(stderr, "APPROX needs aggregates\n");
+            return -1;
+        }
+        sample = dataset == NULL ? table_row_sample(sql_table) : NULL;
+        if (sample == NULL) {
+            fprintf(stderr, "%s has no row sample, answering exactly\n", query->file);
+        }
+    }
+    int first_condition = sample != NULL ? 0 : 1;  // The sample is filtered in memory, the scan does the first otherwise
+
+    // Columns to fetch: the SELECT list, the group, the ORDER BY column, the conditions the scan leaves over
+    // and the columns the expressions read; computed items get a column of their own after the fetched ones
+    int max_fetched = query->num_items + query->num_conditions + 2;
+    for (int i = 0; i < query->num_items; i++) {
+        max_fetched += query->items[i].expr != NULL ? count_expr_columns(query->items[i].expr) : 0;
+    }
+    for (int i = 0; i < query->num_filters; i++) {
+        max_fetched += count_expr_columns(query->filters[i]);
+    }
+    char** fetched = (char**)arena_alloc(arena, max_fetched * sizeof(char*));
+    int* fetched_indices = (int*)arena_alloc(arena, max_fetched * sizeof(int));
+    int* fetched_types = (int*)arena_alloc(arena, (max_fetched + query->num_items) * sizeof(int));
+    int* item_position = (int*)arena_alloc(arena, (query->num_items + 1) * sizeof(int));
+    int* condition_position = (int*)arena_alloc(arena, (query->num_conditions + 1) * sizeof(int));
+    if (!fetched || !fetched_indices || !fetched_types || !item_position || !condition_position) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    int num_fetched = 0, group_position = -1, order_position = -1;
+    for (int i = 0; i < query->num_items; i++) {
+        item_position[i] = query->items[i].column != NULL ? add_fetched_column(fetched, &num_fetched, query->items[i].column) : -1;
+    }
+    if (query->group_by != NULL) {
+        group_position = add_fetched_column(fetched, &num_fetched, query->group_by);
+    }
+    int order_item = -1;
+    for (int i = 0; i < query->num_items && query->order_by != NULL; i++) {
+        if (strcmp(query->items[i].name, query->order_by) == 0) {
+            order_item = i;
+            break;
+        }
+    }
+    if (query->order_by != NULL && order_item == -1) {
+        if (grouped) {
+            fprintf(stderr, "ORDER BY %s must name a selected column\n", query->order_by);
+            num_fetched = -1;
+        } else {
+            order_position = add_fetched_column(fetched, &num_fetched, query->order_by);
+        }
+    }
+    for (int i = first_condition; i < query->num_conditions && num_fetched >= 0; i++) {
+        condition_position[i] = add_fetched_column(fetched, &num_fetched, (char*)query->conditions[i].column);
+    }
+    for (int i = 0; i < query->num_items && num_fetched >= 0; i++) {
+        if (query->items[i].expr != NULL) {
+            collect_expr_columns(query->items[i].expr, fetched, &num_fetched);
+        }
+    }
+    for (int i = 0; i < query->num_filters && num_fetched >= 0; i++) {
+        collect_expr_columns(query->filters[i], fetched, &num_fetched);
+    }
+    int status = num_fetched >= 0 ? resolve_columns(metadata, fetched, num_fetched, fetched_indices, fetched_types) : -1;
+
+    // Compile the expressions for the fetched columns; computed items are numbered after them
+    int num_columns = num_fetched;
+    for (int i = 0; i < query->num_items && status == 0; i++) {
+        if (query->items[i].expr != NULL) {
+            status = bind_expr(query->items[i].expr, fetched, fetched_types, num_fetched);
+            item_position[i] = num_columns;
+            fetched_types[num_columns++] = query->items[i].expr->type;
+        }
+    }
+    // A WHERE that is only column IN (...), on the one column read, is answered by filter_in()
+    int* in_values = NULL;
+    int num_in_values = 0;
+    if (status == 0 && dataset == NULL && sample == NULL && query->num_conditions == 0 && query->num_filters == 1 &&
+        num_fetched == 1) {
+        in_values = (int*)arena_alloc(arena, (count_expr_columns(query->filters[0]) + 1) * sizeof(int));
+        if (in_values != NULL && !in_list_values(query->filters[0], fetched[0], fetched_types[0], in_values, &num_in_values)) {
+            in_values = NULL;
+        }
+    }
+    int first_filter = in_values != NULL ? 1 : 0; // filter_in() already applied the list
+    for (int i = 0; i < query->num_filters && status == 0; i++) {
+        status = bind_expr(query->filters[i], fetched, fetched_types, num_fetched);
+    }
+    int order_computed = order_item >= 0 && query->items[order_item].expr != NULL;
+
+    // Scan: top_k for a bare ORDER BY ... LIMIT, otherwise project or project_and_filter into the table arena
+    int** data = NULL;
+    int data_in_arena = 0;
+    int row_count = -1;
+    if (status == 0 && sample != NULL) {
+        result->plan = "sample";
+        data = (int**)arena_alloc(arena, (num_fetched + 1) * sizeof(int*));
+        for (int i = 0; i < num_fetched && data != NULL; i++) {
+            data[i] = sample->columns[fetched_indices[i]];
+        }
+        row_count = data != NULL ? sample->sample_rows : -1;
+        data_in_arena = 1;
+    } else if (status == 0 && dataset == NULL && !grouped && query->num_conditions == 0 && query->num_filters == 0 &&
+               query->order_by != NULL && !order_computed && query->limit > 0) {
+        result->plan = "top_k";
+        const char* order_column = order_item >= 0 ? query->items[order_item].column : query->order_by;
+        data = top_k(metadata, query->file, order_column, query->descending, query->limit, fetched, num_fetched, &row_count);
+    } else if (status == 0 && in_values != NULL) {
+        result->plan = "filter_in";
+        data = (int**)calloc(2, sizeof(int*));
+        if (data != NULL) {
+            data[0] = filter_in(metadata, query->file, fetched[0], in_values, num_in_values, &row_count);
+        }
+    } else if (status == 0 && dataset != NULL && query->num_conditions == 0) {
+        result->plan = "dataset_project";
+        data = dataset_project(dataset, fetched, num_fetched, &row_count);
+    } else if (status == 0 && dataset != NULL) {
+        result->plan = "dataset_project_and_filter";
+        data = dataset_project_and_filter(dataset, fetched, num_fetched, query->conditions[0].column,
+                                          query->conditions[0].op, query->conditions[0].value, &row_count);
+    } else if (status == 0 && query->num_conditions == 0) {
+        result->plan = "project";
+        data = table_project(sql_table, fetched, num_fetched, &row_count);
+        data_in_arena = 1;
+    } else if (status == 0) {
+        result->plan = "project_and_filter";  // row_count is left at -1 on failure; no match gives NULL and 0 rows
+        data = table_project_and_filter(sql_table, fetched, num_fetched, query->conditions[0].column,
+                                        query->conditions[0].op, query->conditions[0].value, &row_count);
+        data_in_arena = 1;
+    }
+    if (status == 0 && (row_count < 0 || (data == NULL && row_count > 0))) {
+        status = -1;
+    }
+    if (row_count < 0) {
+        row_count = 0;
+    }
+
+    // Remaining conditions, evaluated in memory on the fetched rows a batch at a time: first the
+    // predicates, then each other condition on the rows still left
+    int* rows = (int*)arena_alloc(arena, (row_count + 1) * sizeof(int));
+    int num_rows = 0;
+    if (rows == NULL) {
+        status = -1;
+    }
+    for (int start = 0; start < row_count && status == 0; start += HTY_EXPR_BATCH) {
+        int end = start + HTY_EXPR_BATCH < row_count ? start + HTY_EXPR_BATCH : row_count;
+        int first_row = num_rows;
+        for (int r = start; r < end; r++) {
+            int match = 1;
+            for (int i = first_condition; i < query->num_conditions && match; i++) {
+                int position = condition_position[i];
+                match = compare_values(data[position][r], query->conditions[i].value, query->conditions[i].op,
+                                       fetched_types[position]);
+            }
+            rows[num_rows] = r;
+            num_rows += match;
+        }
+        for (int i = first_filter; i < query->num_filters && num_rows > first_row; i++) {
+            const int* values = eval_expr(query->filters[i], data, rows + first_row, num_rows - first_row);
+            num_rows = first_row + select_true_rows(query->filters[i]->type, values, rows + first_row,
+                                                    num_rows - first_row);
+        }
+    }
+
+    // Computed items: evaluated a batch at a time on the rows left, into a column indexed like the fetched ones
+    int** columns = (int**)arena_alloc(arena, (num_columns + 1) * sizeof(int*));
+    if (columns == NULL) {
+        status = -1;
+    }
+    int num_evaluated = num_rows;
+    if (!grouped && query->order_by == NULL && query->limit >= 0 && num_evaluated > query->limit) {
+        num_evaluated = query->limit;  // Only the rows that will be output
+    }
+    for (int i = 0; i < num_columns && status == 0; i++) {
+        columns[i] = i < num_fetched && data != NULL ? data[i] : NULL;
+    }
+    for (int i = 0; i < query->num_items && status == 0; i++) {
+        HtyExpr* expr = query->items[i].expr;
+        if (expr == NULL) {
+            continue;
+        }
+        int* column = (int*)arena_alloc(arena, (row_count + 1) * sizeof(int));
+        if (column == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            status = -1;
+            break;
+        }
+        for (int start = 0; start < num_evaluated; start += HTY_EXPR_BATCH) {
+            int count = num_evaluated - start < HTY_EXPR_BATCH ? num_evaluated - start : HTY_EXPR_BATCH;
+            const int* values = eval_expr(expr, data, rows + start, count);
+            for (int r = 0; r < count; r++) {
+                column[rows[start + r]] = values[r];
+            }
+        }
+        columns[item_position[i]] = column;
+    }
+
+    // Output columns: the SELECT list, with APPROX each aggregate followed by its error bound
+    int* output_column = (int*)arena_alloc(arena, (query->num_items + 1) * sizeof(int));
+    int* error_column = (int*)arena_alloc(arena, (query->num_items + 1) * sizeof(int));
+    if (output_column == NULL || error_column == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    for (int i = 0; i < query->num_items; i++) {
+        output_column[i] = result->num_columns++;
+        error_column[i] = query->approximate && query->items[i].aggregate != AGG_NONE ? result->num_columns++ : -1;
+    }
+    result->column_names = (char**)calloc(result->num_columns + 1, sizeof(char*));
+    result->column_types = (int*)calloc(result->num_columns + 1, sizeof(int));
+    for (int i = 0; i < query->num_items && result->column_names != NULL && result->column_types != NULL; i++) {
+        int column = output_column[i];
+        result->column_names[column] = strdup(query->items[i].name);
+        int aggregate = query->items[i].aggregate;
+        // SUM keeps the type of its column, so an int SUM stays exact
+        result->column_types[column] = aggregate == AGG_COUNT || aggregate == AGG_COUNT_DISTINCT ? 0 :
+                                       aggregate == AGG_AVG ? 1 :
+                                       status == 0 ? fetched_types[item_position[i]] : 0;
+        if (error_column[i] >= 0) {
+            result->column_names[error_column[i]] = (char*)malloc(strlen(query->items[i].name) + 5);
+            if (result->column_names[error_column[i]] != NULL) {
+                sprintf(result->column_names[error_column[i]], "%s +/-", query->items[i].name);
+            }
+            result->column_types[error_column[i]] = 1;
+        }
+    }
+    if (result->column_names == NULL || result->column_types == NULL) {
+        status = -1;
+    }
+
+    // COUNT(DISTINCT) of a whole column comes from its sketch rather than the sample
+    double* sketch_values = (double*)arena_alloc(arena, (query->num_items + 1) * sizeof(double));
+    unsigned char* registers = (unsigned char*)arena_alloc(arena, HTY_SKETCH_REGISTERS);
+    if (sketch_values == NULL || registers == NULL) {
+        status = -1;
+    }
+    for (int i = 0; i < query->num_items && status == 0; i++) {
+        sketch_values[i] = -1;
+        if (sample != NULL && query->items[i].aggregate == AGG_COUNT_DISTINCT && query->items[i].expr == NULL &&
+            query->num_conditions == 0 && query->num_filters == 0 && group_position < 0) {
+            int loaded = load_distinct_sketch(metadata, query->file, fetched_indices[item_position[i]], registers);
+            if (loaded < 0) {
+                status = -1;
+            } else if (loaded) {
+                sketch_values[i] = sketch_estimate(registers);
+                result->plan = "sample+sketch";
+            }
+        }
+    }
+
+    if (status == 0 && grouped) {
+        // Order the rows by group, then aggregate each run of equal keys
+        int group_type = group_position >= 0 ? fetched_types[group_position] : 0;
+        if (group_position >= 0) {
+            status = sort_rows(arena, data[group_position], group_type, rows, num_rows, 0);
+        }
+        int max_groups = group_position >= 0 ? num_rows : 1;  // One group, even over no rows, without GROUP BY
+        if (status == 0) {
+            status = allocate_output(result, max_groups);
+        }
+        // SUM of an int column is kept in 64 bits until every group is known
+        int64_t** int_sums = (int64_t**)arena_alloc(arena, (query->num_items + 1) * sizeof(int64_t*));
+        if (int_sums == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            status = -1;
+        }
+        for (int i = 0; i < query->num_items && status == 0; i++) {
+            int position = item_position[i];
+            int_sums[i] = NULL;
+            if (query->items[i].aggregate == AGG_SUM && position >= 0 && !fetched_types[position]) {
+                int_sums[i] = (int64_t*)arena_alloc(arena, (max_groups + 1) * sizeof(int64_t));
+                status = int_sums[i] != NULL ? 0 : -1;
+            }
+        }
+        int start = 0;
+        while (status == 0 && result->row_count < max_groups) {
+            int end = start + 1;
+            if (group_position < 0) {
+                end = num_rows;
+            } else {
+                uint32_t key = encode_sort_value(data[group_position][rows[start]], group_type);
+                while (end < num_rows && encode_sort_value(data[group_position][rows[end]], group_type) == key) {
+                    end++;
+                }
+            }
+            for (int i = 0; i < query->num_items && status == 0; i++) {
+                const HtySqlItem* item = &query->items[i];
+                int position = item_position[i];
+                const int* values = position >= 0 ? columns[position] : NULL;
+                int is_float = position >= 0 ? fetched_types[position] : 0;
+                int value = 0;
+                double error = 0;
+                if (item->aggregate == AGG_NONE) {
+                    value = values[rows[start]];
+                } else if (int_sums[i] != NULL) {
+                    if (sample != NULL) {
+                        double sum = estimate_sum(sample, values, 0, rows + start, end - start, &error);
+                        int_sums[i][result->row_count] = (int64_t)(sum < 0 ? sum - 0.5 : sum + 0.5);
+                    } else {
+                        int_sums[i][result->row_count] = sum_int_rows(values, rows + start, end - start);
+                    }
+                } else if (sketch_values[i] >= 0) {
+                    value = (int)(sketch_values[i] + 0.5);
+                    error = sketch_error(sketch_values[i]);
+                } else if (sample != NULL) {
+                    static const HtyColumnStats no_stats; // Computed values have no statistics
+                    const HtyColumnStats* column_stats = position >= num_fetched ? &no_stats :
+                                                         position >= 0 ? &sql_table->column_stats[fetched_indices[position]] : NULL;
+                    status = estimate_aggregate(arena, sample, item->aggregate, values, is_float, rows + start,
+                                                end - start, column_stats, &value, &error);
+                } else if (item->aggregate == AGG_COUNT_DISTINCT) {
+                    value = count_distinct(arena, values, is_float, rows + start, end - start, NULL);
+                    status = value < 0 ? -1 : 0;
+                } else {
+                    value = compute_aggregate(item->aggregate, values, is_float, rows + start, end - start);
+                }
+                result->columns[output_column[i]][result->row_count] = value;
+                if (error_column[i] >= 0) {
+                    float bound = (float)error;
+                    memcpy(&result->columns[error_column[i]][result->row_count], &bound, sizeof(float));  // Store float bits as int
+                }
+            }
+            result->row_count++;
+            start = end;
+            if (start >= num_rows && group_position >= 0) {
+                break;
+            }
+        }
+
+        // An int SUM stays an exact int when every group fits, otherwise the column becomes float
+        for (int i = 0; i < query->num_items && status == 0; i++) {
+            if (int_sums[i] == NULL) {
+                continue;
+            }
+            int fits = 1;
+            for (int r = 0; r < result->row_count; r++) {
+                fits &= int_sums[i][r] >= INT_MIN && int_sums[i][r] <= INT_MAX;
+            }
+            int* column = result->columns[output_column[i]];
+            result->column_types[output_column[i]] = fits ? 0 : 1;
+            for (int r = 0; r < result->row_count; r++) {
+                if (fits) {
+                    column[r] = (int)int_sums[i][r];
+                } else {
+                    float sum = (float)int_sums[i][r];
+                    memcpy(&column[r], &sum, sizeof(float));  // Store float bits as int
+                }
+            }
+        }
+
+        // ORDER BY over the groups
+        if (status == 0 && order_item >= 0) {
+            int* order = (int*)arena_alloc(arena, (result->row_count + 1) * sizeof(int));
+            int* column = (int*)arena_alloc(arena, (result->row_count + 1) * sizeof(int));
+            status = order != NULL && column != NULL ? 0 : -1;
+            for (int r = 0; r < result->row_count && status == 0; r++) {
+                order[r] = r;
+            }
+            if (status == 0) {
+                status = sort_rows(arena, result->columns[output_column[order_item]],
+                                   result->column_types[output_column[order_item]], order, result->row_count,
+                                   query->descending);
+            }
+            for (int i = 0; i < result->num_columns && status == 0; i++) {
+                for (int r = 0; r < result->row_count; r++) {
+                    column[r] = result->columns[i][order[r]];
+                }
+                memcpy(result->columns[i], column, result->row_count * sizeof(int));
+            }
+        }
+    } else if (status == 0) {
+        // ORDER BY over the rows (top_k already returned them in order), then copy out the selected columns
+        if (order_position < 0 && order_item >= 0) {
+            order_position = item_position[order_item];
+        }
+        if (order_position >= 0 && strcmp(result->plan, "top_k") != 0) {
+            status = sort_rows(arena, columns[order_position], fetched_types[order_position], rows, num_rows,
+                               query->descending);
+        }
+        if (query->limit >= 0 && num_rows > query->limit) {
+            num_rows = query->limit;
+        }
+        if (status == 0) {
+            status = allocate_output(result, num_rows);
+        }
+        for (int i = 0; i < query->num_items && status == 0; i++) {
+            for (int r = 0; r < num_rows; r++) {
+                result->columns[output_column[i]][r] = columns[item_position[i]][rows[r]];
+            }
+        }
+        result->row_count = num_rows;
+    }
+    if (status == 0 && grouped && query->limit >= 0 && result->row_count > query->limit) {
+        result->row_count = query->limit;
+    }
+
+    if (data != NULL && !data_in_arena) {
+        for (int i = 0; i < num_fetched; i++) {
+            free(data[i]);
+        }
+        free(data);
+    }
+    if (status != 0) {
+        free_sql_result(result);
+    }
+    return status;
+}
+
+/**
+ * @brief Function to run a statement on the dataset of the directory named by FROM
+ *
+ * @param query - parsed statement
+ * @param result - zeroed result to fill in
+ * @return int - 0 on success, -1 on failure
+ */
+static int run_dataset_sql(HtySqlQuery* query, HtySqlResult* result) {
+    if (dataset_arena == NULL) {
+        dataset_arena = create_arena(0);
+    } else {
+        reset_arena(dataset_arena);
+    }
+    HtyDataset* dataset = dataset_arena != NULL ? open_dataset(query->file) : NULL;
+    if (dataset == NULL) {
+        return -1;
+    }
+    int status = run_table_sql(query, result, dataset);
+    close_dataset(dataset);
+    return status;
+}
+
+int run_sql(HtySqlQuery* query, HtySqlResult* result) {
+    memset(result, 0, sizeof(HtySqlResult));
+
+    // FROM a directory: every .hty file below it, read as one dataset
+    struct stat info;
+    if (stat(query->file, &info) == 0 && S_ISDIR(info.st_mode)) {
+        return run_dataset_sql(query, result);
+    }
+
+    // Statements on the same file share the table handle: metadata is read once and memory is reused
+    if (sql_table != NULL && (strcmp(sql_table->path, query->file) != 0 || begin_table_query(sql_table) != 0)) {
+        close_sql_table();
+    }
+    if (sql_table == NULL) {
+        sql_table = open_table(query->file);
+    }
+    if (sql_table == NULL) {
+        return -1;
+    }
+    int status = run_table_sql(query, result, NULL);
+    end_table_query(sql_table); // The statement read one version of the file; let writers go on
+    return status;
+}
+
+void close_sql_table(void) {
+    close_table(sql_table);
+    sql_table = NULL;
+    free_arena(dataset_arena);
+    dataset_arena = NULL;
+}
+
+void free_sql_query(HtySqlQuery* query) {
+    for (int i = 0; i < query->num_items; i++) {
+        free_item(&query->items[i]);
+    }
+    free(query->items);
+    for (int i = 0; i < query->num_conditions; i++) {
+        free((char*)query->conditions[i].column);
+        free(query->condition_text[i]);
+    }
+    for (int i = 0; i < query->num_filters; i++) {
+        free_expr(query->filters[i]);
+    }
+    free(query->file);
+    free(query->group_by);
+    free(query->order_by);
+    memset(query, 0, sizeof(HtySqlQuery));
+}
+
+void free_sql_result(HtySqlResult* result) {
+    if (result->column_names != NULL) {
+        for (int i = 0; i < result->num_columns; i++) {
+            free(result->column_names[i]);
+        }
+    }
+    if (result->columns != NULL) {
+        for (int i = 0; i < result->num_columns; i++) {
+            free(result->columns[i]);
+        }
+    }
+    free(result->column_names);
+    free(result->column_types);
+    free(result->columns);
+    memset(result, 0, sizeof(HtySqlResult));
+}
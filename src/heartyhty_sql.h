@@ -0,0 +1,150 @@
+/**
+ * @file heartyhty_sql.h
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Header file for the mini-SQL front end (SELECT ... FROM ... WHERE ... GROUP BY ... ORDER BY ... LIMIT)
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef HEARTYHTY_SQL_H
+#define HEARTYHTY_SQL_H
+
+#define SQL_MAX_CONDITIONS 16 // Predicates joined with AND in one WHERE clause
+
+struct HtyExpr; // See heartyhty_expr.h
+
+#define AGG_NONE 0  // Plain column
+#define AGG_COUNT 1 // COUNT(column) or COUNT(*)
+#define AGG_SUM 2   // SUM(column), exact int for an int column whose sums fit, float otherwise
+#define AGG_MIN 3   // MIN(column)
+#define AGG_MAX 4   // MAX(column)
+#define AGG_AVG 5   // AVG(column), float result
+#define AGG_COUNT_DISTINCT 6 // COUNT(DISTINCT column)
+
+/**
+ * @brief One item of the SELECT list
+ */
+typedef struct {
+    int aggregate;          // AGG_* function, AGG_NONE for a plain column or expression
+    char* column;           // Column name, NULL for COUNT(*) and expressions
+    struct HtyExpr* expr;   // Computed value (the argument of an aggregate), NULL for a column
+    char* name;             // Output column name, e.g. "salary", "sum(salary)", "salary * 1.1" or the AS name
+} HtySqlItem;
+
+/**
+ * @brief Parsed statement
+ */
+typedef struct {
+    char* file;                 // Path after FROM
+    HtySqlItem* items;          // SELECT list (expanded later for SELECT *)
+    int num_items;              // Number of items, 0 for SELECT *
+    HtyPredicate conditions[SQL_MAX_CONDITIONS];  // WHERE predicates of the form column op number, all must hold
+    char* condition_text[SQL_MAX_CONDITIONS];     // Value text of each predicate, typed once the file is known
+    int num_conditions;         // Number of predicates
+    struct HtyExpr* filters[SQL_MAX_CONDITIONS];  // Other WHERE conditions, evaluated on the fetched rows
+    int num_filters;            // Number of other conditions
+    char* group_by;             // GROUP BY column, NULL for none
+    char* order_by;             // ORDER BY output column, NULL for none
+    int descending;             // 1 for ORDER BY ... DESC
+    int limit;                  // LIMIT, -1 for none
+    int approximate;            // 1 for SELECT APPROX: aggregates estimated from the row sample
+    int distinct;               // 1 for SELECT DISTINCT
+} HtySqlQuery;
+
+/**
+ * @brief Result of a statement
+ */
+typedef struct {
+    char** column_names;  // Name of each output column
+    int* column_types;    // Type of each output column (0 for int, 1 for float)
+    int num_columns;      // Number of output columns
+    int** columns;        // Output columns
+    int row_count;        // Number of rows
+    const char* plan;     // Which operator answered the statement
+} HtySqlResult;
+
+/**
+ * @brief Function to parse a statement
+ *
+ * SELECT [APPROX] [DISTINCT] item, ... FROM file [WHERE condition] [GROUP BY column]
+ * [ORDER BY item [ASC|DESC]] [LIMIT n]. An item is *, an expression or one
+ * of COUNT(*), COUNT(DISTINCT expression), COUNT/SUM/MIN/MAX/AVG(expression),
+ * optionally followed by AS name. Expressions are columns and numbers
+ * combined with + - * / %, comparisons, AND, OR, NOT, parentheses,
+ * CAST(expression AS INT|FLOAT) and CASE WHEN ... THEN ... [ELSE ...] END
+ * (see heartyhty_expr.h); column [NOT] IN (number, ...) is read as the
+ * equalities joined by OR. The parts of the WHERE condition joined by AND
+ * that compare a column with a number can be pushed down to the scan.
+ * Keywords are case-insensitive; the file may be quoted, and may be a
+ * directory of .hty files read as one dataset. Outside the file,
+ * column names holding - + / must be quoted.
+ *
+ * @param text - statement
+ * @param query - query to fill in (free it with free_sql_query)
+ * @return int - 0 on success, -1 on a syntax error
+ */
+int parse_sql(const char* text, HtySqlQuery* query);
+
+/**
+ * @brief Function to run a parsed statement
+ *
+ * Without GROUP BY or aggregates the statement maps to project(),
+ * project_and_filter() or, for ORDER BY ... LIMIT without WHERE, top_k(); a
+ * WHERE that is only column IN (...) on the one column read maps to filter_in().
+ * Further predicates, grouping, ordering and the limit are applied to the
+ * fetched columns in memory. Expressions are compiled once per statement
+ * and evaluated a batch of rows at a time: WHERE conditions on the rows the
+ * predicates leave, computed items only on the rows that pass (and, with a
+ * LIMIT but no ORDER BY, only on the rows output). The table handle of the file is kept for the
+ * next statement (see close_sql_table), so its metadata and memory are reused.
+ * The statement reads one version of the file, even while it is replaced.
+ *
+ * FROM a directory runs the statement on open_dataset() of it: the scan is
+ * dataset_project() or dataset_project_and_filter() on the first condition,
+ * which prunes files by partition value and footer statistics, and the
+ * partition keys are columns after the stored ones. The rest runs in memory
+ * as above; SELECT DISTINCT is grouped by its column, and APPROX is answered
+ * exactly.
+ *
+ * SELECT DISTINCT takes one column and maps to distinct_values(), and a
+ * statement whose only item is COUNT(DISTINCT column) maps to
+ * count_distinct_values(); both check the WHERE predicates in the same
+ * pass. Neither works with GROUP BY or with WHERE conditions other than
+ * column op number.
+ *
+ * SELECT APPROX answers COUNT, COUNT(DISTINCT), SUM and AVG from the row
+ * sample in the footer instead of scanning the file, scaled up to the whole
+ * file. COUNT(DISTINCT) without WHERE or GROUP BY comes from the distinct
+ * value sketch of the column. Each aggregate is followed by a float column
+ * named like "sum(salary) +/-" holding its 95% error bound. Groups missing
+ * from the sample are missing from the result. Files without a row sample
+ * are answered exactly, with bounds of 0.
+ *
+ * @param query - parsed statement
+ * @param result - result to fill in (free it with free_sql_result)
+ * @return int - 0 on success, -1 on failure
+ */
+int run_sql(HtySqlQuery* query, HtySqlResult* result);
+
+/**
+ * @brief Function to close the table handle kept from the last statement
+ */
+void close_sql_table(void);
+
+/**
+ * @brief Function to free a parsed statement
+ *
+ * @param query - statement to free (the struct itself is not freed)
+ */
+void free_sql_query(HtySqlQuery* query);
+
+/**
+ * @brief Function to free a result
+ *
+ * @param result - result to free (the struct itself is not freed)
+ */
+void free_sql_result(HtySqlResult* result);
+
+#endif // HEARTYHTY_SQL_H
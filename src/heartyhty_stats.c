@@ -0,0 +1,393 @@
+/**
+ * @file heartyhty_stats.c
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Query instrumentation: per-stage timers, I/O and row counters, hardware counters, Chrome trace output
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#define _GNU_SOURCE // syscall
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+#include "heartyhty_stats.h"
+
+int hty_stats_enabled = 0;
+HtyQueryStats hty_query_stats;
+
+static const char* stage_names[HTY_NUM_STAGES] = {"metadata", "io", "decode", "filter", "gather", "output"};
+
+static int stats_requested = 0;          // Set by enable_query_stats()
+static FILE* trace_file = NULL;          // Open trace, NULL when not tracing
+static long trace_start_ns = 0;          // Clock at start_query_trace(), time zero of the trace
+static int trace_events = 0;             // Events written so far
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static int profile_enabled = 0;          // Set by enable_query_profile()
+
+static const char* counter_names[HTY_NUM_COUNTERS] = {"cycles", "instructions", "LLC misses", "branch misses",
+                                                      "dTLB misses"};
+
+/**
+ * @brief Hardware counters of one thread, opened as one perf event group
+ */
+typedef struct {
+    int fds[HTY_NUM_COUNTERS];       // Event of each counter, -1 if it could not be opened
+    int position[HTY_NUM_COUNTERS];  // Index of each counter in a group read, -1 if not opened
+    int group_fd;                    // Group leader, -1 if no counter could be opened
+    int available;                   // Bit per opened counter
+} HtyPerfCounters;
+
+static pthread_key_t perf_key;
+static pthread_once_t perf_key_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Function to read a clock in nanoseconds
+ *
+ * @param clock - clock to read
+ * @return long - time in ns
+ */
+static long clock_ns(clockid_t clock) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+/**
+ * @brief Function to close the counters of a thread when it exits
+ *
+ * @param data - HtyPerfCounters of the thread
+ */
+static void close_perf_counters(void* data) {
+    HtyPerfCounters* perf = (HtyPerfCounters*)data;
+    for (int counter = 0; counter < HTY_NUM_COUNTERS; counter++) {
+        if (perf->fds[counter] >= 0) {
+            close(perf->fds[counter]);
+        }
+    }
+    free(perf);
+}
+
+/**
+ * @brief Function to create the key of the per-thread counters
+ */
+static void create_perf_key(void) {
+    pthread_key_create(&perf_key, close_perf_counters);
+}
+
+/**
+ * @brief Function to open one hardware counter of the calling thread
+ *
+ * @param counter - one of the HTY_COUNTER_* counters
+ * @param group_fd - group leader, -1 to open the leader
+ * @return int - event file descriptor, -1 if the counter is not available
+ */
+static int open_perf_counter(int counter, int group_fd) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.disabled = group_fd == -1;
+    switch (counter) {
+        case HTY_COUNTER_CYCLES:
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case HTY_COUNTER_INSTRUCTIONS:
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case HTY_COUNTER_LLC_MISSES:
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+            break;
+        case HTY_COUNTER_BRANCH_MISSES:
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        default:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+    }
+    // pid 0, cpu -1: the calling thread on any CPU
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+/**
+ * @brief Function to get the counters of the calling thread, opening them on first use
+ *
+ * Counters that the kernel refuses (perf_event_paranoid, no PMU in a virtual
+ * machine) are left out; the thread still gets an HtyPerfCounters so the
+ * open is only tried once.
+ *
+ * @return HtyPerfCounters* - counters of the thread, NULL if out of memory
+ */
+static HtyPerfCounters* get_perf_counters(void) {
+    pthread_once(&perf_key_once, create_perf_key);
+    HtyPerfCounters* perf = (HtyPerfCounters*)pthread_getspecific(perf_key);
+    if (perf != NULL) {
+        return perf;
+    }
+    perf = (HtyPerfCounters*)malloc(sizeof(HtyPerfCounters));
+    if (perf == NULL) {
+        return NULL;
+    }
+    perf->group_fd = -1;
+    perf->available = 0;
+    int opened = 0;
+    for (int counter = 0; counter < HTY_NUM_COUNTERS; counter++) {
+        perf->fds[counter] = open_perf_counter(counter, perf->group_fd);
+        perf->position[counter] = -1;
+        if (perf->fds[counter] >= 0) {
+            if (perf->group_fd == -1) {
+                perf->group_fd = perf->fds[counter];
+            }
+            perf->position[counter] = opened++;
+            perf->available |= 1 << counter;
+        }
+    }
+    if (perf->group_fd >= 0) {
+        ioctl(perf->group_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(perf->group_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+    pthread_setspecific(perf_key, perf);
+    return perf;
+}
+
+/**
+ * @brief Function to read the counters of the calling thread
+ *
+ * Values are scaled up when the kernel multiplexed the group with other events.
+ *
+ * @param counters - array of HTY_NUM_COUNTERS to store the values, 0 for counters not available
+ * @return int - bits of the counters that were read
+ */
+static int read_perf_counters(long* counters) {
+    memset(counters, 0, HTY_NUM_COUNTERS * sizeof(long));
+    HtyPerfCounters* perf = get_perf_counters();
+    if (perf == NULL || perf->group_fd < 0) {
+        return 0;
+    }
+    // nr, time enabled, time running, then one value per group member
+    unsigned long long values[3 + HTY_NUM_COUNTERS];
+    if (read(perf->group_fd, values, sizeof(values)) < (ssize_t)(3 * sizeof(unsigned long long))) {
+        return 0;
+    }
+    double scale = values[2] > 0 ? (double)values[1] / values[2] : 1.0;
+    for (int counter = 0; counter < HTY_NUM_COUNTERS; counter++) {
+        if (perf->position[counter] >= 0 && (unsigned long long)perf->position[counter] < values[0]) {
+            counters[counter] = (long)(values[3 + perf->position[counter]] * scale);
+        }
+    }
+    return perf->available;
+}
+
+/**
+ * @brief Function to add the counters since a start to a counter array of the stats
+ *
+ * @param target - counter array in hty_query_stats
+ * @param start - counters at the start
+ */
+static void add_perf_counters(long* target, const long* start) {
+    long now[HTY_NUM_COUNTERS];
+    int available = read_perf_counters(now);
+    if (available == 0) {
+        return;
+    }
+    for (int counter = 0; counter < HTY_NUM_COUNTERS; counter++) {
+        if (available & (1 << counter)) {
+            __atomic_fetch_add(&target[counter], now[counter] - start[counter], __ATOMIC_RELAXED);
+        }
+    }
+    __atomic_fetch_or(&hty_query_stats.counters_available, available, __ATOMIC_RELAXED);
+}
+
+void enable_query_stats(int enabled) {
+    stats_requested = enabled;
+    hty_stats_enabled = stats_requested || profile_enabled || trace_file != NULL;
+}
+
+int enable_query_profile(int enabled) {
+    profile_enabled = enabled;
+    hty_stats_enabled = stats_requested || profile_enabled || trace_file != NULL;
+    if (!enabled) {
+        return 0;
+    }
+    HtyPerfCounters* perf = get_perf_counters();
+    return perf == NULL ? 0 : perf->available;
+}
+
+void reset_query_stats(void) {
+    memset(&hty_query_stats, 0, sizeof(HtyQueryStats));
+}
+
+void get_query_stats(HtyQueryStats* stats) {
+    memcpy(stats, &hty_query_stats, sizeof(HtyQueryStats));
+}
+
+void print_query_stats(FILE* file, const HtyQueryStats* stats) {
+    fprintf(file, "%-10s %12s %12s %8s\n", "stage", "wall ms", "cpu ms", "calls");
+    for (int stage = 0; stage < HTY_NUM_STAGES; stage++) {
+        if (stats->stage_calls[stage] > 0) {
+            fprintf(file, "%-10s %12.3f %12.3f %8ld\n", stage_names[stage], stats->wall_ns[stage] / 1e6,
+                    stats->cpu_ns[stage] / 1e6, stats->stage_calls[stage]);
+        }
+    }
+    fprintf(file, "queries %ld (%.3f ms), bytes read %ld, blocks read %ld, from pool %ld, skipped %ld\n",
+            stats->queries, stats->query_wall_ns / 1e6, stats->bytes_read, stats->blocks_read,
+            stats->blocks_from_pool, stats->blocks_skipped);
+    fprintf(file, "rows scanned %ld, matched %ld, I/O syscalls %ld, allocations %ld (%ld bytes)\n",
+            stats->rows_scanned, stats->rows_matched, stats->io_syscalls, stats->allocations, stats->allocated_bytes);
+    if (!profile_enabled) {
+        return;
+    }
+    if (stats->counters_available == 0) {
+        fprintf(file, "hardware counters not available (check perf_event_paranoid, or no PMU in a virtual machine)\n");
+        return;
+    }
+    fprintf(file, "%-10s", "stage");
+    for (int counter = 0; counter < HTY_NUM_COUNTERS; counter++) {
+        fprintf(file, " %14s", counter_names[counter]);
+    }
+    fprintf(file, " %6s\n", "IPC");
+    for (int stage = 0; stage < HTY_NUM_STAGES; stage++) {
+        if (stats->stage_calls[stage] == 0) {
+            continue;
+        }
+        fprintf(file, "%-10s", stage_names[stage]);
+        for (int counter = 0; counter < HTY_NUM_COUNTERS; counter++) {
+            if (stats->counters_available & (1 << counter)) {
+                fprintf(file, " %14ld", stats->counters[stage][counter]);
+            } else {
+                fprintf(file, " %14s", "n/a");
+            }
+        }
+        long cycles = stats->counters[stage][HTY_COUNTER_CYCLES];
+        if (cycles > 0) {
+            fprintf(file, " %6.2f\n", (double)stats->counters[stage][HTY_COUNTER_INSTRUCTIONS] / cycles);
+        } else {
+            fprintf(file, " %6s\n", "n/a");
+        }
+    }
+    long totals[HTY_NUM_COUNTERS];
+    get_counter_totals(stats, totals);
+    fprintf(file, "IPC ");
+    if (totals[HTY_COUNTER_CYCLES] > 0) {
+        fprintf(file, "%.2f", (double)totals[HTY_COUNTER_INSTRUCTIONS] / totals[HTY_COUNTER_CYCLES]);
+    } else {
+        fprintf(file, "n/a");
+    }
+    fprintf(file, ", LLC misses per row ");
+    if ((stats->counters_available & (1 << HTY_COUNTER_LLC_MISSES)) && stats->rows_scanned > 0) {
+        fprintf(file, "%.4f", (double)totals[HTY_COUNTER_LLC_MISSES] / stats->rows_scanned);
+    } else {
+        fprintf(file, "n/a");
+    }
+    fprintf(file, ", bytes read per cycle ");
+    if (totals[HTY_COUNTER_CYCLES] > 0) {
+        fprintf(file, "%.4f\n", (double)stats->bytes_read / totals[HTY_COUNTER_CYCLES]);
+    } else {
+        fprintf(file, "n/a\n");
+    }
+}
+
+void get_counter_totals(const HtyQueryStats* stats, long* totals) {
+    for (int counter = 0; counter < HTY_NUM_COUNTERS; counter++) {
+        totals[counter] = 0;
+        if (stats->queries > 0) {
+            totals[counter] = stats->query_counters[counter];
+            continue;
+        }
+        for (int stage = 0; stage < HTY_NUM_STAGES; stage++) {
+            totals[counter] += stats->counters[stage][counter];
+        }
+    }
+}
+
+int start_query_trace(const char* trace_file_path) {
+    stop_query_trace();
+    FILE* file = fopen(trace_file_path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Error opening trace file: %s\n", trace_file_path);
+        return -1;
+    }
+    pthread_mutex_lock(&trace_lock);
+    fputs("[\n", file);
+    trace_file = file;
+    trace_start_ns = clock_ns(CLOCK_MONOTONIC);
+    trace_events = 0;
+    pthread_mutex_unlock(&trace_lock);
+    hty_stats_enabled = 1;
+    return 0;
+}
+
+void stop_query_trace(void) {
+    pthread_mutex_lock(&trace_lock);
+    if (trace_file != NULL) {
+        fputs("\n]\n", trace_file);
+        fclose(trace_file);
+        trace_file = NULL;
+    }
+    pthread_mutex_unlock(&trace_lock);
+    hty_stats_enabled = stats_requested || profile_enabled;
+}
+
+/**
+ * @brief Function to write one complete event to the trace
+ *
+ * @param name - event name
+ * @param category - event category
+ * @param start_ns - start on the monotonic clock
+ * @param end_ns - end on the monotonic clock
+ */
+static void write_trace_event(const char* name, const char* category, long start_ns, long end_ns) {
+    pthread_mutex_lock(&trace_lock);
+    if (trace_file != NULL) {
+        fprintf(trace_file, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%ld}",
+                trace_events++ > 0 ? ",\n" : "", name, category, (start_ns - trace_start_ns) / 1e3,
+                (end_ns - start_ns) / 1e3, (int)getpid(), (long)syscall(SYS_gettid));
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
+
+void begin_stage(HtyStageTimer* timer) {
+    timer->wall_ns = clock_ns(CLOCK_MONOTONIC);
+    timer->cpu_ns = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+    if (profile_enabled) {
+        read_perf_counters(timer->counters);
+    }
+}
+
+void end_stage(int stage, const HtyStageTimer* timer) {
+    long wall_ns = clock_ns(CLOCK_MONOTONIC);
+    long cpu_ns = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+    __atomic_fetch_add(&hty_query_stats.wall_ns[stage], wall_ns - timer->wall_ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hty_query_stats.cpu_ns[stage], cpu_ns - timer->cpu_ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hty_query_stats.stage_calls[stage], 1, __ATOMIC_RELAXED);
+    if (profile_enabled) {
+        add_perf_counters(hty_query_stats.counters[stage], timer->counters);
+    }
+    if (trace_file != NULL) {
+        write_trace_event(stage_names[stage], "stage", timer->wall_ns, wall_ns);
+    }
+}
+
+void end_query_span(const char* name, const HtyStageTimer* timer) {
+    long wall_ns = clock_ns(CLOCK_MONOTONIC);
+    __atomic_fetch_add(&hty_query_stats.queries, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hty_query_stats.query_wall_ns, wall_ns - timer->wall_ns, __ATOMIC_RELAXED);
+    if (profile_enabled) {
+        add_perf_counters(hty_query_stats.query_counters, timer->counters);
+    }
+    if (trace_file != NULL) {
+        write_trace_event(name, "query", timer->wall_ns, wall_ns);
+    }
+}
@@ -0,0 +1,188 @@
+/**
+ * @file heartyhty_stats.h
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Header file for query instrumentation: per-stage timers, I/O and row counters, Chrome trace output
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef HEARTYHTY_STATS_H
+#define HEARTYHTY_STATS_H
+
+#include <stdio.h>
+
+#define HTY_STAGE_METADATA 0  // Reading and parsing metadata
+#define HTY_STAGE_IO 1        // Waiting for row group reads
+#define HTY_STAGE_DECODE 2    // Turning row groups into columns, or copying them from the buffer pool
+#define HTY_STAGE_FILTER 3    // Evaluating predicates
+#define HTY_STAGE_GATHER 4    // Copying projected values into the result
+#define HTY_STAGE_OUTPUT 5    // Formatting and writing results
+#define HTY_NUM_STAGES 6
+
+#define HTY_COUNTER_CYCLES 0         // CPU cycles
+#define HTY_COUNTER_INSTRUCTIONS 1   // Instructions retired
+#define HTY_COUNTER_LLC_MISSES 2     // Last level cache misses
+#define HTY_COUNTER_BRANCH_MISSES 3  // Mispredicted branches
+#define HTY_COUNTER_DTLB_MISSES 4    // Data TLB read misses
+#define HTY_NUM_COUNTERS 5
+
+/**
+ * @brief Counters of the queries run since the last reset_query_stats()
+ *
+ * Times are in nanoseconds. CPU time is the time of the thread that ran the
+ * stage, so the reads of the I/O threads and the formatting threads of
+ * write_delimited() show up as wall time only. The hardware counters are
+ * only collected while profiling (see enable_query_profile()) and count user
+ * space only.
+ */
+typedef struct {
+    long wall_ns[HTY_NUM_STAGES];  // Wall time of each stage
+    long cpu_ns[HTY_NUM_STAGES];   // CPU time of each stage
+    long stage_calls[HTY_NUM_STAGES]; // Times each stage was entered
+    long queries;                  // Query functions run
+    long query_wall_ns;            // Wall time of the query functions, stages included
+    long bytes_read;               // Bytes read from .hty files
+    long blocks_read;              // Row groups read from disk
+    long blocks_from_pool;         // Row groups served by the buffer pool
+    long blocks_skipped;           // Row groups ruled out by zone maps, Bloom filters or indexes
+    long rows_scanned;             // Rows handed to the operators by the column reader
+    long rows_matched;             // Rows returned by filters
+    long io_syscalls;              // open, pread, io_uring_enter and the row-at-a-time reads
+    long allocations;              // Allocations through arena_alloc() and for scan results
+    long allocated_bytes;          // Bytes of those allocations
+    int counters_available;        // Bit (1 << HTY_COUNTER_*) per hardware counter that was collected
+    long counters[HTY_NUM_STAGES][HTY_NUM_COUNTERS];  // Hardware counters of each stage
+    long query_counters[HTY_NUM_COUNTERS];            // Hardware counters of the query functions
+} HtyQueryStats;
+
+/**
+ * @brief Start of a timed stage or span
+ */
+typedef struct {
+    long wall_ns;  // Monotonic clock at the start
+    long cpu_ns;   // Thread CPU clock at the start
+    long counters[HTY_NUM_COUNTERS];  // Hardware counters at the start, when profiling
+} HtyStageTimer;
+
+extern int hty_stats_enabled;          // 1 while stats or a trace are being collected
+extern HtyQueryStats hty_query_stats;  // Counters, updated atomically
+
+// Instrumentation points cost one test of hty_stats_enabled while it is off
+#define HTY_STATS_ADD(field, amount) \
+    do { \
+        if (hty_stats_enabled) { \
+            __atomic_fetch_add(&hty_query_stats.field, (long)(amount), __ATOMIC_RELAXED); \
+        } \
+    } while (0)
+#define HTY_STAGE_BEGIN(timer) \
+    do { \
+        if (hty_stats_enabled) { \
+            begin_stage(&(timer)); \
+        } \
+    } while (0)
+#define HTY_STAGE_END(stage, timer) \
+    do { \
+        if (hty_stats_enabled) { \
+            end_stage((stage), &(timer)); \
+        } \
+    } while (0)
+#define HTY_QUERY_END(name, timer) \
+    do { \
+        if (hty_stats_enabled) { \
+            end_query_span((name), &(timer)); \
+        } \
+    } while (0)
+
+/**
+ * @brief Function to turn stats collection on or off
+ *
+ * @param enabled - 1 to collect stats
+ */
+void enable_query_stats(int enabled);
+
+/**
+ * @brief Function to turn hardware counter profiling on or off
+ *
+ * Profiling wraps every stage and query function in perf_event_open()
+ * counters (cycles, instructions, LLC misses, branch misses and dTLB misses),
+ * opened once per thread. It turns stats collection on, and costs two
+ * counter reads per stage on top of the timers.
+ *
+ * @param enabled - 1 to collect hardware counters
+ * @return int - bits (1 << HTY_COUNTER_*) of the counters this thread could open, 0 if none
+ */
+int enable_query_profile(int enabled);
+
+/**
+ * @brief Function to zero the counters
+ */
+void reset_query_stats(void);
+
+/**
+ * @brief Function to get a copy of the counters
+ *
+ * @param stats - pointer to store the counters
+ */
+void get_query_stats(HtyQueryStats* stats);
+
+/**
+ * @brief Function to get the hardware counter totals of the queries
+ *
+ * The totals are those of the query functions when any ran, otherwise the
+ * sum over the stages.
+ *
+ * @param stats - counters
+ * @param totals - array of HTY_NUM_COUNTERS to store the totals
+ */
+void get_counter_totals(const HtyQueryStats* stats, long* totals);
+
+/**
+ * @brief Function to print the stage breakdown and the counters
+ *
+ * @param file - file to print to
+ * @param stats - counters
+ */
+void print_query_stats(FILE* file, const HtyQueryStats* stats);
+
+/**
+ * @brief Function to start writing Chrome trace-event JSON (chrome://tracing, Perfetto)
+ *
+ * Every stage and query function becomes a complete ("X") event. Tracing
+ * turns stats collection on.
+ *
+ * @param trace_file_path - path to the trace file
+ * @return int - 0 on success, -1 on failure
+ */
+int start_query_trace(const char* trace_file_path);
+
+/**
+ * @brief Function to finish and close the trace file
+ */
+void stop_query_trace(void);
+
+/**
+ * @brief Function to start a stage or span (use HTY_STAGE_BEGIN)
+ *
+ * @param timer - timer to start
+ */
+void begin_stage(HtyStageTimer* timer);
+
+/**
+ * @brief Function to add the time since begin_stage() to a stage (use HTY_STAGE_END)
+ *
+ * @param stage - one of the HTY_STAGE_* stages
+ * @param timer - timer started by begin_stage()
+ */
+void end_stage(int stage, const HtyStageTimer* timer);
+
+/**
+ * @brief Function to count a query function and trace its span (use HTY_QUERY_END)
+ *
+ * @param name - name of the query function
+ * @param timer - timer started by begin_stage()
+ */
+void end_query_span(const char* name, const HtyStageTimer* timer);
+
+#endif // HEARTYHTY_STATS_H
@@ -0,0 +1,128 @@
+/**
+ * @file heartyhty_table.c
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Table handles: an open .hty file whose queries share cached metadata and an arena
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../third_party/cJSON/cJSON.h"
+#include "heartyhty_functions.h"
+#include "heartyhty_pool.h"
+#include "heartyhty_snapshot.h"
+#include "heartyhty_arena.h"
+#include "heartyhty_estimate.h"
+#include "heartyhty_table.h"
+
+HtyTable* open_table(const char* hty_file_path) {
+    HtyTable* table = (HtyTable*)calloc(1, sizeof(HtyTable));
+    if (table == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return NULL;
+    }
+    table->path = strdup(hty_file_path);
+    table->arena = create_arena(0);
+    if (table->path == NULL || table->arena == NULL || begin_table_query(table) != 0) {
+        close_table(table);
+        return NULL;
+    }
+    return table;
+}
+
+int begin_table_query(HtyTable* table) {
+    reset_arena(table->arena);
+    end_table_query(table);
+
+    // The query reads the version pinned here; the metadata is read once per version
+    HtyFileVersion version;
+    if (pin_snapshot(table->path, &version) != 0) {
+        fprintf(stderr, "Error opening file: %s\n", table->path);
+        return -1;
+    }
+    table->pinned = 1;
+    if (table->metadata != NULL && same_file_version(&version, &table->version)) {
+        return 0;
+    }
+    cJSON_Delete(table->metadata);
+    free(table->column_stats);
+    table->column_stats = NULL;
+    free_row_sample(&table->row_sample);
+    table->row_sample_state = 0;
+    table->metadata = extract_metadata(table->path);
+    table->version = version;
+    if (table->metadata == NULL) {
+        return -1;
+    }
+
+    // Statistics of every column, for estimates without parsing the metadata again
+    cJSON* group = cJSON_GetArrayItem(cJSON_GetObjectItemCaseSensitive(table->metadata, "groups"), 0);  // Assuming single group
+    table->num_columns = cJSON_GetArraySize(cJSON_GetObjectItemCaseSensitive(group, "columns"));
+    table->column_stats = (HtyColumnStats*)malloc((table->num_columns + 1) * sizeof(HtyColumnStats));
+    if (table->column_stats == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    for (int i = 0; i < table->num_columns; i++) {
+        load_column_stats(table->metadata, i, &table->column_stats[i]);
+    }
+    return 0;
+}
+
+void end_table_query(HtyTable* table) {
+    if (table->pinned) {
+        unpin_snapshot(table->path);
+        table->pinned = 0;
+    }
+}
+
+int** table_project(HtyTable* table, char** projected_columns, int num_columns, int* row_count) {
+    return project_into_arena(table->arena, table->metadata, table->path, projected_columns, num_columns, row_count);
+}
+
+int** table_project_and_filter(HtyTable* table, char** projected_columns, int num_columns, const char* filtered_column,
+                               int op, int value, int* row_count) {
+    return project_and_filter_into_arena(table->arena, table->metadata, table->path, projected_columns, num_columns,
+                                         filtered_column, op, value, row_count);
+}
+
+long table_estimate_rows(HtyTable* table, const char* column_name, int op, int value) {
+    int column_index, is_float;
+    char* name = (char*)column_name;
+    if (resolve_columns(table->metadata, &name, 1, &column_index, &is_float) != 0) {
+        return -1;
+    }
+    HtyColumnStats* stats = &table->column_stats[column_index];
+    if (stats->num_bounds == 0) {
+        return -1;
+    }
+    return (long)(estimate_selectivity(stats, op, value, is_float) * stats->num_rows + 0.5);
+}
+
+HtyRowSample* table_row_sample(HtyTable* table) {
+    if (table->row_sample_state == 0) {
+        int loaded = load_row_sample(table->metadata, table->path, &table->row_sample);
+        if (loaded < 0) {
+            return NULL; // Try again on the next query
+        }
+        table->row_sample_state = loaded ? 1 : -1;
+    }
+    return table->row_sample_state == 1 ? &table->row_sample : NULL;
+}
+
+void close_table(HtyTable* table) {
+    if (table == NULL) {
+        return;
+    }
+    end_table_query(table);
+    cJSON_Delete(table->metadata);
+    free(table->column_stats);
+    free_row_sample(&table->row_sample);
+    free_arena(table->arena);
+    free(table->path);
+    free(table);
+}
@@ -0,0 +1,120 @@
+/**
+ * @file heartyhty_table.h
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Header file for table handles: an open .hty file whose queries share cached metadata and an arena
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef HEARTYHTY_TABLE_H
+#define HEARTYHTY_TABLE_H
+
+/**
+ * @brief Open .hty file
+ *
+ * Every query on a table allocates its result, its intermediates and its
+ * scan buffers from the table arena. begin_table_query() releases them all
+ * at once and keeps the memory, so a stream of queries on one table
+ * allocates almost nothing from the system. The column statistics are
+ * parsed once per file version, for planning with table_estimate_rows(),
+ * and the row sample is read on the first approximate query of a version.
+ * A query pins the version it starts on (see pin_snapshot()) until
+ * end_table_query(), so appends published meanwhile show up in the next one.
+ */
+typedef struct {
+    char* path;              // Path to the hty file
+    cJSON* metadata;         // Metadata of the file version below
+    HtyFileVersion version;  // File version the metadata was read from
+    int pinned;              // 1 while a query holds the file version pinned
+    HtyArena* arena;         // Memory of the current query
+    int num_columns;         // Number of columns
+    HtyColumnStats* column_stats; // Statistics of each column (num_bounds is 0 for columns without them)
+    int row_sample_state;    // 0 not read yet, 1 read, -1 the file has none
+    HtyRowSample row_sample; // Row sample of the file version, once read
+} HtyTable;
+
+/**
+ * @brief Function to open a table
+ *
+ * @param hty_file_path - path to hty file
+ * @return HtyTable* - table handle, NULL on failure
+ */
+HtyTable* open_table(const char* hty_file_path);
+
+/**
+ * @brief Function to start a new query on a table
+ *
+ * Releases everything the previous query allocated (its results become
+ * invalid), pins the current version of the file and reads the metadata
+ * again if the file has changed.
+ *
+ * @param table - table handle
+ * @return int - 0 on success, -1 if the metadata cannot be read
+ */
+int begin_table_query(HtyTable* table);
+
+/**
+ * @brief Function to finish a query on a table
+ *
+ * Unpins the file version so writers need not wait for the next query; the
+ * results stay valid until the next begin_table_query().
+ *
+ * @param table - table handle
+ */
+void end_table_query(HtyTable* table);
+
+/**
+ * @brief Function to project multiple columns of a table (see project())
+ *
+ * @param table - table handle
+ * @param projected_columns - array of column names to project
+ * @param num_columns - number of columns to project
+ * @param row_count - pointer to store number of rows
+ * @return int** - 2D array of projected data, valid until the next begin_table_query()
+ */
+int** table_project(HtyTable* table, char** projected_columns, int num_columns, int* row_count);
+
+/**
+ * @brief Function to project columns of a table with filtering (see project_and_filter())
+ *
+ * @param table - table handle
+ * @param projected_columns - array of column names to project
+ * @param num_columns - number of columns to project
+ * @param filtered_column - column to apply filter on
+ * @param op - operation for filtering
+ * @param value - value to filter against
+ * @param row_count - pointer to store number of resulting rows
+ * @return int** - 2D array of filtered and projected data, valid until the next begin_table_query()
+ */
+int** table_project_and_filter(HtyTable* table, char** projected_columns, int num_columns, const char* filtered_column,
+                               int op, int value, int* row_count);
+
+/**
+ * @brief Function to estimate the number of rows matching a predicate on a table
+ *
+ * @param table - table handle
+ * @param column_name - column to apply filter on
+ * @param op - operation for filtering
+ * @param value - value to filter against (float bits for float columns)
+ * @return long - estimated matching rows, -1 if the column is unknown or has no statistics
+ */
+long table_estimate_rows(HtyTable* table, const char* column_name, int op, int value);
+
+/**
+ * @brief Function to get the row sample of a table for approximate queries
+ *
+ * @param table - table handle
+ * @return HtyRowSample* - row sample, valid until the file changes; NULL if the file has none or on failure
+ */
+HtyRowSample* table_row_sample(HtyTable* table);
+
+/**
+ * @brief Function to close a table and free its memory
+ *
+ * @param table - table handle, or NULL
+ */
+void close_table(HtyTable* table);
+
+#endif // HEARTYHTY_TABLE_H
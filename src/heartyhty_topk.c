@@ -0,0 +1,478 @@
+/**
+ * @file heartyhty_topk.c
+ * @author Panupong Dangkajitpetch (King)
+ * @brief ORDER BY ... LIMIT (top-k) operator with per-thread bounded heaps
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "../third_party/cJSON/cJSON.h"
+#include "heartyhty_functions.h"
+#include "heartyhty_writer.h"
+#include "heartyhty_sort.h"
+#include "heartyhty_delete.h"
+#include "heartyhty_topk.h"
+#include "heartyhty_pool.h"
+#include "heartyhty_snapshot.h"
+#include "heartyhty_stats.h"
+
+/**
+ * @brief Row candidate
+ *
+ * The rank orders candidates best first: the upper 32 bits are the sort
+ * encoded value (inverted for ascending order), the lower 32 bits prefer
+ * earlier rows, so every candidate has a distinct rank.
+ */
+typedef struct {
+    uint64_t rank;  // Higher is better
+    int row_id;     // Row in the file
+} TopKEntry;
+
+/**
+ * @brief Row group waiting to be scanned
+ */
+typedef struct {
+    int first_row;       // First row of the row group
+    uint64_t best_rank;  // Best rank any row of the row group could have
+} TopKGroup;
+
+/**
+ * @brief Shared state of a parallel top-k scan
+ */
+typedef struct {
+    const char* hty_file_path;  // File to scan
+    HtyRowLayout layout;        // Where the rows are in the file
+    int total_columns;          // Columns per row
+    int num_rows;               // Rows in the file
+    int order_index;            // Column to order by
+    int order_is_float;         // Type of the column to order by
+    int descending;             // 1 for descending order
+    int k;                      // Rows to keep
+    TopKGroup* groups;          // Row groups, most promising first
+    int num_groups;             // Number of row groups
+    int next_group;             // Next row group to hand out
+    uint64_t threshold;         // Best k-th rank of any full heap so far
+    int have_threshold;         // 1 once some heap is full
+    int failed;                 // 1 if a read failed
+    HtyRowBitmap deleted;       // Deleted rows, never candidates
+    TopKEntry** heaps;          // Heap of each thread
+    int* heap_sizes;            // Entries in the heap of each thread
+    pthread_mutex_t lock;       // Protects next_group, threshold and failed
+} TopKScan;
+
+/**
+ * @brief Worker thread argument
+ */
+typedef struct {
+    TopKScan* scan;  // Shared scan state
+    int thread;      // Index of the heap of this thread
+} TopKWorker;
+
+unsigned int* read_zone_map(cJSON* metadata, const char* hty_file_path, int column_index, int* num_row_groups) {
+    cJSON* zone_maps = cJSON_GetObjectItemCaseSensitive(metadata, "zone_maps");
+    if (zone_maps == NULL) {
+        return NULL; // File was written before zone maps existed
+    }
+    cJSON* columns = cJSON_GetObjectItemCaseSensitive(
+        cJSON_GetArrayItem(cJSON_GetObjectItemCaseSensitive(metadata, "groups"), 0), "columns");
+    int total_columns = cJSON_GetArraySize(columns);
+    int num_rows = cJSON_GetObjectItemCaseSensitive(metadata, "num_rows")->valueint;
+    int block_rows = get_block_rows(metadata);
+    long zone_offset = (long)cJSON_GetObjectItemCaseSensitive(zone_maps, "offset")->valuedouble;
+    *num_row_groups = (num_rows + block_rows - 1) / block_rows;
+
+    FILE* file = open_snapshot(hty_file_path);
+    if (file == NULL) {
+        fprintf(stderr, "Error opening file: %s\n", hty_file_path);
+        return NULL;
+    }
+    unsigned int* zone_map = (unsigned int*)malloc((2L * *num_row_groups + 2) * sizeof(unsigned int));
+    for (int group = 0; group < *num_row_groups; group++) {
+        // Zone maps are stored group by group: [group 0: min/max of column 0, column 1, ...] [group 1: ...]
+        fseek(file, zone_offset + ((long)group * total_columns + column_index) * 2 * sizeof(unsigned int), SEEK_SET);
+        if (fread(&zone_map[2 * group], sizeof(unsigned int), 2, file) != 2) {
+            fprintf(stderr, "Error reading zone maps\n");
+            free(zone_map);
+            fclose(file);
+            return NULL;
+        }
+    }
+    fclose(file);
+    return zone_map;
+}
+
+/**
+ * @brief Function to compute the rank part of a value
+ *
+ * @param encoded - sort encoded value
+ * @param descending - 1 for descending order
+ * @return uint64_t - rank of the value in the upper 32 bits
+ */
+static uint64_t value_rank(uint32_t encoded, int descending) {
+    return (uint64_t)(descending ? encoded : ~encoded) << 32;
+}
+
+/**
+ * @brief Function to restore the heap order below a position (worst candidate on top)
+ *
+ * @param heap - min-heap of candidates
+ * @param size - number of candidates in the heap
+ * @param position - position to sift down from
+ */
+static void sift_down(TopKEntry* heap, int size, int position) {
+    for (;;) {
+        int worst = position;
+        int left = 2 * position + 1;
+        int right = left + 1;
+        if (left < size && heap[left].rank < heap[worst].rank) {
+            worst = left;
+        }
+        if (right < size && heap[right].rank < heap[worst].rank) {
+            worst = right;
+        }
+        if (worst == position) {
+            return;
+        }
+        TopKEntry temp = heap[position];
+        heap[position] = heap[worst];
+        heap[worst] = temp;
+        position = worst;
+    }
+}
+
+/**
+ * @brief Function to add a candidate to a bounded heap
+ *
+ * @param heap - min-heap of candidates
+ * @param size - number of candidates in the heap (updated)
+ * @param k - capacity of the heap
+ * @param entry - candidate to add
+ */
+static void heap_offer(TopKEntry* heap, int* size, int k, TopKEntry entry) {
+    if (*size < k) {
+        // Sift up
+        int position = (*size)++;
+        while (position > 0 && heap[(position - 1) / 2].rank > entry.rank) {
+            heap[position] = heap[(position - 1) / 2];
+            position = (position - 1) / 2;
+        }
+        heap[position] = entry;
+    } else if (entry.rank > heap[0].rank) {
+        heap[0] = entry; // Replace the current k-th candidate
+        sift_down(heap, *size, 0);
+    }
+}
+
+/**
+ * @brief Worker thread that scans row groups until none are left
+ *
+ * @param arg - worker argument
+ * @return void* - always NULL
+ */
+static void* topk_worker(void* arg) {
+    TopKScan* scan = ((TopKWorker*)arg)->scan;
+    int thread = ((TopKWorker*)arg)->thread;
+    TopKEntry* heap = scan->heaps[thread];
+    int heap_size = 0;
+
+    FILE* file = open_snapshot(scan->hty_file_path);
+    int* block = (int*)malloc((long)scan->layout.block_rows * scan->total_columns * sizeof(int));
+    if (file == NULL || block == NULL) {
+        fprintf(stderr, "Error opening file: %s\n", scan->hty_file_path);
+        pthread_mutex_lock(&scan->lock);
+        scan->failed = 1;
+        pthread_mutex_unlock(&scan->lock);
+        if (file != NULL) {
+            fclose(file);
+        }
+        free(block);
+        return NULL;
+    }
+
+    for (;;) {
+        // Publish our k-th rank and take the next row group that can still beat the best one
+        pthread_mutex_lock(&scan->lock);
+        if (heap_size == scan->k && (!scan->have_threshold || heap[0].rank > scan->threshold)) {
+            scan->threshold = heap[0].rank;
+            scan->have_threshold = 1;
+        }
+        int group = -1;
+        while (scan->next_group < scan->num_groups && !scan->failed) {
+            TopKGroup* candidate = &scan->groups[scan->next_group++];
+            if (!scan->have_threshold || candidate->best_rank > scan->threshold) {
+                group = candidate->first_row;
+                break;
+            }
+            HTY_STATS_ADD(blocks_skipped, 1);
+        }
+        pthread_mutex_unlock(&scan->lock);
+        if (group == -1) {
+            break;
+        }
+
+        int block_rows = scan->layout.block_rows;
+        int rows_in_block = scan->num_rows - group < block_rows ? scan->num_rows - group : block_rows;
+        HtyStageTimer timer;
+        HTY_STAGE_BEGIN(timer);
+        fseek(file, row_position(&scan->layout, group), SEEK_SET);
+        if (fread(block, scan->total_columns * sizeof(int), rows_in_block, file) != (size_t)rows_in_block) {
+            fprintf(stderr, "Error reading rows %d to %d\n", group, group + rows_in_block - 1);
+            pthread_mutex_lock(&scan->lock);
+            scan->failed = 1;
+            pthread_mutex_unlock(&scan->lock);
+            break;
+        }
+        HTY_STAGE_END(HTY_STAGE_IO, timer);
+        HTY_STATS_ADD(io_syscalls, 1);
+        HTY_STATS_ADD(blocks_read, 1);
+        HTY_STATS_ADD(bytes_read, (long)rows_in_block * scan->total_columns * sizeof(int));
+        HTY_STATS_ADD(rows_scanned, rows_in_block);
+        for (int i = 0; i < rows_in_block; i++) {
+            if (scan->deleted.cardinality > 0 && bitmap_contains(&scan->deleted, group + i)) {
+                continue;
+            }
+            int value = block[(long)i * scan->total_columns + scan->order_index];
+            TopKEntry entry;
+            entry.row_id = group + i;
+            entry.rank = value_rank(encode_sort_value(value, scan->order_is_float), scan->descending) |
+                         (uint32_t)(UINT32_MAX - (uint32_t)entry.row_id);
+            heap_offer(heap, &heap_size, scan->k, entry);
+        }
+    }
+
+    scan->heap_sizes[thread] = heap_size;
+    free(block);
+    fclose(file);
+    return NULL;
+}
+
+/**
+ * @brief Function to order candidates best first for qsort
+ */
+static int compare_entries(const void* a, const void* b) {
+    uint64_t rank1 = ((const TopKEntry*)a)->rank;
+    uint64_t rank2 = ((const TopKEntry*)b)->rank;
+    return (rank1 < rank2) - (rank1 > rank2);
+}
+
+/**
+ * @brief Function to order row groups most promising first for qsort
+ */
+static int compare_groups(const void* a, const void* b) {
+    uint64_t rank1 = ((const TopKGroup*)a)->best_rank;
+    uint64_t rank2 = ((const TopKGroup*)b)->best_rank;
+    return (rank1 < rank2) - (rank1 > rank2);
+}
+
+/**
+ * @brief Function to order candidates by row for qsort
+ */
+static int compare_row_ids(const void* a, const void* b) {
+    int row1 = ((const TopKEntry*)a)->row_id;
+    int row2 = ((const TopKEntry*)b)->row_id;
+    return (row1 > row2) - (row1 < row2);
+}
+
+/**
+ * @brief Function to find the top rows by a column (see top_k())
+ *
+ * @param metadata - metadata object
+ * @param hty_file_path - path to hty file
+ * @param order_column - column to order by
+ * @param descending - 1 for the largest values first
+ * @param k - number of rows to return
+ * @param projected_columns - columns to return
+ * @param num_columns - number of columns to return
+ * @param row_count - pointer to store number of rows
+ * @return int** - 2D array of the top rows
+ */
+static int** find_top_k(cJSON* metadata, const char* hty_file_path, const char* order_column, int descending, int k,
+                        char** projected_columns, int num_columns, int* row_count) {
+    cJSON* groups = cJSON_GetObjectItemCaseSensitive(metadata, "groups");
+    cJSON* group = cJSON_GetArrayItem(groups, 0);  // Assuming single group
+    cJSON* columns = cJSON_GetObjectItemCaseSensitive(group, "columns");
+    int num_rows = cJSON_GetObjectItemCaseSensitive(metadata, "num_rows")->valueint;
+    int total_columns = cJSON_GetArraySize(columns);
+    HtyRowLayout layout;
+    get_row_layout(metadata, &layout);
+    int block_rows = layout.block_rows;
+
+    // Find the order column and the projected columns
+    int order_index, order_is_float;
+    char* order_name = (char*)order_column;
+    int* column_indices = (int*)malloc((num_columns + 1) * sizeof(int));
+    int* column_types = (int*)malloc((num_columns + 1) * sizeof(int));
+    int resolved = resolve_columns(metadata, &order_name, 1, &order_index, &order_is_float) == 0 &&
+                   resolve_columns(metadata, projected_columns, num_columns, column_indices, column_types) == 0;
+    free(column_types);
+    if (!resolved) {
+        free(column_indices);
+        return NULL;
+    }
+    if (k > count_live_rows(metadata)) {
+        k = count_live_rows(metadata);
+    }
+    if (k < 0) {
+        k = 0;
+    }
+
+    int** result = (int**)malloc(num_columns * sizeof(int*));
+    for (int i = 0; i < num_columns; i++) {
+        result[i] = (int*)malloc((k + 1) * sizeof(int));
+    }
+    *row_count = 0;
+    if (k == 0) {
+        free(column_indices);
+        return result;
+    }
+
+    // Row groups with the best possible rows go first, so the heaps fill with good rows early
+    TopKScan scan;
+    memset(&scan, 0, sizeof(scan));
+    if (load_deleted_rows(metadata, hty_file_path, &scan.deleted) < 0) {
+        for (int i = 0; i < num_columns; i++) {
+            free(result[i]);
+        }
+        free(result);
+        free(column_indices);
+        return NULL;
+    }
+    scan.hty_file_path = hty_file_path;
+    scan.layout = layout;
+    scan.total_columns = total_columns;
+    scan.num_rows = num_rows;
+    scan.order_index = order_index;
+    scan.order_is_float = order_is_float;
+    scan.descending = descending;
+    scan.k = k;
+    scan.num_groups = (num_rows + block_rows - 1) / block_rows;
+    scan.groups = (TopKGroup*)malloc(scan.num_groups * sizeof(TopKGroup));
+    int zone_groups = 0;
+    unsigned int* zone_map = read_zone_map(metadata, hty_file_path, order_index, &zone_groups);
+    if (zone_map != NULL && zone_groups != scan.num_groups) {
+        free(zone_map); // Does not describe these row groups
+        zone_map = NULL;
+    }
+    for (int i = 0; i < scan.num_groups; i++) {
+        scan.groups[i].first_row = i * block_rows;
+        scan.groups[i].best_rank = UINT64_MAX;
+        if (zone_map != NULL) {
+            uint32_t best_value = descending ? zone_map[2 * i + 1] : zone_map[2 * i];
+            scan.groups[i].best_rank = value_rank(best_value, descending) |
+                                       (uint32_t)(UINT32_MAX - (uint32_t)scan.groups[i].first_row);
+        }
+    }
+    free(zone_map);
+    qsort(scan.groups, scan.num_groups, sizeof(TopKGroup), compare_groups);
+
+    // Scan in parallel, each thread with its own heap
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int num_threads = scan.num_groups < HTY_TOPK_MAX_THREADS ? scan.num_groups : HTY_TOPK_MAX_THREADS;
+    if (num_cpus > 0 && num_threads > num_cpus) {
+        num_threads = (int)num_cpus;
+    }
+    if (num_threads < 1) {
+        num_threads = 1;
+    }
+    scan.heaps = (TopKEntry**)malloc(num_threads * sizeof(TopKEntry*));
+    scan.heap_sizes = (int*)calloc(num_threads, sizeof(int));
+    TopKWorker workers[HTY_TOPK_MAX_THREADS];
+    for (int i = 0; i < num_threads; i++) {
+        scan.heaps[i] = (TopKEntry*)malloc(k * sizeof(TopKEntry));
+        workers[i].scan = &scan;
+        workers[i].thread = i;
+    }
+    pthread_mutex_init(&scan.lock, NULL);
+    if (num_threads == 1) {
+        topk_worker(&workers[0]);
+    } else {
+        pthread_t threads[HTY_TOPK_MAX_THREADS];
+        int started[HTY_TOPK_MAX_THREADS];
+        for (int i = 0; i < num_threads; i++) {
+            started[i] = pthread_create(&threads[i], NULL, topk_worker, &workers[i]) == 0;
+        }
+        for (int i = 0; i < num_threads; i++) {
+            if (started[i]) {
+                pthread_join(threads[i], NULL);
+            }
+        }
+        if (!started[0]) {
+            topk_worker(&workers[0]); // Fall back to scanning on this thread
+        }
+    }
+    pthread_mutex_destroy(&scan.lock);
+
+    // Merge the heaps and keep the best k candidates
+    int num_candidates = 0;
+    TopKEntry* candidates = (TopKEntry*)malloc((long)num_threads * k * sizeof(TopKEntry));
+    for (int i = 0; i < num_threads; i++) {
+        memcpy(candidates + num_candidates, scan.heaps[i], scan.heap_sizes[i] * sizeof(TopKEntry));
+        num_candidates += scan.heap_sizes[i];
+        free(scan.heaps[i]);
+    }
+    free(scan.heaps);
+    free(scan.heap_sizes);
+    free(scan.groups);
+    free_bitmap(&scan.deleted);
+    qsort(candidates, num_candidates, sizeof(TopKEntry), compare_entries);
+    if (num_candidates > k) {
+        num_candidates = k;
+    }
+
+    // Read the projected columns of the winning rows only, in file order
+    for (int i = 0; i < num_candidates; i++) {
+        candidates[i].rank = i; // Reuse the rank as the output position
+    }
+    qsort(candidates, num_candidates, sizeof(TopKEntry), compare_row_ids);
+    FILE* file = scan.failed ? NULL : open_snapshot(hty_file_path);
+    if (file == NULL && !scan.failed) {
+        fprintf(stderr, "Error opening file: %s\n", hty_file_path);
+        scan.failed = 1;
+    }
+    int* row = (int*)malloc(total_columns * sizeof(int));
+    for (int i = 0; file != NULL && i < num_candidates; i++) {
+        fseek(file, row_position(&layout, candidates[i].row_id), SEEK_SET);
+        if (fread(row, sizeof(int), total_columns, file) != (size_t)total_columns) {
+            fprintf(stderr, "Error reading row %d\n", candidates[i].row_id);
+            scan.failed = 1;
+            break;
+        }
+        for (int col = 0; col < num_columns; col++) {
+            result[col][candidates[i].rank] = row[column_indices[col]];
+        }
+    }
+    if (file != NULL) {
+        fclose(file);
+    }
+    free(row);
+    free(candidates);
+    free(column_indices);
+
+    if (scan.failed) {
+        for (int i = 0; i < num_columns; i++) {
+            free(result[i]);
+        }
+        free(result);
+        return NULL;
+    }
+    *row_count = num_candidates;
+    return result;
+}
+
+int** top_k(cJSON* metadata, const char* hty_file_path, const char* order_column, int descending, int k,
+            char** projected_columns, int num_columns, int* row_count) {
+    HtyStageTimer query_timer;
+    HTY_STAGE_BEGIN(query_timer);
+    int** result = find_top_k(metadata, hty_file_path, order_column, descending, k, projected_columns, num_columns,
+                              row_count);
+    HTY_QUERY_END("top_k", query_timer);
+    return result;
+}
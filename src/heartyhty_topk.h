@@ -0,0 +1,49 @@
+/**
+ * @file heartyhty_topk.h
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Header file for the ORDER BY ... LIMIT (top-k) operator
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef HEARTYHTY_TOPK_H
+#define HEARTYHTY_TOPK_H
+
+#define HTY_TOPK_MAX_THREADS 8 // Maximum number of scan threads
+
+/**
+ * @brief Function to read the zone map of one column
+ *
+ * @param metadata - metadata object
+ * @param hty_file_path - path to hty file
+ * @param column_index - index of the column in the group
+ * @param num_row_groups - pointer to store the number of row groups
+ * @return unsigned int* - min and max (sort encoded) of each row group, NULL if the file has no zone maps
+ */
+unsigned int* read_zone_map(cJSON* metadata, const char* hty_file_path, int column_index, int* num_row_groups);
+
+/**
+ * @brief Function to get the first k rows ordered by a column (ORDER BY ... LIMIT k)
+ *
+ * Each thread keeps a bounded heap of the best k rows it has seen and skips
+ * row groups whose zone map shows they cannot beat its current k-th row.
+ * The heaps are merged at the end and only the winning rows are read back
+ * for the projected columns. Ties keep file order; NaN sorts above every
+ * other float.
+ *
+ * @param metadata - metadata object
+ * @param hty_file_path - path to hty file
+ * @param order_column - column to order by
+ * @param descending - 1 for ORDER BY ... DESC, 0 for ascending
+ * @param k - maximum number of rows to return
+ * @param projected_columns - array of column names to project
+ * @param num_columns - number of columns to project
+ * @param row_count - pointer to store number of resulting rows
+ * @return int** - 2D array of data in order, NULL on failure
+ */
+int** top_k(cJSON* metadata, const char* hty_file_path, const char* order_column, int descending, int k,
+            char** projected_columns, int num_columns, int* row_count);
+
+#endif // HEARTYHTY_TOPK_H
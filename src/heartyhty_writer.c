@@ -0,0 +1,621 @@
+/**
+ * @file heartyhty_writer.c
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Row writer shared by the converter and add_row
+ * @version 0.1
+ * @date 2024-10-14
+ * 
+ * @copyright Copyright (c) 2024
+ * 
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "../third_party/cJSON/cJSON.h"
+#include "heartyhty_functions.h"
+#include "heartyhty_writer.h"
+#include "heartyhty_bloom.h"
+#include "heartyhty_sort.h"
+#include "heartyhty_estimate.h"
+
+HtyWriter* create_writer(FILE* file, int num_columns, const int* column_types) {
+    HtyWriter* writer = (HtyWriter*)calloc(1, sizeof(HtyWriter));
+    if (writer == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return NULL;
+    }
+    writer->file = file;
+    writer->num_columns = num_columns;
+    writer->column_types = (int*)malloc(num_columns * sizeof(int));
+    writer->min_values = (int*)malloc(num_columns * sizeof(int));
+    writer->max_values = (int*)malloc(num_columns * sizeof(int));
+    writer->stats_valid = (int*)malloc(num_columns * sizeof(int));
+    writer->zone_map = (unsigned int*)malloc(2 * num_columns * sizeof(unsigned int));
+    writer->zone_spill = tmpfile();
+    writer->sketches = (unsigned char*)calloc(num_columns, HTY_SKETCH_REGISTERS);
+    writer->sample = (uint32_t*)malloc((long)num_columns * HTY_SAMPLE_ROWS * sizeof(uint32_t));
+    writer->sample_row_ids = (int*)malloc(HTY_SAMPLE_ROWS * sizeof(int));
+    if (!writer->column_types || !writer->min_values || !writer->max_values || !writer->stats_valid ||
+        !writer->zone_map || !writer->zone_spill || !writer->sketches || !writer->sample || !writer->sample_row_ids) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free_writer(writer);
+        return NULL;
+    }
+    memcpy(writer->column_types, column_types, num_columns * sizeof(int));
+    for (int i = 0; i < num_columns; i++) {
+        writer->stats_valid[i] = 1;
+    }
+    writer->block_rows = HTY_DEFAULT_BLOCK_ROWS;
+    writer->zone_maps_valid = 1;
+    writer->column_stats_valid = 1;
+    writer->sample_state = 0x853c49e6748fea9bULL; // Fixed seed: the same rows give the same statistics
+    set_writer_alignment(writer, HTY_DEFAULT_ALIGNMENT);
+    return writer;
+}
+
+int set_writer_alignment(HtyWriter* writer, int alignment) {
+    if (alignment <= 0 || (alignment & (alignment - 1)) != 0) {
+        fprintf(stderr, "Alignment must be a power of two: %d\n", alignment);
+        return -1;
+    }
+    // Round the row group size up to the next multiple of the alignment
+    long group_bytes = (long)writer->block_rows * writer->num_columns * sizeof(int);
+    writer->alignment = alignment;
+    writer->block_stride = (group_bytes + alignment - 1) & ~(long)(alignment - 1);
+    return 0;
+}
+
+void load_writer_statistics(HtyWriter* writer, cJSON* metadata) {
+    cJSON* groups = cJSON_GetObjectItemCaseSensitive(metadata, "groups");
+    cJSON* group = cJSON_GetArrayItem(groups, 0);  // Assuming single group
+    cJSON* columns = cJSON_GetObjectItemCaseSensitive(group, "columns");
+    writer->num_rows = cJSON_GetObjectItemCaseSensitive(metadata, "num_rows")->valueint;
+
+    // Keep the row group layout of the file; files written before alignment stay packed
+    HtyRowLayout layout;
+    get_row_layout(metadata, &layout);
+    cJSON* alignment = cJSON_GetObjectItemCaseSensitive(metadata, "alignment");
+    writer->block_rows = layout.block_rows;
+    writer->block_stride = layout.block_stride;
+    writer->alignment = cJSON_IsNumber(alignment) ? alignment->valueint : 1;
+    if (writer->num_rows == 0) {
+        return; // Nothing written yet, statistics start fresh
+    }
+
+    int col_idx = 0;
+    cJSON* column;
+    cJSON_ArrayForEach(column, columns) {
+        if (col_idx >= writer->num_columns) {
+            break;
+        }
+        // Older files have no footer statistics; those columns stay unknown
+        writer->stats_valid[col_idx] = get_column_range(column, writer->column_types[col_idx],
+                                                        &writer->min_values[col_idx],
+                                                        &writer->max_values[col_idx]);
+        col_idx++;
+    }
+}
+
+int enable_bloom_filters(HtyWriter* writer, const int* column_indices, int num_bloom_columns) {
+    if (num_bloom_columns <= 0) {
+        return 0;
+    }
+    writer->bloom_filter_bytes = bloom_filter_bytes(writer->block_rows);
+    writer->bloom_columns = (int*)malloc(num_bloom_columns * sizeof(int));
+    writer->bloom_filters = (unsigned int*)calloc(num_bloom_columns, writer->bloom_filter_bytes);
+    writer->bloom_spill = tmpfile();
+    if (!writer->bloom_columns || !writer->bloom_filters || !writer->bloom_spill) {
+        fprintf(stderr, "Error preparing Bloom filters\n");
+        return -1;
+    }
+    memcpy(writer->bloom_columns, column_indices, num_bloom_columns * sizeof(int));
+    writer->num_bloom_columns = num_bloom_columns;
+    return 0;
+}
+
+/**
+ * @brief Function to copy bytes from the current position of one file to another
+ * 
+ * @param source - file to read from
+ * @param destination - file to write to
+ * @param num_bytes - number of bytes to copy
+ * @return int - 0 on success, -1 if the source ends early
+ */
+static int copy_bytes(FILE* source, FILE* destination, long num_bytes) {
+    char buffer[4096];
+    while (num_bytes > 0) {
+        size_t bytes_read = fread(buffer, 1, num_bytes < (long)sizeof(buffer) ? num_bytes : (long)sizeof(buffer), source);
+        if (bytes_read == 0) {
+            return -1;
+        }
+        fwrite(buffer, 1, bytes_read, destination);
+        num_bytes -= bytes_read;
+    }
+    return 0;
+}
+
+int load_writer_bloom_filters(HtyWriter* writer, cJSON* metadata, FILE* source_file) {
+    cJSON* bloom = cJSON_GetObjectItemCaseSensitive(metadata, "bloom_filters");
+    if (bloom == NULL) {
+        return 0; // File has no Bloom filters to continue
+    }
+    cJSON* columns = cJSON_GetObjectItemCaseSensitive(
+        cJSON_GetArrayItem(cJSON_GetObjectItemCaseSensitive(metadata, "groups"), 0), "columns");
+    cJSON* bloom_columns = cJSON_GetObjectItemCaseSensitive(bloom, "columns");
+    int num_bloom_columns = cJSON_GetArraySize(bloom_columns);
+    int* column_indices = (int*)malloc((num_bloom_columns + 1) * sizeof(int));
+
+    // Resolve the filtered column names to column indices
+    int bloom_idx = 0;
+    cJSON* name;
+    cJSON_ArrayForEach(name, bloom_columns) {
+        int col_idx = 0;
+        column_indices[bloom_idx] = -1;
+        cJSON* column;
+        cJSON_ArrayForEach(column, columns) {
+            if (strcmp(cJSON_GetObjectItemCaseSensitive(column, "column_name")->valuestring, name->valuestring) == 0) {
+                column_indices[bloom_idx] = col_idx;
+                break;
+            }
+            col_idx++;
+        }
+        if (column_indices[bloom_idx] == -1) {
+            fprintf(stderr, "Bloom filter column not found: %s\n", name->valuestring);
+            free(column_indices);
+            return -1;
+        }
+        bloom_idx++;
+    }
+
+    writer->block_rows = get_block_rows(metadata);
+    int status = enable_bloom_filters(writer, column_indices, num_bloom_columns);
+    free(column_indices);
+    if (status != 0) {
+        return -1;
+    }
+
+    int num_rows = cJSON_GetObjectItemCaseSensitive(metadata, "num_rows")->valueint;
+    long bloom_offset = (long)cJSON_GetObjectItemCaseSensitive(bloom, "offset")->valuedouble;
+    long group_bytes = (long)num_bloom_columns * writer->bloom_filter_bytes;
+    int full_groups = num_rows / writer->block_rows;
+
+    // Filters of full row groups do not change, copy them as they are
+    fseek(source_file, bloom_offset, SEEK_SET);
+    if (copy_bytes(source_file, writer->bloom_spill, full_groups * group_bytes) != 0) {
+        fprintf(stderr, "Error reading Bloom filters\n");
+        return -1;
+    }
+
+    // The last row group keeps growing, so its filters become the current ones
+    if (num_rows % writer->block_rows != 0 &&
+        fread(writer->bloom_filters, 1, group_bytes, source_file) != (size_t)group_bytes) {
+        fprintf(stderr, "Error reading Bloom filters\n");
+        return -1;
+    }
+    return 0;
+}
+
+int load_writer_zone_maps(HtyWriter* writer, cJSON* metadata, FILE* source_file) {
+    int num_rows = cJSON_GetObjectItemCaseSensitive(metadata, "num_rows")->valueint;
+    cJSON* zone_maps = cJSON_GetObjectItemCaseSensitive(metadata, "zone_maps");
+    if (zone_maps == NULL) {
+        writer->zone_maps_valid = num_rows == 0; // Older rows have no zone maps to continue
+        return 0;
+    }
+
+    long zone_offset = (long)cJSON_GetObjectItemCaseSensitive(zone_maps, "offset")->valuedouble;
+    long group_bytes = 2L * writer->num_columns * sizeof(unsigned int);
+    int full_groups = num_rows / writer->block_rows;
+
+    // Zone maps of full row groups do not change, copy them as they are
+    fseek(source_file, zone_offset, SEEK_SET);
+    if (copy_bytes(source_file, writer->zone_spill, full_groups * group_bytes) != 0 ||
+        (num_rows % writer->block_rows != 0 &&
+         fread(writer->zone_map, 1, group_bytes, source_file) != (size_t)group_bytes)) {
+        fprintf(stderr, "Error reading zone maps\n");
+        return -1;
+    }
+    return 0;
+}
+
+int load_writer_column_stats(HtyWriter* writer, cJSON* metadata, FILE* source_file) {
+    int num_rows = cJSON_GetObjectItemCaseSensitive(metadata, "num_rows")->valueint;
+    cJSON* sketches = cJSON_GetObjectItemCaseSensitive(metadata, "distinct_sketches");
+    cJSON* precision = cJSON_GetObjectItemCaseSensitive(sketches, "precision");
+    if (num_rows == 0) {
+        return 0;
+    }
+    if (sketches == NULL || !cJSON_IsNumber(precision) || precision->valueint != HTY_SKETCH_PRECISION) {
+        writer->column_stats_valid = 0; // Older rows have no statistics to continue
+        return 0;
+    }
+
+    long sketch_offset = (long)cJSON_GetObjectItemCaseSensitive(sketches, "offset")->valuedouble;
+    size_t sketch_bytes = (size_t)writer->num_columns * HTY_SKETCH_REGISTERS;
+    fseek(source_file, sketch_offset, SEEK_SET);
+    if (fread(writer->sketches, 1, sketch_bytes, source_file) != sketch_bytes) {
+        fprintf(stderr, "Error reading distinct value sketches\n");
+        return -1;
+    }
+
+    // Continue the stored reservoir, so the sample stays uniform over every row
+    cJSON* row_sample = cJSON_GetObjectItemCaseSensitive(metadata, "row_sample");
+    cJSON* row_ids_offset = cJSON_GetObjectItemCaseSensitive(row_sample, "row_ids_offset");
+    int full_sample = num_rows < HTY_SAMPLE_ROWS ? num_rows : HTY_SAMPLE_ROWS;
+    if (row_sample != NULL && cJSON_GetObjectItemCaseSensitive(row_sample, "rows")->valueint == full_sample &&
+        cJSON_IsNumber(row_ids_offset)) {
+        writer->sample_rows = full_sample;
+        fseek(source_file, (long)cJSON_GetObjectItemCaseSensitive(row_sample, "offset")->valuedouble, SEEK_SET);
+        for (int i = 0; i < writer->num_columns; i++) {
+            uint32_t* column_sample = writer->sample + (long)i * HTY_SAMPLE_ROWS;
+            if (fread(column_sample, sizeof(uint32_t), writer->sample_rows, source_file) != (size_t)writer->sample_rows) {
+                fprintf(stderr, "Error reading row sample\n");
+                return -1;
+            }
+            for (int s = 0; s < writer->sample_rows; s++) {
+                column_sample[s] = encode_sort_value((int)column_sample[s], writer->column_types[i]);
+            }
+        }
+        fseek(source_file, (long)row_ids_offset->valuedouble, SEEK_SET);
+        if (fread(writer->sample_row_ids, sizeof(int), writer->sample_rows, source_file) != (size_t)writer->sample_rows) {
+            fprintf(stderr, "Error reading row sample\n");
+            return -1;
+        }
+        return 0;
+    }
+
+    // Without one (or one of another size or without row ids), rows spread evenly over the file stand in for the reservoir so far
+    HtyRowLayout layout;
+    get_row_layout(metadata, &layout);
+    int* row = (int*)malloc(writer->num_columns * sizeof(int));
+    if (row == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    writer->sample_rows = num_rows < HTY_SAMPLE_ROWS ? num_rows : HTY_SAMPLE_ROWS;
+    for (int s = 0; s < writer->sample_rows; s++) {
+        writer->sample_row_ids[s] = (int)((long)s * num_rows / writer->sample_rows);
+        fseek(source_file, row_position(&layout, writer->sample_row_ids[s]), SEEK_SET);
+        if (fread(row, sizeof(int), writer->num_columns, source_file) != (size_t)writer->num_columns) {
+            fprintf(stderr, "Error reading row data\n");
+            free(row);
+            return -1;
+        }
+        for (int i = 0; i < writer->num_columns; i++) {
+            writer->sample[(long)i * HTY_SAMPLE_ROWS + s] = encode_sort_value(row[i], writer->column_types[i]);
+        }
+    }
+    free(row);
+    return 0;
+}
+
+/**
+ * @brief Function to add a row to the distinct value sketches and the reservoir sample
+ * 
+ * Called before num_rows counts the row.
+ * 
+ * @param writer - writer object
+ * @param row - values of the row
+ */
+static void sample_row(HtyWriter* writer, const int* row) {
+    for (int i = 0; i < writer->num_columns; i++) {
+        sketch_add(writer->sketches + (long)i * HTY_SKETCH_REGISTERS, row[i], writer->column_types[i]);
+    }
+    // Reservoir sampling: row n replaces a random slot with probability HTY_SAMPLE_ROWS / (n + 1)
+    long slot = writer->sample_rows;
+    if (writer->sample_rows == HTY_SAMPLE_ROWS) {
+        writer->sample_state = writer->sample_state * 6364136223846793005ULL + 1442695040888963407ULL;
+        slot = (long)((writer->sample_state >> 33) % ((uint64_t)writer->num_rows + 1));
+        if (slot >= HTY_SAMPLE_ROWS) {
+            return;
+        }
+    } else {
+        writer->sample_rows++;
+    }
+    for (int i = 0; i < writer->num_columns; i++) {
+        writer->sample[(long)i * HTY_SAMPLE_ROWS + slot] = encode_sort_value(row[i], writer->column_types[i]);
+    }
+    writer->sample_row_ids[slot] = writer->num_rows;
+}
+
+/**
+ * @brief Function to move the filters of the current row group to the spill file
+ * 
+ * @param writer - writer object
+ */
+static void flush_bloom_filters(HtyWriter* writer) {
+    size_t group_bytes = (size_t)writer->num_bloom_columns * writer->bloom_filter_bytes;
+    fwrite(writer->bloom_filters, 1, group_bytes, writer->bloom_spill);
+    memset(writer->bloom_filters, 0, group_bytes);
+}
+
+int write_row(HtyWriter* writer, const int* row) {
+    if (fwrite(row, sizeof(int), writer->num_columns, writer->file) != (size_t)writer->num_columns) {
+        fprintf(stderr, "Error writing row data\n");
+        return -1;
+    }
+
+    // Update min/max statistics
+    for (int i = 0; i < writer->num_columns; i++) {
+        if (!writer->stats_valid[i]) {
+            continue;
+        }
+        if (writer->column_types[i] == 1) { // float
+            float value = *(float*)&row[i];
+            if (value != value) {
+                writer->stats_valid[i] = 0; // NaN has no place in a min/max range
+                continue;
+            }
+        }
+        if (writer->num_rows == 0 || compare_values(row[i], writer->min_values[i], OP_LESS, writer->column_types[i])) {
+            writer->min_values[i] = row[i];
+        }
+        if (writer->num_rows == 0 || compare_values(row[i], writer->max_values[i], OP_GREATER, writer->column_types[i])) {
+            writer->max_values[i] = row[i];
+        }
+    }
+    // Add the row to the Bloom filters of its row group
+    if (writer->num_bloom_columns > 0) {
+        int num_blocks = writer->bloom_filter_bytes / (HTY_BLOOM_BLOCK_WORDS * sizeof(unsigned int));
+        int filter_words = writer->bloom_filter_bytes / sizeof(unsigned int);
+        for (int i = 0; i < writer->num_bloom_columns; i++) {
+            int col_idx = writer->bloom_columns[i];
+            bloom_insert(writer->bloom_filters + (long)i * filter_words, num_blocks, row[col_idx],
+                         writer->column_types[col_idx]);
+        }
+    }
+
+    if (writer->column_stats_valid) {
+        sample_row(writer, row);
+    }
+
+    // Widen the zone map of the row group
+    int first_in_group = writer->num_rows % writer->block_rows == 0;
+    for (int i = 0; i < writer->num_columns; i++) {
+        unsigned int encoded = encode_sort_value(row[i], writer->column_types[i]);
+        if (first_in_group || encoded < writer->zone_map[2 * i]) {
+            writer->zone_map[2 * i] = encoded;
+        }
+        if (first_in_group || encoded > writer->zone_map[2 * i + 1]) {
+            writer->zone_map[2 * i + 1] = encoded;
+        }
+    }
+
+    writer->num_rows++;
+    if (writer->num_rows % writer->block_rows == 0) { // Row group is full
+        // Pad up to where the next row group starts
+        static const char padding[4096];
+        long padding_bytes = writer->block_stride - (long)writer->block_rows * writer->num_columns * sizeof(int);
+        while (padding_bytes > 0) {
+            size_t chunk = padding_bytes < (long)sizeof(padding) ? (size_t)padding_bytes : sizeof(padding);
+            if (fwrite(padding, 1, chunk, writer->file) != chunk) {
+                fprintf(stderr, "Error writing row data\n");
+                return -1;
+            }
+            padding_bytes -= chunk;
+        }
+        if (writer->num_bloom_columns > 0) {
+            flush_bloom_filters(writer);
+        }
+        fwrite(writer->zone_map, sizeof(unsigned int), 2 * writer->num_columns, writer->zone_spill);
+    }
+    return 0;
+}
+
+/**
+ * @brief Function to convert a stored value into a JSON number
+ * 
+ * @param value - value (float bits for float columns)
+ * @param is_float - flag to indicate if value is float
+ * @return cJSON* - number object
+ */
+static cJSON* create_value_number(int value, int is_float) {
+    if (is_float) {
+        return cJSON_CreateNumber(*(float*)&value);
+    }
+    return cJSON_CreateNumber(value);
+}
+
+/**
+ * @brief Function to set or replace an item of a JSON object
+ * 
+ * @param object - object to modify
+ * @param name - key of the item
+ * @param item - new item
+ */
+static void set_object_item(cJSON* object, const char* name, cJSON* item) {
+    if (cJSON_GetObjectItemCaseSensitive(object, name) != NULL) {
+        cJSON_ReplaceItemInObjectCaseSensitive(object, name, item);
+    } else {
+        cJSON_AddItemToObject(object, name, item);
+    }
+}
+
+/**
+ * @brief Function to give a new file an id, unless its metadata already has one
+ * 
+ * The id mixes the clock, the process id and a counter, so two files
+ * written at the same path never share one.
+ * 
+ * @param metadata - metadata object
+ */
+static void assign_file_id(cJSON* metadata) {
+    static unsigned long long counter = 0;
+    if (cJSON_IsString(cJSON_GetObjectItemCaseSensitive(metadata, "file_id"))) {
+        return; // Appends keep the id, so the indexes carried over stay valid
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    unsigned long long id = ((unsigned long long)now.tv_sec * 1000000000ULL + now.tv_nsec) ^
+                            ((unsigned long long)getpid() << 40) ^
+                            (__atomic_add_fetch(&counter, 1, __ATOMIC_RELAXED) * 0x9e3779b97f4a7c15ULL);
+    // splitmix64 finalizer, so nearby clocks give unrelated ids
+    id ^= id >> 30;
+    id *= 0xbf58476d1ce4e5b9ULL;
+    id ^= id >> 27;
+    id *= 0x94d049bb133111ebULL;
+    id ^= id >> 31;
+    char text[17];
+    snprintf(text, sizeof(text), "%016llx", id != 0 ? id : 1);  // 0 means no id
+    cJSON_DeleteItemFromObjectCaseSensitive(metadata, "file_id");
+    cJSON_AddStringToObject(metadata, "file_id", text);
+}
+
+int finish_writer(HtyWriter* writer, cJSON* metadata) {
+    assign_file_id(metadata);
+    cJSON* groups = cJSON_GetObjectItemCaseSensitive(metadata, "groups");
+    cJSON* group = cJSON_GetArrayItem(groups, 0);  // Assuming single group
+    cJSON* columns = cJSON_GetObjectItemCaseSensitive(group, "columns");
+
+    // Store footer statistics next to each column definition
+    int col_idx = 0;
+    cJSON* column;
+    cJSON_ArrayForEach(column, columns) {
+        if (col_idx >= writer->num_columns) {
+            break;
+        }
+        if (writer->num_rows > 0 && writer->stats_valid[col_idx]) {
+            set_object_item(column, "min", create_value_number(writer->min_values[col_idx], writer->column_types[col_idx]));
+            set_object_item(column, "max", create_value_number(writer->max_values[col_idx], writer->column_types[col_idx]));
+        } else {
+            cJSON_DeleteItemFromObjectCaseSensitive(column, "min");
+            cJSON_DeleteItemFromObjectCaseSensitive(column, "max");
+        }
+        if (writer->num_rows > 0 && writer->column_stats_valid) {
+            if (store_column_stats(column, writer->sample + (long)col_idx * HTY_SAMPLE_ROWS, writer->sample_rows,
+                                   writer->num_rows, writer->column_types[col_idx],
+                                   sketch_estimate(writer->sketches + (long)col_idx * HTY_SKETCH_REGISTERS)) != 0) {
+                return -1;
+            }
+        } else {
+            remove_column_stats(column);
+        }
+        col_idx++;
+    }
+
+    cJSON_DeleteItemFromObjectCaseSensitive(metadata, "block_rows");
+    cJSON_AddNumberToObject(metadata, "block_rows", writer->block_rows);
+    cJSON_DeleteItemFromObjectCaseSensitive(metadata, "alignment");
+    cJSON_AddNumberToObject(metadata, "alignment", writer->alignment);
+    cJSON_DeleteItemFromObjectCaseSensitive(metadata, "block_stride");
+    cJSON_AddNumberToObject(metadata, "block_stride", writer->block_stride);
+
+    // Write the Bloom filters right after the raw data
+    cJSON_DeleteItemFromObjectCaseSensitive(metadata, "bloom_filters");
+    if (writer->num_bloom_columns > 0) {
+        if (writer->num_rows % writer->block_rows != 0) {
+            flush_bloom_filters(writer); // Last, partly filled row group
+        }
+        long bloom_offset = ftell(writer->file);
+        char buffer[4096];
+        size_t bytes_read;
+        rewind(writer->bloom_spill);
+        while ((bytes_read = fread(buffer, 1, sizeof(buffer), writer->bloom_spill)) > 0) {
+            fwrite(buffer, 1, bytes_read, writer->file);
+        }
+
+        cJSON* bloom = cJSON_AddObjectToObject(metadata, "bloom_filters");
+        cJSON_AddNumberToObject(bloom, "offset", bloom_offset);
+        cJSON_AddNumberToObject(bloom, "filter_bytes", writer->bloom_filter_bytes);
+        cJSON* bloom_columns = cJSON_AddArrayToObject(bloom, "columns");
+        for (int i = 0; i < writer->num_bloom_columns; i++) {
+            cJSON* bloom_column = cJSON_GetArrayItem(columns, writer->bloom_columns[i]);
+            cJSON_AddItemToArray(bloom_columns, cJSON_CreateString(
+                cJSON_GetObjectItemCaseSensitive(bloom_column, "column_name")->valuestring));
+        }
+    }
+
+    // Write the zone maps after the Bloom filters
+    cJSON_DeleteItemFromObjectCaseSensitive(metadata, "zone_maps");
+    if (writer->zone_maps_valid && writer->num_rows > 0) {
+        if (writer->num_rows % writer->block_rows != 0) {
+            fwrite(writer->zone_map, sizeof(unsigned int), 2 * writer->num_columns, writer->zone_spill);
+        }
+        long num_groups = (writer->num_rows + writer->block_rows - 1) / writer->block_rows;
+        long zone_offset = ftell(writer->file);
+        rewind(writer->zone_spill);
+        if (copy_bytes(writer->zone_spill, writer->file, num_groups * 2 * writer->num_columns * sizeof(unsigned int)) != 0) {
+            fprintf(stderr, "Error writing zone maps\n");
+            return -1;
+        }
+        cJSON* zone_maps = cJSON_AddObjectToObject(metadata, "zone_maps");
+        cJSON_AddNumberToObject(zone_maps, "offset", zone_offset);
+    }
+
+    // Write the distinct value sketches after the zone maps so appends can continue them
+    cJSON_DeleteItemFromObjectCaseSensitive(metadata, "distinct_sketches");
+    if (writer->column_stats_valid && writer->num_rows > 0) {
+        long sketch_offset = ftell(writer->file);
+        size_t sketch_bytes = (size_t)writer->num_columns * HTY_SKETCH_REGISTERS;
+        if (fwrite(writer->sketches, 1, sketch_bytes, writer->file) != sketch_bytes) {
+            fprintf(stderr, "Error writing distinct value sketches\n");
+            return -1;
+        }
+        cJSON* sketches = cJSON_AddObjectToObject(metadata, "distinct_sketches");
+        cJSON_AddNumberToObject(sketches, "offset", sketch_offset);
+        cJSON_AddNumberToObject(sketches, "precision", HTY_SKETCH_PRECISION);
+    }
+
+    // Write the reservoir as the row sample for approximate queries, one column after another
+    cJSON_DeleteItemFromObjectCaseSensitive(metadata, "row_sample");
+    if (writer->column_stats_valid && writer->num_rows > 0) {
+        long sample_offset = ftell(writer->file);
+        for (int i = 0; i < writer->num_columns; i++) {
+            const uint32_t* column_sample = writer->sample + (long)i * HTY_SAMPLE_ROWS;
+            for (int s = 0; s < writer->sample_rows; s++) {
+                int value = decode_sort_value(column_sample[s], writer->column_types[i]);
+                if (fwrite(&value, sizeof(int), 1, writer->file) != 1) {
+                    fprintf(stderr, "Error writing row sample\n");
+                    return -1;
+                }
+            }
+        }
+        // Row ids follow, so deletes and updates can find their rows in the sample
+        long row_ids_offset = ftell(writer->file);
+        if (fwrite(writer->sample_row_ids, sizeof(int), writer->sample_rows, writer->file) != (size_t)writer->sample_rows) {
+            fprintf(stderr, "Error writing row sample\n");
+            return -1;
+        }
+        cJSON* row_sample = cJSON_AddObjectToObject(metadata, "row_sample");
+        cJSON_AddNumberToObject(row_sample, "offset", sample_offset);
+        cJSON_AddNumberToObject(row_sample, "rows", writer->sample_rows);
+        cJSON_AddNumberToObject(row_sample, "row_ids_offset", row_ids_offset);
+    }
+
+    // Write metadata followed by its size
+    char* metadata_str = cJSON_PrintUnformatted(metadata);
+    if (metadata_str == NULL) {
+        fprintf(stderr, "Error creating metadata string\n");
+        return -1;
+    }
+    int metadata_size = strlen(metadata_str);
+    fwrite(metadata_str, 1, metadata_size, writer->file);
+    fwrite(&metadata_size, sizeof(int), 1, writer->file);
+    free(metadata_str);
+    return 0;
+}
+
+void free_writer(HtyWriter* writer) {
+    if (writer == NULL) {
+        return;
+    }
+    free(writer->column_types);
+    free(writer->min_values);
+    free(writer->max_values);
+    free(writer->stats_valid);
+    free(writer->bloom_columns);
+    free(writer->bloom_filters);
+    if (writer->bloom_spill != NULL) {
+        fclose(writer->bloom_spill);
+    }
+    free(writer->zone_map);
+    if (writer->zone_spill != NULL) {
+        fclose(writer->zone_spill);
+    }
+    free(writer->sketches);
+    free(writer->sample);
+    free(writer->sample_row_ids);
+    free(writer);
+}
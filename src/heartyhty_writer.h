@@ -0,0 +1,168 @@
+/**
+ * @file heartyhty_writer.h
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Header file for the HeartyHTY row writer shared by the converter and add_row
+ * @version 0.1
+ * @date 2024-10-14
+ * 
+ * @copyright Copyright (c) 2024
+ * 
+ */
+#ifndef HEARTYHTY_WRITER_H
+#define HEARTYHTY_WRITER_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/**
+ * @brief Row writer state
+ * 
+ * Writes rows to the raw data section, padding each full row group to the
+ * alignment so that every row group starts on an aligned offset, and keeps the per-column
+ * min/max footer statistics, the per-row-group zone maps and the
+ * per-row-group Bloom filters up to date while doing so. It also feeds a
+ * distinct value sketch per column and a reservoir sample of rows, from
+ * which finish_writer() stores the column statistics used for estimates and
+ * the row sample used by approximate queries.
+ */
+typedef struct {
+    FILE* file;          // Output file positioned at the end of the raw data
+    int num_columns;     // Number of columns in each row
+    int* column_types;   // 0 for int, 1 for float
+    int num_rows;        // Rows covered by the statistics (existing + written)
+    int* min_values;     // Minimum value of each column (float bits for float columns)
+    int* max_values;     // Maximum value of each column (float bits for float columns)
+    int* stats_valid;    // 1 if min/max of the column can be trusted
+    int block_rows;      // Rows per row group
+    int alignment;       // Row groups start on multiples of this many bytes
+    long block_stride;   // Bytes from the start of one row group to the next
+    int num_bloom_columns;        // Number of columns with Bloom filters
+    int* bloom_columns;           // Column index of each Bloom filter
+    int bloom_filter_bytes;       // Size of the filter of one row group and column
+    unsigned int* bloom_filters;  // Filters of the current row group, one column after another
+    FILE* bloom_spill;            // Finished row group filters, copied after the raw data at the end
+    int zone_maps_valid;          // 1 if every row group so far has a zone map
+    unsigned int* zone_map;       // Min/max of each column in the current row group (sort encoded)
+    FILE* zone_spill;             // Finished row group zone maps, copied after the raw data at the end
+    int column_stats_valid;       // 1 if the sketches and the sample cover every row so far
+    unsigned char* sketches;      // Distinct value sketch of each column, HTY_SKETCH_REGISTERS each
+    uint32_t* sample;             // Reservoir sample of rows (sort encoded), HTY_SAMPLE_ROWS per column
+    int* sample_row_ids;          // Row id of each sampled row
+    int sample_rows;              // Rows in the sample
+    uint64_t sample_state;        // Random state of the reservoir
+} HtyWriter;
+
+/**
+ * @brief Function to create a row writer
+ * 
+ * @param file - output file positioned where the rows should go
+ * @param num_columns - number of columns in each row
+ * @param column_types - type of each column (0 for int, 1 for float)
+ * @return HtyWriter* - writer object, NULL on failure
+ */
+HtyWriter* create_writer(FILE* file, int num_columns, const int* column_types);
+
+/**
+ * @brief Function to choose the boundary that row groups are aligned to
+ * 
+ * Must be called before the first row is written. Use 1 for packed rows,
+ * 64 for aligned vector loads or 4096 for O_DIRECT and huge pages.
+ * 
+ * @param writer - writer object
+ * @param alignment - boundary in bytes (a power of two)
+ * @return int - 0 on success, -1 on failure
+ */
+int set_writer_alignment(HtyWriter* writer, int alignment);
+
+/**
+ * @brief Function to seed the writer statistics from existing metadata
+ * 
+ * Used when appending to an existing file. Columns without footer
+ * statistics are marked as unknown so that no wrong min/max is written.
+ * The row group layout of the file is kept as it is.
+ * 
+ * @param writer - writer object
+ * @param metadata - metadata object of the existing file
+ */
+void load_writer_statistics(HtyWriter* writer, cJSON* metadata);
+
+/**
+ * @brief Function to build a Bloom filter per row group for some columns
+ * 
+ * Must be called before the first row is written.
+ * 
+ * @param writer - writer object
+ * @param column_indices - index of each column to build Bloom filters for
+ * @param num_bloom_columns - number of columns
+ * @return int - 0 on success, -1 on failure
+ */
+int enable_bloom_filters(HtyWriter* writer, const int* column_indices, int num_bloom_columns);
+
+/**
+ * @brief Function to continue the Bloom filters of an existing file
+ * 
+ * Copies the filters of the full row groups from the source file and
+ * reloads the filters of the last, partly filled row group.
+ * 
+ * @param writer - writer object
+ * @param metadata - metadata object of the existing file
+ * @param source_file - existing file
+ * @return int - 0 on success, -1 on failure
+ */
+int load_writer_bloom_filters(HtyWriter* writer, cJSON* metadata, FILE* source_file);
+
+/**
+ * @brief Function to continue the zone maps of an existing file
+ * 
+ * Copies the zone maps of the full row groups from the source file and
+ * reloads the one of the last, partly filled row group. Files written
+ * before zone maps existed get none.
+ * 
+ * @param writer - writer object
+ * @param metadata - metadata object of the existing file
+ * @param source_file - existing file
+ * @return int - 0 on success, -1 on failure
+ */
+int load_writer_zone_maps(HtyWriter* writer, cJSON* metadata, FILE* source_file);
+
+/**
+ * @brief Function to continue the column statistics of an existing file
+ * 
+ * Reloads the distinct value sketches and the row sample, which the new
+ * rows continue as a reservoir. Files with sketches but no row sample (or one
+ * without row ids) refill it from rows spread evenly across the file. Files
+ * written before column statistics get none.
+ * 
+ * @param writer - writer object
+ * @param metadata - metadata object of the existing file
+ * @param source_file - existing file
+ * @return int - 0 on success, -1 on failure
+ */
+int load_writer_column_stats(HtyWriter* writer, cJSON* metadata, FILE* source_file);
+
+/**
+ * @brief Function to write one row
+ * 
+ * @param writer - writer object
+ * @param row - values of the row (float bits for float columns)
+ * @return int - 0 on success, -1 on failure
+ */
+int write_row(HtyWriter* writer, const int* row);
+
+/**
+ * @brief Function to store the statistics in the metadata and write the footer
+ * 
+ * @param writer - writer object
+ * @param metadata - metadata object to update and write
+ * @return int - 0 on success, -1 on failure
+ */
+int finish_writer(HtyWriter* writer, cJSON* metadata);
+
+/**
+ * @brief Function to free a writer (does not close the file)
+ * 
+ * @param writer - writer object
+ */
+void free_writer(HtyWriter* writer);
+
+#endif // HEARTYHTY_WRITER_H
@@ -0,0 +1,812 @@
+/**
+ * @file hty_bench.c
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Benchmarks for HeartyHTY: synthetic .hty generator, per-operation timings and baseline comparison
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include "../third_party/cJSON/cJSON.h" // Include cJSON library
+#include "heartyhty_functions.h" // Include heartyhty_functions.h
+#include "heartyhty_writer.h" // Include row writer used by the generator
+#include "heartyhty_pool.h" // Include column reader and buffer pool
+#include "heartyhty_results.h" // Include result cache
+#include "heartyhty_output.h" // Include CSV writer used for the converter input
+#include "heartyhty_stats.h" // Include hardware counters for profiled runs
+
+#define BENCH_MAX_COLUMNS 64           // Columns a generated file may have
+#define BENCH_DEFAULT_REPEATS 5        // Runs of each benchmark
+#define BENCH_DEFAULT_CSV_ROWS 100000  // Rows converted by the csv_to_hty benchmark
+#define BENCH_ADD_ROWS 1000            // Rows appended by the add_row benchmark
+#define BENCH_DEFAULT_THRESHOLD 10.0   // Slowdown in percent that compare reports as a regression
+#define BENCH_NOISE_MS 0.05            // Differences below this many ms are never regressions
+
+static const double selectivities[] = {0.001, 0.01, 0.1, 0.5, 0.9}; // Target selectivities of the range filters
+#define NUM_SELECTIVITIES (int)(sizeof(selectivities) / sizeof(selectivities[0]))
+
+/**
+ * @brief Shape of a generated file
+ */
+typedef struct {
+    long num_rows;                       // Rows to write
+    int num_columns;                     // Columns, named c0, c1, ...
+    int column_types[BENCH_MAX_COLUMNS]; // 0 for int, 1 for float
+    int block_rows;                      // Rows per row group
+    int alignment;                       // Row group alignment in bytes
+    long cardinality;                    // Distinct values per column
+    double sortedness;                   // Fraction of c0 values that follow the row order
+    uint64_t seed;                       // Seed; the same seed gives the same file
+} HtyGenSpec;
+
+/**
+ * @brief Arguments of one benchmarked operation
+ */
+typedef struct {
+    const char* hty_file_path; // File under test
+    cJSON* metadata;           // Its metadata
+    char** columns;            // Columns to project
+    int num_columns;           // Number of columns to project
+    const char* column;        // Column to project or filter on
+    int op;                    // Filter operation
+    int value;                 // Filter value
+    int** new_rows;            // Values for add_row, one array of BENCH_ADD_ROWS per column
+    const char* scratch_path;  // Output of add_row
+    const char* command;       // Command the converter benchmark runs
+    long csv_rows;             // Rows the converter benchmark converts
+} BenchArgs;
+
+typedef long (*BenchFunction)(BenchArgs* args); // Runs the operation once, returns result rows or -1
+
+static int profile_counters = 0; // run -p: one extra run of each benchmark under hardware counters
+
+/**
+ * @brief Mix a 64-bit value into a well-distributed hash (splitmix64 finalizer)
+ *
+ * @param x - value
+ * @return uint64_t - hash
+ */
+static uint64_t mix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/**
+ * @brief Compute the value of a cell of a generated file
+ *
+ * Values only depend on the seed, the row and the column, so any part of a
+ * file can be generated again. Column values are uniform in [0, cardinality);
+ * c0 follows the row order for a fraction sortedness of the rows. Floats are
+ * the int value plus 0.5.
+ *
+ * @param spec - file shape
+ * @param row - row number
+ * @param column - column index
+ * @return int - value (float bits for float columns)
+ */
+static int generate_value(const HtyGenSpec* spec, long row, int column) {
+    uint64_t hash = mix64(spec->seed ^ mix64(((uint64_t)row << 8) | (uint64_t)column));
+    long value = (long)(hash % (uint64_t)spec->cardinality);
+    if (column == 0 && (double)(hash >> 11) / (double)(1ULL << 53) < spec->sortedness) {
+        value = (long)((double)row * spec->cardinality / spec->num_rows);
+    }
+    if (spec->column_types[column] == 1) {
+        float float_value = (float)value + 0.5f;
+        int bits;
+        memcpy(&bits, &float_value, sizeof(float));
+        return bits;
+    }
+    return (int)value;
+}
+
+/**
+ * @brief Parse a count with an optional K, M or B suffix (thousand, million, billion)
+ *
+ * @param text - text such as "10M"
+ * @return long - count, -1 if invalid
+ */
+static long parse_count(const char* text) {
+    char* end;
+    double count = strtod(text, &end);
+    if (end == text) {
+        return -1;
+    }
+    if (*end == 'K' || *end == 'k') {
+        count *= 1e3;
+        end++;
+    } else if (*end == 'M' || *end == 'm') {
+        count *= 1e6;
+        end++;
+    } else if (*end == 'B' || *end == 'b') {
+        count *= 1e9;
+        end++;
+    }
+    return *end == '\0' && count >= 0 ? (long)count : -1;
+}
+
+/**
+ * @brief Get the time from a monotonic clock in milliseconds
+ *
+ * @return double - time in ms
+ */
+static double now_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
+
+/**
+ * @brief Generate a .hty file
+ *
+ * Rows go straight to the row writer, so the size is only limited by disk
+ * space (up to INT_MAX rows, the limit of the format).
+ *
+ * @param spec - file shape
+ * @param hty_file_path - output path
+ * @param bloom_columns - comma-separated columns to build Bloom filters for, NULL for none
+ * @return int - 0 on success, 1 on failure
+ */
+int generate_file(const HtyGenSpec* spec, const char* hty_file_path, char* bloom_columns) {
+    FILE* file = fopen(hty_file_path, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "Error opening output file: %s\n", hty_file_path);
+        return 1;
+    }
+
+    // Same metadata as csv_to_hty writes
+    cJSON* metadata = cJSON_CreateObject();
+    cJSON_AddNumberToObject(metadata, "num_rows", (double)spec->num_rows);
+    cJSON_AddNumberToObject(metadata, "num_groups", 1);
+    cJSON* groups = cJSON_AddArrayToObject(metadata, "groups");
+    cJSON* group = cJSON_CreateObject();
+    cJSON_AddNumberToObject(group, "num_columns", spec->num_columns);
+    cJSON_AddNumberToObject(group, "offset", 0);
+    cJSON* columns = cJSON_AddArrayToObject(group, "columns");
+    for (int i = 0; i < spec->num_columns; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "c%d", i);
+        cJSON* column = cJSON_CreateObject();
+        cJSON_AddStringToObject(column, "column_name", name);
+        cJSON_AddStringToObject(column, "column_type", spec->column_types[i] == 0 ? "int" : "float");
+        cJSON_AddItemToArray(columns, column);
+    }
+    cJSON_AddItemToArray(groups, group);
+
+    // Row group layout before the Bloom filters, whose size depends on it
+    HtyWriter* writer = create_writer(file, spec->num_columns, spec->column_types);
+    int status = writer != NULL ? 0 : 1;
+    if (status == 0) {
+        writer->block_rows = spec->block_rows;
+        status = set_writer_alignment(writer, spec->alignment) == 0 ? 0 : 1;
+    }
+    int bloom_indices[BENCH_MAX_COLUMNS];
+    int num_bloom_columns = 0;
+    for (char* token = bloom_columns != NULL ? strtok(bloom_columns, ", ") : NULL; token != NULL;
+         token = strtok(NULL, ", ")) {
+        int index = token[0] == 'c' ? atoi(token + 1) : -1;
+        if (index < 0 || index >= spec->num_columns || num_bloom_columns == BENCH_MAX_COLUMNS) {
+            fprintf(stderr, "Bloom filter column not found: %s\n", token);
+            continue;
+        }
+        bloom_indices[num_bloom_columns++] = index;
+    }
+    if (status == 0 && enable_bloom_filters(writer, bloom_indices, num_bloom_columns) != 0) {
+        status = 1;
+    }
+
+    int row[BENCH_MAX_COLUMNS];
+    double start = now_ms();
+    long progress_step = spec->num_rows / 10 > 0 ? spec->num_rows / 10 : 1;
+    for (long r = 0; r < spec->num_rows && status == 0; r++) {
+        for (int c = 0; c < spec->num_columns; c++) {
+            row[c] = generate_value(spec, r, c);
+        }
+        if (write_row(writer, row) != 0) {
+            status = 1;
+        }
+        if ((r + 1) % progress_step == 0 && spec->num_rows >= 10000000) {
+            fprintf(stderr, "  %ld / %ld rows\n", r + 1, spec->num_rows);
+        }
+    }
+    if (status == 0 && finish_writer(writer, metadata) != 0) {
+        status = 1;
+    }
+    free_writer(writer);
+    cJSON_Delete(metadata);
+    if (fclose(file) != 0) {
+        status = 1;
+    }
+    if (status == 0) {
+        fprintf(stderr, "Generated %s: %ld rows, %d columns in %.0f ms\n", hty_file_path, spec->num_rows,
+                spec->num_columns, now_ms() - start);
+    }
+    return status;
+}
+
+/**
+ * @brief Write the first rows of a .hty file to a CSV file, the input of the converter benchmark
+ *
+ * @param metadata - metadata object
+ * @param hty_file_path - path to hty file
+ * @param csv_file_path - path to CSV file
+ * @param max_rows - rows to write
+ * @return long - rows written, -1 on failure
+ */
+static long write_csv_sample(cJSON* metadata, const char* hty_file_path, const char* csv_file_path, long max_rows) {
+    cJSON* columns = cJSON_GetObjectItemCaseSensitive(cJSON_GetArrayItem(cJSON_GetObjectItemCaseSensitive(metadata, "groups"), 0), "columns");
+    int num_columns = cJSON_GetArraySize(columns);
+    char* names[BENCH_MAX_COLUMNS];
+    int indices[BENCH_MAX_COLUMNS], types[BENCH_MAX_COLUMNS];
+    for (int i = 0; i < num_columns && i < BENCH_MAX_COLUMNS; i++) {
+        names[i] = cJSON_GetObjectItemCaseSensitive(cJSON_GetArrayItem(columns, i), "column_name")->valuestring;
+    }
+    FILE* file = fopen(csv_file_path, "w");
+    if (num_columns > BENCH_MAX_COLUMNS || file == NULL ||
+        resolve_columns(metadata, names, num_columns, indices, types) != 0) {
+        if (file != NULL) {
+            fclose(file);
+        }
+        return -1;
+    }
+    HtyColumnReader* reader = open_column_reader(metadata, hty_file_path, indices, num_columns, NULL);
+    long written = 0;
+    int status = reader != NULL ? write_delimited(file, names, types, num_columns, NULL, 0, ",", HTY_FLOAT_EXACT) : -1;
+    int** block;
+    int first_row, rows_in_block;
+    while (status == 0 && written < max_rows && next_column_block(reader, &block, &first_row, &rows_in_block) > 0) {
+        int rows = rows_in_block < max_rows - written ? rows_in_block : (int)(max_rows - written);
+        status = write_delimited(file, NULL, types, num_columns, block, rows, ",", HTY_FLOAT_EXACT);
+        written += rows;
+    }
+    close_column_reader(reader);
+    if (fclose(file) != 0) {
+        status = -1;
+    }
+    return status == 0 ? written : -1;
+}
+
+static long bench_extract_metadata(BenchArgs* args) {
+    cJSON* metadata = extract_metadata(args->hty_file_path);
+    cJSON_Delete(metadata);
+    return metadata != NULL ? 1 : -1;
+}
+
+static long bench_project_single_column(BenchArgs* args) {
+    int size = -1;
+    int* data = project_single_column(args->metadata, args->hty_file_path, args->column, &size);
+    free(data);
+    return size;
+}
+
+static long bench_filter(BenchArgs* args) {
+    int size = -1;
+    int* data = filter(args->metadata, args->hty_file_path, args->column, args->op, args->value, &size);
+    free(data);
+    return size;
+}
+
+static long bench_project(BenchArgs* args) {
+    int row_count = -1;
+    int** data = project(args->metadata, args->hty_file_path, args->columns, args->num_columns, &row_count);
+    for (int i = 0; data != NULL && i < args->num_columns; i++) {
+        free(data[i]);
+    }
+    free(data);
+    return row_count;
+}
+
+static long bench_project_and_filter(BenchArgs* args) {
+    int row_count = -1;
+    int** data = project_and_filter(args->metadata, args->hty_file_path, args->columns, args->num_columns,
+                                    args->column, args->op, args->value, &row_count);
+    for (int i = 0; data != NULL && i < args->num_columns; i++) {
+        free(data[i]);
+    }
+    free(data);
+    return row_count;
+}
+
+static long bench_add_row(BenchArgs* args) {
+    cJSON* metadata = cJSON_Duplicate(args->metadata, 1); // add_row updates the metadata it is given
+    add_row(metadata, args->hty_file_path, args->scratch_path, args->new_rows, BENCH_ADD_ROWS, args->num_columns);
+    cJSON_Delete(metadata);
+    return BENCH_ADD_ROWS;
+}
+
+static long bench_csv_to_hty(BenchArgs* args) {
+    return system(args->command) == 0 ? args->csv_rows : -1;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Run an operation once under hardware counters and add them to its benchmark
+ *
+ * Profiling is kept out of the timed runs so their numbers stay comparable
+ * with results recorded without -p.
+ *
+ * @param benchmark - JSON object of the benchmark to add the counters to
+ * @param function - operation
+ * @param args - its arguments
+ */
+static void profile_benchmark(cJSON* benchmark, BenchFunction function, BenchArgs* args) {
+    clear_buffer_pool();
+    clear_result_cache();
+    reset_query_stats();
+    enable_query_profile(1);
+    long result_rows = function(args);
+    enable_query_profile(0);
+    HtyQueryStats stats;
+    get_query_stats(&stats);
+    reset_query_stats();
+    long totals[HTY_NUM_COUNTERS];
+    get_counter_totals(&stats, totals);
+    // Operations that run no instrumented code (add_row, the converter in a child process) have nothing to report
+    if (result_rows < 0 || stats.counters_available == 0 || totals[HTY_COUNTER_CYCLES] <= 0) {
+        return;
+    }
+    double ipc = (double)totals[HTY_COUNTER_INSTRUCTIONS] / totals[HTY_COUNTER_CYCLES];
+    double misses_per_row = stats.rows_scanned > 0 ? (double)totals[HTY_COUNTER_LLC_MISSES] / stats.rows_scanned : 0;
+    double bytes_per_cycle = (double)stats.bytes_read / totals[HTY_COUNTER_CYCLES];
+    fprintf(stderr, "%-40s IPC %6.2f  %10.4f LLC misses/row  %8.4f bytes/cycle\n", "", ipc, misses_per_row,
+            bytes_per_cycle);
+
+    cJSON* counters = cJSON_AddObjectToObject(benchmark, "counters");
+    cJSON_AddNumberToObject(counters, "cycles", (double)totals[HTY_COUNTER_CYCLES]);
+    cJSON_AddNumberToObject(counters, "instructions", (double)totals[HTY_COUNTER_INSTRUCTIONS]);
+    cJSON_AddNumberToObject(counters, "ipc", ipc);
+    if (stats.counters_available & (1 << HTY_COUNTER_LLC_MISSES)) {
+        cJSON_AddNumberToObject(counters, "llc_misses", (double)totals[HTY_COUNTER_LLC_MISSES]);
+        cJSON_AddNumberToObject(counters, "llc_misses_per_row", misses_per_row);
+    }
+    if (stats.counters_available & (1 << HTY_COUNTER_BRANCH_MISSES)) {
+        cJSON_AddNumberToObject(counters, "branch_misses", (double)totals[HTY_COUNTER_BRANCH_MISSES]);
+    }
+    if (stats.counters_available & (1 << HTY_COUNTER_DTLB_MISSES)) {
+        cJSON_AddNumberToObject(counters, "dtlb_misses", (double)totals[HTY_COUNTER_DTLB_MISSES]);
+    }
+    cJSON_AddNumberToObject(counters, "bytes_per_cycle", bytes_per_cycle);
+}
+
+/**
+ * @brief Time an operation and add its result to the benchmark list
+ *
+ * The buffer pool and the result cache are cleared before every run, so each
+ * run scans the file (from the OS page cache once it is warm).
+ *
+ * @param benchmarks - JSON array to add the result to
+ * @param name - benchmark name, unique within a run
+ * @param function - operation
+ * @param args - its arguments
+ * @param repeats - number of runs
+ * @param rows_scanned - rows the operation reads, for the throughput
+ * @return int - 0 on success, -1 if the operation failed
+ */
+static int time_benchmark(cJSON* benchmarks, const char* name, BenchFunction function, BenchArgs* args, int repeats,
+                          long rows_scanned) {
+    double samples[256];
+    long result_rows = 0;
+    repeats = repeats < 256 ? repeats : 256;
+    for (int i = 0; i < repeats; i++) {
+        clear_buffer_pool();
+        clear_result_cache();
+        double start = now_ms();
+        result_rows = function(args);
+        samples[i] = now_ms() - start;
+        if (result_rows < 0) {
+            fprintf(stderr, "%-40s failed\n", name);
+            return -1;
+        }
+    }
+    qsort(samples, repeats, sizeof(double), compare_doubles);
+    double total = 0;
+    for (int i = 0; i < repeats; i++) {
+        total += samples[i];
+    }
+    double median = repeats % 2 == 1 ? samples[repeats / 2] : (samples[repeats / 2 - 1] + samples[repeats / 2]) / 2;
+    double rows_per_sec = median > 0 ? rows_scanned / (median / 1e3) : 0;
+    fprintf(stderr, "%-40s median %10.3f ms  min %10.3f ms  %12.0f rows/s  %ld result rows\n", name, median,
+            samples[0], rows_per_sec, result_rows);
+
+    cJSON* benchmark = cJSON_CreateObject();
+    cJSON_AddStringToObject(benchmark, "name", name);
+    cJSON_AddNumberToObject(benchmark, "median_ms", median);
+    cJSON_AddNumberToObject(benchmark, "min_ms", samples[0]);
+    cJSON_AddNumberToObject(benchmark, "max_ms", samples[repeats - 1]);
+    cJSON_AddNumberToObject(benchmark, "mean_ms", total / repeats);
+    cJSON_AddNumberToObject(benchmark, "rows_scanned", (double)rows_scanned);
+    cJSON_AddNumberToObject(benchmark, "result_rows", (double)result_rows);
+    cJSON_AddNumberToObject(benchmark, "rows_per_sec", rows_per_sec);
+    cJSON_AddItemToArray(benchmarks, benchmark);
+    if (profile_counters) {
+        profile_benchmark(benchmark, function, args);
+    }
+    return 0;
+}
+
+/**
+ * @brief Pick the filter value at a fraction of a column's min/max range
+ *
+ * For the uniform columns of generated files, "column < value" then selects
+ * about that fraction of the rows.
+ *
+ * @param column - column object from the metadata
+ * @param is_float - 1 if the column is float
+ * @param fraction - fraction of the range, 0 to 1
+ * @return int - value (float bits for float columns)
+ */
+static int value_at_fraction(cJSON* column, int is_float, double fraction) {
+    int min_value = 0, max_value = 0;
+    get_column_range(column, is_float, &min_value, &max_value);
+    if (is_float) {
+        float low, high;
+        memcpy(&low, &min_value, sizeof(float));
+        memcpy(&high, &max_value, sizeof(float));
+        float value = low + (float)((high - low) * fraction);
+        int bits;
+        memcpy(&bits, &value, sizeof(float));
+        return bits;
+    }
+    return (int)(min_value + ((double)max_value - min_value) * fraction);
+}
+
+/**
+ * @brief Run every benchmark on a file
+ *
+ * @param hty_file_path - file under test
+ * @param repeats - runs of each benchmark
+ * @param csv_rows - rows for the csv_to_hty benchmark, 0 to skip it
+ * @param converter - path to the csv_to_hty program
+ * @return cJSON* - results object, NULL on failure
+ */
+cJSON* run_benchmarks(const char* hty_file_path, int repeats, long csv_rows, const char* converter) {
+    cJSON* metadata = extract_metadata(hty_file_path);
+    if (metadata == NULL) {
+        return NULL;
+    }
+    cJSON* columns = cJSON_GetObjectItemCaseSensitive(cJSON_GetArrayItem(cJSON_GetObjectItemCaseSensitive(metadata, "groups"), 0), "columns");
+    int num_columns = cJSON_GetArraySize(columns);
+    long num_rows = (long)cJSON_GetObjectItemCaseSensitive(metadata, "num_rows")->valuedouble;
+    if (num_columns > BENCH_MAX_COLUMNS || num_columns == 0) {
+        fprintf(stderr, "Unsupported number of columns: %d\n", num_columns);
+        cJSON_Delete(metadata);
+        return NULL;
+    }
+    char* names[BENCH_MAX_COLUMNS];
+    int types[BENCH_MAX_COLUMNS];
+    int float_column = -1;
+    for (int i = 0; i < num_columns; i++) {
+        cJSON* column = cJSON_GetArrayItem(columns, i);
+        names[i] = cJSON_GetObjectItemCaseSensitive(column, "column_name")->valuestring;
+        types[i] = strcmp(cJSON_GetObjectItemCaseSensitive(column, "column_type")->valuestring, "float") == 0;
+        if (types[i] == 1 && float_column == -1) {
+            float_column = i;
+        }
+    }
+
+    cJSON* results = cJSON_CreateObject();
+    cJSON_AddStringToObject(results, "file", hty_file_path);
+    cJSON_AddNumberToObject(results, "num_rows", (double)num_rows);
+    cJSON_AddNumberToObject(results, "num_columns", num_columns);
+    cJSON_AddNumberToObject(results, "block_rows", get_block_rows(metadata));
+    cJSON_AddNumberToObject(results, "repeats", repeats);
+    cJSON* benchmarks = cJSON_AddArrayToObject(results, "benchmarks");
+    BenchArgs args = {hty_file_path, metadata, names, num_columns, names[0], 0, 0, NULL, NULL, NULL, 0};
+    char name[128];
+    int status = 0;
+
+    status |= time_benchmark(benchmarks, "extract_metadata", bench_extract_metadata, &args, repeats, 0);
+    for (int i = 0; i < num_columns; i++) {
+        if (i == 0 || i == float_column) {
+            args.column = names[i];
+            snprintf(name, sizeof(name), "project_single_column %s", names[i]);
+            status |= time_benchmark(benchmarks, name, bench_project_single_column, &args, repeats, num_rows);
+        }
+    }
+
+    // filter on the first column: every range operation at each selectivity, then = and !=
+    static const char* op_names[] = {"", ">", ">=", "<", "<=", "=", "!="};
+    cJSON* first_column = cJSON_GetArrayItem(columns, 0);
+    args.column = names[0];
+    for (int op = OP_GREATER; op <= OP_LESS_EQUAL; op++) {
+        for (int s = 0; s < NUM_SELECTIVITIES; s++) {
+            double fraction = op == OP_LESS || op == OP_LESS_EQUAL ? selectivities[s] : 1 - selectivities[s];
+            args.op = op;
+            args.value = value_at_fraction(first_column, types[0], fraction);
+            snprintf(name, sizeof(name), "filter %s %s sel=%g", names[0], op_names[op], selectivities[s]);
+            status |= time_benchmark(benchmarks, name, bench_filter, &args, repeats, num_rows);
+        }
+    }
+    for (int op = OP_EQUAL; op <= OP_NOT_EQUAL; op++) {
+        args.op = op;
+        args.value = value_at_fraction(first_column, types[0], 0.5);
+        snprintf(name, sizeof(name), "filter %s %s", names[0], op_names[op]);
+        status |= time_benchmark(benchmarks, name, bench_filter, &args, repeats, num_rows);
+    }
+    if (float_column >= 0) {
+        args.column = names[float_column];
+        args.op = OP_LESS;
+        for (int s = 0; s < NUM_SELECTIVITIES; s++) {
+            args.value = value_at_fraction(cJSON_GetArrayItem(columns, float_column), 1, selectivities[s]);
+            snprintf(name, sizeof(name), "filter %s < sel=%g", names[float_column], selectivities[s]);
+            status |= time_benchmark(benchmarks, name, bench_filter, &args, repeats, num_rows);
+        }
+    }
+
+    // project and project_and_filter over every column
+    status |= time_benchmark(benchmarks, "project all", bench_project, &args, repeats, num_rows);
+    args.column = names[0];
+    args.op = OP_LESS;
+    for (int s = 0; s < NUM_SELECTIVITIES; s++) {
+        args.value = value_at_fraction(first_column, types[0], selectivities[s]);
+        snprintf(name, sizeof(name), "project_and_filter all %s < sel=%g", names[0], selectivities[s]);
+        status |= time_benchmark(benchmarks, name, bench_project_and_filter, &args, repeats, num_rows);
+    }
+
+    // add_row copies the file with BENCH_ADD_ROWS more rows into a scratch file
+    char scratch_path[1024], csv_path[1024], command[4096];
+    snprintf(scratch_path, sizeof(scratch_path), "%s.bench.hty", hty_file_path);
+    int** new_rows = (int**)malloc(num_columns * sizeof(int*)); // add_row() takes one array per column
+    for (int col = 0; new_rows != NULL && col < num_columns; col++) {
+        new_rows[col] = (int*)calloc(BENCH_ADD_ROWS, sizeof(int));
+    }
+    args.new_rows = new_rows;
+    args.scratch_path = scratch_path;
+    status |= time_benchmark(benchmarks, "add_row 1000", bench_add_row, &args, repeats, BENCH_ADD_ROWS);
+    for (int col = 0; new_rows != NULL && col < num_columns; col++) {
+        free(new_rows[col]);
+    }
+    free(new_rows);
+
+    // csv_to_hty on a CSV made of the first rows of the file, answering its prompts on stdin
+    if (csv_rows > 0 && access(converter, X_OK) != 0) {
+        fprintf(stderr, "Skipping csv_to_hty: %s not found (build it with convert_csv_to_hty.sh)\n", converter);
+    } else if (csv_rows > 0) {
+        snprintf(csv_path, sizeof(csv_path), "%s.bench.csv", hty_file_path);
+        args.csv_rows = write_csv_sample(metadata, hty_file_path, csv_path, csv_rows);
+        snprintf(command, sizeof(command), "printf '%%s\\n%%s\\n\\n\\n' '%s' '%s' | '%s' > /dev/null", csv_path,
+                 scratch_path, converter);
+        args.command = command;
+        snprintf(name, sizeof(name), "csv_to_hty %ld", args.csv_rows);
+        status |= args.csv_rows < 0 ? -1 :
+                  time_benchmark(benchmarks, name, bench_csv_to_hty, &args, repeats, args.csv_rows);
+        remove(csv_path);
+    }
+    remove(scratch_path);
+
+    clear_buffer_pool();
+    clear_result_cache();
+    cJSON_Delete(metadata);
+    if (status != 0) {
+        cJSON_Delete(results);
+        return NULL;
+    }
+    return results;
+}
+
+/**
+ * @brief Read a JSON file
+ *
+ * @param path - path to the file
+ * @return cJSON* - parsed JSON, NULL on failure
+ */
+static cJSON* read_json_file(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Error opening file: %s\n", path);
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char* text = (char*)malloc(size + 1);
+    cJSON* json = NULL;
+    if (text != NULL && fread(text, 1, size, file) == (size_t)size) {
+        text[size] = '\0';
+        json = cJSON_Parse(text);
+    }
+    if (json == NULL) {
+        fprintf(stderr, "Error parsing JSON: %s\n", path);
+    }
+    free(text);
+    fclose(file);
+    return json;
+}
+
+/**
+ * @brief Compare results against a baseline and report the regressions
+ *
+ * A benchmark regresses when its median is more than threshold percent (and
+ * more than BENCH_NOISE_MS) above the baseline median.
+ *
+ * @param baseline_path - saved results
+ * @param current_path - new results
+ * @param threshold - slowdown in percent to report
+ * @return int - 0 if nothing regressed, 1 otherwise
+ */
+int compare_results(const char* baseline_path, const char* current_path, double threshold) {
+    cJSON* baseline = read_json_file(baseline_path);
+    cJSON* current = read_json_file(current_path);
+    if (baseline == NULL || current == NULL) {
+        cJSON_Delete(baseline);
+        cJSON_Delete(current);
+        return 1;
+    }
+    cJSON* baseline_benchmarks = cJSON_GetObjectItemCaseSensitive(baseline, "benchmarks");
+    int regressions = 0;
+    cJSON* benchmark;
+    printf("%-40s %12s %12s %9s\n", "benchmark", "baseline ms", "current ms", "change");
+    cJSON_ArrayForEach(benchmark, cJSON_GetObjectItemCaseSensitive(current, "benchmarks")) {
+        const char* name = cJSON_GetObjectItemCaseSensitive(benchmark, "name")->valuestring;
+        double current_ms = cJSON_GetObjectItemCaseSensitive(benchmark, "median_ms")->valuedouble;
+        cJSON* match = NULL;
+        cJSON* candidate;
+        cJSON_ArrayForEach(candidate, baseline_benchmarks) {
+            if (strcmp(cJSON_GetObjectItemCaseSensitive(candidate, "name")->valuestring, name) == 0) {
+                match = candidate;
+                break;
+            }
+        }
+        if (match == NULL) {
+            printf("%-40s %12s %12.3f %9s\n", name, "-", current_ms, "new");
+            continue;
+        }
+        double baseline_ms = cJSON_GetObjectItemCaseSensitive(match, "median_ms")->valuedouble;
+        double change = baseline_ms > 0 ? (current_ms - baseline_ms) / baseline_ms * 100 : 0;
+        int regressed = change > threshold && current_ms - baseline_ms > BENCH_NOISE_MS;
+        regressions += regressed;
+        printf("%-40s %12.3f %12.3f %+8.1f%%%s\n", name, baseline_ms, current_ms, change,
+               regressed ? "  REGRESSION" : "");
+    }
+    printf("%d regression%s (threshold %.1f%%)\n", regressions, regressions == 1 ? "" : "s", threshold);
+    cJSON_Delete(baseline);
+    cJSON_Delete(current);
+    return regressions > 0 ? 1 : 0;
+}
+
+/**
+ * @brief Print the usage of the benchmark program
+ *
+ * @param program - program name
+ */
+static void print_usage(const char* program) {
+    fprintf(stderr,
+            "Usage:\n"
+            "  %s generate data.hty [-r rows] [-t int,float,...] [-b block_rows] [-a alignment]\n"
+            "                       [-k cardinality] [-s sortedness] [-f bloom_columns] [-e seed]\n"
+            "  %s run data.hty [-n repeats] [-o results.json] [-c csv_rows] [-x csv_to_hty] [-p]\n"
+            "  %s compare baseline.json results.json [-t threshold_percent]\n",
+            program, program, program);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3 || (strcmp(argv[1], "generate") == 0 && argc % 2 == 0)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    if (strcmp(argv[1], "generate") == 0) {
+        // hty_bench generate data.hty -r 10M -t int,int,float -b 65536 -a 4096 -k 1000 -s 0.5 -f c1 -e 42
+        HtyGenSpec spec = {1000000, 3, {0, 0, 1}, HTY_DEFAULT_BLOCK_ROWS, HTY_DEFAULT_ALIGNMENT, 0, 0.0, 42};
+        char* bloom_columns = NULL;
+        for (int i = 3; i + 1 < argc; i += 2) {
+            const char* value = argv[i + 1];
+            if (strcmp(argv[i], "-r") == 0) {
+                spec.num_rows = parse_count(value);
+            } else if (strcmp(argv[i], "-t") == 0) {
+                spec.num_columns = 0;
+                char* types = strdup(value);
+                for (char* token = strtok(types, ","); token != NULL; token = strtok(NULL, ",")) {
+                    if (spec.num_columns == BENCH_MAX_COLUMNS || (strcmp(token, "int") != 0 && strcmp(token, "float") != 0)) {
+                        spec.num_columns = -1;
+                        break;
+                    }
+                    spec.column_types[spec.num_columns++] = strcmp(token, "float") == 0;
+                }
+                free(types);
+            } else if (strcmp(argv[i], "-b") == 0) {
+                spec.block_rows = (int)parse_count(value);
+            } else if (strcmp(argv[i], "-a") == 0) {
+                spec.alignment = atoi(value);
+            } else if (strcmp(argv[i], "-k") == 0) {
+                spec.cardinality = parse_count(value);
+            } else if (strcmp(argv[i], "-s") == 0) {
+                spec.sortedness = atof(value);
+            } else if (strcmp(argv[i], "-f") == 0) {
+                bloom_columns = argv[i + 1];
+            } else if (strcmp(argv[i], "-e") == 0) {
+                spec.seed = strtoull(value, NULL, 10);
+            } else {
+                spec.num_rows = -1; // Unknown option
+            }
+        }
+        if (spec.cardinality == 0) {
+            spec.cardinality = spec.num_rows > 0 ? spec.num_rows : 1;
+        }
+        if (spec.num_rows <= 0 || spec.num_rows > INT_MAX || spec.num_columns <= 0 || spec.block_rows <= 0 ||
+            spec.cardinality <= 0 || spec.cardinality > INT_MAX || spec.sortedness < 0 || spec.sortedness > 1) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        return generate_file(&spec, argv[2], bloom_columns);
+    }
+
+    if (strcmp(argv[1], "run") == 0) {
+        // hty_bench run data.hty -n 5 -o results.json -c 100000 -x ./csv_to_hty -p
+        int repeats = BENCH_DEFAULT_REPEATS;
+        long csv_rows = BENCH_DEFAULT_CSV_ROWS;
+        const char* output_path = NULL;
+        const char* converter = "./csv_to_hty";
+        for (int i = 3; i < argc; i += 2) {
+            if (strcmp(argv[i], "-p") == 0) {
+                profile_counters = 1;
+                i--; // No value
+            } else if (i + 1 == argc) {
+                repeats = 0; // Missing value
+            } else if (strcmp(argv[i], "-n") == 0) {
+                repeats = atoi(argv[i + 1]);
+            } else if (strcmp(argv[i], "-o") == 0) {
+                output_path = argv[i + 1];
+            } else if (strcmp(argv[i], "-c") == 0) {
+                csv_rows = parse_count(argv[i + 1]);
+            } else if (strcmp(argv[i], "-x") == 0) {
+                converter = argv[i + 1];
+            } else {
+                repeats = 0; // Unknown option
+            }
+        }
+        if (repeats <= 0 || csv_rows < 0) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        if (profile_counters && enable_query_profile(1) == 0) {
+            fprintf(stderr, "Hardware counters not available (check perf_event_paranoid, or no PMU in a virtual machine); "
+                            "running without them\n");
+            profile_counters = 0;
+        }
+        enable_query_profile(0);
+        cJSON* results = run_benchmarks(argv[2], repeats, csv_rows, converter);
+        if (results == NULL) {
+            return 1;
+        }
+        char* printed_results = cJSON_Print(results);
+        FILE* output = output_path != NULL ? fopen(output_path, "w") : stdout;
+        int status = output != NULL && fprintf(output, "%s\n", printed_results) > 0 ? 0 : 1;
+        if (output != NULL && output != stdout && fclose(output) != 0) {
+            status = 1;
+        }
+        if (status != 0) {
+            fprintf(stderr, "Error writing results: %s\n", output_path != NULL ? output_path : "stdout");
+        }
+        free(printed_results);
+        cJSON_Delete(results);
+        return status;
+    }
+
+    if (strcmp(argv[1], "compare") == 0 && argc >= 4) {
+        double threshold = BENCH_DEFAULT_THRESHOLD;
+        if (argc == 6 && strcmp(argv[4], "-t") == 0) {
+            threshold = atof(argv[5]);
+        } else if (argc != 4) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        return compare_results(argv[2], argv[3], threshold);
+    }
+
+    print_usage(argv[0]);
+    return 1;
+}
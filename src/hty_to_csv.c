@@ -0,0 +1,210 @@
+/**
+ * @file hty_to_csv.c
+ * @author Panupong Dangkajitpetch (King)
+ * @brief Hearty file format convert from HTY file to CSV file
+ * @version 0.1
+ * @date 2024-10-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../third_party/cJSON/cJSON.h" // Include cJSON library
+#include "heartyhty_functions.h" // Include heartyhty_functions.h
+#include "heartyhty_writer.h" // Include heartyhty_writer.h
+#include "heartyhty_pool.h" // Include column reader
+#include "heartyhty_batch.h" // Include query parser
+#include "heartyhty_output.h" // Include parallel CSV writer
+
+#define EXPORT_BATCH_ROWS (HTY_OUTPUT_MAX_THREADS * HTY_OUTPUT_CHUNK_ROWS) // Rows handed to the writer at a time
+
+/**
+ * @brief Convert HTY file to CSV file
+ *
+ * Row groups are read through the column reader, filtered, gathered into
+ * batches of about EXPORT_BATCH_ROWS rows and written by write_delimited(), which
+ * formats the chunks of a batch in parallel and writes them in order. Floats
+ * are written exactly, not as "%.1f".
+ *
+ * @param hty_file_path - path to data.hty
+ * @param csv_file_path - path to data.csv, "-" for stdout (.tsv for tab-separated values)
+ * @param column_list - comma-separated columns to export, NULL for all
+ * @param predicate - "column op value" filter, NULL for none
+ * @return int - 0 on success, 1 on failure
+ */
+int convert_from_hty_to_csv(const char* hty_file_path, const char* csv_file_path, const char* column_list,
+                            const char* predicate) {
+    cJSON* metadata = extract_metadata(hty_file_path);
+    if (metadata == NULL) {
+        fprintf(stderr, "Error extracting metadata.\n");
+        return 1;
+    }
+    cJSON* group = cJSON_GetArrayItem(cJSON_GetObjectItemCaseSensitive(metadata, "groups"), 0);  // Assuming single group
+    cJSON* columns = cJSON_GetObjectItemCaseSensitive(group, "columns");
+    int total_columns = cJSON_GetArraySize(columns);
+
+    // Parse the columns and the filter like a query line: "col1,col2 WHERE column op value"
+    size_t query_length = 16 + (predicate != NULL ? strlen(predicate) : 0) + (column_list != NULL ? strlen(column_list) : 0);
+    for (int i = 0; column_list == NULL && i < total_columns; i++) {
+        query_length += strlen(cJSON_GetObjectItemCaseSensitive(cJSON_GetArrayItem(columns, i), "column_name")->valuestring) + 1;
+    }
+    char* query_text = (char*)calloc(query_length, 1);
+    for (int i = 0; column_list == NULL && i < total_columns; i++) {
+        strcat(query_text, i > 0 ? "," : "");
+        strcat(query_text, cJSON_GetObjectItemCaseSensitive(cJSON_GetArrayItem(columns, i), "column_name")->valuestring);
+    }
+    if (column_list != NULL) {
+        strcat(query_text, column_list);
+    }
+    if (predicate != NULL) {
+        strcat(query_text, " WHERE ");
+        strcat(query_text, predicate);
+    }
+    HtyBatchQuery query;
+    int status = parse_batch_query(metadata, query_text, &query);
+    free(query_text);
+    if (status != 0) {
+        cJSON_Delete(metadata);
+        return 1;
+    }
+
+    // Read each exported column once, plus the filter column
+    int num_columns = query.num_columns;
+    int* column_indices = (int*)malloc((num_columns + 1) * sizeof(int));
+    int* column_types = (int*)malloc((num_columns + 1) * sizeof(int));
+    int* read_columns = (int*)malloc((num_columns + 1) * sizeof(int));
+    int* positions = (int*)malloc((num_columns + 1) * sizeof(int));
+    int** batch = (int**)calloc(num_columns + 1, sizeof(int*));
+    int block_rows = get_block_rows(metadata);
+    int batch_capacity = block_rows > EXPORT_BATCH_ROWS ? block_rows : EXPORT_BATCH_ROWS;
+    int* selection = (int*)malloc((block_rows + 1) * sizeof(int));
+    resolve_columns(metadata, query.columns, num_columns, column_indices, column_types);
+    int num_read = 0, filter_position = -1, filter_index = 0, filter_type = 0;
+    for (int i = 0; i < num_columns; i++) {
+        positions[i] = num_read;
+        for (int j = 0; j < num_read; j++) {
+            if (read_columns[j] == column_indices[i]) {
+                positions[i] = j;
+            }
+        }
+        if (positions[i] == num_read) {
+            read_columns[num_read++] = column_indices[i];
+        }
+        batch[i] = (int*)malloc(batch_capacity * sizeof(int));
+        if (batch[i] == NULL) {
+            status = 1;
+        }
+    }
+    int* row_groups = NULL;
+    if (query.has_filter) {
+        char* filter_name = (char*)query.filter.column;
+        resolve_columns(metadata, &filter_name, 1, &filter_index, &filter_type);
+        for (int j = 0; j < num_read; j++) {
+            if (read_columns[j] == filter_index) {
+                filter_position = j;
+            }
+        }
+        if (filter_position == -1) {
+            read_columns = (int*)realloc(read_columns, (num_read + 1) * sizeof(int));
+            filter_position = num_read;
+            read_columns[num_read++] = filter_index;
+        }
+        row_groups = row_groups_to_read(metadata, hty_file_path, query.filter.column, filter_index, filter_type,
+                                        query.filter.op, &query.filter.value, 1);
+    }
+
+    FILE* output = strcmp(csv_file_path, "-") == 0 ? stdout : fopen(csv_file_path, "w");
+    const char* extension = strrchr(csv_file_path, '.');
+    const char* separator = extension != NULL && strcmp(extension, ".tsv") == 0 ? "\t" : ",";
+    if (output == NULL) {
+        fprintf(stderr, "Error opening output file: %s\n", csv_file_path);
+        status = 1;
+    }
+    HtyColumnReader* reader = status == 0 ? open_column_reader(metadata, hty_file_path, read_columns, num_read, row_groups) : NULL;
+    if (status == 0 && reader == NULL) {
+        status = 1;
+    }
+    if (status == 0 && write_delimited(output, query.columns, column_types, num_columns, NULL, 0, separator,
+                                       HTY_FLOAT_EXACT) != 0) {
+        status = 1;
+    }
+
+    // Filter each row group into the batch; write the batch whenever it cannot take another row group
+    int** block;
+    int first_row, rows_in_block, got, batch_rows = 0;
+    long exported_rows = 0;
+    while (status == 0 && (got = next_column_block(reader, &block, &first_row, &rows_in_block)) != 0) {
+        if (got < 0) {
+            status = 1;
+            break;
+        }
+        int selected = 0;
+        for (int i = 0; i < rows_in_block; i++) {
+            selection[selected] = i;
+            selected += !query.has_filter ||
+                        compare_values(block[filter_position][i], query.filter.value, query.filter.op, filter_type);
+        }
+        if (batch_rows + selected > batch_capacity) {
+            status = write_delimited(output, NULL, column_types, num_columns, batch, batch_rows, separator, HTY_FLOAT_EXACT) == 0 ? 0 : 1;
+            exported_rows += batch_rows;
+            batch_rows = 0;
+        }
+        for (int c = 0; c < num_columns; c++) {
+            const int* values = block[positions[c]];
+            int* out = batch[c] + batch_rows;
+            for (int i = 0; i < selected; i++) {
+                out[i] = values[selection[i]];
+            }
+        }
+        batch_rows += selected;
+    }
+    if (status == 0 && batch_rows > 0) {
+        status = write_delimited(output, NULL, column_types, num_columns, batch, batch_rows, separator, HTY_FLOAT_EXACT) == 0 ? 0 : 1;
+        exported_rows += batch_rows;
+    }
+    close_column_reader(reader);
+    if (output != NULL && output != stdout && fclose(output) != 0) {
+        status = 1;
+    }
+    if (status == 0) {
+        fprintf(stderr, "Exported %ld rows to %s\n", exported_rows, csv_file_path);
+    }
+
+    for (int i = 0; i < num_columns; i++) {
+        free(batch[i]);
+    }
+    free(batch);
+    free(selection);
+    free(row_groups);
+    free(positions);
+    free(read_columns);
+    free(column_types);
+    free(column_indices);
+    free_batch_query(&query);
+    cJSON_Delete(metadata);
+    clear_buffer_pool();
+    return status;
+}
+
+int main(int argc, char* argv[]) {
+    const char* column_list = NULL; // columns to export
+    const char* predicate = NULL; // filter
+
+    // hty_to_csv data.hty data.csv [-c col1,col2] [-w "column op value"]
+    for (int i = 3; i + 1 < argc && argc >= 3; i += 2) {
+        if (strcmp(argv[i], "-c") == 0) {
+            column_list = argv[i + 1];
+        } else if (strcmp(argv[i], "-w") == 0) {
+            predicate = argv[i + 1];
+        } else {
+            argc = 0; // Unknown option
+        }
+    }
+    if (argc < 3 || argc % 2 == 0) {
+        fprintf(stderr, "Usage: %s data.hty data.csv|data.tsv|- [-c col1,col2] [-w \"column op value\"]\n", argv[0]);
+        return 1;
+    }
+    return convert_from_hty_to_csv(argv[1], argv[2], column_list, predicate); // Export HTY to CSV
+}